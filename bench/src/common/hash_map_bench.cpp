@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common/clock.h"
+#include "common/defines.h"
+#include "common/memory/memutils.h"
+#include "common/collections/hash_map.h"
+#include "uthash/uthash.h"
+
+/*
+ * Compares Hash_Map with uthash, the way the server used it: u32 keys with a small value,
+ * one heap node per uthash entry. Keys are shuffled so neither table sees them in order.
+ * Every operation is timed over all entries and reported per entry.
+ */
+
+#define NUM_ROUNDS 5 // the fastest round is reported
+
+LOCAL u32 entry_counts[] = { 1000, 10000, 100000 };
+
+typedef struct {
+    u32 key;
+    u32 value;
+    UT_hash_handle hh;
+} Ut_Entry;
+
+typedef struct {
+    f64 insert;
+    f64 find;
+    f64 iterate;
+    f64 erase;
+} Timings;
+
+// Prevents the compiler from dropping the lookups.
+LOCAL volatile u64 sink;
+
+LOCAL u32 *make_keys(u32 count)
+{
+    u32 *keys = (u32 *) mem_alloc(count * sizeof(u32), MEMORY_TAG_ARRAY);
+    for (u32 i = 0; i < count; i++) {
+        keys[i] = i * 2654435761u; // distinct, since the multiplier is odd
+    }
+
+    srand(42);
+    for (u32 i = count - 1; i > 0; i--) {
+        u32 j = (u32) rand() % (i + 1);
+        u32 tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    return keys;
+}
+
+INLINE f64 per_entry(u64 start, u32 count)
+{
+    return (f64) (clock_get_absolute_time_ns() - start) / count;
+}
+
+LOCAL Timings bench_hash_map(const u32 *keys, u32 count)
+{
+    Timings t = {};
+    Hash_Map map;
+    hash_map_create(&map, sizeof(u32), sizeof(u32));
+
+    u64 start = clock_get_absolute_time_ns();
+    for (u32 i = 0; i < count; i++) {
+        hash_map_insert(&map, &keys[i], &i);
+    }
+    t.insert = per_entry(start, count);
+
+    u64 sum = 0;
+    start = clock_get_absolute_time_ns();
+    for (u32 i = 0; i < count; i++) {
+        sum += *(u32 *) hash_map_find(&map, &keys[count - 1 - i]);
+    }
+    t.find = per_entry(start, count);
+
+    start = clock_get_absolute_time_ns();
+    u64 it = 0;
+    void *value;
+    while (hash_map_next(&map, &it, NULL, &value)) {
+        sum += *(u32 *) value;
+    }
+    t.iterate = per_entry(start, count);
+
+    start = clock_get_absolute_time_ns();
+    for (u32 i = 0; i < count; i++) {
+        hash_map_remove(&map, &keys[i], NULL);
+    }
+    t.erase = per_entry(start, count);
+
+    sink = sum;
+    hash_map_destroy(&map);
+    return t;
+}
+
+LOCAL Timings bench_uthash(const u32 *keys, u32 count)
+{
+    Timings t = {};
+    Ut_Entry *map = NULL;
+
+    u64 start = clock_get_absolute_time_ns();
+    for (u32 i = 0; i < count; i++) {
+        Ut_Entry *entry = (Ut_Entry *) mem_alloc(sizeof(Ut_Entry), MEMORY_TAG_GAME);
+        entry->key = keys[i];
+        entry->value = i;
+        HASH_ADD_INT(map, key, entry);
+    }
+    t.insert = per_entry(start, count);
+
+    u64 sum = 0;
+    start = clock_get_absolute_time_ns();
+    for (u32 i = 0; i < count; i++) {
+        Ut_Entry *entry;
+        HASH_FIND_INT(map, &keys[count - 1 - i], entry);
+        sum += entry->value;
+    }
+    t.find = per_entry(start, count);
+
+    start = clock_get_absolute_time_ns();
+    for (Ut_Entry *entry = map; entry != NULL; entry = (Ut_Entry *) entry->hh.next) {
+        sum += entry->value;
+    }
+    t.iterate = per_entry(start, count);
+
+    start = clock_get_absolute_time_ns();
+    for (u32 i = 0; i < count; i++) {
+        Ut_Entry *entry;
+        HASH_FIND_INT(map, &keys[i], entry);
+        HASH_DEL(map, entry);
+        mem_free(entry, sizeof(Ut_Entry), MEMORY_TAG_GAME);
+    }
+    t.erase = per_entry(start, count);
+
+    sink = sum;
+    return t;
+}
+
+LOCAL void keep_fastest(Timings *best, Timings t)
+{
+    if (t.insert < best->insert) best->insert = t.insert;
+    if (t.find < best->find) best->find = t.find;
+    if (t.iterate < best->iterate) best->iterate = t.iterate;
+    if (t.erase < best->erase) best->erase = t.erase;
+}
+
+int main(void)
+{
+    Memory_Stats mem_stats = {};
+    mem_init(&mem_stats);
+
+    printf("u32 -> u32 map, ns per entry (fastest of %d rounds)\n", NUM_ROUNDS);
+    printf("  %-8s %-8s %-12s %-12s %s\n", "entries", "op", "uthash", "hash_map", "speedup");
+
+    for (u32 c = 0; c < ARRAY_LEN(entry_counts); c++) {
+        u32 count = entry_counts[c];
+        u32 *keys = make_keys(count);
+
+        Timings ut = { 1e30, 1e30, 1e30, 1e30 };
+        Timings hm = ut;
+        for (u32 round = 0; round < NUM_ROUNDS; round++) {
+            keep_fastest(&ut, bench_uthash(keys, count));
+            keep_fastest(&hm, bench_hash_map(keys, count));
+        }
+
+        const char *ops[] = { "insert", "find", "iterate", "erase" };
+        f64 ut_ns[] = { ut.insert, ut.find, ut.iterate, ut.erase };
+        f64 hm_ns[] = { hm.insert, hm.find, hm.iterate, hm.erase };
+        for (u32 i = 0; i < ARRAY_LEN(ops); i++) {
+            printf("  %-8u %-8s %-12.1f %-12.1f %.2fx\n", count, ops[i], ut_ns[i], hm_ns[i], ut_ns[i] / hm_ns[i]);
+        }
+
+        mem_free(keys, count * sizeof(u32), MEMORY_TAG_ARRAY);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/clock.h"
+#include "common/defines.h"
+#include "common/job.h"
+#include "common/memory/memutils.h"
+
+/*
+ * How the job system scales with the number of workers. Every round submits one job from
+ * the main thread, which splits its range in halves and submits them until a range holds
+ * a single leaf, so nearly all jobs are submitted by workers to their own deques and the
+ * other workers only get work by stealing. Tiny leaves measure the scheduling overhead,
+ * medium leaves (about 10 us of arithmetic) how well real work spreads across the cores.
+ * The main thread only waits for the leaf counter to reach the total.
+ *
+ * Usage: job_bench [max workers], defaults to the number of online cores.
+ */
+
+#define NUM_ROUNDS 3 // the fastest round is reported
+#define TINY_LEAVES 200000
+#define MEDIUM_LEAVES 20000
+#define MEDIUM_LEAF_NS 10000
+
+typedef struct {
+    u32 begin;
+    u32 end;
+    u32 leaf_iterations;
+    u32 *completed;
+} Split_Params;
+
+// Prevents the compiler from dropping the leaf work.
+LOCAL volatile u64 sink;
+
+LOCAL u64 leaf_work(u32 seed, u32 iterations)
+{
+    u64 x = seed + 1;
+    for (u32 i = 0; i < iterations; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    return x;
+}
+
+LOCAL bool split_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Split_Params *params = (Split_Params *) param_data;
+
+    while (params->end - params->begin > 1) {
+        u32 middle = params->begin + (params->end - params->begin) / 2;
+        Split_Params upper = *params;
+        upper.begin = middle;
+        job_system_submit(split_job, &upper, sizeof(upper), NULL, 0);
+        params->end = middle;
+    }
+
+    u64 x = leaf_work(params->begin, params->leaf_iterations);
+    if (x == 0) {
+        sink = x;
+    }
+    __atomic_add_fetch(params->completed, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+LOCAL u32 calibrate_medium_leaf(void)
+{
+    u32 iterations = 1000;
+    for (;;) {
+        u64 start = clock_get_absolute_time_ns();
+        sink = leaf_work(0, iterations);
+        u64 elapsed = clock_get_absolute_time_ns() - start;
+        if (elapsed >= MEDIUM_LEAF_NS / 2) {
+            return (u32) ((u64) iterations * MEDIUM_LEAF_NS / elapsed);
+        }
+        iterations *= 2;
+    }
+}
+
+LOCAL f64 run_round(u32 leaves, u32 leaf_iterations)
+{
+    u32 completed = 0;
+    Split_Params params = { .begin = 0, .end = leaves, .leaf_iterations = leaf_iterations, .completed = &completed };
+
+    u64 start = clock_get_absolute_time_ns();
+    job_system_submit(split_job, &params, sizeof(params), NULL, 0);
+
+    struct timespec pause = { .tv_sec = 0, .tv_nsec = 20000 };
+    while (__atomic_load_n(&completed, __ATOMIC_ACQUIRE) != leaves) {
+        nanosleep(&pause, NULL);
+    }
+
+    return (f64) (clock_get_absolute_time_ns() - start) / 1e9;
+}
+
+LOCAL f64 bench_workers(u8 workers, u32 leaves, u32 leaf_iterations)
+{
+    Job_System job_system = {};
+    job_system_init(&job_system, workers);
+
+    f64 best = 1e9;
+    for (u32 round = 0; round < NUM_ROUNDS; round++) {
+        f64 seconds = run_round(leaves, leaf_iterations);
+        if (seconds < best) {
+            best = seconds;
+        }
+    }
+
+    job_system_shutdown();
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    Memory_Stats mem_stats;
+    mem_init(&mem_stats);
+
+    i64 max_workers = argc > 1 ? atol(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_workers < 1) {
+        max_workers = 1;
+    } else if (max_workers > JOB_SYSTEM_MAX_NUM_WORKERS) {
+        max_workers = JOB_SYSTEM_MAX_NUM_WORKERS;
+    }
+
+    u32 medium_iterations = calibrate_medium_leaf();
+    printf("%ld online cores, medium leaf is %u iterations\n", sysconf(_SC_NPROCESSORS_ONLN), medium_iterations);
+    printf("%7s  %-6s %10s %12s %8s\n", "workers", "leaf", "time (ms)", "jobs/s", "speedup");
+
+    struct {
+        const char *name;
+        u32 leaves;
+        u32 iterations;
+    } kinds[] = {
+        { "tiny", TINY_LEAVES, 1 },
+        { "medium", MEDIUM_LEAVES, medium_iterations },
+    };
+
+    for (u32 k = 0; k < ARRAY_LEN(kinds); k++) {
+        f64 baseline = 0.0;
+        for (u32 workers = 1; workers <= (u32) max_workers; workers++) {
+            f64 seconds = bench_workers((u8) workers, kinds[k].leaves, kinds[k].iterations);
+            if (workers == 1) {
+                baseline = seconds;
+            }
+
+            // Every split submits one job, so the jobs run are one per leaf.
+            printf("%7u  %-6s %10.2f %12.0f %7.2fx\n", workers, kinds[k].name, seconds * 1000.0,
+                   kinds[k].leaves / seconds, baseline / seconds);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+
+#include "common/clock.h"
+#include "common/defines.h"
+#include "common/job.h"
+#include "common/memory/memutils.h"
+
+/*
+ * What submitting and running one job costs, by the size of its params. The job system has
+ * no workers, so the main thread runs every job itself in job_system_wait and the numbers
+ * are the bookkeeping of one job without any contention or wakeups: building it, copying
+ * the params, queueing, dequeueing, running and freeing. Params up to JOB_INLINE_DATA_SIZE
+ * live in the job, larger ones up to 4 KiB come from the pools, anything above that from
+ * the heap. For comparison, the two mem_alloc and mem_free pairs every job used to make.
+ */
+
+#define NUM_ROUNDS 5 // the fastest round is reported
+#define JOBS_PER_BATCH 512 // stays well below the inject queue capacity
+#define NUM_BATCHES 400
+
+LOCAL u32 param_sizes[] = { 16, 64, 256, 2048, 8192 };
+
+// Prevents the compiler from dropping the work.
+LOCAL volatile u64 sink;
+
+LOCAL bool touch_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    sink = *(u8 *) param_data;
+    return true;
+}
+
+LOCAL f64 bench_submit(u32 param_size)
+{
+    u8 params[8192] = {};
+    f64 best = 1e9;
+
+    for (u32 round = 0; round < NUM_ROUNDS; round++) {
+        u64 start = clock_get_absolute_time_ns();
+        for (u32 batch = 0; batch < NUM_BATCHES; batch++) {
+            Job_Counter counter = {};
+            for (u32 i = 0; i < JOBS_PER_BATCH; i++) {
+                job_system_submit_counted(touch_job, params, param_size, &counter);
+            }
+            job_system_wait(&counter);
+        }
+
+        f64 per_job = (f64) (clock_get_absolute_time_ns() - start) / (NUM_BATCHES * JOBS_PER_BATCH);
+        if (per_job < best) {
+            best = per_job;
+        }
+    }
+
+    return best;
+}
+
+LOCAL f64 bench_heap_pairs(u32 param_size)
+{
+    f64 best = 1e9;
+
+    for (u32 round = 0; round < NUM_ROUNDS; round++) {
+        u64 start = clock_get_absolute_time_ns();
+        for (u32 i = 0; i < NUM_BATCHES * JOBS_PER_BATCH; i++) {
+            void *param_data = mem_alloc(param_size, MEMORY_TAG_JOB);
+            void *result_data = mem_alloc(sizeof(u32), MEMORY_TAG_JOB);
+            sink = *(u8 *) param_data;
+            mem_free(result_data, sizeof(u32), MEMORY_TAG_JOB);
+            mem_free(param_data, param_size, MEMORY_TAG_JOB);
+        }
+
+        f64 per_job = (f64) (clock_get_absolute_time_ns() - start) / (NUM_BATCHES * JOBS_PER_BATCH);
+        if (per_job < best) {
+            best = per_job;
+        }
+    }
+
+    return best;
+}
+
+int main(void)
+{
+    Memory_Stats mem_stats = {};
+    mem_init(&mem_stats);
+
+    Job_System job_system = {};
+    job_system_init(&job_system, 0);
+
+    printf("%u jobs per size, ns per job\n", NUM_BATCHES * JOBS_PER_BATCH);
+    printf("%8s  %-8s %10s %16s\n", "params", "storage", "job", "2x alloc+free");
+
+    for (u32 i = 0; i < ARRAY_LEN(param_sizes); i++) {
+        u32 size = param_sizes[i];
+        const char *storage = size <= JOB_INLINE_DATA_SIZE ? "inline" : size <= (JOB_POOL_MIN_BLOCK_SIZE << (JOB_POOL_SIZE_CLASS_COUNT - 1)) ? "pool" : "heap";
+        f64 job = bench_submit(size);
+        f64 heap = bench_heap_pairs(size);
+        printf("%8u  %-8s %10.1f %16.1f\n", size, storage, job, heap);
+    }
+
+    job_system_shutdown();
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common/defines.h"
+#include "common/datagram.h"
+#include "common/memory/memutils.h"
+#include "common/collections/darray.h"
+
+/*
+ * Stand-in for a lossy, slow link, comparing how old the newest position held by a receiver
+ * is when the sender publishes 60 updates per second over TCP or over the datagram channel.
+ * Nothing goes over a socket, the link is simulated: every transmission takes the one-way
+ * delay plus jitter and is lost with the given probability.
+ *
+ * TCP delivers in order, so a lost segment holds back everything behind it until the
+ * retransmission arrives. The loss is repaired by fast retransmit once three later segments
+ * caused duplicate acknowledgements, and a lost retransmission waits for the retransmission
+ * timeout, doubled every time. Congestion control is left out, which only flatters TCP.
+ * Datagrams go through the same Datagram_Window as on the client, so one that is overtaken
+ * by a newer one is dropped instead of moving the position back.
+ *
+ * The age of the receiver's newest position is sampled every millisecond.
+ */
+
+#define UPDATE_RATE 60
+#define DURATION_S 120
+#define WARMUP_MS 1000.0
+#define ONE_WAY_DELAY_MS 40.0
+#define JITTER_MS 20.0 // more than an update interval, so datagrams are sometimes reordered
+#define MIN_RTO_MS 200.0
+#define DUP_ACK_THRESHOLD 3
+#define SAMPLE_PERIOD_MS 1.0
+
+LOCAL f64 loss_rates[] = { 0.0, 0.005, 0.01, 0.02, 0.05 };
+
+typedef struct {
+    f64 time; // when the receiver gets it, in ms
+    u32 sequence;
+} Arrival;
+
+typedef struct {
+    f64 p50;
+    f64 p99;
+    f64 max;
+} Age_Stats;
+
+LOCAL u64 rng_state;
+
+LOCAL f64 random_unit(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (f64) ((rng_state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+LOCAL f64 link_delay(void)
+{
+    return ONE_WAY_DELAY_MS + random_unit() * JITTER_MS;
+}
+
+LOCAL bool link_drops(f64 loss)
+{
+    return random_unit() < loss;
+}
+
+INLINE f64 send_time(u32 sequence)
+{
+    return sequence * 1000.0 / UPDATE_RATE;
+}
+
+LOCAL u32 simulate_tcp(f64 loss, u32 count, Arrival *arrivals)
+{
+    f64 interval = 1000.0 / UPDATE_RATE;
+    f64 rtt = 2.0 * ONE_WAY_DELAY_MS;
+    f64 delivered = 0.0;
+
+    for (u32 i = 0; i < count; i++) {
+        f64 arrival = send_time(i) + link_delay();
+
+        if (link_drops(loss)) {
+            // The duplicate acknowledgements of the later segments reach the sender a round trip after they were sent.
+            f64 retransmit = send_time(i) + DUP_ACK_THRESHOLD * interval + rtt;
+            f64 timeout = rtt + MIN_RTO_MS;
+            while (link_drops(loss)) {
+                retransmit += timeout;
+                timeout *= 2.0;
+            }
+            arrival = retransmit + link_delay();
+        }
+
+        // Nothing is handed to the application before everything in front of it.
+        if (arrival < delivered) {
+            arrival = delivered;
+        }
+        delivered = arrival;
+
+        arrivals[i].time = arrival;
+        arrivals[i].sequence = i;
+    }
+
+    return count;
+}
+
+LOCAL int compare_arrival(const void *a, const void *b)
+{
+    f64 lhs = ((const Arrival *) a)->time;
+    f64 rhs = ((const Arrival *) b)->time;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+LOCAL u32 simulate_udp(f64 loss, u32 count, Arrival *arrivals)
+{
+    u32 arrived = 0;
+    for (u32 i = 0; i < count; i++) {
+        if (link_drops(loss)) {
+            continue;
+        }
+
+        arrivals[arrived].time = send_time(i) + link_delay();
+        arrivals[arrived].sequence = i;
+        arrived++;
+    }
+
+    qsort(arrivals, arrived, sizeof(Arrival), compare_arrival);
+    return arrived;
+}
+
+LOCAL int compare_f64(const void *a, const void *b)
+{
+    f64 lhs = *(const f64 *) a;
+    f64 rhs = *(const f64 *) b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+// 'window' is NULL for TCP, which never delivers anything out of order.
+LOCAL Age_Stats measure_ages(const Arrival *arrivals, u32 arrived, u32 count, Datagram_Window *window, f64 **ages)
+{
+    darray_clear(*ages);
+    f64 *samples = *ages;
+
+    u32 next = 0;
+    f64 newest = 0.0; // send time of the newest update applied
+    for (f64 t = WARMUP_MS; t < send_time(count); t += SAMPLE_PERIOD_MS) {
+        while (next < arrived && arrivals[next].time <= t) {
+            if (window == NULL || datagram_window_accept(window, arrivals[next].sequence)) {
+                newest = send_time(arrivals[next].sequence);
+            }
+            next++;
+        }
+
+        darray_push(samples, t - newest);
+    }
+
+    u64 length = darray_length(samples);
+    qsort(samples, length, sizeof(f64), compare_f64);
+    *ages = samples;
+
+    Age_Stats stats;
+    stats.p50 = samples[length / 2];
+    stats.p99 = samples[length * 99 / 100];
+    stats.max = samples[length - 1];
+    return stats;
+}
+
+int main(void)
+{
+    Memory_Stats mem_stats;
+    mem_init(&mem_stats);
+
+    u32 count = UPDATE_RATE * DURATION_S;
+    Arrival *arrivals = (Arrival *) mem_alloc(count * sizeof(Arrival), MEMORY_TAG_ARRAY);
+    f64 *ages = (f64 *) darray_create(sizeof(f64));
+
+    printf("%u updates per second for %u s, one-way delay %.0f ms + up to %.0f ms jitter, position age in ms\n",
+           UPDATE_RATE, DURATION_S, ONE_WAY_DELAY_MS, JITTER_MS);
+    printf("%6s  %-8s %8s %8s %8s  %s\n", "loss", "channel", "p50", "p99", "max", "stale drops");
+
+    for (u32 i = 0; i < ARRAY_LEN(loss_rates); i++) {
+        f64 loss = loss_rates[i];
+
+        rng_state = 0x9E3779B97F4A7C15ULL + i;
+        u32 arrived = simulate_tcp(loss, count, arrivals);
+        Age_Stats tcp = measure_ages(arrivals, arrived, count, NULL, &ages);
+
+        rng_state = 0x9E3779B97F4A7C15ULL + i;
+        Datagram_Window window = {};
+        arrived = simulate_udp(loss, count, arrivals);
+        Age_Stats udp = measure_ages(arrivals, arrived, count, &window, &ages);
+
+        printf("%5.1f%%  %-8s %8.1f %8.1f %8.1f\n", loss * 100.0, "tcp", tcp.p50, tcp.p99, tcp.max);
+        printf("%5.1f%%  %-8s %8.1f %8.1f %8.1f  %llu\n", loss * 100.0, "udp", udp.p50, udp.p99, udp.max, window.stale_drops);
+    }
+
+    darray_destroy(ages);
+    mem_free(arrivals, count * sizeof(Arrival), MEMORY_TAG_ARRAY);
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include "common/clock.h"
+#include "common/defines.h"
+#include "common/memory/memutils.h"
+#include "server/reactor.h"
+
+/*
+ * Measures the cost of a single wakeup for one active connection while N other
+ * connections stay idle. Idle connections are eventfds that are never signaled,
+ * so that 10k of them fit within the default descriptor limit.
+ */
+
+#define NUM_WAKEUPS 20000
+
+LOCAL u32 connection_counts[] = { 100, 1000, 10000 };
+
+LOCAL void raise_fd_limit(void)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+LOCAL void on_idle_event(i32 fd, u32 events, void *user_data)
+{
+    UNUSED(fd); UNUSED(events); UNUSED(user_data);
+}
+
+LOCAL void on_active_event(i32 fd, u32 events, void *user_data)
+{
+    UNUSED(events); UNUSED(user_data);
+
+    u8 byte;
+    while (read(fd, &byte, sizeof(byte)) > 0);
+}
+
+LOCAL f64 bench_poll(i32 *idle_fds, u32 idle_count, i32 active[2])
+{
+    u32 count = idle_count + 1;
+    struct pollfd *pfds = (struct pollfd *) mem_alloc(count * sizeof(struct pollfd), MEMORY_TAG_NETWORK);
+    for (u32 i = 0; i < idle_count; i++) {
+        pfds[i].fd = idle_fds[i];
+        pfds[i].events = POLLIN;
+    }
+    pfds[idle_count].fd = active[0];
+    pfds[idle_count].events = POLLIN;
+
+    u8 byte = 1;
+    u64 start = clock_get_absolute_time_ns();
+    for (u32 n = 0; n < NUM_WAKEUPS; n++) {
+        if (write(active[1], &byte, sizeof(byte)) != sizeof(byte)) {
+            abort();
+        }
+
+        poll(pfds, count, -1);
+
+        // The same scan the old server loop did to find the ready descriptors.
+        for (u32 i = 0; i < count; i++) {
+            if (pfds[i].revents & POLLIN) {
+                on_active_event(pfds[i].fd, 0, NULL);
+            }
+        }
+    }
+    u64 elapsed = clock_get_absolute_time_ns() - start;
+
+    mem_free(pfds, count * sizeof(struct pollfd), MEMORY_TAG_NETWORK);
+    return (f64) elapsed / NUM_WAKEUPS;
+}
+
+LOCAL f64 bench_reactor(i32 *idle_fds, u32 idle_count, i32 active[2])
+{
+    Reactor reactor;
+    reactor_init(&reactor, REACTOR_DEFAULT_MAX_EVENTS);
+
+    for (u32 i = 0; i < idle_count; i++) {
+        reactor_add(&reactor, idle_fds[i], REACTOR_EVENT_READ, on_idle_event, NULL);
+    }
+    reactor_add(&reactor, active[0], REACTOR_EVENT_READ, on_active_event, NULL);
+
+    u8 byte = 1;
+    u64 start = clock_get_absolute_time_ns();
+    for (u32 n = 0; n < NUM_WAKEUPS; n++) {
+        if (write(active[1], &byte, sizeof(byte)) != sizeof(byte)) {
+            abort();
+        }
+
+        reactor_wait(&reactor, REACTOR_INFINITE_TIMEOUT);
+    }
+    u64 elapsed = clock_get_absolute_time_ns() - start;
+
+    reactor_shutdown(&reactor);
+    return (f64) elapsed / NUM_WAKEUPS;
+}
+
+int main(void)
+{
+    Memory_Stats mem_stats = {};
+    mem_init(&mem_stats);
+    raise_fd_limit();
+
+    printf("idle connection overhead per wakeup (%d wakeups of one active connection)\n", NUM_WAKEUPS);
+    printf("  %-12s %-16s %-16s %s\n", "connections", "poll (ns)", "reactor (ns)", "speedup");
+
+    for (u32 c = 0; c < ARRAY_LEN(connection_counts); c++) {
+        u32 idle_count = connection_counts[c] - 1;
+
+        i32 *idle_fds = (i32 *) mem_alloc(idle_count * sizeof(i32), MEMORY_TAG_NETWORK);
+        for (u32 i = 0; i < idle_count; i++) {
+            idle_fds[i] = eventfd(0, EFD_NONBLOCK);
+            if (idle_fds[i] == -1) {
+                fprintf(stderr, "eventfd error: %s (raise the open file limit)\n", strerror(errno));
+                return EXIT_FAILURE;
+            }
+        }
+
+        i32 active[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, active) == -1) {
+            fprintf(stderr, "socketpair error: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        f64 poll_ns = bench_poll(idle_fds, idle_count, active);
+        f64 reactor_ns = bench_reactor(idle_fds, idle_count, active);
+
+        printf("  %-12u %-16.1f %-16.1f %.2fx\n", connection_counts[c], poll_ns, reactor_ns, poll_ns / reactor_ns);
+
+        for (u32 i = 0; i < idle_count; i++) {
+            close(idle_fds[i]);
+        }
+        close(active[0]);
+        close(active[1]);
+        mem_free(idle_fds, idle_count * sizeof(i32), MEMORY_TAG_NETWORK);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -36,6 +36,9 @@ typedef struct {
     f32 camera_yaw;
     f32 camera_speed_factor;
     i32 client_socket;
+    i32 udp_socket;   // connected to the server, -1 when unavailable
+    u64 udp_token;    // from the join response, 0 until then or when the server has no datagram channel, atomic
+    u32 udp_sequence; // of the last datagram sent, atomic
     f32 client_update_freq;
     f32 client_update_period;
     Renderer2D *renderer2d;
@@ -1,6 +1,7 @@
 #include "game.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -12,14 +13,19 @@
 #include "client/global.h"
 #include "common/log.h"
 #include "common/packet.h"
+#include "common/datagram.h"
 #include "common/clock.h"
 #include "common/asserts.h"
+#include "common/collections/darray.h"
 
 #define CUBE_MAP_NUM_FACES 6
+#define MOVE_DATAGRAM_REPEATS 3
 
 #define SHADOW_WIDTH 2048
 #define SHADOW_HEIGHT 2048
 
+#define VOXEL_DATA_GRAIN 256 // instances per job, a few microseconds of matrix math
+
 const i32 num_instances = 100 * 100;
 
 void process_input(Game *game, f32 dt)
@@ -58,17 +64,28 @@ void process_input(Game *game, f32 dt)
 
     PERSIST f32 acc_updt = 0.0f;
     acc_updt += dt;
-    if (acc_updt >= game->global_data->client_update_period && game->player_moved) {
-        game->player_moved = false;
+    if (acc_updt >= game->global_data->client_update_period && (game->player_moved || game->move_repeats > 0)) {
         acc_updt = 0.0f;
 
         Packet_Player_Move packet = {};
         packet.id = game->self->id;
         memcpy(packet.position, glm::value_ptr(game->self->position), 3 * sizeof(f32));
 
-        if (!packet_send(game->global_data->client_socket, PACKET_TYPE_PLAYER_MOVE, &packet)) {
+        u64 udp_token = __atomic_load_n(&game->global_data->udp_token, __ATOMIC_ACQUIRE);
+        if (udp_token != 0) {
+            // Lost datagrams are not resent, so the final position is repeated a few times after
+            // the player stops, or losing the last move would leave the player behind on the server.
+            game->move_repeats = game->player_moved ? MOVE_DATAGRAM_REPEATS : (u8) (game->move_repeats - 1);
+
+            u32 sequence = __atomic_add_fetch(&game->global_data->udp_sequence, 1, __ATOMIC_RELAXED);
+            if (!datagram_send(game->global_data->udp_socket, udp_token, sequence, PACKET_TYPE_PLAYER_MOVE, &packet)) {
+                LOG_ERROR("failed to send player move datagram\n");
+            }
+        } else if (!packet_send(game->global_data->client_socket, PACKET_TYPE_PLAYER_MOVE, &packet)) {
             LOG_ERROR("failed to send player move packet\n");
         }
+
+        game->player_moved = false;
     }
 }
 
@@ -77,6 +94,20 @@ void process_input(Game *game, f32 dt)
 // in order to retrieve functions by name using dlsym
 extern "C" {
 
+// Lays the instances out on a 100 by 100 grid around the origin.
+LOCAL void fill_voxel_data(u64 begin, u64 end, void *context)
+{
+    Voxel_Data *voxel_data = (Voxel_Data *) context;
+    for (u64 i = begin; i < end; i++) {
+        i32 x = (i32) (i % 100) - 50;
+        i32 z = (i32) (i / 100) - 50;
+        voxel_data[i] = {
+            .model = glm::translate(glm::mat4(1.0f), glm::vec3(1.2f * (f32) x, -1.0f, 1.2f * (f32) z)),
+            .color = glm::vec3(0.6f, 0.6f, 0.2f)
+        };
+    }
+}
+
 void game_post_reload(Game *game)
 {
     net_init(game->global_data->ns);
@@ -189,18 +220,9 @@ void game_init(Game *game)
     game->voxel_data = (Voxel_Data *) mem_alloc(num_instances * sizeof(Voxel_Data), MEMORY_TAG_GAME);
     ASSERT_MSG(game->voxel_data != NULL, "failed to allocate memory for voxel models");
 
-    u32 count = 0;
-    for (i32 z = -50; z < 50; z++) {
-        for (i32 x = -50; x < 50; x++) {
-            Voxel_Data data = {
-                .model = glm::translate(glm::mat4(1.0f), glm::vec3(1.2f * (f32) x, -1.0f, 1.2f * (f32) z)),
-                .color = glm::vec3(0.6f, 0.6f, 0.2f)
-            };
+    job_parallel_for(0, num_instances, VOXEL_DATA_GRAIN, fill_voxel_data, game->voxel_data);
 
-            game->voxel_data[count] = data;
-            count++;
-        }
-    }
+    game->frame_players = (Player *) darray_create(sizeof(Player));
 
     glGenBuffers(1, &game->inst_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, game->inst_vbo);
@@ -256,6 +278,16 @@ void game_update(Game *game, f32 dt)
 {
     process_input(game, dt);
 
+    // The network thread adds and removes players while the frame is drawn, so draw a copy.
+    pthread_mutex_lock(&game->players_lock);
+    darray_clear(game->frame_players);
+    u64 it = 0;
+    void *value;
+    while (hash_map_next(&game->players, &it, NULL, &value)) {
+        darray_push(game->frame_players, *(Player *) value);
+    }
+    pthread_mutex_unlock(&game->players_lock);
+
     glm::mat4 projection = glm::perspective(glm::radians(game->global_data->camera_fov), (f32) game->global_data->current_window_width / (f32) game->global_data->current_window_height, 0.1f, 100.0f);
     glm::mat4 view = glm::lookAt(game->global_data->camera_position, game->global_data->camera_position + game->global_data->camera_direction, game->global_data->camera_up);
 
@@ -293,7 +325,8 @@ void game_update(Game *game, f32 dt)
     shader_set_uniform_float(&game->shadow_shader, "u_far_plane", light_far_plane);
     shader_set_uniform_mat4_array(&game->shadow_shader, "u_shadow_transforms", (const glm::mat4 *) &light_space_transforms, CUBE_MAP_NUM_FACES);
 
-    for (Player *player = game->players; player != NULL; player = (Player *) player->hh.next) {
+    for (u64 i = 0; i < darray_length(game->frame_players); i++) {
+        Player *player = &game->frame_players[i];
         glm::mat4 model = glm::translate(glm::mat4(1.0f), player->position);
         shader_set_uniform_mat4(&game->shadow_shader, "u_model", &model);
         glDrawArrays(GL_TRIANGLES, 0, 36);
@@ -356,7 +389,8 @@ void game_update(Game *game, f32 dt)
     glBindTexture(GL_TEXTURE_CUBE_MAP, game->omni_depth_map_texture_id);
 
     // Render players
-    for (Player *player = game->players; player != NULL; player = (Player *) player->hh.next) {
+    for (u64 i = 0; i < darray_length(game->frame_players); i++) {
+        Player *player = &game->frame_players[i];
         glm::mat4 model = glm::translate(glm::mat4(1.0f), player->position);
         shader_set_uniform_mat4(&game->lighting_shader, "u_model", &model);
         shader_set_uniform_vec3(&game->lighting_shader, "u_material.ambient", &player->color);
@@ -403,6 +437,7 @@ void game_shutdown(Game *game)
     glDeleteBuffers(1, &game->inst_vbo);
     glDeleteTextures(1, &game->omni_depth_map_texture_id);
     mem_free(game->voxel_data, num_instances * sizeof(Voxel_Data), MEMORY_TAG_GAME);
+    darray_destroy(game->frame_players);
     skybox_destroy(game->skybox);
     mem_free(game->skybox, sizeof(Skybox), MEMORY_TAG_GAME);
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <pthread.h>
+
 #include <glm/glm.hpp>
 
 #include "client/global.h"
@@ -8,6 +10,7 @@
 #include "common/defines.h"
 #include "common/player_types.h"
 #include "common/entity_types.h"
+#include "common/collections/hash_map.h"
 
 struct GLFWwindow;
 
@@ -19,6 +22,7 @@ typedef struct {
 typedef struct {
     Global_Data *global_data;
     bool player_moved;
+    u8 move_repeats; // datagram moves left to send after the player stopped
     u32 vao, vbo, inst_vbo;
     u32 omni_depth_map_fbo, omni_depth_map_texture_id;
     Voxel_Data *voxel_data;
@@ -27,7 +31,9 @@ typedef struct {
     Shader voxel_shader;
     Shader shadow_shader;
     Light light;
-    Player *players; // uthash
+    Hash_Map players; // player_id -> Player, written by the network thread, guarded by 'players_lock'
+    pthread_mutex_t players_lock;
+    Player *frame_players; // darray, copy of 'players' taken every frame so the lock is not held while rendering
     Player *self;
     Skybox *skybox;
 } Game;
@@ -33,15 +33,18 @@
 #include "common/defines.h"
 #include "common/hexdump.h"
 #include "common/packet.h"
+#include "common/packet_framer.h"
+#include "common/datagram.h"
 #include "common/clock.h"
 #include "common/size_unit.h"
 #include "common/memory/memutils.h"
 #include "common/collections/darray.h"
 
-#define POLLFD_COUNT 1
-#define INPUT_BUFFER_SIZE 1024
-#define INPUT_OVERFLOW_BUFFER_SIZE 1024
+#define POLLFD_COUNT 2
 #define POLL_INFINITE_TIMEOUT -1
+#define CLIENT_UDP_KEEPALIVE_PERIOD_MS 1000 // also retries binding the channel if the first datagram was lost
+#define CLIENT_MAX_PACKET_PAYLOAD_SIZE MiB(1)
+#define CLIENT_JOB_CALLBACK_BUDGET_NS 2000000 // per frame, callbacks left over run next frame
 
 Net_Stat net_stat;
 Memory_Stats mem_stats;
@@ -56,7 +59,11 @@ bool client_show_mem_info = true;
 LOCAL Game game = {};
 LOCAL Renderer2D *renderer2d = NULL;
 LOCAL i32 client_socket;
+LOCAL i32 udp_socket = -1;
+LOCAL Datagram_Window server_datagrams; // network thread only
+LOCAL u64 udp_keepalive_time = 0;
 LOCAL struct pollfd pfds[POLLFD_COUNT];
+LOCAL Packet_Framer server_framer;
 LOCAL bool running = false;
 LOCAL pthread_t network_thread;
 
@@ -114,6 +121,22 @@ void ping_server(void)
     }
 }
 
+// Binds the datagram channel on the server, which then replies to wherever this came from.
+LOCAL void send_udp_keepalive(void)
+{
+    u64 udp_token = __atomic_load_n(&global_data.udp_token, __ATOMIC_ACQUIRE);
+    if (udp_socket == -1 || udp_token == 0) {
+        return;
+    }
+
+    Packet_Ping ping = { .time = clock_get_absolute_time_ns() };
+    u32 sequence = __atomic_add_fetch(&global_data.udp_sequence, 1, __ATOMIC_RELAXED);
+    if (!datagram_send(udp_socket, udp_token, sequence, PACKET_TYPE_PING, &ping)) {
+        LOG_WARN("failed to send udp keepalive: %s\n", strerror(errno));
+    }
+    udp_keepalive_time = ping.time;
+}
+
 LOCAL void send_text_message_to_server(const char *message)
 {
     ASSERT(client_socket > 2);
@@ -134,8 +157,30 @@ LOCAL void signal_handler(i32 sig)
     running = false;
 }
 
+LOCAL void apply_light_update(const Packet_Light_Update *packet)
+{
+    game.light.id = packet->id;
+    game.light.radius = packet->radius;
+    game.light.angular_velocity = packet->angular_velocity;
+    game.light.initial_position = glm::vec3(packet->initial_position[0], packet->initial_position[1], packet->initial_position[2]);
+    game.light.ambient = glm::vec3(packet->ambient[0], packet->ambient[1], packet->ambient[2]);
+    game.light.diffuse = glm::vec3(packet->diffuse[0], packet->diffuse[1], packet->diffuse[2]);
+    game.light.specular = glm::vec3(packet->specular[0], packet->specular[1], packet->specular[2]);
+    LOG_DEBUG("light updated:\n");
+    LOG_DEBUG("  id: %u\n", game.light.id);
+    LOG_DEBUG("  radius: %f\n", game.light.radius);
+    LOG_DEBUG("  angular velocity: %f\n", game.light.angular_velocity);
+    LOG_DEBUG("  initial position: (%f,%f,%f)\n", game.light.initial_position.x, game.light.initial_position.y, game.light.initial_position.z);
+    LOG_DEBUG("  ambient color: (%f,%f,%f)\n", game.light.ambient.x, game.light.ambient.y, game.light.ambient.z);
+    LOG_DEBUG("  diffuse color: (%f,%f,%f)\n", game.light.diffuse.x, game.light.diffuse.y, game.light.diffuse.z);
+    LOG_DEBUG("  specular color: (%f,%f,%f)\n", game.light.specular.x, game.light.specular.y, game.light.specular.z);
+}
+
 LOCAL void process_network_packet(u32 type, void *data)
 {
+    // game_update copies the players under the same lock, a growing map frees its old buckets.
+    pthread_mutex_lock(&game.players_lock);
+
     switch (type) {
         case PACKET_TYPE_NONE: {
             LOG_WARN("ignoring received packet of type PACKET_TYPE_NONE\n");
@@ -160,43 +205,41 @@ LOCAL void process_network_packet(u32 type, void *data)
             memcpy(glm::value_ptr(game.self->color), packet->color, 3 * sizeof(f32));
             memcpy(glm::value_ptr(game.self->position), packet->position, 3 * sizeof(f32));
             LOG_DEBUG("approved by the server with id=%u color=(%f,%f,%f)\n", packet->id, packet->color[0], packet->color[1], packet->color[2]);
+
+            if (udp_socket != -1) {
+                __atomic_store_n(&global_data.udp_token, packet->udp_token, __ATOMIC_RELEASE);
+                send_udp_keepalive();
+            }
         } break;
         case PACKET_TYPE_PLAYER_ADD: {
             Packet_Player_Add *packet = (Packet_Player_Add *) data;
 
-            Player *player;
-            HASH_FIND_INT(game.players, &packet->id, player);
-            if (player != NULL) {
+            if (hash_map_contains(&game.players, &packet->id)) {
                 LOG_ERROR("player with id=%u already exists\n", packet->id);
                 break;
             }
 
-            player = (Player *) mem_alloc(sizeof(*player), MEMORY_TAG_GAME);
-            memset(player, 0, sizeof(*player));
+            Player added = {};
             // TODO: move player init to a function
-            player->id = packet->id;
-            memcpy(player->username, packet->username, packet->username_length);
-            player->color = glm::vec3(packet->color[0], packet->color[1], packet->color[2]);
-            player->position = glm::vec3(packet->position[0], packet->position[1], packet->position[2]);
-            HASH_ADD_INT(game.players, id, player);
+            added.id = packet->id;
+            memcpy(added.username, packet->username, packet->username_length);
+            added.color = glm::vec3(packet->color[0], packet->color[1], packet->color[2]);
+            added.position = glm::vec3(packet->position[0], packet->position[1], packet->position[2]);
+            Player *player = (Player *) hash_map_insert(&game.players, &added.id, &added);
             LOG_DEBUG("added player: username='%s' id=%u position=(%f,%f,%f)\n", player->username, player->id, player->position.x, player->position.y, player->position.z);
         } break;
         case PACKET_TYPE_PLAYER_REMOVE: {
             Packet_Player_Remove *packet = (Packet_Player_Remove *) data;
-            Player *player;
-            HASH_FIND_INT(game.players, &packet->id, player);
-            if (player == NULL) {
+            Player player;
+            if (!hash_map_remove(&game.players, &packet->id, &player)) { // NOTE: maybe we want to keep the data for further use
                 LOG_ERROR("failed to find player with id=%u to remove\n", packet->id);
                 break;
             }
-            LOG_DEBUG("removed player: username='%s' id=%u\n", player->username, player->id);
-            HASH_DEL(game.players, player);
-            mem_free(player, sizeof(Player), MEMORY_TAG_GAME); // NOTE: maybe we want to keep the data for further use
+            LOG_DEBUG("removed player: username='%s' id=%u\n", player.username, player.id);
         } break;
         case PACKET_TYPE_PLAYER_MOVE: {
             Packet_Player_Move *packet = (Packet_Player_Move *) data;
-            Player *player = NULL;
-            HASH_FIND_INT(game.players, &packet->id, player);
+            Player *player = (Player *) hash_map_find(&game.players, &packet->id);
             if (player == NULL) {
                 LOG_ERROR("failed to find player with id=%u to move\n", packet->id);
                 break;
@@ -209,46 +252,58 @@ LOCAL void process_network_packet(u32 type, void *data)
             deserialize_packet_player_batch_move(data, &packet);
 
             for (u32 i = 0; i < packet.count; i++) {
-                Player *player = NULL;
-                HASH_FIND_INT(game.players, &packet.ids[i], player);
+                Player *player = (Player *) hash_map_find(&game.players, &packet.ids[i]);
                 if (player == NULL) {
+                    // Either self, or a player that just went out of view and whose move was already in flight.
                     if (packet.ids[i] != game.self->id) {
-                        LOG_ERROR("failed to find player with id=%u to move\n", packet.ids[i]);
+                        LOG_TRACE("skipping move of unknown player with id=%u\n", packet.ids[i]);
                     }
-                    break;
+                    continue;
                 }
 
                 memcpy(glm::value_ptr(player->position), &packet.positions[i * 3], 3 * sizeof(f32));
             }
         } break;
         case PACKET_TYPE_LIGHT_UPDATE: {
-            Packet_Light_Update *packet = (Packet_Light_Update *) data;
-            game.light.id = packet->id;
-            game.light.radius = packet->radius;
-            game.light.angular_velocity = packet->angular_velocity;
-            game.light.initial_position = glm::vec3(packet->initial_position[0], packet->initial_position[1], packet->initial_position[2]);
-            game.light.ambient = glm::vec3(packet->ambient[0], packet->ambient[1], packet->ambient[2]);
-            game.light.diffuse = glm::vec3(packet->diffuse[0], packet->diffuse[1], packet->diffuse[2]);
-            game.light.specular = glm::vec3(packet->specular[0], packet->specular[1], packet->specular[2]);
-            LOG_DEBUG("light updated:\n");
-            LOG_DEBUG("  id: %u\n", game.light.id);
-            LOG_DEBUG("  radius: %f\n", game.light.radius);
-            LOG_DEBUG("  angular velocity: %f\n", game.light.angular_velocity);
-            LOG_DEBUG("  initial position: (%f,%f,%f)\n", game.light.initial_position.x, game.light.initial_position.y, game.light.initial_position.z);
-            LOG_DEBUG("  ambient color: (%f,%f,%f)\n", game.light.ambient.x, game.light.ambient.y, game.light.ambient.z);
-            LOG_DEBUG("  diffuse color: (%f,%f,%f)\n", game.light.diffuse.x, game.light.diffuse.y, game.light.diffuse.z);
-            LOG_DEBUG("  specular color: (%f,%f,%f)\n", game.light.specular.x, game.light.specular.y, game.light.specular.z);
+            apply_light_update((Packet_Light_Update *) data);
+        } break;
+        case PACKET_TYPE_WORLD_SNAPSHOT: {
+            Packet_World_Snapshot packet;
+            deserialize_packet_world_snapshot(data, &packet);
+
+            // Make room for all of them up front, so the inserts below never rehash.
+            hash_map_resize(&game.players, hash_map_length(&game.players) + packet.player_count);
+
+            u32 username_offset = 0;
+            for (u32 i = 0; i < packet.player_count; i++) {
+                Player player = {};
+                memcpy(&player.id, &packet.ids[i], sizeof(player_id));
+                memcpy(player.username, packet.usernames + username_offset, packet.username_lengths[i]);
+                memcpy(glm::value_ptr(player.color), &packet.colors[i * 3], 3 * sizeof(f32));
+                memcpy(glm::value_ptr(player.position), &packet.positions[i * 3], 3 * sizeof(f32));
+                username_offset += packet.username_lengths[i];
+
+                hash_map_insert(&game.players, &player.id, &player);
+            }
+
+            for (u32 i = 0; i < packet.light_count; i++) {
+                apply_light_update(&packet.lights[i]);
+            }
+
+            LOG_DEBUG("world snapshot: added %u players and %u lights\n", packet.player_count, packet.light_count);
         } break;
         default: {
             LOG_ERROR("unknown packet type value `%u`\n", type);
         }
     }
+
+    pthread_mutex_unlock(&game.players_lock);
 }
 
 LOCAL void handle_incoming_server_data(void)
 {
-    u8 recv_buffer[INPUT_BUFFER_SIZE + INPUT_OVERFLOW_BUFFER_SIZE] = {0};
-    i64 bytes_read = net_recv(client_socket, recv_buffer, INPUT_BUFFER_SIZE, 0);
+    // One large read per wakeup; whatever does not form a complete packet yet stays in the framer.
+    i64 bytes_read = packet_framer_recv(&server_framer, client_socket);
     if (bytes_read <= 0) {
         if (bytes_read == 0) {
             LOG_INFO("orderly shutdown: disconnected from server\n");
@@ -259,66 +314,48 @@ LOCAL void handle_incoming_server_data(void)
         return;
     }
 
-#if 0
-    LOG_DEBUG("read %lld bytes of data:\n", bytes_read);
-    hexdump(stdout, recv_buffer, bytes_read, HEXDUMP_FLAG_CANONICAL);
-#endif
-
-    PERSIST const u32 header_size = PACKET_TYPE_SIZE[PACKET_TYPE_HEADER];
+    Packet_Header header;
+    u8 *payload;
+    Packet_Framer_Status status;
+    while ((status = packet_framer_next(&server_framer, &header, &payload)) == PACKET_FRAMER_STATUS_READY) {
+        process_network_packet(header.type, payload);
+    }
 
-    ASSERT_MSG(bytes_read >= header_size, "unhandled: read fewer bytes than header size");
+    if (status == PACKET_FRAMER_STATUS_ERROR) {
+        LOG_ERROR("received malformed packet from server\n");
+        running = false;
+    }
+}
 
-    i64 remaining_bytes_to_parse = bytes_read;
-    u8 *bufptr = recv_buffer;
+LOCAL void handle_incoming_server_datagrams(void)
+{
+    PERSIST u8 data[DATAGRAM_MAX_SIZE];
 
-    // Iterate over all the packets included in single TCP data reception.
-    // Optionally, read more data to complete the payload.
     for (;;) {
-        Packet_Header *header = (Packet_Header *) bufptr;
-
-        if (header->type >= NUM_OF_PACKET_TYPES) {
-            LOG_ERROR("received unknown header type `%u`\n", header->type);
-            break;
+        i64 bytes_read = net_recv(udp_socket, data, sizeof(data), 0);
+        if (bytes_read == -1) {
+            // ECONNREFUSED only means that a datagram of ours bounced, the next keepalive tries again.
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+                LOG_ERROR("udp recv error: %s\n", strerror(errno));
+            }
+            return;
         }
 
-        // Verify whether all the payload data is present in the receive buffer.
-        // If it’s not, read the remaining bytes from the socket that are needed to complete the payload.
-        if (remaining_bytes_to_parse - header_size < header->payload_size) {
-            i64 missing_bytes = header->payload_size - (remaining_bytes_to_parse - header_size);
-
-            LOG_DEBUG("reading %lu more bytes to complete payload\n", missing_bytes);
-
-            ASSERT_MSG(missing_bytes <= INPUT_OVERFLOW_BUFFER_SIZE, "not enough space in overflow buffer");
-
-            // Read into INPUT_OVERFLOW_BUFFER of the recv_buffer and proceed to packet interpretation.
-            i64 new_bytes_read = net_recv(client_socket, &recv_buffer[INPUT_BUFFER_SIZE], missing_bytes, 0);
-            UNUSED(new_bytes_read);
-            ASSERT(new_bytes_read == missing_bytes);
+        Datagram_Header header;
+        Packet_Header packet_header;
+        u8 *payload;
+        if (!datagram_parse(data, (u64) bytes_read, &header, &packet_header, &payload) ||
+            header.token != __atomic_load_n(&global_data.udp_token, __ATOMIC_ACQUIRE)) {
+            LOG_TRACE("ignoring invalid datagram of %lld bytes\n", bytes_read);
+            continue;
         }
 
-        process_network_packet(header->type, bufptr + header_size);
-
-        // Check if there are more bytes to parse.
-        u64 parsed_packet_size = header_size + header->payload_size;
-        bufptr = (bufptr + parsed_packet_size);
-        remaining_bytes_to_parse -= parsed_packet_size;
-        if (remaining_bytes_to_parse > 0) {
-            LOG_DEBUG("remaining_bytes_to_parse = %lu\n", remaining_bytes_to_parse);
-            if (remaining_bytes_to_parse >= header_size) {
-                // Enough unparsed bytes to read the header.
-                Packet_Header *next_header = (Packet_Header *) bufptr;
-                if (next_header->type <= PACKET_TYPE_NONE || next_header->type >= NUM_OF_PACKET_TYPES) {
-                    break;
-                }
-                LOG_DEBUG("next header is valid\n");
-            } else {
-                // Not enough remaining unparsed bytes to read a complete header.
-                ASSERT_MSG(0, "unhandled: fewer bytes than header size");
-            }
-        } else {
-            // No more bytes to parse.
-            break;
+        // Moves that arrive after newer ones would only move players back.
+        if (!datagram_window_accept(&server_datagrams, header.sequence)) {
+            continue;
         }
+
+        process_network_packet(packet_header.type, payload);
     }
 }
 
@@ -327,7 +364,8 @@ LOCAL void *handle_networking(void *args)
     UNUSED(args);
 
     while (running) {
-        i32 num_events = poll(pfds, POLLFD_COUNT, POLL_INFINITE_TIMEOUT);
+        i32 timeout = udp_socket != -1 ? CLIENT_UDP_KEEPALIVE_PERIOD_MS : POLL_INFINITE_TIMEOUT;
+        i32 num_events = poll(pfds, POLLFD_COUNT, timeout);
 
         if (num_events == -1) {
             if (errno == EINTR) {
@@ -342,9 +380,19 @@ LOCAL void *handle_networking(void *args)
             if (pfds[i].revents & POLLIN) {
                 if (pfds[i].fd == client_socket) {
                     handle_incoming_server_data();
+                } else if (pfds[i].fd == udp_socket) {
+                    handle_incoming_server_datagrams();
                 }
             }
         }
+
+        if (clock_get_absolute_time_ns() - udp_keepalive_time >= CLIENT_UDP_KEEPALIVE_PERIOD_MS * 1000000ULL) {
+            send_udp_keepalive();
+        }
+    }
+
+    if (udp_socket != -1) {
+        close(udp_socket);
     }
 
     if (close(client_socket) == -1) {
@@ -353,6 +401,8 @@ LOCAL void *handle_networking(void *args)
         LOG_INFO("closed client socket\n");
     }
 
+    packet_framer_destroy(&server_framer);
+
     return NULL;
 }
 
@@ -427,12 +477,28 @@ LOCAL bool connect_to_server(const char *ip_addr, const char *port)
         break;
     }
 
-    freeaddrinfo(result);
-
     if (rp == NULL) {
+        freeaddrinfo(result);
         return false;
     }
 
+    // The datagram channel goes to the same address and port. Without it everything uses TCP.
+    udp_socket = socket(rp->ai_family, SOCK_DGRAM, 0);
+    if (udp_socket == -1 || connect(udp_socket, rp->ai_addr, rp->ai_addrlen) == -1 || !net_set_nonblocking(udp_socket)) {
+        LOG_WARN("failed to set up the udp socket, using tcp only: %s\n", strerror(errno));
+        if (udp_socket != -1) {
+            close(udp_socket);
+            udp_socket = -1;
+        }
+    }
+
+    freeaddrinfo(result);
+
+    // Every packet is a single send, so waiting for more data to coalesce only delays moves.
+    if (!net_set_nodelay(client_socket)) {
+        LOG_WARN("failed to disable nagle's algorithm on socket=%d: %s\n", client_socket, strerror(errno));
+    }
+
     if (!handle_client_validation(client_socket)) {
         LOG_FATAL("failed client validation\n");
         close(client_socket);
@@ -443,6 +509,10 @@ LOCAL bool connect_to_server(const char *ip_addr, const char *port)
 
     pfds[0].fd = client_socket;
     pfds[0].events = POLLIN;
+    pfds[1].fd = udp_socket; // ignored by poll when -1
+    pfds[1].events = POLLIN;
+
+    packet_framer_create(&server_framer, PACKET_FRAMER_DEFAULT_CAPACITY, CLIENT_MAX_PACKET_PAYLOAD_SIZE);
 
     struct sigaction sa;
     sa.sa_flags = SA_RESTART;
@@ -512,7 +582,9 @@ LOCAL bool client_on_key_pressed_event(Event_Code code, Event_Data data)
         }
     } else if (key == KEYCODE_J) {
         i32 param = -420;
-        job_system_submit(fake_job_entry_point, &param, sizeof(i32), fake_job_callback, sizeof(i32));
+        if (!job_system_submit(fake_job_entry_point, &param, sizeof(i32), fake_job_callback, sizeof(i32))) {
+            LOG_WARN("too many job results pending, fake job not submitted\n");
+        }
     }
 
     return false;
@@ -839,6 +911,9 @@ int main(int argc, char **argv)
 
     running = true;
 
+    // Before the network thread starts, which takes it for every packet.
+    pthread_mutex_init(&game.players_lock, NULL);
+
     if (connect_to_server(server_ip_address, server_port)) {
         LOG_INFO("successfully connected to server at %s:%s\n", server_ip_address, server_port);
     } else {
@@ -884,6 +959,7 @@ int main(int argc, char **argv)
     game.self = (Player *) mem_alloc(sizeof(Player), MEMORY_TAG_GAME);
     memset(game.self, 0, sizeof(Player));
     global_data.client_socket = client_socket;
+    global_data.udp_socket = udp_socket;
     global_data.client_update_freq = 60.0f;
     global_data.client_update_period = 1.0f / global_data.client_update_freq;
 
@@ -903,6 +979,7 @@ int main(int argc, char **argv)
     };
 
     game.skybox = (Skybox *) mem_alloc(sizeof(Skybox), MEMORY_TAG_GAME);
+    hash_map_create_tagged(&game.players, sizeof(player_id), sizeof(Player), MEMORY_TAG_GAME);
 
     bool skybox_create_result; UNUSED(skybox_create_result);
     skybox_create_result = skybox_create(&skybox_create_info, game.skybox);
@@ -948,7 +1025,7 @@ int main(int argc, char **argv)
         renderer2d_end_scene(renderer2d);
 
         net_update(delta_time);
-        job_system_update();
+        job_system_update(CLIENT_JOB_CALLBACK_BUDGET_NS);
 
         window_swap_buffers();
         window_poll_events();
@@ -965,15 +1042,6 @@ int main(int argc, char **argv)
 
     mem_free(game.self, sizeof(Player), MEMORY_TAG_GAME);
 
-    {
-        // uthash cleanup
-        Player *p, *tmp1;
-        HASH_ITER(hh, game.players, p, tmp1) {
-            HASH_DEL(game.players, p);
-            free(p);
-        }
-    }
-
     window_destroy();
     renderer2d_destroy(renderer2d);
     job_system_shutdown();
@@ -998,6 +1066,10 @@ int main(int argc, char **argv)
     pthread_kill(network_thread, SIGINT);
     pthread_join(network_thread, NULL);
 
+    // Only now that the network thread is gone.
+    hash_map_destroy(&game.players);
+    pthread_mutex_destroy(&game.players_lock);
+
     if (dlclose(libgame) != 0) {
         LOG_ERROR("error closing shared object: %s\n", dlerror());
     }
@@ -139,7 +139,10 @@ LOCAL void skybox_init_jobs(Skybox_Create_Info *create_info)
     for (u32 i = 0; i < SKYBOX_NUM_FACES; i++) {
         params.image_filepath = create_info->face_filepaths[i];
         params.gl_face = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
-        job_system_submit(skybox_job_load_face_entry_point, &params, sizeof(Skybox_Job_Load_Face_Params), skybox_job_load_face_callback, sizeof(Skybox_Job_Load_Face_Result));
+        if (!job_system_submit(skybox_job_load_face_entry_point, &params, sizeof(Skybox_Job_Load_Face_Params), skybox_job_load_face_callback, sizeof(Skybox_Job_Load_Face_Result))) {
+            // The face keeps the debug texture.
+            LOG_ERROR("failed to submit job loading skybox face `%s`\n", params.image_filepath);
+        }
     }
 }
 
@@ -0,0 +1,426 @@
+#include "hash_map.h"
+
+#include <string.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+INLINE u64 hash_map_mix(u64 hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Keys are mostly ids and sockets, so those sizes skip the generic loop. The memcpy calls
+// below have constant sizes wherever possible, which compiles them down to plain loads.
+INLINE u64 hash_map_hash(const void *key, u64 size)
+{
+    if (size == sizeof(u32)) {
+        u32 word;
+        memcpy(&word, key, sizeof(u32));
+        return hash_map_mix(word);
+    }
+
+    if (size == sizeof(u64)) {
+        u64 word;
+        memcpy(&word, key, sizeof(u64));
+        return hash_map_mix(word);
+    }
+
+    const u8 *bytes = (const u8 *) key;
+    u64 hash = 0xCBF29CE484222325ULL ^ size;
+
+    while (size >= sizeof(u64)) {
+        u64 word;
+        memcpy(&word, bytes, sizeof(u64));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 32;
+        bytes += sizeof(u64);
+        size -= sizeof(u64);
+    }
+
+    if (size >= sizeof(u32)) {
+        u32 word;
+        memcpy(&word, bytes, sizeof(u32));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        bytes += sizeof(u32);
+        size -= sizeof(u32);
+    }
+
+    while (size > 0) {
+        hash = (hash ^ *bytes) * 0x100000001B3ULL;
+        bytes++;
+        size--;
+    }
+
+    return hash_map_mix(hash);
+}
+
+INLINE bool hash_map_key_equal(const void *a, const void *b, u64 size)
+{
+    if (size == sizeof(u32)) {
+        u32 x, y;
+        memcpy(&x, a, sizeof(u32));
+        memcpy(&y, b, sizeof(u32));
+        return x == y;
+    }
+
+    if (size == sizeof(u64)) {
+        u64 x, y;
+        memcpy(&x, a, sizeof(u64));
+        memcpy(&y, b, sizeof(u64));
+        return x == y;
+    }
+
+    return memcmp(a, b, size) == 0;
+}
+
+INLINE void hash_map_copy(void *dest, const void *source, u64 size)
+{
+    switch (size) {
+        case 0:  break;
+        case 4:  memcpy(dest, source, 4); break;
+        case 8:  memcpy(dest, source, 8); break;
+        case 12: memcpy(dest, source, 12); break;
+        case 16: memcpy(dest, source, 16); break;
+        default: memcpy(dest, source, size); break;
+    }
+}
+
+INLINE u8 *hash_map_key_at(const Hash_Map *map, u64 index)
+{
+    return map->keys + index * map->key_size;
+}
+
+INLINE u8 *hash_map_value_at(const Hash_Map *map, u64 index)
+{
+    return map->values + index * map->value_size;
+}
+
+// Room for three entries after the buckets: two to swap entries during a place, one to park an entry during a grow.
+INLINE u64 hash_map_block_size(u64 capacity, u64 key_size, u64 value_size)
+{
+    return capacity * (1 + key_size + value_size) + 3 * (key_size + value_size);
+}
+
+INLINE u8 *hash_map_parking(const Hash_Map *map)
+{
+    return map->scratch + 2 * (map->key_size + map->value_size);
+}
+
+LOCAL void hash_map_allocate(Hash_Map *map, u64 capacity)
+{
+    u8 *block = (u8 *) mem_alloc(hash_map_block_size(capacity, map->key_size, map->value_size), map->tag);
+
+    map->capacity = capacity;
+    map->count = 0;
+    map->distances = block;
+    map->keys = block + capacity;
+    map->values = map->keys + capacity * map->key_size;
+    map->scratch = map->values + capacity * map->value_size;
+}
+
+LOCAL void hash_map_free(Hash_Map *map)
+{
+    mem_free(map->distances, hash_map_block_size(map->capacity, map->key_size, map->value_size), map->tag);
+}
+
+void hash_map_create(Hash_Map *map, u64 key_size, u64 value_size)
+{
+    hash_map_reserve_tagged(map, 0, key_size, value_size, MEMORY_TAG_HASH_MAP);
+}
+
+void hash_map_create_tagged(Hash_Map *map, u64 key_size, u64 value_size, Memory_Tag tag)
+{
+    hash_map_reserve_tagged(map, 0, key_size, value_size, tag);
+}
+
+void hash_map_reserve(Hash_Map *map, u64 capacity, u64 key_size, u64 value_size)
+{
+    hash_map_reserve_tagged(map, capacity, key_size, value_size, MEMORY_TAG_HASH_MAP);
+}
+
+LOCAL u64 hash_map_buckets_for(u64 capacity)
+{
+    u64 buckets = HASH_MAP_DEFAULT_CAPACITY;
+    while (buckets * HASH_MAP_MAX_LOAD_NUMERATOR < capacity * HASH_MAP_MAX_LOAD_DENOMINATOR) {
+        buckets *= 2;
+    }
+    return buckets;
+}
+
+void hash_map_reserve_tagged(Hash_Map *map, u64 capacity, u64 key_size, u64 value_size, Memory_Tag tag)
+{
+    ASSERT(map);
+    ASSERT(key_size > 0);
+
+    map->key_size = key_size;
+    map->value_size = value_size;
+    map->tag = tag;
+    hash_map_allocate(map, hash_map_buckets_for(capacity));
+}
+
+void hash_map_destroy(Hash_Map *map)
+{
+    ASSERT(map);
+
+    hash_map_free(map);
+    mem_zero(map, sizeof(Hash_Map));
+}
+
+// Places the entry held in the first scratch slot, whose key must not be in the map yet, and
+// returns its bucket. Returns 'capacity' when a probe got too long, then the entry that is still
+// without a bucket (either the one being placed or one it displaced) is left in the first scratch slot.
+LOCAL u64 hash_map_place(Hash_Map *map, u64 hash)
+{
+    u64 entry_size = map->key_size + map->value_size;
+    u8 *carry = map->scratch;
+    u8 *swap = map->scratch + entry_size;
+    u64 mask = map->capacity - 1;
+
+    u64 index = hash & mask;
+    u64 distance = 1;
+    u64 placed = map->capacity;
+
+    for (;;) {
+        u8 resident = map->distances[index];
+        if (resident < distance) {
+            u8 *key = hash_map_key_at(map, index);
+            u8 *value = hash_map_value_at(map, index);
+
+            // An empty bucket, or a resident closer to its home bucket which gives up its place.
+            if (resident != 0) {
+                hash_map_copy(swap, key, map->key_size);
+                hash_map_copy(swap + map->key_size, value, map->value_size);
+            }
+
+            hash_map_copy(key, carry, map->key_size);
+            hash_map_copy(value, carry + map->key_size, map->value_size);
+            map->distances[index] = (u8) distance;
+            if (placed == map->capacity) {
+                placed = index;
+            }
+
+            if (resident == 0) {
+                map->count++;
+                return placed;
+            }
+
+            u8 *tmp = carry;
+            carry = swap;
+            swap = tmp;
+            distance = resident;
+        }
+
+        index = (index + 1) & mask;
+        distance++;
+
+        if (distance >= HASH_MAP_MAX_DISTANCE) {
+            if (carry != map->scratch) {
+                memcpy(map->scratch, carry, entry_size);
+            }
+            return map->capacity;
+        }
+    }
+}
+
+// Moves every entry into at least 'buckets' buckets, the parked entry is carried over.
+LOCAL void hash_map_rehash(Hash_Map *map, u64 buckets)
+{
+    u64 entry_size = map->key_size + map->value_size;
+    Hash_Map old = *map;
+
+    for (u64 capacity = buckets;; capacity *= 2) {
+        hash_map_allocate(map, capacity);
+
+        bool placed = true;
+        for (u64 i = 0; i < old.capacity && placed; i++) {
+            if (old.distances[i] == 0) {
+                continue;
+            }
+
+            const u8 *key = hash_map_key_at(&old, i);
+            hash_map_copy(map->scratch, key, map->key_size);
+            hash_map_copy(map->scratch + map->key_size, hash_map_value_at(&old, i), map->value_size);
+            placed = hash_map_place(map, hash_map_hash(key, map->key_size)) != map->capacity;
+        }
+
+        if (placed) {
+            break;
+        }
+
+        // Still a probe that is too long, the old map is intact so start over with more buckets.
+        hash_map_free(map);
+    }
+
+    memcpy(hash_map_parking(map), hash_map_parking(&old), entry_size);
+    hash_map_free(&old);
+}
+
+LOCAL void hash_map_grow(Hash_Map *map)
+{
+    hash_map_rehash(map, map->capacity * 2);
+}
+
+void hash_map_resize(Hash_Map *map, u64 capacity)
+{
+    ASSERT(map);
+
+    u64 buckets = hash_map_buckets_for(capacity);
+    if (buckets > map->capacity) {
+        hash_map_rehash(map, buckets);
+    }
+}
+
+INLINE u64 hash_map_index_of(const Hash_Map *map, const void *key, u64 hash)
+{
+    u64 mask = map->capacity - 1;
+    u64 index = hash & mask;
+
+    // Entries are ordered by distance along a probe, so the key cannot be past a closer one.
+    for (u64 distance = 1; map->distances[index] >= distance; distance++) {
+        if (hash_map_key_equal(hash_map_key_at(map, index), key, map->key_size)) {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+
+    return map->capacity;
+}
+
+void *hash_map_insert(Hash_Map *map, const void *key, const void *value)
+{
+    ASSERT(map);
+    ASSERT(key);
+    ASSERT(value || map->value_size == 0);
+
+    u64 hash = hash_map_hash(key, map->key_size);
+    u64 index = hash_map_index_of(map, key, hash);
+    if (index != map->capacity) {
+        hash_map_copy(hash_map_value_at(map, index), value, map->value_size);
+        return hash_map_value_at(map, index);
+    }
+
+    if ((map->count + 1) * HASH_MAP_MAX_LOAD_DENOMINATOR > map->capacity * HASH_MAP_MAX_LOAD_NUMERATOR) {
+        hash_map_grow(map);
+    }
+
+    hash_map_copy(map->scratch, key, map->key_size);
+    hash_map_copy(map->scratch + map->key_size, value, map->value_size);
+    index = hash_map_place(map, hash);
+    if (index != map->capacity) {
+        return hash_map_value_at(map, index);
+    }
+
+    // The entry left over may be one that the new key displaced, so the key is looked up at the end.
+    u64 entry_size = map->key_size + map->value_size;
+    do {
+        memcpy(hash_map_parking(map), map->scratch, entry_size);
+        hash_map_grow(map);
+        memcpy(map->scratch, hash_map_parking(map), entry_size);
+    } while (hash_map_place(map, hash_map_hash(map->scratch, map->key_size)) == map->capacity);
+
+    return hash_map_find(map, key);
+}
+
+void *hash_map_find(const Hash_Map *map, const void *key)
+{
+    ASSERT(map);
+    ASSERT(key);
+
+    u64 index = hash_map_index_of(map, key, hash_map_hash(key, map->key_size));
+    return index != map->capacity ? hash_map_value_at(map, index) : NULL;
+}
+
+bool hash_map_contains(const Hash_Map *map, const void *key)
+{
+    ASSERT(map);
+    ASSERT(key);
+
+    return hash_map_index_of(map, key, hash_map_hash(key, map->key_size)) != map->capacity;
+}
+
+bool hash_map_remove(Hash_Map *map, const void *key, void *out_value)
+{
+    ASSERT(map);
+    ASSERT(key);
+
+    u64 index = hash_map_index_of(map, key, hash_map_hash(key, map->key_size));
+    if (index == map->capacity) {
+        return false;
+    }
+
+    if (out_value != NULL) {
+        hash_map_copy(out_value, hash_map_value_at(map, index), map->value_size);
+    }
+
+    // Shift the following entries of the probe back by one, until one that is already home.
+    u64 mask = map->capacity - 1;
+    u64 next = (index + 1) & mask;
+    while (map->distances[next] > 1) {
+        hash_map_copy(hash_map_key_at(map, index), hash_map_key_at(map, next), map->key_size);
+        hash_map_copy(hash_map_value_at(map, index), hash_map_value_at(map, next), map->value_size);
+        map->distances[index] = (u8) (map->distances[next] - 1);
+        index = next;
+        next = (next + 1) & mask;
+    }
+
+    map->distances[index] = 0;
+    map->count--;
+    return true;
+}
+
+void hash_map_clear(Hash_Map *map)
+{
+    ASSERT(map);
+
+    mem_zero(map->distances, map->capacity);
+    map->count = 0;
+}
+
+u64 hash_map_length(const Hash_Map *map)
+{
+    ASSERT(map);
+    return map->count;
+}
+
+bool hash_map_next(const Hash_Map *map, u64 *iterator, void **out_key, void **out_value)
+{
+    ASSERT(map);
+    ASSERT(iterator);
+
+    u64 index = *iterator;
+    while (index < map->capacity) {
+        // Occupancy is close to random, so testing one bucket at a time mispredicts about every
+        // other branch. Eight distance bytes are tested at once instead and the lowest nonzero
+        // byte (the first one in memory on little endian) is found with a bit scan.
+        if (index + sizeof(u64) <= map->capacity) {
+            u64 word;
+            memcpy(&word, map->distances + index, sizeof(u64));
+            if (word == 0) {
+                index += sizeof(u64);
+                continue;
+            }
+            index += (u64) __builtin_ctzll(word) / 8;
+        } else if (map->distances[index] == 0) {
+            index++;
+            continue;
+        }
+
+        if (out_key != NULL) {
+            *out_key = hash_map_key_at(map, index);
+        }
+        if (out_value != NULL) {
+            *out_value = hash_map_value_at(map, index);
+        }
+        *iterator = index + 1;
+        return true;
+    }
+
+    *iterator = map->capacity;
+    return false;
+}
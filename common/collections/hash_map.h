@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common/defines.h"
+#include "common/memory/memutils.h"
+
+#define HASH_MAP_DEFAULT_CAPACITY 16
+#define HASH_MAP_MAX_LOAD_NUMERATOR 3   // grows once more than 3/4 of the buckets are taken
+#define HASH_MAP_MAX_LOAD_DENOMINATOR 4
+#define HASH_MAP_MAX_DISTANCE 255       // probe distances are kept in a byte, the map grows before exceeding it
+
+/*
+ * Open addressing hash map with Robin Hood probing, for fixed-size keys compared bytewise.
+ * Keys and values are copied into the map, so there are no per-entry allocations and no
+ * handle inside the stored type. Every bucket has a probe distance byte (0 when empty),
+ * stored apart from the keys and values, so a lookup scans a few adjacent bytes and keys.
+ * On insert an entry that is further from its home bucket takes the place of one that is
+ * closer, which keeps the probe lengths short and lets a lookup stop early. Removal shifts
+ * the following entries back instead of leaving tombstones.
+ * Pointers returned by the map stay valid until the next insert or remove.
+ */
+typedef struct {
+    u64 capacity; // number of buckets, a power of two
+    u64 count;
+    u64 key_size;
+    u64 value_size;
+    u8 *distances; // per bucket, probe distance + 1, 0 when empty
+    u8 *keys;
+    u8 *values;
+    u8 *scratch;   // room for three entries, two to swap them around during an insert and one to park an entry while growing
+    Memory_Tag tag;
+} Hash_Map;
+
+void hash_map_create(Hash_Map *map, u64 key_size, u64 value_size);
+void hash_map_create_tagged(Hash_Map *map, u64 key_size, u64 value_size, Memory_Tag tag);
+// Sized so that 'capacity' entries fit without growing.
+void hash_map_reserve(Hash_Map *map, u64 capacity, u64 key_size, u64 value_size);
+void hash_map_reserve_tagged(Hash_Map *map, u64 capacity, u64 key_size, u64 value_size, Memory_Tag tag);
+void hash_map_destroy(Hash_Map *map);
+// Grows the map so that 'capacity' entries fit without growing again, ahead of a bulk insert. Never shrinks.
+void hash_map_resize(Hash_Map *map, u64 capacity);
+
+// Inserts or overwrites the value of 'key', returns where the value is stored.
+void *hash_map_insert(Hash_Map *map, const void *key, const void *value);
+// Returns NULL when 'key' is absent.
+void *hash_map_find(const Hash_Map *map, const void *key);
+bool  hash_map_contains(const Hash_Map *map, const void *key);
+// Copies the value to 'out_value' when it is not NULL. Returns false when 'key' is absent.
+bool  hash_map_remove(Hash_Map *map, const void *key, void *out_value);
+void  hash_map_clear(Hash_Map *map);
+u64   hash_map_length(const Hash_Map *map);
+
+// Iterates over all entries in bucket order, starting with *iterator set to 0.
+// The map must not be changed while iterating.
+bool hash_map_next(const Hash_Map *map, u64 *iterator, void **out_key, void **out_value);
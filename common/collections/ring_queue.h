@@ -24,7 +24,7 @@ void ring_queue_destroy(Ring_Queue *ring_queue);
 bool ring_queue_enqueue(Ring_Queue *ring_queue, const void *element);
 bool ring_queue_dequeue(Ring_Queue *ring_queue, void *out_element);
 
-bool ring_queue_peek_from_end(void *ring_queue, u64 n, void *out_element);
+bool ring_queue_peek_from_end(Ring_Queue *ring_queue, u64 n, void *out_element);
 
 bool ring_queue_is_full(Ring_Queue *ring_queue);
 bool ring_queue_is_empty(Ring_Queue *ring_queue);
@@ -0,0 +1,67 @@
+#include "pbkdf2.h"
+
+#include "sha256.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+void pbkdf2_hmac_sha256(const void *password, u64 password_size,
+                        const void *salt, u64 salt_size,
+                        u32 iterations, u8 *out_key, u64 key_size)
+{
+    ASSERT(password || password_size == 0);
+    ASSERT(salt || salt_size == 0);
+    ASSERT(iterations > 0);
+    ASSERT(out_key);
+
+    Hmac_Sha256_Key key;
+    hmac_sha256_key(&key, password, password_size);
+
+    u8 block_u[SHA256_DIGEST_SIZE];
+    u8 block_t[SHA256_DIGEST_SIZE];
+
+    for (u32 block_index = 1; key_size > 0; block_index++) {
+        // U1 = PRF(password, salt || INT(block_index))
+        u8 index_bytes[4] = { (u8) (block_index >> 24), (u8) (block_index >> 16), (u8) (block_index >> 8), (u8) block_index };
+        Sha256_Context context = key.inner;
+        sha256_update(&context, salt, salt_size);
+        sha256_update(&context, index_bytes, sizeof(index_bytes));
+        sha256_final(&context, block_u);
+        context = key.outer;
+        sha256_update(&context, block_u, SHA256_DIGEST_SIZE);
+        sha256_final(&context, block_u);
+
+        mem_copy(block_t, block_u, SHA256_DIGEST_SIZE);
+
+        // T = U1 ^ U2 ^ ... ^ Uc, with Ui = PRF(password, Ui-1)
+        for (u32 i = 1; i < iterations; i++) {
+            hmac_sha256(&key, block_u, SHA256_DIGEST_SIZE, block_u);
+            for (u32 j = 0; j < SHA256_DIGEST_SIZE; j++) {
+                block_t[j] ^= block_u[j];
+            }
+        }
+
+        u64 taken = key_size < SHA256_DIGEST_SIZE ? key_size : SHA256_DIGEST_SIZE;
+        mem_copy(out_key, block_t, taken);
+        out_key += taken;
+        key_size -= taken;
+    }
+
+    mem_zero(&key, sizeof(key));
+    mem_zero(block_u, sizeof(block_u));
+    mem_zero(block_t, sizeof(block_t));
+}
+
+bool constant_time_equal(const void *a, const void *b, u64 size)
+{
+    ASSERT(a && b);
+
+    const volatile u8 *lhs = (const volatile u8 *) a;
+    const volatile u8 *rhs = (const volatile u8 *) b;
+
+    u8 difference = 0;
+    for (u64 i = 0; i < size; i++) {
+        difference |= (u8) (lhs[i] ^ rhs[i]);
+    }
+
+    return difference == 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "common/defines.h"
+
+// PBKDF2 (RFC 8018) with HMAC-SHA256 as the pseudorandom function.
+// The cost grows linearly with 'iterations', each one is two SHA-256 compressions.
+void pbkdf2_hmac_sha256(const void *password, u64 password_size,
+                        const void *salt, u64 salt_size,
+                        u32 iterations, u8 *out_key, u64 key_size);
+
+// Compares without an early exit, so the time taken does not tell how many leading bytes match.
+bool constant_time_equal(const void *a, const void *b, u64 size);
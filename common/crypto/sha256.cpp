@@ -0,0 +1,183 @@
+#include "sha256.h"
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+LOCAL const u32 SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+INLINE u32 rotate_right(u32 value, u32 count)
+{
+    return (value >> count) | (value << (32 - count));
+}
+
+LOCAL void sha256_compress(u32 *state, const u8 *block)
+{
+    u32 w[64];
+    for (u32 i = 0; i < 16; i++) {
+        w[i] = ((u32) block[i * 4] << 24) | ((u32) block[i * 4 + 1] << 16) |
+               ((u32) block[i * 4 + 2] << 8) | (u32) block[i * 4 + 3];
+    }
+
+    for (u32 i = 16; i < 64; i++) {
+        u32 s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        u32 s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    u32 a = state[0], b = state[1], c = state[2], d = state[3];
+    u32 e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (u32 i = 0; i < 64; i++) {
+        u32 s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+        u32 choice = (e & f) ^ (~e & g);
+        u32 t1 = h + s1 + choice + SHA256_K[i] + w[i];
+        u32 s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+        u32 majority = (a & b) ^ (a & c) ^ (b & c);
+        u32 t2 = s0 + majority;
+
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha256_init(Sha256_Context *context)
+{
+    ASSERT(context);
+
+    context->state[0] = 0x6a09e667;
+    context->state[1] = 0xbb67ae85;
+    context->state[2] = 0x3c6ef372;
+    context->state[3] = 0xa54ff53a;
+    context->state[4] = 0x510e527f;
+    context->state[5] = 0x9b05688c;
+    context->state[6] = 0x1f83d9ab;
+    context->state[7] = 0x5be0cd19;
+    context->length = 0;
+    context->buffer_length = 0;
+}
+
+void sha256_update(Sha256_Context *context, const void *data, u64 size)
+{
+    ASSERT(context);
+    ASSERT(data || size == 0);
+
+    const u8 *bytes = (const u8 *) data;
+    context->length += size;
+
+    if (context->buffer_length > 0) {
+        u64 needed = SHA256_BLOCK_SIZE - context->buffer_length;
+        u64 taken = size < needed ? size : needed;
+        mem_copy(context->buffer + context->buffer_length, bytes, taken);
+        context->buffer_length += (u32) taken;
+        bytes += taken;
+        size -= taken;
+
+        if (context->buffer_length < SHA256_BLOCK_SIZE) {
+            return;
+        }
+
+        sha256_compress(context->state, context->buffer);
+        context->buffer_length = 0;
+    }
+
+    while (size >= SHA256_BLOCK_SIZE) {
+        sha256_compress(context->state, bytes);
+        bytes += SHA256_BLOCK_SIZE;
+        size -= SHA256_BLOCK_SIZE;
+    }
+
+    if (size > 0) {
+        mem_copy(context->buffer, bytes, size);
+        context->buffer_length = (u32) size;
+    }
+}
+
+void sha256_final(Sha256_Context *context, u8 *out_digest)
+{
+    ASSERT(context);
+    ASSERT(out_digest);
+
+    u64 bit_length = context->length * 8;
+
+    // Padding: a single 1 bit, zeros up to 56 bytes into the block, then the big-endian bit length.
+    u8 padding[SHA256_BLOCK_SIZE * 2] = { 0x80 };
+    u32 padding_size = context->buffer_length < 56 ? 56 - context->buffer_length : 120 - context->buffer_length;
+    for (u32 i = 0; i < 8; i++) {
+        padding[padding_size + i] = (u8) (bit_length >> (56 - i * 8));
+    }
+    sha256_update(context, padding, padding_size + 8);
+    ASSERT(context->buffer_length == 0);
+
+    for (u32 i = 0; i < 8; i++) {
+        out_digest[i * 4]     = (u8) (context->state[i] >> 24);
+        out_digest[i * 4 + 1] = (u8) (context->state[i] >> 16);
+        out_digest[i * 4 + 2] = (u8) (context->state[i] >> 8);
+        out_digest[i * 4 + 3] = (u8) context->state[i];
+    }
+}
+
+void sha256(const void *data, u64 size, u8 *out_digest)
+{
+    Sha256_Context context;
+    sha256_init(&context);
+    sha256_update(&context, data, size);
+    sha256_final(&context, out_digest);
+}
+
+void hmac_sha256_key(Hmac_Sha256_Key *key, const void *secret, u64 secret_size)
+{
+    ASSERT(key);
+    ASSERT(secret || secret_size == 0);
+
+    u8 block[SHA256_BLOCK_SIZE] = {0};
+    if (secret_size > SHA256_BLOCK_SIZE) {
+        sha256(secret, secret_size, block);
+    } else if (secret_size > 0) {
+        mem_copy(block, secret, secret_size);
+    }
+
+    u8 pad[SHA256_BLOCK_SIZE];
+
+    for (u32 i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        pad[i] = block[i] ^ 0x36;
+    }
+    sha256_init(&key->inner);
+    sha256_update(&key->inner, pad, SHA256_BLOCK_SIZE);
+
+    for (u32 i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        pad[i] = block[i] ^ 0x5c;
+    }
+    sha256_init(&key->outer);
+    sha256_update(&key->outer, pad, SHA256_BLOCK_SIZE);
+
+    mem_zero(block, sizeof(block));
+    mem_zero(pad, sizeof(pad));
+}
+
+void hmac_sha256(const Hmac_Sha256_Key *key, const void *data, u64 size, u8 *out_mac)
+{
+    ASSERT(key);
+    ASSERT(out_mac);
+
+    u8 inner_digest[SHA256_DIGEST_SIZE];
+
+    Sha256_Context context = key->inner;
+    sha256_update(&context, data, size);
+    sha256_final(&context, inner_digest);
+
+    context = key->outer;
+    sha256_update(&context, inner_digest, SHA256_DIGEST_SIZE);
+    sha256_final(&context, out_mac);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common/defines.h"
+
+#define SHA256_BLOCK_SIZE 64
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct {
+    u32 state[8];
+    u64 length;                    // bytes hashed so far
+    u8 buffer[SHA256_BLOCK_SIZE];  // partial block
+    u32 buffer_length;
+} Sha256_Context;
+
+void sha256_init(Sha256_Context *context);
+void sha256_update(Sha256_Context *context, const void *data, u64 size);
+void sha256_final(Sha256_Context *context, u8 *out_digest);
+void sha256(const void *data, u64 size, u8 *out_digest);
+
+/*
+ * HMAC-SHA256 with the key already absorbed, so that computing many MACs with the same
+ * key, as PBKDF2 does, starts from the copied inner and outer states instead of hashing
+ * the padded key twice per MAC.
+ */
+typedef struct {
+    Sha256_Context inner;
+    Sha256_Context outer;
+} Hmac_Sha256_Key;
+
+void hmac_sha256_key(Hmac_Sha256_Key *key, const void *secret, u64 secret_size);
+void hmac_sha256(const Hmac_Sha256_Key *key, const void *data, u64 size, u8 *out_mac);
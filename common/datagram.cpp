@@ -0,0 +1,79 @@
+#include "datagram.h"
+
+#include <string.h>
+#include <sys/uio.h>
+
+#include "net.h"
+#include "asserts.h"
+
+bool datagram_sequence_is_newer(u32 sequence, u32 latest)
+{
+    return (i32) (sequence - latest) > 0;
+}
+
+bool datagram_window_accept(Datagram_Window *window, u32 sequence)
+{
+    ASSERT(window);
+
+    if (window->started && datagram_sequence_is_newer(window->latest, sequence)) {
+        window->stale_drops++;
+        return false;
+    }
+
+    window->started = true;
+    window->latest = sequence;
+    return true;
+}
+
+bool datagram_type_is_unreliable(u32 type)
+{
+    return type == PACKET_TYPE_PING ||
+           type == PACKET_TYPE_PLAYER_MOVE ||
+           type == PACKET_TYPE_PLAYER_BATCH_MOVE;
+}
+
+bool datagram_parse(u8 *data, u64 size, Datagram_Header *out_header, Packet_Header *out_packet_header, u8 **out_payload)
+{
+    ASSERT(data);
+    ASSERT(out_header && out_packet_header && out_payload);
+
+    if (size < sizeof(Datagram_Header) + sizeof(Packet_Header)) {
+        return false;
+    }
+
+    memcpy(out_header, data, sizeof(Datagram_Header));
+    memcpy(out_packet_header, data + sizeof(Datagram_Header), sizeof(Packet_Header));
+
+    u64 payload_size = size - sizeof(Datagram_Header) - sizeof(Packet_Header);
+    if (!datagram_type_is_unreliable(out_packet_header->type) || out_packet_header->payload_size != payload_size) {
+        return false;
+    }
+
+    u8 *payload = data + sizeof(Datagram_Header) + sizeof(Packet_Header);
+    if (!packet_payload_is_valid(out_packet_header->type, payload, payload_size)) {
+        return false;
+    }
+
+    *out_payload = payload;
+    return true;
+}
+
+bool datagram_send(i32 socket, u64 token, u32 sequence, u32 type, void *packet_data)
+{
+    ASSERT(datagram_type_is_unreliable(type));
+
+    Datagram_Header header = { .token = token, .sequence = sequence };
+    Packet_Buffer *buffer = packet_buffer_create(type, packet_data);
+    ASSERT(sizeof(header) + buffer->size <= DATAGRAM_MAX_SIZE);
+
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = buffer->data;
+    iov[1].iov_len = buffer->size;
+
+    // A datagram is sent whole or not at all.
+    bool sent = net_writev(socket, iov, 2) == (i64) (sizeof(header) + buffer->size);
+    packet_buffer_release(buffer);
+    return sent;
+}
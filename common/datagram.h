@@ -0,0 +1,43 @@
+#pragma once
+
+#include "defines.h"
+#include "packet.h"
+
+#define DATAGRAM_MAX_SIZE 1472 // UDP payload of a 1500 byte ethernet frame
+
+/*
+ * Unreliable channel that runs next to the TCP session for state that is replaced as
+ * soon as a newer copy exists, like positions. A lost datagram is never resent, the
+ * next one supersedes it, so a loss costs one update instead of stalling everything
+ * behind it the way a retransmission on the TCP stream does.
+ *
+ * Every datagram holds exactly one framed packet behind a Datagram_Header. The token
+ * is handed out in the join response over TCP and binds the datagram to that session,
+ * the sequence lets the receiver drop datagrams that arrive after newer ones.
+ */
+typedef struct PACKED {
+    u64 token;
+    u32 sequence;
+} Datagram_Header;
+
+// Drops everything older than the newest sequence seen so far. Equal sequences are accepted,
+// so a sender may split one update (like one tick) across several datagrams.
+typedef struct {
+    bool started;
+    u32 latest;
+    u64 stale_drops;
+} Datagram_Window;
+
+// Wraparound safe, 'sequence' is newer when it is less than 2^31 ahead of 'latest'.
+bool datagram_sequence_is_newer(u32 sequence, u32 latest);
+bool datagram_window_accept(Datagram_Window *window, u32 sequence);
+
+// Only these may travel over the unreliable channel, everything else needs TCP.
+bool datagram_type_is_unreliable(u32 type);
+
+// Validates a received datagram and points 'out_payload' into 'data'. Returns false for
+// anything that is not one complete packet of an unreliable type.
+bool datagram_parse(u8 *data, u64 size, Datagram_Header *out_header, Packet_Header *out_packet_header, u8 **out_payload);
+
+// Sends one packet on a connected datagram socket.
+bool datagram_send(i32 socket, u64 token, u32 sequence, u32 type, void *packet_data);
@@ -1,56 +1,636 @@
 #include "job.h"
 
+#include <sched.h>
 #include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #include "log.h"
+#include "clock.h"
 #include "asserts.h"
 #include "memory/memutils.h"
 
 LOCAL Job_System *job_system = NULL;
 
-LOCAL void *job_system_worker_function(void *arg)
+void job_deque_create(Job_Deque *deque)
 {
-    UNUSED(arg);
-    LOG_INFO("spawning worker thread TID=%d\n", gettid());
+    ASSERT(deque);
+    STATIC_ASSERT((JOB_DEQUE_CAPACITY & (JOB_DEQUE_CAPACITY - 1)) == 0, "job deque capacity must be a power of two");
+
+    deque->top = 0;
+    deque->bottom = 0;
+    deque->jobs = (Job *) mem_alloc(JOB_DEQUE_CAPACITY * sizeof(Job), MEMORY_TAG_JOB);
+}
 
-    while (true) {
-        pthread_mutex_lock(&job_system->job_queue_lock);
+void job_deque_destroy(Job_Deque *deque)
+{
+    ASSERT(deque);
 
-        while (ring_queue_is_empty(&job_system->job_queue) && job_system->running) {
-            pthread_cond_wait(&job_system->job_queue_notify, &job_system->job_queue_lock);
-        }
+    mem_free(deque->jobs, JOB_DEQUE_CAPACITY * sizeof(Job), MEMORY_TAG_JOB);
+    deque->jobs = NULL;
+}
+
+bool job_deque_push(Job_Deque *deque, const Job *job)
+{
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= JOB_DEQUE_CAPACITY) {
+        return false;
+    }
+
+    deque->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)] = *job;
+    // The job has to be visible before a thief can see the new bottom.
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool job_deque_pop(Job_Deque *deque, Job *out_job)
+{
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    // Publishing the smaller bottom before reading top makes a thief that read the old bottom
+    // and the owner agree on who takes the last job, through the CAS on top.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    *out_job = deque->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)];
+    if (top < bottom) {
+        return true;
+    }
+
+    // The last job, thieves may be after it too.
+    bool taken = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return taken;
+}
 
-        if (!job_system->running) {
-            LOG_INFO("shutting down worker thread TID=%d\n", gettid());
-            pthread_mutex_unlock(&job_system->job_queue_lock);
-            pthread_exit(NULL);
+bool job_deque_steal(Job_Deque *deque, Job *out_job)
+{
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+    if (top >= bottom) {
+        return false;
+    }
+
+    // Read before claiming, the slot cannot be reused until top moves past it, and if it
+    // already has the CAS fails and the copy is thrown away.
+    Job job = deque->jobs[top & (JOB_DEQUE_CAPACITY - 1)];
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+    *out_job = job;
+    return true;
+}
+
+bool job_deque_is_empty(Job_Deque *deque)
+{
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    return top >= bottom;
+}
+
+LOCAL void job_inject_queue_create(Job_Inject_Queue *queue)
+{
+    STATIC_ASSERT((JOB_INJECT_QUEUE_CAPACITY & (JOB_INJECT_QUEUE_CAPACITY - 1)) == 0, "job inject queue capacity must be a power of two");
+
+    queue->cells = (Job_Inject_Cell *) mem_alloc(JOB_INJECT_QUEUE_CAPACITY * sizeof(Job_Inject_Cell), MEMORY_TAG_JOB);
+    for (u64 i = 0; i < JOB_INJECT_QUEUE_CAPACITY; i++) {
+        queue->cells[i].sequence = i;
+    }
+    queue->enqueue_position = 0;
+    queue->dequeue_position = 0;
+}
+
+LOCAL void job_inject_queue_destroy(Job_Inject_Queue *queue)
+{
+    mem_free(queue->cells, JOB_INJECT_QUEUE_CAPACITY * sizeof(Job_Inject_Cell), MEMORY_TAG_JOB);
+    queue->cells = NULL;
+}
+
+LOCAL bool job_inject_queue_enqueue(Job_Inject_Queue *queue, const Job *job)
+{
+    u64 position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+    Job_Inject_Cell *cell;
+
+    for (;;) {
+        cell = &queue->cells[position & (JOB_INJECT_QUEUE_CAPACITY - 1)];
+        u64 sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        i64 difference = (i64) (sequence - position);
+
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&queue->enqueue_position, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // The cell still holds a job from one lap ago.
+            return false;
+        } else {
+            position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
         }
+    }
 
-        Job job;
-        if (!ring_queue_dequeue(&job_system->job_queue, &job)) {
-            LOG_ERROR("failed to dequeue a job\n");
-            pthread_mutex_unlock(&job_system->job_queue_lock);
-            continue;
+    cell->job = *job;
+    __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+LOCAL bool job_inject_queue_dequeue(Job_Inject_Queue *queue, Job *out_job)
+{
+    u64 position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
+    Job_Inject_Cell *cell;
+
+    for (;;) {
+        cell = &queue->cells[position & (JOB_INJECT_QUEUE_CAPACITY - 1)];
+        u64 sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        i64 difference = (i64) (sequence - (position + 1));
+
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&queue->dequeue_position, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
         }
+    }
 
-        pthread_mutex_unlock(&job_system->job_queue_lock);
+    *out_job = cell->job;
+    __atomic_store_n(&cell->sequence, position + JOB_INJECT_QUEUE_CAPACITY, __ATOMIC_RELEASE);
+    return true;
+}
 
-        bool result = job.entry_point(job.param_data, job.result_data);
-        mem_free(job.param_data, job.param_data_size, MEMORY_TAG_JOB);
+LOCAL bool job_inject_queue_is_empty(Job_Inject_Queue *queue)
+{
+    return __atomic_load_n(&queue->dequeue_position, __ATOMIC_ACQUIRE) == __atomic_load_n(&queue->enqueue_position, __ATOMIC_ACQUIRE);
+}
+
+LOCAL void job_completion_queue_create(Job_Completion_Queue *queue)
+{
+    STATIC_ASSERT((JOB_SYSTEM_MAX_NUM_RESULTS & (JOB_SYSTEM_MAX_NUM_RESULTS - 1)) == 0, "job result capacity must be a power of two");
 
-        pthread_mutex_lock(&job_system->results_lock);
-        for (u32 i = 0; i < JOB_SYSTEM_MAX_NUM_RESULTS; i++) {
-            if (job_system->results[i].empty) {
-                job_system->results[i].empty = false;
-                job_system->results[i].status = result ? JOB_STATUS_COMPLETED : JOB_STATUS_FAILED;
-                job_system->results[i].callback = job.callback;
-                job_system->results[i].result_data = job.result_data;
-                job_system->results[i].result_data_size = job.result_data_size;
+    queue->cells = (Job_Completion_Cell *) mem_alloc(JOB_SYSTEM_MAX_NUM_RESULTS * sizeof(Job_Completion_Cell), MEMORY_TAG_JOB);
+    for (u64 i = 0; i < JOB_SYSTEM_MAX_NUM_RESULTS; i++) {
+        queue->cells[i].sequence = i;
+    }
+    queue->enqueue_position = 0;
+    queue->dequeue_position = 0;
+}
+
+LOCAL void job_completion_queue_destroy(Job_Completion_Queue *queue)
+{
+    mem_free(queue->cells, JOB_SYSTEM_MAX_NUM_RESULTS * sizeof(Job_Completion_Cell), MEMORY_TAG_JOB);
+    queue->cells = NULL;
+}
+
+LOCAL bool job_completion_queue_enqueue(Job_Completion_Queue *queue, const Job_Result *result)
+{
+    u64 position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+    Job_Completion_Cell *cell;
+
+    for (;;) {
+        cell = &queue->cells[position & (JOB_SYSTEM_MAX_NUM_RESULTS - 1)];
+        u64 sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        i64 difference = (i64) (sequence - position);
+
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&queue->enqueue_position, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
                 break;
             }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->result = *result;
+    __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+LOCAL bool job_completion_queue_dequeue(Job_Completion_Queue *queue, Job_Result *out_result)
+{
+    // Single consumer, so nobody else moves the position.
+    u64 position = queue->dequeue_position;
+    Job_Completion_Cell *cell = &queue->cells[position & (JOB_SYSTEM_MAX_NUM_RESULTS - 1)];
+    if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != position + 1) {
+        return false;
+    }
+
+    *out_result = cell->result;
+    __atomic_store_n(&cell->sequence, position + JOB_SYSTEM_MAX_NUM_RESULTS, __ATOMIC_RELEASE);
+    queue->dequeue_position = position + 1;
+    return true;
+}
+
+typedef struct {
+    Job job;
+    u32 remaining; // atomic, dependencies that are not done yet, plus one held by the submitter
+    u32 dependency_count;
+} Job_Deferred;
+
+// One for every dependency of a deferred job, allocated right behind the Job_Deferred.
+struct Job_Waiter {
+    Job_Deferred *deferred;
+    Job_Waiter *next;
+};
+
+// Header in front of every block of job data that does not fit inline.
+struct alignas(JOB_DATA_ALIGNMENT) Job_Pool_Block {
+    Job_Pool *owner; // NULL for blocks too large for any size class
+    Job_Pool_Block *next;
+    u64 size; // usable bytes behind the header
+};
+
+LOCAL void job_system_run(Job *job);
+
+LOCAL void futex_wait(u32 *address, u32 expected)
+{
+    // Returns right away when the value already changed, spurious wakeups are fine for the callers.
+    syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+LOCAL void futex_wake(u32 *address, i32 count)
+{
+    syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Called after making a job visible. Pairs with the sleepers increment in job_system_park.
+LOCAL void job_system_wake_one(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&job_system->sleepers, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    __atomic_add_fetch(&job_system->wake_epoch, 1, __ATOMIC_RELEASE);
+    futex_wake(&job_system->wake_epoch, 1);
+}
+
+LOCAL Job_Context *job_system_get_context(void)
+{
+    return (Job_Context *) pthread_getspecific(job_system->context_key);
+}
+
+LOCAL Job_Pool *job_system_get_pool(void)
+{
+    Job_Context *context = job_system_get_context();
+    return context != NULL && context->worker != NULL ? &context->worker->pool : &job_system->shared_pool;
+}
+
+// JOB_POOL_SIZE_CLASS_COUNT when no size class is large enough.
+LOCAL u32 job_pool_size_class(u64 size)
+{
+    u32 size_class = 0;
+    for (u64 block_size = JOB_POOL_MIN_BLOCK_SIZE; block_size < size && size_class < JOB_POOL_SIZE_CLASS_COUNT; block_size <<= 1) {
+        size_class++;
+    }
+    return size_class;
+}
+
+LOCAL Job_Pool_Block *job_pool_take(Job_Pool *pool, u32 size_class)
+{
+    Job_Pool_Block *block = pool->free_blocks[size_class];
+    if (block == NULL) {
+        block = __atomic_exchange_n(&pool->returned_blocks[size_class], NULL, __ATOMIC_ACQUIRE);
+    }
+    if (block != NULL) {
+        pool->free_blocks[size_class] = block->next;
+    }
+    return block;
+}
+
+// Not zeroed.
+LOCAL void *job_data_alloc(u64 size)
+{
+    u32 size_class = job_pool_size_class(size);
+    if (size_class == JOB_POOL_SIZE_CLASS_COUNT) {
+        Job_Pool_Block *block = (Job_Pool_Block *) mem_alloc(sizeof(Job_Pool_Block) + size, MEMORY_TAG_JOB);
+        block->owner = NULL;
+        block->size = size;
+        return block + 1;
+    }
+
+    Job_Pool *pool = job_system_get_pool();
+    Job_Pool_Block *block;
+    if (pool == &job_system->shared_pool) {
+        pthread_mutex_lock(&job_system->shared_pool_lock);
+        block = job_pool_take(pool, size_class);
+        pthread_mutex_unlock(&job_system->shared_pool_lock);
+    } else {
+        block = job_pool_take(pool, size_class);
+    }
+
+    if (block == NULL) {
+        u64 block_size = (u64) JOB_POOL_MIN_BLOCK_SIZE << size_class;
+        block = (Job_Pool_Block *) mem_alloc(sizeof(Job_Pool_Block) + block_size, MEMORY_TAG_JOB);
+        block->owner = pool;
+        block->size = block_size;
+    }
+
+    return block + 1;
+}
+
+LOCAL void job_data_free(void *data)
+{
+    Job_Pool_Block *block = (Job_Pool_Block *) data - 1;
+    Job_Pool *owner = block->owner;
+    if (owner == NULL) {
+        mem_free(block, sizeof(Job_Pool_Block) + block->size, MEMORY_TAG_JOB);
+        return;
+    }
+
+    u32 size_class = job_pool_size_class(block->size);
+    if (owner != &job_system->shared_pool && owner == job_system_get_pool()) {
+        block->next = owner->free_blocks[size_class];
+        owner->free_blocks[size_class] = block;
+        return;
+    }
+
+    block->next = __atomic_load_n(&owner->returned_blocks[size_class], __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&owner->returned_blocks[size_class], &block->next, block, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+LOCAL void job_pool_destroy(Job_Pool *pool)
+{
+    for (u32 i = 0; i < JOB_POOL_SIZE_CLASS_COUNT; i++) {
+        Job_Pool_Block *lists[2] = { pool->free_blocks[i], pool->returned_blocks[i] };
+        for (u32 j = 0; j < ARRAY_LEN(lists); j++) {
+            Job_Pool_Block *block = lists[j];
+            while (block != NULL) {
+                Job_Pool_Block *next = block->next;
+                mem_free(block, sizeof(Job_Pool_Block) + block->size, MEMORY_TAG_JOB);
+                block = next;
+            }
+        }
+        pool->free_blocks[i] = NULL;
+        pool->returned_blocks[i] = NULL;
+    }
+}
+
+INLINE u64 job_data_align(u64 size)
+{
+    return (size + JOB_DATA_ALIGNMENT - 1) & ~((u64) JOB_DATA_ALIGNMENT - 1);
+}
+
+LOCAL void *job_param_data(Job *job)
+{
+    if (job->param_data != NULL || job->param_data_size == 0) {
+        return job->param_data;
+    }
+    return job->inline_data;
+}
+
+LOCAL void *job_result_data(Job *job)
+{
+    if (job->result_data != NULL || job->result_data_size == 0) {
+        return job->result_data;
+    }
+
+    // Behind the params when those are inline as well.
+    u64 offset = job->param_data == NULL ? job_data_align(job->param_data_size) : 0;
+    return job->inline_data + offset;
+}
+
+LOCAL void job_system_push(Job *job)
+{
+    // A job submitted by a job stays with the worker running it until someone steals it.
+    Job_Context *context = job_system_get_context();
+    if (context != NULL && context->worker != NULL) {
+        if (!job_deque_push(&context->worker->deque, job)) {
+            // Running it right away is as good as waiting behind 4096 others.
+            job_system_run(job);
+            return;
+        }
+    } else if (!job_inject_queue_enqueue(&job_system->inject_queue, job)) {
+        // Never dropped, somebody may be waiting on its counter.
+        job_system_run(job);
+        return;
+    }
+
+    job_system_wake_one();
+}
+
+LOCAL void job_counter_lock(Job_Counter *counter)
+{
+    while (__atomic_exchange_n(&counter->lock, 1, __ATOMIC_ACQUIRE) != 0) {
+        while (__atomic_load_n(&counter->lock, __ATOMIC_RELAXED) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+LOCAL void job_counter_unlock(Job_Counter *counter)
+{
+    __atomic_store_n(&counter->lock, 0, __ATOMIC_RELEASE);
+}
+
+LOCAL void job_counter_add(Job_Counter *counter)
+{
+    if (counter != NULL) {
+        __atomic_add_fetch(&counter->pending, 1, __ATOMIC_RELAXED);
+    }
+}
+
+LOCAL void job_deferred_release(Job_Deferred *deferred)
+{
+    if (__atomic_sub_fetch(&deferred->remaining, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
+    Job job = deferred->job;
+    job_data_free(deferred);
+    job_system_push(&job);
+}
+
+LOCAL void job_counter_signal(Job_Counter *counter)
+{
+    // Anything but the last decrement is a plain CAS, the counter may not be touched after it.
+    u32 pending = __atomic_load_n(&counter->pending, __ATOMIC_RELAXED);
+    while (pending > 1) {
+        if (__atomic_compare_exchange_n(&counter->pending, &pending, pending - 1, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+    ASSERT(pending == 1);
+
+    // The last one takes the lock, so a job registering as a waiter right now either sees a
+    // pending job and gets released here, or sees zero and does not wait at all. Waiters
+    // also check the lock, which keeps the counter alive until it is unlocked.
+    Job_Waiter *waiters = NULL;
+    job_counter_lock(counter);
+    if (__atomic_sub_fetch(&counter->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        waiters = counter->waiters;
+        counter->waiters = NULL;
+    }
+    job_counter_unlock(counter);
+
+    while (waiters != NULL) {
+        Job_Waiter *next = waiters->next; // the release may free the waiter
+        job_deferred_release(waiters->deferred);
+        waiters = next;
+    }
+}
+
+bool job_counter_is_done(Job_Counter *counter)
+{
+    ASSERT(counter);
+    return __atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) == 0 && __atomic_load_n(&counter->lock, __ATOMIC_ACQUIRE) == 0;
+}
+
+LOCAL u64 job_system_next_random(u64 *state)
+{
+    // xorshift64
+    u64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// 'self' is NULL on threads that own no deque.
+LOCAL bool job_system_find_job(Worker *self, u64 *random_state, Job *out_job)
+{
+    if (self != NULL && job_deque_pop(&self->deque, out_job)) {
+        return true;
+    }
+
+    if (job_inject_queue_dequeue(&job_system->inject_queue, out_job)) {
+        return true;
+    }
+
+    u32 count = job_system->workers_count;
+    if (count == 0) {
+        return false;
+    }
+
+    u32 first = (u32) (job_system_next_random(random_state) % count);
+    for (u32 i = 0; i < count; i++) {
+        Worker *victim = &job_system->workers[(first + i) % count];
+        if (victim != self && job_deque_steal(&victim->deque, out_job)) {
+            return true;
         }
-        pthread_mutex_unlock(&job_system->results_lock);
     }
+
+    return false;
+}
+
+LOCAL bool job_system_has_work(void)
+{
+    if (!job_inject_queue_is_empty(&job_system->inject_queue)) {
+        return true;
+    }
+
+    for (u32 i = 0; i < job_system->workers_count; i++) {
+        if (!job_deque_is_empty(&job_system->workers[i].deque)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+LOCAL void job_system_park(void)
+{
+    u32 epoch = __atomic_load_n(&job_system->wake_epoch, __ATOMIC_ACQUIRE);
+    __atomic_add_fetch(&job_system->sleepers, 1, __ATOMIC_SEQ_CST);
+
+    // A job submitted before the increment was either seen here, or its submitter saw the
+    // sleeper and bumped the epoch, in which case the wait returns right away.
+    if (__atomic_load_n(&job_system->running, __ATOMIC_ACQUIRE) && !job_system_has_work()) {
+        futex_wait(&job_system->wake_epoch, epoch);
+    }
+
+    __atomic_sub_fetch(&job_system->sleepers, 1, __ATOMIC_RELAXED);
+}
+
+LOCAL void job_system_post_result(Job *job, bool result)
+{
+    if (job->callback == NULL) {
+        if (job->result_data != NULL) {
+            job_data_free(job->result_data);
+        }
+        return;
+    }
+
+    Job_Result completion;
+    completion.status = result ? JOB_STATUS_COMPLETED : JOB_STATUS_FAILED;
+    completion.callback = job->callback;
+    completion.result_data = job->result_data;
+    completion.result_data_size = job->result_data_size;
+    if (job->result_data == NULL && job->result_data_size > 0) {
+        mem_copy(completion.inline_result, job_result_data(job), job->result_data_size);
+    }
+
+    bool posted = job_completion_queue_enqueue(&job_system->completions, &completion);
+    ASSERT_MSG(posted, "job result posted without a reserved slot");
+    UNUSED(posted);
+}
+
+LOCAL void job_system_run(Job *job)
+{
+    // Threads helping out while they wait have no context of their own.
+    Job_Context helper_context = {};
+    Job_Context *context = job_system_get_context();
+    if (context == NULL) {
+        context = &helper_context;
+        pthread_setspecific(job_system->context_key, context);
+    }
+
+    // Jobs run nested while their thread waits, so the outer job's counter comes back afterwards.
+    Job_Counter *outer_counter = context->counter;
+    context->counter = job->counter;
+    bool result = job->entry_point(job_param_data(job), job_result_data(job));
+    context->counter = outer_counter;
+
+    if (context == &helper_context) {
+        pthread_setspecific(job_system->context_key, NULL);
+    }
+
+    if (job->param_data != NULL) {
+        job_data_free(job->param_data);
+    }
+
+    job_system_post_result(job, result);
+
+    if (job->counter != NULL) {
+        job_counter_signal(job->counter);
+    }
+}
+
+LOCAL void *job_system_worker_function(void *arg)
+{
+    Worker *self = (Worker *) arg;
+    pthread_setspecific(job_system->context_key, &self->context);
+    LOG_INFO("spawning worker thread TID=%d\n", gettid());
+
+    while (__atomic_load_n(&job_system->running, __ATOMIC_ACQUIRE)) {
+        Job job;
+        bool found = false;
+        for (u32 spin = 0; spin < JOB_SYSTEM_SPIN_COUNT && !found; spin++) {
+            found = job_system_find_job(self, &self->random_state, &job);
+        }
+
+        if (found) {
+            job_system_run(&job);
+        } else {
+            job_system_park();
+        }
+    }
+
+    LOG_INFO("shutting down worker thread TID=%d\n", gettid());
+    return NULL;
 }
 
 bool job_system_init(Job_System *js, u8 num_workers)
@@ -66,86 +646,348 @@ bool job_system_init(Job_System *js, u8 num_workers)
     }
 
     job_system->workers_count = num_workers;
-    ring_queue_reserve_tagged(&job_system->job_queue, JOB_SYSTEM_MAX_NUM_RESULTS, sizeof(Job), MEMORY_TAG_JOB);
-    pthread_mutex_init(&job_system->job_queue_lock, NULL);
-    pthread_cond_init(&job_system->job_queue_notify, NULL);
-    pthread_mutex_init(&job_system->results_lock, NULL);
+    job_inject_queue_create(&job_system->inject_queue);
+    job_system->sleepers = 0;
+    job_system->wake_epoch = 0;
+    pthread_key_create(&job_system->context_key, NULL);
+    mem_zero(&job_system->shared_pool, sizeof(Job_Pool));
+    pthread_mutex_init(&job_system->shared_pool_lock, NULL);
+    job_completion_queue_create(&job_system->completions);
+    job_system->results_in_flight = 0;
     job_system->running = true;
 
     LOG_INFO("job system initialized with %hhu workers\n", job_system->workers_count);
 
-    for (u32 i = 0; i < JOB_SYSTEM_MAX_NUM_RESULTS; i++) {
-        job_system->results[i].empty = true;
+    // Every deque exists before any worker may try to steal from it.
+    for (u32 i = 0; i < num_workers; i++) {
+        Worker *worker = &job_system->workers[i];
+        job_deque_create(&worker->deque);
+        worker->random_state = 0x9E3779B97F4A7C15ULL * (i + 1);
+        worker->context.worker = worker;
+        worker->context.counter = NULL;
+        mem_zero(&worker->pool, sizeof(Job_Pool));
     }
 
     for (u32 i = 0; i < num_workers; i++) {
-        pthread_create(&job_system->workers[i].thread, NULL, job_system_worker_function, job_system);
+        pthread_create(&job_system->workers[i].thread, NULL, job_system_worker_function, &job_system->workers[i]);
     }
 
     return true;
 }
 
+LOCAL void job_system_discard(Job *job)
+{
+    if (job->param_data != NULL) {
+        job_data_free(job->param_data);
+    }
+    if (job->result_data != NULL) {
+        job_data_free(job->result_data);
+    }
+}
+
 void job_system_shutdown(void)
 {
     ASSERT(job_system != NULL);
 
-    job_system->running = false;
-
-    pthread_cond_broadcast(&job_system->job_queue_notify);
+    __atomic_store_n(&job_system->running, false, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&job_system->wake_epoch, 1, __ATOMIC_RELEASE);
+    futex_wake(&job_system->wake_epoch, JOB_SYSTEM_MAX_NUM_WORKERS);
 
     for (u32 i = 0; i < job_system->workers_count; i++) {
         pthread_join(job_system->workers[i].thread, NULL);
     }
 
-    pthread_mutex_destroy(&job_system->job_queue_lock);
-    pthread_cond_destroy(&job_system->job_queue_notify);
-    pthread_mutex_destroy(&job_system->results_lock);
-    ring_queue_destroy(&job_system->job_queue);
+    // Jobs that never ran still own their copies.
+    Job job;
+    for (u32 i = 0; i < job_system->workers_count; i++) {
+        while (job_deque_pop(&job_system->workers[i].deque, &job)) {
+            job_system_discard(&job);
+        }
+        job_deque_destroy(&job_system->workers[i].deque);
+    }
+    while (job_inject_queue_dequeue(&job_system->inject_queue, &job)) {
+        job_system_discard(&job);
+    }
+    job_inject_queue_destroy(&job_system->inject_queue);
+
+    Job_Result result;
+    while (job_completion_queue_dequeue(&job_system->completions, &result)) {
+        if (result.result_data != NULL) {
+            job_data_free(result.result_data);
+        }
+    }
+    job_completion_queue_destroy(&job_system->completions);
+
+    // Every block is back in its pool now, apart from those of jobs still waiting on dependencies.
+    for (u32 i = 0; i < job_system->workers_count; i++) {
+        job_pool_destroy(&job_system->workers[i].pool);
+    }
+    job_pool_destroy(&job_system->shared_pool);
+    pthread_mutex_destroy(&job_system->shared_pool_lock);
+
+    pthread_key_delete(job_system->context_key);
 
     LOG_INFO("job system shutdown complete\n");
 }
 
-void job_system_update(void)
+void job_system_update(u64 time_budget_ns)
+{
+    ASSERT(job_system != NULL);
+
+    // Workers keep posting while the callbacks run, nothing is locked.
+    u64 start = clock_get_absolute_time_ns();
+    Job_Result result;
+    while (job_completion_queue_dequeue(&job_system->completions, &result)) {
+        void *result_data = result.result_data;
+        if (result_data == NULL && result.result_data_size > 0) {
+            result_data = result.inline_result;
+        }
+
+        result.callback(result.status, result_data);
+        if (result.result_data != NULL) {
+            job_data_free(result.result_data);
+        }
+        __atomic_sub_fetch(&job_system->results_in_flight, 1, __ATOMIC_RELEASE);
+
+        if (time_budget_ns > 0 && clock_get_absolute_time_ns() - start >= time_budget_ns) {
+            break;
+        }
+    }
+}
+
+LOCAL bool job_system_reserve_result(void)
+{
+    u32 in_flight = __atomic_load_n(&job_system->results_in_flight, __ATOMIC_RELAXED);
+    do {
+        if (in_flight >= JOB_SYSTEM_MAX_NUM_RESULTS) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&job_system->results_in_flight, &in_flight, in_flight + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    return true;
+}
+
+LOCAL Job job_system_make_job(pfn_job_entry_point entry_point, void *param_data, u64 param_data_size, pfn_job_callback callback, u64 result_data_size, Job_Counter *counter)
+{
+    Job job = {};
+    job.entry_point = entry_point;
+    job.param_data_size = param_data_size;
+    job.callback = callback;
+    job.result_data_size = result_data_size;
+    job.counter = counter;
+
+    u64 inline_used = 0;
+    if (param_data_size > JOB_INLINE_DATA_SIZE) {
+        job.param_data = job_data_alloc(param_data_size);
+        mem_copy(job.param_data, param_data, param_data_size);
+    } else if (param_data_size > 0) {
+        mem_copy(job.inline_data, param_data, param_data_size);
+        inline_used = job_data_align(param_data_size);
+    }
+
+    // Results start out zeroed, the inline ones are already.
+    if (result_data_size > JOB_INLINE_DATA_SIZE - inline_used) {
+        job.result_data = job_data_alloc(result_data_size);
+        mem_zero(job.result_data, result_data_size);
+    }
+
+    return job;
+}
+
+bool job_system_submit(pfn_job_entry_point entry_point, void *param_data, u64 param_data_size, pfn_job_callback callback, u64 result_data_size)
+{
+    ASSERT(job_system != NULL);
+
+    if (callback != NULL && !job_system_reserve_result()) {
+        return false;
+    }
+
+    Job job = job_system_make_job(entry_point, param_data, param_data_size, callback, result_data_size, NULL);
+    job_system_push(&job);
+    return true;
+}
+
+void job_system_submit_counted(pfn_job_entry_point entry_point, void *param_data, u64 param_data_size, Job_Counter *counter)
+{
+    ASSERT(job_system != NULL);
+
+    job_counter_add(counter);
+    Job job = job_system_make_job(entry_point, param_data, param_data_size, NULL, 0, counter);
+    job_system_push(&job);
+}
+
+void job_system_submit_after(Job_Counter **dependencies, u32 dependency_count, pfn_job_entry_point entry_point, void *param_data, u64 param_data_size, Job_Counter *counter)
+{
+    ASSERT(job_system != NULL);
+    ASSERT(dependencies != NULL || dependency_count == 0);
+
+    job_counter_add(counter);
+
+    u64 size = sizeof(Job_Deferred) + dependency_count * sizeof(Job_Waiter);
+    Job_Deferred *deferred = (Job_Deferred *) job_data_alloc(size);
+    deferred->job = job_system_make_job(entry_point, param_data, param_data_size, NULL, 0, counter);
+    deferred->remaining = dependency_count + 1;
+    deferred->dependency_count = dependency_count;
+
+    Job_Waiter *waiters = (Job_Waiter *) (deferred + 1);
+    for (u32 i = 0; i < dependency_count; i++) {
+        Job_Counter *dependency = dependencies[i];
+        bool done = true;
+
+        if (dependency != NULL) {
+            job_counter_lock(dependency);
+            done = __atomic_load_n(&dependency->pending, __ATOMIC_ACQUIRE) == 0;
+            if (!done) {
+                waiters[i].deferred = deferred;
+                waiters[i].next = dependency->waiters;
+                dependency->waiters = &waiters[i];
+            }
+            job_counter_unlock(dependency);
+        }
+
+        if (done) {
+            // Cannot reach zero, the submitter still holds its own reference.
+            __atomic_sub_fetch(&deferred->remaining, 1, __ATOMIC_ACQ_REL);
+        }
+    }
+
+    job_deferred_release(deferred);
+}
+
+void job_system_submit_child(pfn_job_entry_point entry_point, void *param_data, u64 param_data_size)
+{
+    job_system_submit_counted(entry_point, param_data, param_data_size, job_system_current_counter());
+}
+
+Job_Counter *job_system_current_counter(void)
 {
     ASSERT(job_system != NULL);
 
-    pthread_mutex_lock(&job_system->results_lock);
-    for (u32 i = 0; i < JOB_SYSTEM_MAX_NUM_RESULTS; i++) {
-        if (!job_system->results[i].empty) {
-            Job_Result *result = &job_system->results[i];
-            result->callback(result->status, result->result_data);
-            mem_free(result->result_data, result->result_data_size, MEMORY_TAG_JOB);
-            result->empty = true;
+    Job_Context *context = job_system_get_context();
+    return context != NULL ? context->counter : NULL;
+}
+
+void job_system_wait(Job_Counter *counter)
+{
+    ASSERT(job_system != NULL);
+    ASSERT(counter);
+
+    Job_Context *context = job_system_get_context();
+    Worker *self = context != NULL ? context->worker : NULL;
+    u64 helper_random_state = (u64) counter | 1;
+    u64 *random_state = self != NULL ? &self->random_state : &helper_random_state;
+
+    while (!job_counter_is_done(counter)) {
+        Job job;
+        if (job_system_find_job(self, random_state, &job)) {
+            job_system_run(&job);
+        } else {
+            sched_yield();
         }
     }
-    pthread_mutex_unlock(&job_system->results_lock);
 }
 
-void job_system_submit(pfn_job_entry_point entry_point, void *param_data, u64 param_data_size, pfn_job_callback callback, u64 result_data_size)
+typedef struct {
+    pfn_job_parallel_for fn;
+    pfn_job_parallel_reduce reduce_fn;
+    void *context;
+    u64 begin;
+    u64 end;
+    void *accumulator; // reduce only
+} Job_Parallel_Chunk;
+
+LOCAL bool job_parallel_chunk_entry_point(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Job_Parallel_Chunk *chunk = (Job_Parallel_Chunk *) param_data;
+    if (chunk->fn != NULL) {
+        chunk->fn(chunk->begin, chunk->end, chunk->context);
+    } else {
+        chunk->reduce_fn(chunk->begin, chunk->end, chunk->context, chunk->accumulator);
+    }
+    return true;
+}
+
+LOCAL u64 job_parallel_chunk_size(u64 count, u64 grain)
+{
+    u64 threads = (u64) job_system->workers_count + 1;
+    u64 target_chunks = threads * JOB_PARALLEL_CHUNKS_PER_THREAD;
+    u64 chunk_size = (count + target_chunks - 1) / target_chunks;
+    return chunk_size > grain ? chunk_size : (grain > 0 ? grain : 1);
+}
+
+// Runs the first chunk on the calling thread, the others as jobs.
+LOCAL void job_parallel_run(Job_Parallel_Chunk *chunk_template, u64 begin, u64 end, u64 chunk_size, u8 *accumulators, u64 accumulator_stride)
+{
+    Job_Counter counter = {};
+    Job_Parallel_Chunk chunk = *chunk_template;
+
+    u64 index = 1;
+    for (u64 chunk_begin = begin + chunk_size; chunk_begin < end; chunk_begin += chunk_size, index++) {
+        chunk.begin = chunk_begin;
+        chunk.end = end - chunk_begin > chunk_size ? chunk_begin + chunk_size : end;
+        chunk.accumulator = accumulators != NULL ? accumulators + index * accumulator_stride : NULL;
+        job_system_submit_counted(job_parallel_chunk_entry_point, &chunk, sizeof(chunk), &counter);
+    }
+
+    chunk.begin = begin;
+    chunk.end = end - begin > chunk_size ? begin + chunk_size : end;
+    chunk.accumulator = accumulators;
+    job_parallel_chunk_entry_point(&chunk, NULL);
+
+    job_system_wait(&counter);
+}
+
+void job_parallel_for(u64 begin, u64 end, u64 grain, pfn_job_parallel_for fn, void *context)
 {
     ASSERT(job_system != NULL);
+    ASSERT(fn);
+
+    if (begin >= end) {
+        return;
+    }
+
+    u64 chunk_size = job_parallel_chunk_size(end - begin, grain);
+    if (end - begin <= chunk_size) {
+        fn(begin, end, context);
+        return;
+    }
 
-    void *param_data_copy = mem_alloc(param_data_size, MEMORY_TAG_JOB);
-    mem_copy(param_data_copy, param_data, param_data_size);
+    Job_Parallel_Chunk chunk = { .fn = fn, .reduce_fn = NULL, .context = context, .begin = 0, .end = 0, .accumulator = NULL };
+    job_parallel_run(&chunk, begin, end, chunk_size, NULL, 0);
+}
 
-    Job job = {
-        .entry_point = entry_point,
-        .param_data = param_data_copy,
-        .param_data_size = param_data_size,
-        .callback = callback,
-        .result_data = mem_alloc(result_data_size, MEMORY_TAG_JOB),
-        .result_data_size = result_data_size
-    };
+void job_parallel_reduce(u64 begin, u64 end, u64 grain, pfn_job_parallel_reduce fn, pfn_job_reduce_combine combine, void *context, void *result, u64 result_size)
+{
+    ASSERT(job_system != NULL);
+    ASSERT(fn && combine);
+    ASSERT(result && result_size > 0);
 
-    pthread_mutex_lock(&job_system->job_queue_lock);
+    if (begin >= end) {
+        return;
+    }
 
-    if (!ring_queue_enqueue(&job_system->job_queue, &job)) {
-        LOG_ERROR("failed to enqueue a job\n");
-        pthread_mutex_unlock(&job_system->job_queue_lock);
+    u64 chunk_size = job_parallel_chunk_size(end - begin, grain);
+    if (end - begin <= chunk_size) {
+        fn(begin, end, context, result);
         return;
+    }
+
+    u64 chunk_count = (end - begin + chunk_size - 1) / chunk_size;
+    u64 stride = job_data_align(result_size);
+    u8 *accumulators = (u8 *) job_data_alloc(chunk_count * stride);
+    for (u64 i = 0; i < chunk_count; i++) {
+        mem_copy(accumulators + i * stride, result, result_size);
+    }
+
+    Job_Parallel_Chunk chunk = { .fn = NULL, .reduce_fn = fn, .context = context, .begin = 0, .end = 0, .accumulator = NULL };
+    job_parallel_run(&chunk, begin, end, chunk_size, accumulators, stride);
 
+    // The first chunk started from the identity as well, so it replaces it rather than being folded in.
+    mem_copy(result, accumulators, result_size);
+    for (u64 i = 1; i < chunk_count; i++) {
+        combine(result, accumulators + i * stride, context);
     }
 
-    pthread_mutex_unlock(&job_system->job_queue_lock);
-    pthread_cond_signal(&job_system->job_queue_notify);
+    job_data_free(accumulators);
 }
@@ -3,10 +3,18 @@
 #include <pthread.h>
 
 #include "defines.h"
-#include "collections/ring_queue.h"
 
-#define JOB_SYSTEM_MAX_NUM_WORKERS 8
-#define JOB_SYSTEM_MAX_NUM_RESULTS 256
+#define JOB_SYSTEM_MAX_NUM_WORKERS 32
+#define JOB_SYSTEM_MAX_NUM_RESULTS 256 // power of two, jobs with a callback whose callback did not run yet
+#define JOB_DEQUE_CAPACITY 4096        // per worker, power of two, a job submitted to a full deque runs right away
+#define JOB_INJECT_QUEUE_CAPACITY 1024 // power of two, jobs submitted from outside the workers
+#define JOB_SYSTEM_SPIN_COUNT 64       // rounds of looking for work before an idle worker parks
+#define JOB_CACHE_LINE_SIZE 64
+#define JOB_INLINE_DATA_SIZE 64        // params and result of a job stored in the job itself, no allocation
+#define JOB_DATA_ALIGNMENT 16
+#define JOB_POOL_SIZE_CLASS_COUNT 6    // pooled blocks of 128 bytes up to 4 KiB, anything larger is allocated
+#define JOB_POOL_MIN_BLOCK_SIZE 128
+#define JOB_PARALLEL_CHUNKS_PER_THREAD 4 // chunks per thread when splitting a range, leaves room to even out uneven chunks
 
 typedef enum {
     JOB_STATUS_FAILED,
@@ -15,7 +23,33 @@ typedef enum {
 
 typedef bool (*pfn_job_entry_point)(void *param_data, void *result_data);
 typedef void (*pfn_job_callback)(Job_Status status, void *result_data);
+// Processes the indices in [begin, end).
+typedef void (*pfn_job_parallel_for)(u64 begin, u64 end, void *context);
+// Folds the indices in [begin, end) into 'accumulator'.
+typedef void (*pfn_job_parallel_reduce)(u64 begin, u64 end, void *context, void *accumulator);
+// Folds 'other' into 'accumulator'.
+typedef void (*pfn_job_reduce_combine)(void *accumulator, const void *other, void *context);
 
+typedef struct Job_Waiter Job_Waiter;
+
+/*
+ * Handle for a group of jobs. Every job submitted with a counter increments it and
+ * decrements it once it finished, so the counter reaches zero when the whole group is done.
+ * Jobs may be submitted to run only after other counters reached zero, which makes it
+ * possible to describe a frame as a graph of jobs without going back to the main thread
+ * between the stages. Waiting jobs are released every time the counter reaches zero, so a
+ * stage has to be submitted in full before anything is submitted after it. Zero initialize
+ * it, and keep it alive until it is done and nothing else waits on it.
+ */
+typedef struct {
+    u32 pending; // atomic, jobs submitted with this counter that did not finish yet
+    u32 lock;    // atomic spin lock, orders the last decrement against new waiters
+    Job_Waiter *waiters; // jobs to release when 'pending' reaches zero
+} Job_Counter;
+
+// Params and result that fit into 'inline_data' together live there, the pointers are
+// NULL then, since a job is copied around between the queues. Larger ones come from the
+// Job_Pool of the submitting thread.
 typedef struct {
     pfn_job_entry_point entry_point;
     void *param_data;
@@ -23,32 +57,155 @@ typedef struct {
     pfn_job_callback callback;
     void *result_data;
     u64 result_data_size;
+    Job_Counter *counter; // signalled when the job finished, may be NULL
+    alignas(JOB_DATA_ALIGNMENT) u8 inline_data[JOB_INLINE_DATA_SIZE];
 } Job;
 
+typedef struct Job_Pool_Block Job_Pool_Block;
+
+/*
+ * Free lists of job data blocks in power of two size classes. Only the owning thread takes
+ * blocks from 'free_blocks' and gives its own blocks back there, other threads push blocks
+ * they are done with to 'returned_blocks', which the owner takes over all at once when its
+ * own list runs dry. Taking the whole list instead of popping single blocks rules out ABA.
+ * Blocks are kept until the job system shuts down.
+ */
+typedef struct {
+    Job_Pool_Block *free_blocks[JOB_POOL_SIZE_CLASS_COUNT];
+    alignas(JOB_CACHE_LINE_SIZE) Job_Pool_Block *returned_blocks[JOB_POOL_SIZE_CLASS_COUNT]; // atomic
+} Job_Pool;
+
+/*
+ * Chase-Lev work-stealing deque. The owning worker pushes and pops at the bottom without
+ * any atomic read-modify-write, other workers steal from the top with a CAS, which only
+ * contends with the owner when one job is left. The capacity is fixed, so a push fails
+ * instead of growing the buffer under the thieves' feet.
+ */
+typedef struct {
+    alignas(JOB_CACHE_LINE_SIZE) i64 top; // atomic, advanced by thieves and by the owner taking the last job
+    alignas(JOB_CACHE_LINE_SIZE) i64 bottom; // atomic, only written by the owner
+    Job *jobs; // JOB_DEQUE_CAPACITY of them
+} Job_Deque;
+
+void job_deque_create(Job_Deque *deque);
+void job_deque_destroy(Job_Deque *deque);
+bool job_deque_push(Job_Deque *deque, const Job *job); // Owner only, false when full.
+bool job_deque_pop(Job_Deque *deque, Job *out_job);    // Owner only, newest first.
+bool job_deque_steal(Job_Deque *deque, Job *out_job);  // Any thread, oldest first. May fail spuriously under contention.
+bool job_deque_is_empty(Job_Deque *deque);
+
+typedef struct {
+    u64 sequence; // atomic, tells producers and consumers whose turn the cell is
+    Job job;
+} Job_Inject_Cell;
+
+// Bounded multi-producer multi-consumer queue (Vyukov) for jobs submitted by threads that own no deque.
 typedef struct {
+    Job_Inject_Cell *cells; // JOB_INJECT_QUEUE_CAPACITY of them
+    alignas(JOB_CACHE_LINE_SIZE) u64 enqueue_position; // atomic
+    alignas(JOB_CACHE_LINE_SIZE) u64 dequeue_position; // atomic
+} Job_Inject_Queue;
+
+typedef struct Worker Worker;
+
+// What the calling thread is running, kept in thread specific data rather than in a
+// thread_local, so that every copy of this code (see Job_System) sees the same one.
+typedef struct {
+    Worker *worker;       // NULL on threads that only run jobs while waiting on a counter
+    Job_Counter *counter; // of the job running right now, children of it are added to it
+} Job_Context;
+
+struct Worker {
     pthread_t thread;
-} Worker;
+    Job_Deque deque;
+    u64 random_state; // picks the first victim to steal from, worker only
+    Job_Context context;
+    Job_Pool pool;
+};
 
 typedef struct {
-    bool empty;
     Job_Status status;
     pfn_job_callback callback;
-    void *result_data;
+    void *result_data; // NULL when the result is in 'inline_result'
     u64 result_data_size;
+    alignas(JOB_DATA_ALIGNMENT) u8 inline_result[JOB_INLINE_DATA_SIZE];
 } Job_Result;
 
+typedef struct {
+    u64 sequence; // atomic, same protocol as Job_Inject_Cell
+    Job_Result result;
+} Job_Completion_Cell;
+
+// Bounded multi-producer single-consumer queue of finished jobs whose callback has to run
+// on the thread calling job_system_update. Slots are reserved when the job is submitted,
+// so a worker finishing a job always finds room.
+typedef struct {
+    Job_Completion_Cell *cells; // JOB_SYSTEM_MAX_NUM_RESULTS of them
+    alignas(JOB_CACHE_LINE_SIZE) u64 enqueue_position; // atomic
+    alignas(JOB_CACHE_LINE_SIZE) u64 dequeue_position; // consumer only
+} Job_Completion_Queue;
+
+/*
+ * Every worker runs the jobs of its own deque, newest first, and once that is empty takes
+ * the jobs submitted from outside and then steals from the other workers, starting at a
+ * random one. Jobs submitted by a job go to the deque of the worker running it, so work that
+ * fans out stays on one core until others run dry and come to take it.
+ *
+ * A worker that finds nothing spins for a bit and then parks on 'wake_epoch' (an event count
+ * on a futex). Submitting only bumps the epoch and wakes a worker when one is parked, so
+ * a busy system never makes a system call to hand out work.
+ *
+ * All state lives here rather than in the translation unit, because the hot-reloadable game
+ * library runs its own copy of the code against the same Job_System.
+ */
 typedef struct {
     u8 workers_count;
     Worker workers[JOB_SYSTEM_MAX_NUM_WORKERS];
-    pthread_mutex_t job_queue_lock;
-    pthread_cond_t job_queue_notify;
-    Ring_Queue job_queue;
-    pthread_mutex_t results_lock;
-    Job_Result results[JOB_SYSTEM_MAX_NUM_RESULTS];
-    bool running;
+    Job_Inject_Queue inject_queue;
+    alignas(JOB_CACHE_LINE_SIZE) u32 sleepers; // atomic, workers parked or about to park
+    alignas(JOB_CACHE_LINE_SIZE) u32 wake_epoch; // atomic, futex word
+    pthread_key_t context_key; // Job_Context of the calling thread
+    Job_Pool shared_pool; // for threads that are not workers
+    pthread_mutex_t shared_pool_lock; // guards its 'free_blocks', there may be more than one such thread
+    Job_Completion_Queue completions;
+    alignas(JOB_CACHE_LINE_SIZE) u32 results_in_flight; // atomic, reserved on submit, released after the callback
+    bool running; // atomic
 } Job_System;
 
 bool job_system_init(Job_System *js, u8 num_workers);
+// Results still waiting for their callback are freed without running it.
 void job_system_shutdown(void);
-void job_system_update(void);
-void job_system_submit(pfn_job_entry_point entry_point, void *param_data, u64 param_data_size, pfn_job_callback callback, u64 result_data_size);
+// Runs the callbacks of finished jobs until none are left or 'time_budget_ns' ran out, the
+// rest wait for the next call. At least one runs per call, 0 runs all of them.
+void job_system_update(u64 time_budget_ns);
+// 'callback' may be NULL for jobs whose result nobody waits for, those never take a result slot.
+// Returns false without submitting when JOB_SYSTEM_MAX_NUM_RESULTS callbacks are pending
+// already, the caller may retry after the next job_system_update.
+bool job_system_submit(pfn_job_entry_point entry_point, void *param_data, u64 param_data_size, pfn_job_callback callback, u64 result_data_size);
+// Adds the job to 'counter', the job gets no result buffer and no callback.
+void job_system_submit_counted(pfn_job_entry_point entry_point, void *param_data, u64 param_data_size, Job_Counter *counter);
+// Adds the job to 'counter' right away, but only runs it once every one of 'dependencies'
+// reached zero. Jobs still waiting on their dependencies at shutdown never run.
+void job_system_submit_after(Job_Counter **dependencies, u32 dependency_count, pfn_job_entry_point entry_point, void *param_data, u64 param_data_size, Job_Counter *counter);
+// Called from inside a job, adds the child to the counter of the running job, so whoever
+// waits on the parent also waits on its children.
+void job_system_submit_child(pfn_job_entry_point entry_point, void *param_data, u64 param_data_size);
+// The counter of the job the calling thread runs, NULL outside of jobs.
+Job_Counter *job_system_current_counter(void);
+
+bool job_counter_is_done(Job_Counter *counter);
+// Runs other jobs until 'counter' reached zero. May be called from the main thread and from
+// inside jobs, a waiting job never keeps a worker idle.
+void job_system_wait(Job_Counter *counter);
+
+/*
+ * Splits [begin, end) into chunks of at least 'grain' indices, or of a size picked from the
+ * number of threads when 'grain' is 0, runs them as jobs and returns once all of them are
+ * done. The calling thread works on the chunks as well, so this may be called from the main
+ * thread and from inside jobs alike.
+ */
+void job_parallel_for(u64 begin, u64 end, u64 grain, pfn_job_parallel_for fn, void *context);
+// Like job_parallel_for, every chunk starts from a copy of what 'result' holds on entry, which
+// has to be the identity of 'combine'. The chunks are combined in index order, so the result
+// does not depend on the scheduling even for operations like floating point sums.
+void job_parallel_reduce(u64 begin, u64 end, u64 grain, pfn_job_parallel_reduce fn, pfn_job_reduce_combine combine, void *context, void *result, u64 result_size);
@@ -15,6 +15,7 @@ LOCAL const char *memory_tag_strings[MEMORY_TAG_COUNT] = {
     "darray    ",
     "gen_arena ",
     "gen_ring  ",
+    "hash_map  ",
     "renderer2d",
     "game      ",
     "opengl    ",
@@ -38,13 +39,14 @@ void* mem_alloc(u64 size, Memory_Tag tag)
     ASSERT(size > 0);
     ASSERT(tag >= MEMORY_TAG_UNKNOWN && tag < MEMORY_TAG_COUNT);
 
-    stats->total_allocated += size;
+    // Jobs allocate and free on the worker threads.
+    __atomic_add_fetch(&stats->total_allocated, size, __ATOMIC_RELAXED);
 
     if (tag == MEMORY_TAG_UNKNOWN) {
         LOG_WARN("memory allocation of tag 'unknown' - consider re-tagging");
     }
 
-    stats->tagged_allocations[tag] += size;
+    __atomic_add_fetch(&stats->tagged_allocations[tag], size, __ATOMIC_RELAXED);
 
     void *memory = malloc(size);
     mem_zero(memory, size);
@@ -57,9 +59,9 @@ void mem_free(void* memory, u64 size, Memory_Tag tag)
     ASSERT(memory);
     ASSERT(size > 0);
     ASSERT(tag >= MEMORY_TAG_UNKNOWN && tag < MEMORY_TAG_COUNT);
-    ASSERT(stats->tagged_allocations[tag] > 0);
+    ASSERT(__atomic_load_n(&stats->tagged_allocations[tag], __ATOMIC_RELAXED) > 0);
 
-    stats->tagged_allocations[tag] -= size;
+    __atomic_sub_fetch(&stats->tagged_allocations[tag], size, __ATOMIC_RELAXED);
     free(memory);
 }
 
@@ -91,7 +93,7 @@ char* memory_usage_as_cstr(void)
     u64 total = 0;
     for (i32 i = 0; i < MEMORY_TAG_COUNT; i++) {
         f32 usage;
-        const char *unit = get_size_unit(stats->tagged_allocations[i], &usage);
+        const char *unit = get_size_unit(__atomic_load_n(&stats->tagged_allocations[i], __ATOMIC_RELAXED), &usage);
         i32 length = snprintf(buffer + offset, 1024 - offset, "  %s: %.02f %s\n", memory_tag_strings[i], usage, unit);
         offset += length;
         total += stats->tagged_allocations[i];
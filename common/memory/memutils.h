@@ -9,6 +9,7 @@ typedef enum {
     MEMORY_TAG_DARRAY,
     MEMORY_TAG_GENERIC_ARENA,
     MEMORY_TAG_GENERIC_RING,
+    MEMORY_TAG_HASH_MAP,
     MEMORY_TAG_RENDERER2D,
     MEMORY_TAG_GAME,
     MEMORY_TAG_OPENGL,
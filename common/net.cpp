@@ -1,6 +1,9 @@
 #include "net.h"
 
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include "asserts.h"
 
@@ -11,6 +14,22 @@ void net_init(Net_Stat *ns)
     net_stat = ns;
 }
 
+bool net_set_nonblocking(i32 socket)
+{
+    i32 flags = fcntl(socket, F_GETFL, 0);
+    if (flags == -1) {
+        return false;
+    }
+
+    return fcntl(socket, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+bool net_set_nodelay(i32 socket)
+{
+    i32 yes = 1;
+    return setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)) != -1;
+}
+
 i64 net_send(i32 socket, const void *buffer, u64 size, i32 flags)
 {
     ASSERT_MSG(net_stat, "net_send: net_stat not initialized");
@@ -35,6 +54,48 @@ i64 net_recv(i32 socket, void *buffer, u64 size, i32 flags)
     return bytes_read;
 }
 
+i64 net_writev(i32 socket, const struct iovec *iov, i32 iov_count)
+{
+    ASSERT_MSG(net_stat, "net_writev: net_stat not initialized");
+
+    // sendmsg instead of writev, because only send* calls accept MSG_NOSIGNAL.
+    struct msghdr message = {};
+    message.msg_iov = (struct iovec *) iov;
+    message.msg_iovlen = (u64) iov_count;
+
+    i64 bytes_sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    if (bytes_sent > 0) {
+        net_stat->bpp_up += bytes_sent;
+    }
+
+    return bytes_sent;
+}
+
+i64 net_recvfrom(i32 socket, void *buffer, u64 size, struct sockaddr_storage *out_address, socklen_t *out_address_length)
+{
+    ASSERT_MSG(net_stat, "net_recvfrom: net_stat not initialized");
+
+    *out_address_length = sizeof(struct sockaddr_storage);
+    i64 bytes_read = recvfrom(socket, buffer, size, 0, (struct sockaddr *) out_address, out_address_length);
+    if (bytes_read > 0) {
+        net_stat->bpp_down += bytes_read;
+    }
+
+    return bytes_read;
+}
+
+i32 net_sendmmsg(i32 socket, struct mmsghdr *messages, u32 count)
+{
+    ASSERT_MSG(net_stat, "net_sendmmsg: net_stat not initialized");
+
+    i32 sent = sendmmsg(socket, messages, count, MSG_NOSIGNAL);
+    for (i32 i = 0; i < sent; i++) {
+        net_stat->bpp_up += messages[i].msg_len;
+    }
+
+    return sent;
+}
+
 void net_get_bandwidth(u64 *up, u64 *down)
 {
     ASSERT_MSG(net_stat, "net_get_bandwidth: net_stat not initialized");
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <sys/uio.h>
+#include <sys/socket.h>
+
 #include "defines.h"
 
 #define NET_STAT_UPDATE_PERIOD 0.5f
@@ -13,7 +16,12 @@ typedef struct {
 } Net_Stat;
 
 void net_init(Net_Stat *ns);
+bool net_set_nonblocking(i32 socket);
+bool net_set_nodelay(i32 socket); // Disables Nagle's algorithm, for callers that batch their own writes.
 i64 net_send(i32 socket, const void *buffer, u64 size, i32 flags);
 i64 net_recv(i32 socket, void *buffer, u64 size, i32 flags);
+i64 net_writev(i32 socket, const struct iovec *iov, i32 iov_count); // Never raises SIGPIPE.
+i64 net_recvfrom(i32 socket, void *buffer, u64 size, struct sockaddr_storage *out_address, socklen_t *out_address_length);
+i32 net_sendmmsg(i32 socket, struct mmsghdr *messages, u32 count); // Returns how many of the datagrams were sent.
 void net_get_bandwidth(u64 *up, u64 *down);
 void net_update(f32 dt);
@@ -10,15 +10,15 @@
 #include "asserts.h"
 #include "memory/memutils.h"
 
-u32 serialize_packet_txt_msg(const Packet_Text_Message *packet, u8 **buffer)
+u32 payload_size_packet_txt_msg(const Packet_Text_Message *packet)
 {
-    u32 payload_size = sizeof(packet->length) + packet->length;
-    *buffer = (u8 *) mem_alloc(sizeof(Packet_Header) + payload_size, MEMORY_TAG_NETWORK);
-
-    memcpy(*buffer + sizeof(Packet_Header), &packet->length, sizeof(packet->length));
-    memcpy(*buffer + sizeof(Packet_Header) + sizeof(packet->length), packet->message, packet->length);
+    return sizeof(packet->length) + packet->length;
+}
 
-    return payload_size;
+void serialize_packet_txt_msg(const Packet_Text_Message *packet, u8 *payload)
+{
+    memcpy(payload, &packet->length, sizeof(packet->length));
+    memcpy(payload + sizeof(packet->length), packet->message, packet->length);
 }
 
 void deserialize_packet_txt_msg(void *data, Packet_Text_Message *packet)
@@ -31,22 +31,22 @@ void deserialize_packet_txt_msg(void *data, Packet_Text_Message *packet)
     packet->message = (char *) ((u8 *) data + sizeof(length));
 }
 
-u32 serialize_packet_player_batch_move(const Packet_Player_Batch_Move *packet, u8 **buffer)
+u32 payload_size_packet_player_batch_move(const Packet_Player_Batch_Move *packet)
 {
-    u32 payload_size = (u32) (sizeof(packet->count) + (packet->count * sizeof(player_id)) + (packet->count * 3 * sizeof(f32)));
-    *buffer = (u8 *) mem_alloc(sizeof(Packet_Header) + payload_size, MEMORY_TAG_NETWORK);
+    return (u32) (sizeof(packet->count) + (packet->count * sizeof(player_id)) + (packet->count * 3 * sizeof(f32)));
+}
 
-    u32 offset = sizeof(Packet_Header);
+void serialize_packet_player_batch_move(const Packet_Player_Batch_Move *packet, u8 *payload)
+{
+    u32 offset = 0;
 
-    memcpy(*buffer + offset, &packet->count, sizeof(packet->count));
+    memcpy(payload + offset, &packet->count, sizeof(packet->count));
     offset += sizeof(packet->count);
 
-    memcpy(*buffer + offset, packet->ids, packet->count * sizeof(player_id));
+    memcpy(payload + offset, packet->ids, packet->count * sizeof(player_id));
     offset += (u32) (packet->count * sizeof(player_id));
 
-    memcpy(*buffer + offset, packet->positions, packet->count * 3 * sizeof(f32));
-
-    return payload_size;
+    memcpy(payload + offset, packet->positions, packet->count * 3 * sizeof(f32));
 }
 
 void deserialize_packet_player_batch_move(void *data, Packet_Player_Batch_Move *packet)
@@ -62,53 +62,281 @@ void deserialize_packet_player_batch_move(void *data, Packet_Player_Batch_Move *
     packet->positions = (f32 *) ((u8 *) data + sizeof(count) + count * sizeof(player_id));
 }
 
-bool packet_send(i32 socket, u32 type, void *packet_data)
+LOCAL u32 usernames_size_packet_world_snapshot(const Packet_World_Snapshot *packet)
+{
+    u32 size = 0;
+    for (u32 i = 0; i < packet->player_count; i++) {
+        size += packet->username_lengths[i];
+    }
+    return size;
+}
+
+u32 payload_size_packet_world_snapshot(const Packet_World_Snapshot *packet)
+{
+    return (u32) (sizeof(packet->player_count) +
+                  packet->player_count * (sizeof(player_id) + 3 * sizeof(f32) + 3 * sizeof(f32) + sizeof(u8)) +
+                  usernames_size_packet_world_snapshot(packet) +
+                  sizeof(packet->light_count) +
+                  packet->light_count * sizeof(Packet_Light_Update));
+}
+
+void serialize_packet_world_snapshot(const Packet_World_Snapshot *packet, u8 *payload)
+{
+    u32 count = packet->player_count;
+    u32 offset = 0;
+
+    memcpy(payload + offset, &count, sizeof(count));
+    offset += sizeof(count);
+
+    memcpy(payload + offset, packet->ids, count * sizeof(player_id));
+    offset += (u32) (count * sizeof(player_id));
+
+    memcpy(payload + offset, packet->colors, count * 3 * sizeof(f32));
+    offset += (u32) (count * 3 * sizeof(f32));
+
+    memcpy(payload + offset, packet->positions, count * 3 * sizeof(f32));
+    offset += (u32) (count * 3 * sizeof(f32));
+
+    memcpy(payload + offset, packet->username_lengths, count * sizeof(u8));
+    offset += (u32) (count * sizeof(u8));
+
+    u32 usernames_size = usernames_size_packet_world_snapshot(packet);
+    memcpy(payload + offset, packet->usernames, usernames_size);
+    offset += usernames_size;
+
+    memcpy(payload + offset, &packet->light_count, sizeof(packet->light_count));
+    offset += sizeof(packet->light_count);
+
+    // Only the first packet of a split snapshot carries the lights, the others have none.
+    if (packet->light_count > 0) {
+        memcpy(payload + offset, packet->lights, packet->light_count * sizeof(Packet_Light_Update));
+    }
+}
+
+void deserialize_packet_world_snapshot(void *data, Packet_World_Snapshot *packet)
+{
+    // Assuming the lifetime of void *data is longer than all the arrays pointing into it.
+    u8 *payload = (u8 *) data;
+    u32 count;
+    memcpy(&count, payload, sizeof(count));
+    packet->player_count = count;
+    payload += sizeof(count);
+
+    packet->ids = (player_id *) payload;
+    payload += count * sizeof(player_id);
+
+    packet->colors = (f32 *) payload;
+    payload += count * 3 * sizeof(f32);
+
+    packet->positions = (f32 *) payload;
+    payload += count * 3 * sizeof(f32);
+
+    packet->username_lengths = payload;
+    payload += count * sizeof(u8);
+
+    packet->usernames = (char *) payload;
+    payload += usernames_size_packet_world_snapshot(packet);
+
+    u32 light_count;
+    memcpy(&light_count, payload, sizeof(light_count));
+    packet->light_count = light_count;
+    payload += sizeof(light_count);
+
+    packet->lights = (Packet_Light_Update *) payload;
+}
+
+LOCAL bool payload_is_valid_world_snapshot(const u8 *payload, u64 payload_size)
+{
+    u32 count;
+    if (payload_size < sizeof(count)) {
+        return false;
+    }
+    memcpy(&count, payload, sizeof(count));
+
+    u64 lengths_offset = sizeof(count) + (u64) count * (sizeof(player_id) + 3 * sizeof(f32) + 3 * sizeof(f32));
+    u64 usernames_offset = lengths_offset + (u64) count * sizeof(u8);
+    if (payload_size < usernames_offset + sizeof(u32)) {
+        return false;
+    }
+
+    u64 usernames_size = 0;
+    for (u32 i = 0; i < count; i++) {
+        u8 length = payload[lengths_offset + i];
+        if (length > PLAYER_USERNAME_MAX_LEN) {
+            return false;
+        }
+        usernames_size += length;
+    }
+
+    u64 light_count_offset = usernames_offset + usernames_size;
+    u32 light_count;
+    if (payload_size < light_count_offset + sizeof(light_count)) {
+        return false;
+    }
+    memcpy(&light_count, payload + light_count_offset, sizeof(light_count));
+
+    return payload_size == light_count_offset + sizeof(light_count) + (u64) light_count * sizeof(Packet_Light_Update);
+}
+
+bool packet_payload_is_valid(u32 type, const u8 *payload, u64 payload_size)
+{
+    if (type <= PACKET_TYPE_HEADER || type >= NUM_OF_PACKET_TYPES) {
+        return false;
+    }
+
+    // Sizes are worked out in 64 bits, so a huge count in a short payload cannot wrap around.
+    switch (type) {
+        case PACKET_TYPE_TXT_MSG: {
+            u32 length;
+            if (payload_size < sizeof(length)) {
+                return false;
+            }
+            memcpy(&length, payload, sizeof(length));
+            return payload_size == sizeof(length) + (u64) length;
+        }
+        case PACKET_TYPE_PLAYER_BATCH_MOVE: {
+            u32 count;
+            if (payload_size < sizeof(count)) {
+                return false;
+            }
+            memcpy(&count, payload, sizeof(count));
+            return payload_size == sizeof(count) + (u64) count * (sizeof(player_id) + 3 * sizeof(f32));
+        }
+        case PACKET_TYPE_WORLD_SNAPSHOT: {
+            return payload_is_valid_world_snapshot(payload, payload_size);
+        }
+        case PACKET_TYPE_PLAYER_JOIN_REQ: {
+            Packet_Player_Join_Req packet;
+            if (payload_size != sizeof(packet)) {
+                return false;
+            }
+            memcpy(&packet, payload, sizeof(packet));
+            return packet.username_length <= PLAYER_USERNAME_MAX_LEN && packet.password_length <= PLAYER_PASSWORD_MAX_LEN;
+        }
+        case PACKET_TYPE_PLAYER_ADD: {
+            Packet_Player_Add packet;
+            if (payload_size != sizeof(packet)) {
+                return false;
+            }
+            memcpy(&packet, payload, sizeof(packet));
+            return packet.username_length <= PLAYER_USERNAME_MAX_LEN;
+        }
+        default: {
+            return payload_size == PACKET_TYPE_SIZE[type];
+        }
+    }
+}
+
+LOCAL Packet_Buffer *packet_buffer_alloc(u32 size)
+{
+    Packet_Buffer *buffer = (Packet_Buffer *) mem_alloc(sizeof(Packet_Buffer) + size, MEMORY_TAG_NETWORK);
+    buffer->data = (u8 *) (buffer + 1);
+    buffer->size = size;
+    buffer->ref_count = 1;
+    return buffer;
+}
+
+Packet_Buffer *packet_buffer_create(u32 type, void *packet_data)
 {
     ASSERT(type > PACKET_TYPE_NONE && type < NUM_OF_PACKET_TYPES);
     ASSERT(packet_data);
 
     Packet_Header header = { .type = type, .payload_size = 0 };
-    u8 *buffer = NULL;
 
     // Handle variable size packets differently.
-    // NOTE: serialize_packet_* functions allocate memory for both header and payload
     switch (type) {
         case PACKET_TYPE_TXT_MSG: {
-            header.payload_size = serialize_packet_txt_msg((Packet_Text_Message *) packet_data, &buffer);
+            header.payload_size = payload_size_packet_txt_msg((Packet_Text_Message *) packet_data);
         } break;
         case PACKET_TYPE_PLAYER_BATCH_MOVE: {
-            header.payload_size = serialize_packet_player_batch_move((Packet_Player_Batch_Move *) packet_data, &buffer);
+            header.payload_size = payload_size_packet_player_batch_move((Packet_Player_Batch_Move *) packet_data);
+        } break;
+        case PACKET_TYPE_WORLD_SNAPSHOT: {
+            header.payload_size = payload_size_packet_world_snapshot((Packet_World_Snapshot *) packet_data);
         } break;
         default: {
             // The packet is fixed size.
             header.payload_size = PACKET_TYPE_SIZE[type];
-            buffer = (u8 *) mem_alloc(sizeof(Packet_Header) + header.payload_size, MEMORY_TAG_NETWORK);
-            memcpy(buffer + sizeof(Packet_Header), packet_data, header.payload_size);
         }
     }
 
-    ASSERT(buffer != NULL);
+    Packet_Buffer *buffer = packet_buffer_alloc(sizeof(Packet_Header) + header.payload_size);
+
+    u8 *payload = buffer->data + sizeof(Packet_Header);
+    memcpy(buffer->data, (void *) &header, sizeof(Packet_Header));
+
+    switch (type) {
+        case PACKET_TYPE_TXT_MSG: {
+            serialize_packet_txt_msg((Packet_Text_Message *) packet_data, payload);
+        } break;
+        case PACKET_TYPE_PLAYER_BATCH_MOVE: {
+            serialize_packet_player_batch_move((Packet_Player_Batch_Move *) packet_data, payload);
+        } break;
+        case PACKET_TYPE_WORLD_SNAPSHOT: {
+            serialize_packet_world_snapshot((Packet_World_Snapshot *) packet_data, payload);
+        } break;
+        default: {
+            memcpy(payload, packet_data, header.payload_size);
+        }
+    }
+
+    return buffer;
+}
+
+Packet_Buffer *packet_buffer_create_raw(const void *bytes, u32 size)
+{
+    ASSERT(bytes);
+    ASSERT(size > 0);
+
+    Packet_Buffer *buffer = packet_buffer_alloc(size);
+    memcpy(buffer->data, bytes, size);
+    return buffer;
+}
+
+Packet_Buffer *packet_buffer_retain(Packet_Buffer *buffer)
+{
+    ASSERT(buffer);
+
+    u32 previous = __atomic_fetch_add(&buffer->ref_count, 1, __ATOMIC_RELAXED);
+    ASSERT(previous > 0);
+    UNUSED(previous);
+
+    return buffer;
+}
+
+void packet_buffer_release(Packet_Buffer *buffer)
+{
+    ASSERT(buffer);
 
-    memcpy(buffer, (void *) &header, sizeof(Packet_Header));
-    u32 buffer_size = sizeof(Packet_Header) + header.payload_size;
+    u32 previous = __atomic_fetch_sub(&buffer->ref_count, 1, __ATOMIC_ACQ_REL);
+    ASSERT(previous > 0);
+
+    if (previous == 1) {
+        mem_free(buffer, sizeof(Packet_Buffer) + buffer->size, MEMORY_TAG_NETWORK);
+    }
+}
+
+bool packet_send(i32 socket, u32 type, void *packet_data)
+{
+    Packet_Buffer *buffer = packet_buffer_create(type, packet_data);
 
-    // TODO: Change it to add data to the queue instead of sending it straightaway
     i64 bytes_sent_total = 0;
     i64 bytes_sent = 0;
-    while (bytes_sent_total < buffer_size) {
-        bytes_sent = net_send(socket, buffer + bytes_sent, buffer_size - bytes_sent, 0);
+    while (bytes_sent_total < buffer->size) {
+        bytes_sent = net_send(socket, buffer->data + bytes_sent_total, buffer->size - bytes_sent_total, 0);
         if (bytes_sent <= 0) {
             if (bytes_sent == -1) {
-                LOG_ERROR("packet_enqueue error: %s\n", strerror(errno));
+                LOG_ERROR("packet_send error: %s\n", strerror(errno));
             } else {
                 LOG_ERROR("server unexpectedly performed orderly shutdown\n");
             }
+            packet_buffer_release(buffer);
             return false;
         }
         bytes_sent_total += bytes_sent;
     }
 
-    mem_free(buffer, sizeof(Packet_Header) + header.payload_size, MEMORY_TAG_NETWORK);
+    packet_buffer_release(buffer);
 
-    return bytes_sent_total == buffer_size;
+    return true;
 }
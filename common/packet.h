@@ -16,6 +16,7 @@ typedef enum {
     PACKET_TYPE_PLAYER_MOVE,
     PACKET_TYPE_PLAYER_BATCH_MOVE,
     PACKET_TYPE_LIGHT_UPDATE,
+    PACKET_TYPE_WORLD_SNAPSHOT,
     NUM_OF_PACKET_TYPES
 } Packet_Type;
 
@@ -34,7 +35,9 @@ typedef struct PACKED {
 } Packet_Text_Message;
 
 // Required for variable size packets.
-u32 serialize_packet_txt_msg(const Packet_Text_Message *packet, u8 **buffer);
+// serialize_packet_* functions write the payload to 'payload', which must hold payload_size_packet_* bytes.
+u32 payload_size_packet_txt_msg(const Packet_Text_Message *packet);
+void serialize_packet_txt_msg(const Packet_Text_Message *packet, u8 *payload);
 void deserialize_packet_txt_msg(void *data, Packet_Text_Message *packet);
 
 typedef struct PACKED {
@@ -49,6 +52,7 @@ typedef struct PACKED {
     player_id id;
     f32 color[3];
     f32 position[3];
+    u64 udp_token; // binds datagrams to the session, see datagram.h
 } Packet_Player_Join_Res;
 
 typedef struct PACKED {
@@ -84,10 +88,30 @@ typedef struct PACKED {
     f32 specular[3];
 } Packet_Light_Update;
 
+// Everything a player needs to know about its surroundings, sent in one packet instead of one
+// PLAYER_ADD per player. The player fields are laid out as arrays, usernames are concatenated
+// without terminators, each 'username_lengths[i]' bytes long.
+typedef struct PACKED {
+    u32 player_count;
+    player_id *ids;
+    f32 *colors;    // array of color[3]
+    f32 *positions; // array of position[3]
+    u8 *username_lengths;
+    char *usernames;
+    u32 light_count;
+    Packet_Light_Update *lights;
+} Packet_World_Snapshot;
+
 // Required for variable size packets.
-u32 serialize_packet_player_batch_move(const Packet_Player_Batch_Move *packet, u8 **buffer);
+u32 payload_size_packet_player_batch_move(const Packet_Player_Batch_Move *packet);
+void serialize_packet_player_batch_move(const Packet_Player_Batch_Move *packet, u8 *payload);
 void deserialize_packet_player_batch_move(void *data, Packet_Player_Batch_Move *packet);
 
+// Required for variable size packets.
+u32 payload_size_packet_world_snapshot(const Packet_World_Snapshot *packet);
+void serialize_packet_world_snapshot(const Packet_World_Snapshot *packet, u8 *payload);
+void deserialize_packet_world_snapshot(void *data, Packet_World_Snapshot *packet);
+
 // C++20 does not support array designated initializers...
 // so make sure the order is the same as in Packet_Type enum.
 LOCAL const u32 PACKET_TYPE_SIZE[NUM_OF_PACKET_TYPES] = {
@@ -101,7 +125,31 @@ LOCAL const u32 PACKET_TYPE_SIZE[NUM_OF_PACKET_TYPES] = {
     sizeof(Packet_Player_Remove),
     sizeof(Packet_Player_Move),
     sizeof(Packet_Player_Batch_Move),
-    sizeof(Packet_Light_Update)
+    sizeof(Packet_Light_Update),
+    sizeof(Packet_World_Snapshot)
 };
 
+// Checks a received payload before anything reads it: fixed size packets have to be exactly
+// PACKET_TYPE_SIZE bytes, variable size ones exactly as long as the counts and lengths they
+// carry say, and username and password lengths have to fit their arrays.
+bool packet_payload_is_valid(u32 type, const u8 *payload, u64 payload_size);
+
+/*
+ * Serialized packet (header followed by payload) ready to be written to sockets.
+ * The bytes are never modified after creation, so a broadcast serializes a packet once
+ * and queues the same buffer on every connection. Every holder owns one reference and
+ * the buffer is freed when the last reference is released, possibly on another thread.
+ */
+typedef struct {
+    u8 *data;      // points right after the struct, both live in a single allocation
+    u32 size;
+    u32 ref_count; // modified atomically
+} Packet_Buffer;
+
+Packet_Buffer *packet_buffer_create(u32 type, void *packet_data); // Returns a buffer with a single reference.
+Packet_Buffer *packet_buffer_create_raw(const void *bytes, u32 size); // Unframed bytes, for the handshake.
+Packet_Buffer *packet_buffer_retain(Packet_Buffer *buffer);
+void packet_buffer_release(Packet_Buffer *buffer);
+
+// Blocking send of a single packet, used where the socket is not driven by an event loop.
 bool packet_send(i32 socket, u32 type, void *packet_data);
@@ -0,0 +1,169 @@
+#include "packet_framer.h"
+
+#include <string.h>
+
+#include "net.h"
+#include "asserts.h"
+#include "memory/memutils.h"
+
+void packet_framer_create(Packet_Framer *framer, u64 initial_capacity, u32 max_payload_size)
+{
+    ASSERT(framer);
+    ASSERT(initial_capacity >= sizeof(Packet_Header));
+
+    framer->data = (u8 *) mem_alloc(initial_capacity, MEMORY_TAG_NETWORK);
+    framer->capacity = initial_capacity;
+    framer->read_offset = 0;
+    framer->write_offset = 0;
+    framer->pending_frame_size = 0;
+    framer->max_payload_size = max_payload_size;
+}
+
+void packet_framer_destroy(Packet_Framer *framer)
+{
+    ASSERT(framer);
+
+    mem_free(framer->data, framer->capacity, MEMORY_TAG_NETWORK);
+    mem_zero(framer, sizeof(Packet_Framer));
+}
+
+u8 *packet_framer_reserve(Packet_Framer *framer, u64 min_size, u64 *out_available)
+{
+    ASSERT(framer);
+    ASSERT(out_available);
+
+    u64 unparsed = framer->write_offset - framer->read_offset;
+
+    // A partially received frame must fit in the buffer as a whole to be parsed in place.
+    u64 required = min_size;
+    if (framer->pending_frame_size > unparsed && framer->pending_frame_size - unparsed > required) {
+        required = framer->pending_frame_size - unparsed;
+    }
+
+    if (framer->capacity - framer->write_offset < required && framer->read_offset > 0) {
+        // Move the unparsed tail (at most one partial frame in the common case) to the front.
+        if (unparsed > 0) {
+            memmove(framer->data, framer->data + framer->read_offset, unparsed);
+        }
+        framer->read_offset = 0;
+        framer->write_offset = unparsed;
+    }
+
+    if (framer->capacity - framer->write_offset < required) {
+        u64 new_capacity = framer->capacity;
+        while (new_capacity - framer->write_offset < required) {
+            new_capacity *= 2;
+        }
+
+        u8 *new_data = (u8 *) mem_alloc(new_capacity, MEMORY_TAG_NETWORK);
+        mem_copy(new_data, framer->data + framer->read_offset, unparsed);
+        mem_free(framer->data, framer->capacity, MEMORY_TAG_NETWORK);
+
+        framer->data = new_data;
+        framer->capacity = new_capacity;
+        framer->read_offset = 0;
+        framer->write_offset = unparsed;
+    }
+
+    *out_available = framer->capacity - framer->write_offset;
+    return framer->data + framer->write_offset;
+}
+
+void packet_framer_commit(Packet_Framer *framer, u64 size)
+{
+    ASSERT(framer);
+    ASSERT(framer->write_offset + size <= framer->capacity);
+
+    framer->write_offset += size;
+}
+
+i64 packet_framer_recv(Packet_Framer *framer, i32 socket)
+{
+    ASSERT(framer);
+
+    u64 available;
+    u8 *buffer = packet_framer_reserve(framer, PACKET_FRAMER_MIN_READ_SIZE, &available);
+
+    i64 bytes_read = net_recv(socket, buffer, available, 0);
+    if (bytes_read > 0) {
+        packet_framer_commit(framer, (u64) bytes_read);
+    }
+
+    return bytes_read;
+}
+
+Packet_Framer_Status packet_framer_next(Packet_Framer *framer, Packet_Header *out_header, u8 **out_payload)
+{
+    ASSERT(framer);
+    ASSERT(out_header);
+    ASSERT(out_payload);
+
+    u64 unparsed = framer->write_offset - framer->read_offset;
+    if (unparsed < sizeof(Packet_Header)) {
+        return PACKET_FRAMER_STATUS_INCOMPLETE;
+    }
+
+    Packet_Header header;
+    mem_copy(&header, framer->data + framer->read_offset, sizeof(Packet_Header));
+
+    if (header.type <= PACKET_TYPE_HEADER || header.type >= NUM_OF_PACKET_TYPES) {
+        return PACKET_FRAMER_STATUS_ERROR;
+    }
+
+    if (header.payload_size > framer->max_payload_size) {
+        return PACKET_FRAMER_STATUS_ERROR;
+    }
+
+    u64 frame_size = sizeof(Packet_Header) + header.payload_size;
+    if (unparsed < frame_size) {
+        framer->pending_frame_size = frame_size;
+        return PACKET_FRAMER_STATUS_INCOMPLETE;
+    }
+
+    u8 *payload = framer->data + framer->read_offset + sizeof(Packet_Header);
+    if (!packet_payload_is_valid(header.type, payload, header.payload_size)) {
+        return PACKET_FRAMER_STATUS_ERROR;
+    }
+
+    *out_header = header;
+    *out_payload = payload;
+
+    framer->pending_frame_size = 0;
+    framer->read_offset += frame_size;
+
+    if (framer->read_offset == framer->write_offset) {
+        // Fully drained: start over from the front so that the next read gets the whole buffer.
+        // The returned payload is still intact, since nothing is written before the next reserve.
+        framer->read_offset = 0;
+        framer->write_offset = 0;
+    }
+
+    return PACKET_FRAMER_STATUS_READY;
+}
+
+bool packet_framer_take(Packet_Framer *framer, void *out_data, u64 size)
+{
+    ASSERT(framer);
+    ASSERT(out_data);
+    ASSERT_MSG(framer->pending_frame_size == 0, "taking raw bytes out of a partially parsed packet");
+
+    if (framer->write_offset - framer->read_offset < size) {
+        return false;
+    }
+
+    mem_copy(out_data, framer->data + framer->read_offset, size);
+    framer->read_offset += size;
+
+    if (framer->read_offset == framer->write_offset) {
+        framer->read_offset = 0;
+        framer->write_offset = 0;
+    }
+
+    return true;
+}
+
+u64 packet_framer_unparsed_length(const Packet_Framer *framer)
+{
+    ASSERT(framer);
+    return framer->write_offset - framer->read_offset;
+}
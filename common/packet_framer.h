@@ -0,0 +1,43 @@
+#pragma once
+
+#include "defines.h"
+#include "packet.h"
+
+#define PACKET_FRAMER_DEFAULT_CAPACITY KiB(4)
+#define PACKET_FRAMER_MIN_READ_SIZE KiB(1)
+
+/*
+ * Per-connection receive buffer that splits a TCP byte stream into packets.
+ * Bytes are appended at write_offset and packets are parsed in place from read_offset,
+ * so the payload pointers handed out by packet_framer_next point directly into the buffer.
+ * Those pointers stay valid only until the next packet_framer_reserve call, which may
+ * move the unparsed tail to the front of the buffer or grow the buffer to fit a frame.
+ */
+typedef struct {
+    u8 *data;
+    u64 capacity;
+    u64 read_offset;
+    u64 write_offset;
+    u64 pending_frame_size; // size of the partially received frame, if its header is already known
+    u32 max_payload_size;
+} Packet_Framer;
+
+typedef enum {
+    PACKET_FRAMER_STATUS_INCOMPLETE,
+    PACKET_FRAMER_STATUS_READY,
+    PACKET_FRAMER_STATUS_ERROR
+} Packet_Framer_Status;
+
+void packet_framer_create(Packet_Framer *framer, u64 initial_capacity, u32 max_payload_size);
+void packet_framer_destroy(Packet_Framer *framer);
+
+u8  *packet_framer_reserve(Packet_Framer *framer, u64 min_size, u64 *out_available);
+void packet_framer_commit(Packet_Framer *framer, u64 size);
+i64  packet_framer_recv(Packet_Framer *framer, i32 socket); // Same return value semantics as net_recv.
+
+Packet_Framer_Status packet_framer_next(Packet_Framer *framer, Packet_Header *out_header, u8 **out_payload);
+
+// Copies 'size' unframed bytes out of the stream, for exchanges that precede packets such as the handshake.
+// Returns false and consumes nothing when fewer bytes have been received so far.
+bool packet_framer_take(Packet_Framer *framer, void *out_data, u64 size);
+u64 packet_framer_unparsed_length(const Packet_Framer *framer);
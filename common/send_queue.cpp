@@ -0,0 +1,137 @@
+#include "send_queue.h"
+
+#include <errno.h>
+
+#include "net.h"
+#include "asserts.h"
+#include "memory/memutils.h"
+
+void send_queue_create(Send_Queue *queue, u64 max_packets, u64 max_bytes)
+{
+    ASSERT(queue);
+    ASSERT(max_packets > 0);
+
+    ring_queue_reserve_tagged(&queue->packets, max_packets, sizeof(Packet_Buffer *), MEMORY_TAG_NETWORK);
+    queue->head_offset = 0;
+    queue->bytes_queued = 0;
+    queue->max_bytes = max_bytes;
+    queue->peak_depth = 0;
+    queue->write_calls = 0;
+}
+
+void send_queue_destroy(Send_Queue *queue)
+{
+    ASSERT(queue);
+
+    Packet_Buffer *buffer;
+    while (ring_queue_dequeue(&queue->packets, &buffer)) {
+        packet_buffer_release(buffer);
+    }
+
+    ring_queue_destroy(&queue->packets);
+    mem_zero(queue, sizeof(Send_Queue));
+}
+
+bool send_queue_push(Send_Queue *queue, Packet_Buffer *buffer)
+{
+    ASSERT(queue);
+    ASSERT(buffer);
+
+    // A single packet larger than the byte cap is still accepted into an empty queue.
+    if (queue->bytes_queued > 0 && queue->bytes_queued + buffer->size > queue->max_bytes) {
+        return false;
+    }
+
+    if (!ring_queue_enqueue(&queue->packets, &buffer)) {
+        return false;
+    }
+
+    queue->bytes_queued += buffer->size;
+
+    u64 depth = ring_queue_length(&queue->packets);
+    if (depth > queue->peak_depth) {
+        queue->peak_depth = depth;
+    }
+
+    return true;
+}
+
+// Drops the first 'size' written bytes from the front of the queue.
+LOCAL void send_queue_consume(Send_Queue *queue, u64 size)
+{
+    queue->bytes_queued -= size;
+
+    while (size > 0) {
+        Packet_Buffer *head;
+        ring_queue_peek_from_end(&queue->packets, 0, &head);
+
+        u64 remaining = head->size - queue->head_offset;
+        if (size < remaining) {
+            queue->head_offset += size;
+            return;
+        }
+
+        size -= remaining;
+        queue->head_offset = 0;
+        ring_queue_dequeue(&queue->packets, &head);
+        packet_buffer_release(head);
+    }
+}
+
+Send_Queue_Flush_Result send_queue_flush(Send_Queue *queue, i32 socket)
+{
+    ASSERT(queue);
+
+    struct iovec iov[SEND_QUEUE_MAX_IOVECS];
+
+    while (!ring_queue_is_empty(&queue->packets)) {
+        u64 count = ring_queue_length(&queue->packets);
+        if (count > SEND_QUEUE_MAX_IOVECS) {
+            count = SEND_QUEUE_MAX_IOVECS;
+        }
+        u64 batch_size = 0;
+
+        for (u64 i = 0; i < count; i++) {
+            Packet_Buffer *buffer;
+            ring_queue_peek_from_end(&queue->packets, i, &buffer);
+
+            u64 offset = i == 0 ? queue->head_offset : 0;
+            iov[i].iov_base = buffer->data + offset;
+            iov[i].iov_len = buffer->size - offset;
+            batch_size += iov[i].iov_len;
+        }
+
+        i64 bytes_sent = net_writev(socket, iov, (i32) count);
+        queue->write_calls++;
+        if (bytes_sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return SEND_QUEUE_FLUSH_PENDING;
+            }
+            return SEND_QUEUE_FLUSH_ERROR;
+        }
+
+        send_queue_consume(queue, (u64) bytes_sent);
+
+        // A short write means the socket buffer is full, so another call would only return EAGAIN.
+        if ((u64) bytes_sent < batch_size) {
+            return SEND_QUEUE_FLUSH_PENDING;
+        }
+    }
+
+    return SEND_QUEUE_FLUSH_DRAINED;
+}
+
+u64 send_queue_depth(Send_Queue *queue)
+{
+    ASSERT(queue);
+    return ring_queue_length(&queue->packets);
+}
+
+bool send_queue_is_empty(Send_Queue *queue)
+{
+    ASSERT(queue);
+    return ring_queue_is_empty(&queue->packets);
+}
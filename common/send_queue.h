@@ -0,0 +1,41 @@
+#pragma once
+
+#include "defines.h"
+#include "packet.h"
+#include "collections/ring_queue.h"
+
+#define SEND_QUEUE_DEFAULT_MAX_PACKETS 256
+#define SEND_QUEUE_DEFAULT_MAX_BYTES KiB(256)
+#define SEND_QUEUE_MAX_IOVECS 64 // packets gathered into a single writev call
+
+/*
+ * Per-connection outbound queue of serialized packets for non-blocking sockets.
+ * Packets are appended with send_queue_push and written with as few system calls as
+ * possible by send_queue_flush, which gathers the queued buffers into one writev call.
+ * The queue takes over the caller's reference to pushed buffers and releases it once they are fully sent.
+ * Both the number of packets and the number of unsent bytes are capped, so a client
+ * that does not read its socket cannot make the server buffer data indefinitely.
+ */
+typedef struct {
+    Ring_Queue packets;   // Packet_Buffer *
+    u64 head_offset;      // bytes of the oldest packet that were already written
+    u64 bytes_queued;     // unsent bytes across all queued packets
+    u64 max_bytes;
+    u64 peak_depth;       // highest number of queued packets seen so far
+    u64 write_calls;      // system calls made by send_queue_flush so far
+} Send_Queue;
+
+typedef enum {
+    SEND_QUEUE_FLUSH_DRAINED, // everything was written
+    SEND_QUEUE_FLUSH_PENDING, // the socket buffer is full, retry once the socket is writable
+    SEND_QUEUE_FLUSH_ERROR    // the connection is broken, errno is set
+} Send_Queue_Flush_Result;
+
+void send_queue_create(Send_Queue *queue, u64 max_packets, u64 max_bytes);
+void send_queue_destroy(Send_Queue *queue); // Releases the packets that were not sent.
+
+bool send_queue_push(Send_Queue *queue, Packet_Buffer *buffer); // Returns false without taking the reference when the queue is full.
+Send_Queue_Flush_Result send_queue_flush(Send_Queue *queue, i32 socket);
+
+u64  send_queue_depth(Send_Queue *queue);
+bool send_queue_is_empty(Send_Queue *queue);
@@ -0,0 +1,174 @@
+#include "auth_pool.h"
+
+#include "common/log.h"
+#include "common/clock.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+#include "common/collections/darray.h"
+
+LOCAL void auth_pool_verify(Auth_Pool *pool, Auth_Job *job)
+{
+    const char *credential = job->unknown_user ? pool->dummy_credential : job->credential;
+    Credential_Check check = credential_verify(job->password, credential, pool->iterations);
+    job->approved = check != CREDENTIAL_MISMATCH && !job->unknown_user;
+    job->upgraded = false;
+
+    if (job->approved && check == CREDENTIAL_MATCH_NEEDS_UPGRADE) {
+        job->upgraded = credential_create(job->password, pool->iterations, job->credential);
+    }
+
+    mem_zero(job->password, sizeof(job->password));
+}
+
+LOCAL void *auth_pool_worker_loop(void *args)
+{
+    Auth_Pool *pool = (Auth_Pool *) args;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stopping && ring_queue_is_empty(&pool->pending)) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+
+        if (pool->stopping) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        Auth_Job job;
+        ring_queue_dequeue(&pool->pending, &job);
+        pthread_mutex_unlock(&pool->lock);
+
+        u64 start = clock_get_absolute_time_ns();
+        auth_pool_verify(pool, &job);
+        u64 now = clock_get_absolute_time_ns();
+
+        pthread_mutex_lock(&pool->lock);
+        u64 latency = now - job.submit_time;
+        pool->stats.completed++;
+        pool->stats.hash_total_ns += now - start;
+        pool->stats.latency_total_ns += latency;
+        if (latency > pool->stats.latency_max_ns) {
+            pool->stats.latency_max_ns = latency;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        mailbox_post(&pool->results, &job, 1);
+    }
+
+    return NULL;
+}
+
+bool auth_pool_create(Auth_Pool *pool, u32 worker_count, u32 iterations)
+{
+    ASSERT(pool);
+    ASSERT(worker_count > 0 && worker_count <= AUTH_POOL_MAX_WORKERS);
+    ASSERT(iterations > 0);
+
+    mem_zero(pool, sizeof(Auth_Pool));
+
+    // Hashed with a random salt, so no password is ever known to match it.
+    if (!credential_create("", iterations, pool->dummy_credential)) {
+        return false;
+    }
+
+    if (!mailbox_create(&pool->results, sizeof(Auth_Job))) {
+        return false;
+    }
+
+    pool->iterations = iterations;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    ring_queue_reserve_tagged(&pool->pending, AUTH_POOL_MAX_IN_FLIGHT, sizeof(Auth_Job), MEMORY_TAG_NETWORK);
+
+    for (u32 i = 0; i < worker_count; i++) {
+        if (pthread_create(&pool->workers[i], NULL, auth_pool_worker_loop, pool) != 0) {
+            LOG_ERROR("failed to start authentication worker %u\n", i);
+            break;
+        }
+        pool->worker_count++;
+    }
+
+    return pool->worker_count > 0;
+}
+
+void auth_pool_destroy(Auth_Pool *pool)
+{
+    ASSERT(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (u32 i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    // Do not leave passwords of jobs that never ran lying around in freed memory.
+    mem_zero(pool->pending.data, pool->pending.capacity * pool->pending.stride);
+
+    ring_queue_destroy(&pool->pending);
+    mailbox_destroy(&pool->results);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+bool auth_pool_submit(Auth_Pool *pool, const Auth_Job *job)
+{
+    ASSERT(pool);
+    ASSERT(job);
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->stats.in_flight >= AUTH_POOL_MAX_IN_FLIGHT) {
+        pool->stats.rejected++;
+        pthread_mutex_unlock(&pool->lock);
+        return false;
+    }
+
+    Auth_Job queued = *job;
+    queued.submit_time = clock_get_absolute_time_ns();
+    bool enqueued = ring_queue_enqueue(&pool->pending, &queued);
+    ASSERT(enqueued); UNUSED(enqueued);
+    mem_zero(queued.password, sizeof(queued.password));
+
+    pool->stats.in_flight++;
+    if (pool->stats.in_flight > pool->stats.peak_in_flight) {
+        pool->stats.peak_in_flight = pool->stats.in_flight;
+    }
+
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    return true;
+}
+
+Auth_Job *auth_pool_take(Auth_Pool *pool, Auth_Job *spare)
+{
+    ASSERT(pool);
+    ASSERT(spare && darray_length(spare) == 0);
+
+    Auth_Job *taken = (Auth_Job *) mailbox_take(&pool->results, spare);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.in_flight -= darray_length(taken);
+    pthread_mutex_unlock(&pool->lock);
+
+    return taken;
+}
+
+Auth_Pool_Stats auth_pool_take_stats(Auth_Pool *pool)
+{
+    ASSERT(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    Auth_Pool_Stats stats = pool->stats;
+    u64 in_flight = pool->stats.in_flight;
+    mem_zero(&pool->stats, sizeof(Auth_Pool_Stats));
+    pool->stats.in_flight = in_flight;
+    pool->stats.peak_in_flight = in_flight;
+    pthread_mutex_unlock(&pool->lock);
+
+    return stats;
+}
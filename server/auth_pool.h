@@ -0,0 +1,71 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "common/defines.h"
+#include "common/player_types.h"
+#include "common/collections/ring_queue.h"
+#include "credentials.h"
+#include "mailbox.h"
+
+#define AUTH_POOL_MAX_WORKERS 16
+#define AUTH_POOL_DEFAULT_WORKERS 2
+#define AUTH_POOL_MAX_IN_FLIGHT 64 // verifications admitted at once, the rest are turned away right away
+
+typedef struct {
+    i32 socket;              // connection the verification is for, the serial tells a reused socket apart
+    u64 connection_serial;
+    u64 submit_time;
+    char username[PLAYER_USERNAME_MAX_LEN + 1];
+    char password[PLAYER_PASSWORD_MAX_LEN + 1]; // wiped by the worker once verified
+    char credential[CREDENTIAL_MAX_LEN];        // stored credential, replaced when 'upgraded'
+    bool unknown_user;       // verified against 'dummy_credential' and always refused, see Auth_Pool
+    bool approved;
+    bool upgraded;           // 'credential' holds a freshly hashed replacement to be stored
+} Auth_Job;
+
+typedef struct {
+    u64 in_flight;         // admitted and not yet taken back
+    u64 peak_in_flight;
+    u64 rejected;          // turned away by the admission limit
+    u64 completed;
+    u64 latency_total_ns;  // from submit until the result is posted back
+    u64 latency_max_ns;
+    u64 hash_total_ns;     // spent in the key derivation
+} Auth_Pool_Stats;
+
+/*
+ * Bounded pool of threads verifying passwords against stored credentials, so the deliberately
+ * slow key derivation never runs on the network thread. At most AUTH_POOL_MAX_IN_FLIGHT jobs
+ * are admitted, further submissions fail immediately and the join is refused, which keeps a
+ * login storm from queueing up unbounded work. Results are posted back through the 'results'
+ * mailbox.
+ *
+ * Usernames that do not exist go through the pool as well, checked against a credential made
+ * up at startup, so a refusal takes as long as for a wrong password and through the same
+ * admission limit, and the response time does not tell which usernames exist.
+ */
+typedef struct {
+    pthread_t workers[AUTH_POOL_MAX_WORKERS];
+    u32 worker_count;
+    u32 iterations;        // cost of newly created credentials
+    char dummy_credential[CREDENTIAL_MAX_LEN]; // of the same cost, written once before the workers start
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stopping;
+    Ring_Queue pending;    // Auth_Job, never more than AUTH_POOL_MAX_IN_FLIGHT
+    Mailbox results;       // Auth_Job, waiting for the network thread
+    Auth_Pool_Stats stats; // under 'lock'
+} Auth_Pool;
+
+bool auth_pool_create(Auth_Pool *pool, u32 worker_count, u32 iterations);
+void auth_pool_destroy(Auth_Pool *pool);
+
+// Returns false when the admission limit is reached.
+bool auth_pool_submit(Auth_Pool *pool, const Auth_Job *job);
+
+// Swaps the completed jobs with the empty 'spare' darray and returns them, like mailbox_take.
+Auth_Job *auth_pool_take(Auth_Pool *pool, Auth_Job *spare);
+
+// Returns the stats since the previous call, in_flight is the current value.
+Auth_Pool_Stats auth_pool_take_stats(Auth_Pool *pool);
@@ -0,0 +1,37 @@
+#include "connection.h"
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+LOCAL u64 connection_next_serial = 1;
+
+Connection *connection_create(i32 socket, const struct sockaddr_storage *address)
+{
+    ASSERT(address);
+
+    Connection *connection = (Connection *) mem_alloc(sizeof(Connection), MEMORY_TAG_NETWORK);
+    connection->socket = socket;
+    connection->serial = connection_next_serial++;
+    connection->id = 0;
+    connection->state = CONNECTION_STATE_AWAITING_PUZZLE_ANSWER;
+    connection->puzzle_answer = 0;
+    connection->handshake_deadline = 0;
+    connection->closed = false;
+    connection->write_pending = false;
+    connection->send_failed = false;
+    connection->address = *address;
+    connection->udp_token = 0;
+    connection->udp_bound = false;
+    packet_framer_create(&connection->framer, PACKET_FRAMER_DEFAULT_CAPACITY, SERVER_MAX_PACKET_PAYLOAD_SIZE);
+    send_queue_create(&connection->send_queue, SEND_QUEUE_DEFAULT_MAX_PACKETS, SEND_QUEUE_DEFAULT_MAX_BYTES);
+    return connection;
+}
+
+void connection_destroy(Connection *connection)
+{
+    ASSERT(connection);
+
+    packet_framer_destroy(&connection->framer);
+    send_queue_destroy(&connection->send_queue);
+    mem_free(connection, sizeof(Connection), MEMORY_TAG_NETWORK);
+}
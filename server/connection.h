@@ -0,0 +1,45 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include "common/defines.h"
+#include "common/datagram.h"
+#include "common/packet_framer.h"
+#include "common/send_queue.h"
+#include "common/player_types.h"
+
+#define SERVER_MAX_PACKET_PAYLOAD_SIZE KiB(64)
+
+// The handshake goes through these in order, each step driven by the data the client sends.
+typedef enum {
+    CONNECTION_STATE_AWAITING_PUZZLE_ANSWER, // puzzle sent, waiting for the raw 8 byte answer
+    CONNECTION_STATE_AWAITING_JOIN,          // puzzle solved, waiting for a join request
+    CONNECTION_STATE_AUTHENTICATING,         // join request sent to the database, back to AWAITING_JOIN if rejected
+    CONNECTION_STATE_LOADING_PROFILE,        // authenticated, waiting for the stored player profile
+    CONNECTION_STATE_JOINED
+} Connection_State;
+
+typedef struct {
+    i32 socket;
+    u64 serial;   // unique for the lifetime of the server, unlike the socket
+    player_id id; // player id, 0 until the join request is approved
+    Connection_State state;
+    u64 puzzle_answer;
+    u64 handshake_deadline; // disconnected if not joined by then
+    bool closed;
+    bool write_pending; // the send queue is waiting for the socket to become writable
+    bool send_failed;   // scheduled for disconnect after a send error or a send queue overflow
+    bool flush_scheduled; // has packets queued since the last flush, written at the end of the loop iteration
+    bool tick_data_queued; // holds packets produced by a tick that were not fully written yet, for the send stats
+    Packet_Framer framer;
+    Send_Queue send_queue;
+    struct sockaddr_storage address; // of the TCP peer, datagrams are only accepted from the same host
+    u64 udp_token;                   // handed out on join, 0 before
+    bool udp_bound;                  // a datagram with the token arrived, so 'udp_address' is known
+    struct sockaddr_storage udp_address;
+    socklen_t udp_address_length;
+    Datagram_Window udp_window;      // sequences of the datagrams received from the client
+} Connection;
+
+Connection *connection_create(i32 socket, const struct sockaddr_storage *address); // Only called by the network thread.
+void connection_destroy(Connection *connection);
@@ -0,0 +1,122 @@
+#include "credentials.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "common/log.h"
+#include "common/asserts.h"
+#include "common/crypto/pbkdf2.h"
+#include "common/memory/memutils.h"
+
+LOCAL void hex_encode(const u8 *bytes, u64 size, char *out_hex)
+{
+    PERSIST const char digits[] = "0123456789abcdef";
+    for (u64 i = 0; i < size; i++) {
+        out_hex[i * 2] = digits[bytes[i] >> 4];
+        out_hex[i * 2 + 1] = digits[bytes[i] & 0xF];
+    }
+    out_hex[size * 2] = '\0';
+}
+
+LOCAL i32 hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+LOCAL bool hex_decode(const char *hex, u64 hex_length, u8 *out_bytes, u64 size)
+{
+    if (hex_length != size * 2) {
+        return false;
+    }
+
+    for (u64 i = 0; i < size; i++) {
+        i32 high = hex_digit(hex[i * 2]);
+        i32 low = hex_digit(hex[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out_bytes[i] = (u8) ((high << 4) | low);
+    }
+
+    return true;
+}
+
+bool credential_create(const char *password, u32 iterations, char *out_credential)
+{
+    ASSERT(password && out_credential);
+    ASSERT(iterations > 0);
+
+    u8 salt[CREDENTIAL_SALT_SIZE];
+    if (getrandom(salt, sizeof(salt), 0) != (i64) sizeof(salt)) {
+        LOG_ERROR("failed to generate a credential salt\n");
+        return false;
+    }
+
+    u8 key[CREDENTIAL_KEY_SIZE];
+    pbkdf2_hmac_sha256(password, strlen(password), salt, sizeof(salt), iterations, key, sizeof(key));
+
+    char salt_hex[CREDENTIAL_SALT_SIZE * 2 + 1];
+    char key_hex[CREDENTIAL_KEY_SIZE * 2 + 1];
+    hex_encode(salt, sizeof(salt), salt_hex);
+    hex_encode(key, sizeof(key), key_hex);
+    mem_zero(key, sizeof(key));
+
+    snprintf(out_credential, CREDENTIAL_MAX_LEN, CREDENTIAL_SCHEME "$%u$%s$%s", iterations, salt_hex, key_hex);
+    return true;
+}
+
+Credential_Check credential_verify(const char *password, const char *stored, u32 iterations)
+{
+    ASSERT(password && stored);
+
+    u64 scheme_length = strlen(CREDENTIAL_SCHEME);
+    if (strncmp(stored, CREDENTIAL_SCHEME "$", scheme_length + 1) != 0) {
+        // Plaintext from before hashing. Pad both to the same size, so the comparison time does not depend on the length.
+        char padded_password[CREDENTIAL_MAX_LEN] = {0};
+        char padded_stored[CREDENTIAL_MAX_LEN] = {0};
+        if (strlen(password) >= CREDENTIAL_MAX_LEN || strlen(stored) >= CREDENTIAL_MAX_LEN) {
+            return CREDENTIAL_MISMATCH;
+        }
+        strcpy(padded_password, password);
+        strcpy(padded_stored, stored);
+
+        bool equal = constant_time_equal(padded_password, padded_stored, CREDENTIAL_MAX_LEN);
+        mem_zero(padded_password, sizeof(padded_password));
+        return equal ? CREDENTIAL_MATCH_NEEDS_UPGRADE : CREDENTIAL_MISMATCH;
+    }
+
+    const char *cursor = stored + scheme_length + 1;
+    char *end = NULL;
+    unsigned long stored_iterations = strtoul(cursor, &end, 10);
+    if (end == cursor || *end != '$' || stored_iterations == 0 || stored_iterations > 0xFFFFFFFFUL) {
+        LOG_WARN("malformed stored credential\n");
+        return CREDENTIAL_MISMATCH;
+    }
+
+    const char *salt_hex = end + 1;
+    const char *key_hex = strchr(salt_hex, '$');
+    u8 salt[CREDENTIAL_SALT_SIZE];
+    u8 expected_key[CREDENTIAL_KEY_SIZE];
+    if (key_hex == NULL ||
+        !hex_decode(salt_hex, (u64) (key_hex - salt_hex), salt, sizeof(salt)) ||
+        !hex_decode(key_hex + 1, strlen(key_hex + 1), expected_key, sizeof(expected_key))) {
+        LOG_WARN("malformed stored credential\n");
+        return CREDENTIAL_MISMATCH;
+    }
+
+    u8 key[CREDENTIAL_KEY_SIZE];
+    pbkdf2_hmac_sha256(password, strlen(password), salt, sizeof(salt), (u32) stored_iterations, key, sizeof(key));
+    bool equal = constant_time_equal(key, expected_key, sizeof(key));
+    mem_zero(key, sizeof(key));
+
+    if (!equal) {
+        return CREDENTIAL_MISMATCH;
+    }
+
+    return stored_iterations == iterations ? CREDENTIAL_MATCH : CREDENTIAL_MATCH_NEEDS_UPGRADE;
+}
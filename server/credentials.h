@@ -0,0 +1,23 @@
+#pragma once
+
+#include "common/defines.h"
+
+#define CREDENTIAL_SCHEME "pbkdf2-sha256"
+#define CREDENTIAL_SALT_SIZE 16
+#define CREDENTIAL_KEY_SIZE 32
+#define CREDENTIAL_MAX_LEN 160 // fits the scheme, a 10 digit cost and both hex fields
+#define CREDENTIAL_DEFAULT_ITERATIONS 100000
+
+typedef enum {
+    CREDENTIAL_MISMATCH,
+    CREDENTIAL_MATCH,
+    CREDENTIAL_MATCH_NEEDS_UPGRADE // matched a plaintext or differently priced credential, store a fresh one
+} Credential_Check;
+
+/*
+ * Stored credentials have the form "pbkdf2-sha256$<iterations>$<salt hex>$<key hex>".
+ * Anything else in the users table is a password from before hashing was introduced,
+ * which is still accepted once, compared in constant time, and then replaced.
+ */
+bool credential_create(const char *password, u32 iterations, char *out_credential); // out_credential is CREDENTIAL_MAX_LEN
+Credential_Check credential_verify(const char *password, const char *stored, u32 iterations);
@@ -0,0 +1,378 @@
+#include "db_worker.h"
+
+#include <string.h>
+
+#include "common/log.h"
+#include "common/clock.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+#include "common/collections/darray.h"
+
+// Make sure the order is the same as in Db_Request_Type enum.
+LOCAL const char *DB_REQUEST_SQL[NUM_OF_DB_REQUEST_TYPES] = {
+    "SELECT ip_address FROM ip_blacklist;",
+    "SELECT password FROM users WHERE username = ?1;",
+    "UPDATE users SET password = ?2 WHERE username = ?1;",
+    "SELECT position_x, position_y, position_z, color_r, color_g, color_b FROM player_profiles WHERE username = ?1;",
+    "INSERT INTO player_profiles (username, position_x, position_y, position_z, color_r, color_g, color_b)\n"
+    "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)\n"
+    "ON CONFLICT (username) DO UPDATE SET\n"
+    "    position_x = excluded.position_x, position_y = excluded.position_y, position_z = excluded.position_z,\n"
+    "    color_r = excluded.color_r, color_g = excluded.color_g, color_b = excluded.color_b,\n"
+    "    updated_at = DATETIME('now', 'localtime');"
+};
+
+// Steps a statement that returns no rows and resets it.
+LOCAL bool db_worker_run(Db_Worker *worker, sqlite3_stmt *stmt)
+{
+    i32 rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    if (rc != SQLITE_DONE) {
+        LOG_ERROR("failed to execute statement: %s\n", sqlite3_errmsg(worker->db));
+        return false;
+    }
+
+    return true;
+}
+
+LOCAL bool db_worker_load_ip_blacklist(Db_Worker *worker, Db_Request *request)
+{
+    sqlite3_stmt *stmt = worker->statements[DB_REQUEST_LOAD_IP_BLACKLIST];
+    Ip_Blacklist *blacklist = ip_blacklist_create();
+
+    i32 rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char *entry = (const char *) sqlite3_column_text(stmt, 0);
+        if (entry == NULL || !ip_blacklist_add(blacklist, entry)) {
+            LOG_WARN("skipping invalid ip blacklist entry `%s`\n", entry != NULL ? entry : "NULL");
+        }
+    }
+    sqlite3_reset(stmt);
+
+    if (rc != SQLITE_DONE) {
+        LOG_ERROR("failed to execute statement: %s\n", sqlite3_errmsg(worker->db));
+        ip_blacklist_destroy(blacklist);
+        request->result = false;
+        request->blacklist = NULL;
+        return false;
+    }
+
+    request->result = true;
+    request->blacklist = blacklist;
+    return true;
+}
+
+LOCAL bool db_worker_load_credential(Db_Worker *worker, Db_Request *request)
+{
+    sqlite3_stmt *stmt = worker->statements[DB_REQUEST_LOAD_CREDENTIAL];
+    sqlite3_bind_text(stmt, 1, request->username, -1, SQLITE_STATIC);
+
+    i32 rc = sqlite3_step(stmt);
+    request->result = false;
+    if (rc == SQLITE_ROW) {
+        const char *credential = (const char *) sqlite3_column_text(stmt, 0);
+        if (credential != NULL && strlen(credential) < sizeof(request->credential)) {
+            strcpy(request->credential, credential);
+            request->result = true;
+        }
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        LOG_ERROR("failed to execute statement: %s\n", sqlite3_errmsg(worker->db));
+        return false;
+    }
+
+    return true;
+}
+
+LOCAL bool db_worker_store_credential(Db_Worker *worker, Db_Request *request)
+{
+    sqlite3_stmt *stmt = worker->statements[DB_REQUEST_STORE_CREDENTIAL];
+    sqlite3_bind_text(stmt, 1, request->username, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, request->credential, -1, SQLITE_STATIC);
+
+    request->result = db_worker_run(worker, stmt);
+    return request->result;
+}
+
+LOCAL bool db_worker_load_profile(Db_Worker *worker, Db_Request *request)
+{
+    sqlite3_stmt *stmt = worker->statements[DB_REQUEST_LOAD_PROFILE];
+    sqlite3_bind_text(stmt, 1, request->username, -1, SQLITE_STATIC);
+
+    i32 rc = sqlite3_step(stmt);
+    request->found = rc == SQLITE_ROW;
+    if (request->found) {
+        Player_Profile *profile = &request->profile;
+        mem_copy(profile->username, request->username, sizeof(profile->username));
+        for (i32 i = 0; i < 3; i++) {
+            profile->position[i] = (f32) sqlite3_column_double(stmt, i);
+            profile->color[i] = (f32) sqlite3_column_double(stmt, 3 + i);
+        }
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    request->result = rc == SQLITE_ROW || rc == SQLITE_DONE;
+    if (!request->result) {
+        LOG_ERROR("failed to execute statement: %s\n", sqlite3_errmsg(worker->db));
+        return false;
+    }
+
+    return true;
+}
+
+LOCAL bool db_worker_store_profiles(Db_Worker *worker, Db_Request *request)
+{
+    sqlite3_stmt *stmt = worker->statements[DB_REQUEST_STORE_PROFILES];
+
+    request->result = false;
+    if (!db_worker_run(worker, worker->begin_transaction)) {
+        return false;
+    }
+
+    bool stored = true;
+    for (u64 i = 0; i < darray_length(request->profiles) && stored; i++) {
+        const Player_Profile *profile = &request->profiles[i];
+        sqlite3_bind_text(stmt, 1, profile->username, -1, SQLITE_STATIC);
+        for (i32 j = 0; j < 3; j++) {
+            sqlite3_bind_double(stmt, 2 + j, (f64) profile->position[j]);
+            sqlite3_bind_double(stmt, 5 + j, (f64) profile->color[j]);
+        }
+        stored = db_worker_run(worker, stmt);
+    }
+
+    if (!stored || !db_worker_run(worker, worker->commit_transaction)) {
+        db_worker_run(worker, worker->rollback_transaction);
+        return false;
+    }
+
+    request->result = true;
+    return true;
+}
+
+// Fills in the result, returns false when the statement failed to execute.
+LOCAL bool db_worker_execute(Db_Worker *worker, Db_Request *request)
+{
+    switch (request->type) {
+        case DB_REQUEST_LOAD_IP_BLACKLIST: return db_worker_load_ip_blacklist(worker, request);
+        case DB_REQUEST_LOAD_CREDENTIAL:   return db_worker_load_credential(worker, request);
+        case DB_REQUEST_STORE_CREDENTIAL:  return db_worker_store_credential(worker, request);
+        case DB_REQUEST_LOAD_PROFILE:      return db_worker_load_profile(worker, request);
+        case DB_REQUEST_STORE_PROFILES:    return db_worker_store_profiles(worker, request);
+        case NUM_OF_DB_REQUEST_TYPES: {
+            ASSERT_MSG(false, "invalid database request type");
+        } break;
+    }
+
+    return false;
+}
+
+LOCAL void *db_worker_loop(void *args)
+{
+    Db_Worker *worker = (Db_Worker *) args;
+    Db_Request *batch = (Db_Request *) darray_create(sizeof(Db_Request));
+
+    for (;;) {
+        pthread_mutex_lock(&worker->lock);
+        while (!worker->stopping && darray_length(worker->pending) == 0) {
+            pthread_cond_wait(&worker->wake, &worker->lock);
+        }
+
+        // What was submitted before stopping is still executed, so the final profiles get stored.
+        if (darray_length(worker->pending) == 0) {
+            pthread_mutex_unlock(&worker->lock);
+            break;
+        }
+
+        Db_Request *taken = worker->pending;
+        worker->pending = batch;
+        batch = taken;
+        pthread_mutex_unlock(&worker->lock);
+
+        u64 execute_ns[DB_WORKER_MAX_PENDING];
+        u64 count = darray_length(batch);
+        ASSERT(count <= DB_WORKER_MAX_PENDING);
+
+        bool failed[DB_WORKER_MAX_PENDING];
+        for (u64 i = 0; i < count; i++) {
+            u64 start = clock_get_absolute_time_ns();
+            failed[i] = !db_worker_execute(worker, &batch[i]);
+            execute_ns[i] = clock_get_absolute_time_ns() - start;
+        }
+
+        u64 now = clock_get_absolute_time_ns();
+
+        pthread_mutex_lock(&worker->lock);
+        for (u64 i = 0; i < count; i++) {
+            Db_Query_Stats *stats = &worker->stats.queries[batch[i].type];
+            u64 latency = now - batch[i].submit_time;
+            stats->count++;
+            stats->failures += failed[i] ? 1 : 0;
+            stats->latency_total_ns += latency;
+            stats->execute_total_ns += execute_ns[i];
+            if (latency > stats->latency_max_ns) {
+                stats->latency_max_ns = latency;
+            }
+        }
+        pthread_mutex_unlock(&worker->lock);
+
+        mailbox_post(&worker->results, batch, count);
+        darray_clear(batch);
+    }
+
+    darray_destroy(batch);
+    return NULL;
+}
+
+LOCAL bool db_worker_prepare(Db_Worker *worker, const char *sql, sqlite3_stmt **out_stmt)
+{
+    if (sqlite3_prepare_v3(worker->db, sql, -1, SQLITE_PREPARE_PERSISTENT, out_stmt, NULL) != SQLITE_OK) {
+        LOG_ERROR("failed to prepare statement `%s`: %s\n", sql, sqlite3_errmsg(worker->db));
+        return false;
+    }
+
+    return true;
+}
+
+// Finalizing a NULL statement is a no-op, so this also cleans up after a partial prepare.
+LOCAL void db_worker_finalize(Db_Worker *worker)
+{
+    for (u32 i = 0; i < NUM_OF_DB_REQUEST_TYPES; i++) {
+        sqlite3_finalize(worker->statements[i]);
+    }
+    sqlite3_finalize(worker->begin_transaction);
+    sqlite3_finalize(worker->commit_transaction);
+    sqlite3_finalize(worker->rollback_transaction);
+}
+
+bool db_worker_create(Db_Worker *worker, sqlite3 *db)
+{
+    ASSERT(worker);
+    ASSERT(db);
+
+    mem_zero(worker, sizeof(Db_Worker));
+    worker->db = db;
+
+    bool prepared = db_worker_prepare(worker, "BEGIN;", &worker->begin_transaction) &&
+                    db_worker_prepare(worker, "COMMIT;", &worker->commit_transaction) &&
+                    db_worker_prepare(worker, "ROLLBACK;", &worker->rollback_transaction);
+    for (u32 i = 0; i < NUM_OF_DB_REQUEST_TYPES && prepared; i++) {
+        prepared = db_worker_prepare(worker, DB_REQUEST_SQL[i], &worker->statements[i]);
+    }
+
+    if (!prepared) {
+        db_worker_finalize(worker);
+        return false;
+    }
+
+    if (!mailbox_create(&worker->results, sizeof(Db_Request))) {
+        db_worker_finalize(worker);
+        return false;
+    }
+
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->wake, NULL);
+    worker->pending = (Db_Request *) darray_create(sizeof(Db_Request));
+
+    pthread_create(&worker->thread, NULL, db_worker_loop, worker);
+    return true;
+}
+
+void db_worker_destroy(Db_Worker *worker)
+{
+    ASSERT(worker);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->stopping = true;
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+
+    pthread_join(worker->thread, NULL);
+
+    // Results that were never taken may own a blacklist or profiles.
+    Db_Request *completed = (Db_Request *) worker->results.pending;
+    for (u64 i = 0; i < darray_length(completed); i++) {
+        if (completed[i].blacklist != NULL) {
+            ip_blacklist_destroy(completed[i].blacklist);
+        }
+        if (completed[i].profiles != NULL) {
+            darray_destroy(completed[i].profiles);
+        }
+    }
+
+    db_worker_finalize(worker);
+
+    // Move everything from the WAL into the database file, so it is complete on its own.
+    i32 log_frames, checkpointed_frames;
+    if (sqlite3_wal_checkpoint_v2(worker->db, NULL, SQLITE_CHECKPOINT_TRUNCATE, &log_frames, &checkpointed_frames) != SQLITE_OK) {
+        LOG_ERROR("failed to checkpoint the database: %s\n", sqlite3_errmsg(worker->db));
+    } else {
+        LOG_INFO("checkpointed %d of %d database log frames\n", checkpointed_frames, log_frames);
+    }
+    sqlite3_close(worker->db);
+
+    darray_destroy(worker->pending);
+    mailbox_destroy(&worker->results);
+    pthread_cond_destroy(&worker->wake);
+    pthread_mutex_destroy(&worker->lock);
+}
+
+bool db_worker_submit(Db_Worker *worker, const Db_Request *request)
+{
+    ASSERT(worker);
+    ASSERT(request && request->type < NUM_OF_DB_REQUEST_TYPES);
+
+    pthread_mutex_lock(&worker->lock);
+
+    if (worker->stats.depth >= DB_WORKER_MAX_PENDING) {
+        worker->stats.rejected++;
+        pthread_mutex_unlock(&worker->lock);
+        return false;
+    }
+
+    Db_Request queued = *request;
+    queued.submit_time = clock_get_absolute_time_ns();
+    darray_push(worker->pending, queued);
+
+    worker->stats.depth++;
+    if (worker->stats.depth > worker->stats.peak_depth) {
+        worker->stats.peak_depth = worker->stats.depth;
+    }
+
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+
+    return true;
+}
+
+Db_Request *db_worker_take(Db_Worker *worker, Db_Request *spare)
+{
+    ASSERT(worker);
+    ASSERT(spare && darray_length(spare) == 0);
+
+    Db_Request *taken = (Db_Request *) mailbox_take(&worker->results, spare);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->stats.depth -= darray_length(taken);
+    pthread_mutex_unlock(&worker->lock);
+
+    return taken;
+}
+
+Db_Worker_Stats db_worker_get_stats(Db_Worker *worker)
+{
+    ASSERT(worker);
+
+    pthread_mutex_lock(&worker->lock);
+    Db_Worker_Stats stats = worker->stats;
+    pthread_mutex_unlock(&worker->lock);
+
+    return stats;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "common/defines.h"
+#include "common/player_types.h"
+#include "ip_blacklist.h"
+#include "credentials.h"
+#include "mailbox.h"
+
+#define DB_WORKER_MAX_PENDING 1024 // requests submitted but not yet taken back by the network thread
+
+typedef enum {
+    DB_REQUEST_LOAD_IP_BLACKLIST, // result is true when 'blacklist' was loaded, the requester owns it
+    DB_REQUEST_LOAD_CREDENTIAL,   // result is true when the user exists, 'credential' holds the stored one
+    DB_REQUEST_STORE_CREDENTIAL,  // replaces the stored credential of 'username' with 'credential'
+    DB_REQUEST_LOAD_PROFILE,      // result is true when the query ran, 'found' tells whether 'profile' was stored
+    DB_REQUEST_STORE_PROFILES,    // writes all 'profiles' in one transaction, result is true when it was committed
+    NUM_OF_DB_REQUEST_TYPES
+} Db_Request_Type;
+
+// Persisted player state, keyed by username.
+typedef struct {
+    char username[PLAYER_USERNAME_MAX_LEN + 1];
+    f32 position[3];
+    f32 color[3];
+} Player_Profile;
+
+typedef struct {
+    Db_Request_Type type;
+    i32 socket;             // connection the request was made for, the serial tells a reused socket apart
+    u64 connection_serial;
+    u64 submit_time;
+    bool result;            // filled in by the worker
+    Ip_Blacklist *blacklist;
+    char username[PLAYER_USERNAME_MAX_LEN + 1];
+    char password[PLAYER_PASSWORD_MAX_LEN + 1]; // never used in a query, only carried to the verification
+    char credential[CREDENTIAL_MAX_LEN];
+    bool found;
+    Player_Profile profile;
+    Player_Profile *profiles; // darray, owned by the request and handed back with the result
+} Db_Request;
+
+typedef struct {
+    u64 count;
+    u64 failures;          // statements that failed to execute, reported as a false result
+    u64 latency_total_ns;  // from submit until the result is posted back
+    u64 latency_max_ns;
+    u64 execute_total_ns;  // spent stepping the statement
+} Db_Query_Stats;
+
+typedef struct {
+    u64 depth;      // requests in flight
+    u64 peak_depth;
+    u64 rejected;   // submissions refused because the queue was full
+    Db_Query_Stats queries[NUM_OF_DB_REQUEST_TYPES];
+} Db_Worker_Stats;
+
+/*
+ * Thread that owns the database connection, so queries never run on the network thread.
+ * Every query is a statement prepared once at startup with bound parameters. Requests are
+ * queued under a mutex and executed in batches. Results are posted back through the
+ * 'results' mailbox, which the network thread drains with db_worker_take.
+ * The database is expected to be in WAL mode, so the frequent small transactions that
+ * store player profiles append to the log instead of rewriting pages in place.
+ */
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *statements[NUM_OF_DB_REQUEST_TYPES];
+    sqlite3_stmt *begin_transaction;
+    sqlite3_stmt *commit_transaction;
+    sqlite3_stmt *rollback_transaction;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stopping;
+    Db_Request *pending;   // darray, waiting for the worker
+    Mailbox results;       // Db_Request, waiting for the network thread
+    Db_Worker_Stats stats; // under 'lock'
+} Db_Worker;
+
+// Takes over 'db', which is closed by db_worker_destroy.
+bool db_worker_create(Db_Worker *worker, sqlite3 *db);
+// Executes the requests that were already submitted, checkpoints the WAL and closes the database.
+void db_worker_destroy(Db_Worker *worker);
+
+// Returns false when DB_WORKER_MAX_PENDING requests are already in flight.
+bool db_worker_submit(Db_Worker *worker, const Db_Request *request);
+
+// Swaps the completed requests with the empty 'spare' darray and returns them, like mailbox_take.
+Db_Request *db_worker_take(Db_Worker *worker, Db_Request *spare);
+
+Db_Worker_Stats db_worker_get_stats(Db_Worker *worker);
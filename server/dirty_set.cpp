@@ -0,0 +1,75 @@
+#include "dirty_set.h"
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+void dirty_set_create(Dirty_Set *set, u32 capacity)
+{
+    ASSERT(set);
+    ASSERT(capacity > 0 && capacity < DIRTY_SET_END);
+
+    set->capacity = capacity;
+    set->head = DIRTY_SET_END;
+    set->next = (u32 *) mem_alloc(capacity * sizeof(u32), MEMORY_TAG_GAME);
+    set->ids = (u32 *) mem_alloc(capacity * sizeof(u32), MEMORY_TAG_GAME);
+    set->dirty = (u8 *) mem_alloc(capacity * sizeof(u8), MEMORY_TAG_GAME);
+}
+
+void dirty_set_destroy(Dirty_Set *set)
+{
+    ASSERT(set);
+
+    mem_free(set->next, set->capacity * sizeof(u32), MEMORY_TAG_GAME);
+    mem_free(set->ids, set->capacity * sizeof(u32), MEMORY_TAG_GAME);
+    mem_free(set->dirty, set->capacity * sizeof(u8), MEMORY_TAG_GAME);
+    mem_zero(set, sizeof(Dirty_Set));
+}
+
+void dirty_set_mark(Dirty_Set *set, u32 slot, u32 id)
+{
+    ASSERT(set);
+    ASSERT(slot < set->capacity);
+
+    // Written on every mark, a slot still on the stack may have been freed and reused since
+    // its first mark, and then the consumer has to see the id of its new owner.
+    __atomic_store_n(&set->ids[slot], id, __ATOMIC_RELAXED);
+
+    // Already on the stack, the consumer will pick it up.
+    if (__atomic_exchange_n(&set->dirty[slot], 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
+    u32 head = __atomic_load_n(&set->head, __ATOMIC_RELAXED);
+    do {
+        set->next[slot] = head;
+    } while (!__atomic_compare_exchange_n(&set->head, &head, slot, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+u32 dirty_set_detach(Dirty_Set *set)
+{
+    ASSERT(set);
+    return __atomic_exchange_n(&set->head, DIRTY_SET_END, __ATOMIC_ACQUIRE);
+}
+
+bool dirty_set_next(Dirty_Set *set, u32 *cursor, u32 *out_slot, u32 *out_id)
+{
+    ASSERT(set);
+    ASSERT(cursor && out_slot && out_id);
+
+    u32 slot = *cursor;
+    if (slot == DIRTY_SET_END) {
+        return false;
+    }
+
+    ASSERT(slot < set->capacity);
+
+    // The link has to be read before clearing the flag, after that a producer may push the slot
+    // again. The id only after it, a producer that found the flag still set wrote its id before
+    // that, and the exchange makes it visible here.
+    *cursor = set->next[slot];
+    *out_slot = slot;
+    __atomic_exchange_n(&set->dirty[slot], 0, __ATOMIC_ACQ_REL);
+    *out_id = __atomic_load_n(&set->ids[slot], __ATOMIC_RELAXED);
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "common/defines.h"
+
+#define DIRTY_SET_END 0xFFFFFFFF
+
+/*
+ * Lock-free set of dirty slots, marked by any number of producer threads and drained
+ * by a single consumer. Every slot has a dirty flag and a link, both preallocated,
+ * so marking never allocates: the first mark of a slot sets its flag and pushes the
+ * slot onto an intrusive stack with a CAS, later marks only find the flag already set.
+ * The consumer detaches the whole stack with one atomic exchange and walks it with
+ * dirty_set_next, which clears each flag after reading the link, so a slot that is
+ * marked again during the walk is simply pushed onto the next stack. The id is stored on
+ * every mark, so the consumer reports the latest one even when the slot changed owner
+ * while it was on the stack.
+ * The stack is LIFO, so a walk yields the most recently dirtied slots first.
+ */
+typedef struct {
+    u32 capacity;
+    u32 head;   // top of the stack or DIRTY_SET_END, atomic
+    u32 *next;  // per slot link to the slot below it in the stack
+    u32 *ids;   // per slot id reported to the consumer, written by every mark, atomic
+    u8 *dirty;  // per slot flag, atomic
+} Dirty_Set;
+
+void dirty_set_create(Dirty_Set *set, u32 capacity);
+void dirty_set_destroy(Dirty_Set *set);
+
+void dirty_set_mark(Dirty_Set *set, u32 slot, u32 id);
+
+// Consumer only.
+u32  dirty_set_detach(Dirty_Set *set); // Returns the cursor for dirty_set_next.
+bool dirty_set_next(Dirty_Set *set, u32 *cursor, u32 *out_slot, u32 *out_id);
@@ -0,0 +1,173 @@
+#include "ip_blacklist.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+#include "common/collections/darray.h"
+
+#define IP_BLACKLIST_ADDRESS_BITS (IP_BLACKLIST_ADDRESS_SIZE * 8)
+#define IPV4_MAPPED_PREFIX_BITS 96
+
+LOCAL void ipv4_to_mapped(const void *ipv4, u8 *out_address)
+{
+    mem_zero(out_address, IP_BLACKLIST_ADDRESS_SIZE);
+    out_address[10] = 0xFF;
+    out_address[11] = 0xFF;
+    mem_copy(out_address + 12, ipv4, 4);
+}
+
+INLINE u32 address_bit(const u8 *address, u32 index)
+{
+    return (address[index / 8] >> (7 - index % 8)) & 1;
+}
+
+Ip_Blacklist *ip_blacklist_create(void)
+{
+    Ip_Blacklist *blacklist = (Ip_Blacklist *) mem_alloc(sizeof(Ip_Blacklist), MEMORY_TAG_NETWORK);
+    blacklist->addresses = NULL;
+    blacklist->nodes = (Ip_Blacklist_Node *) darray_create(sizeof(Ip_Blacklist_Node));
+    blacklist->address_count = 0;
+    blacklist->range_count = 0;
+
+    Ip_Blacklist_Node root = {};
+    darray_push(blacklist->nodes, root);
+
+    return blacklist;
+}
+
+void ip_blacklist_destroy(Ip_Blacklist *blacklist)
+{
+    ASSERT(blacklist);
+
+    Ip_Blacklist_Address *entry, *tmp;
+    HASH_ITER(hh, blacklist->addresses, entry, tmp) {
+        HASH_DEL(blacklist->addresses, entry);
+        mem_free(entry, sizeof(Ip_Blacklist_Address), MEMORY_TAG_NETWORK);
+    }
+
+    darray_destroy(blacklist->nodes);
+    mem_free(blacklist, sizeof(Ip_Blacklist), MEMORY_TAG_NETWORK);
+}
+
+LOCAL void ip_blacklist_add_range(Ip_Blacklist *blacklist, const u8 *address, u32 prefix_length)
+{
+    u32 node = 0;
+    for (u32 i = 0; i < prefix_length; i++) {
+        if (blacklist->nodes[node].blocked) {
+            // Already covered by a wider range.
+            return;
+        }
+
+        u32 bit = address_bit(address, i);
+        u32 child = blacklist->nodes[node].children[bit];
+        if (child == 0) {
+            Ip_Blacklist_Node empty = {};
+            child = (u32) darray_length(blacklist->nodes);
+            darray_push(blacklist->nodes, empty);
+            blacklist->nodes[node].children[bit] = child;
+        }
+        node = child;
+    }
+
+    // Everything below is covered now, the subtree is left in place but never reached.
+    blacklist->nodes[node].blocked = true;
+    blacklist->range_count++;
+}
+
+bool ip_blacklist_add(Ip_Blacklist *blacklist, const char *entry)
+{
+    ASSERT(blacklist);
+    ASSERT(entry);
+
+    char text[INET6_ADDRSTRLEN + 8] = {0};
+    if (strlen(entry) >= sizeof(text)) {
+        return false;
+    }
+    strcpy(text, entry);
+
+    u32 max_prefix_length = IP_BLACKLIST_ADDRESS_BITS;
+    u32 prefix_offset = 0;
+    u8 address[IP_BLACKLIST_ADDRESS_SIZE];
+
+    char *slash = strchr(text, '/');
+    if (slash != NULL) {
+        *slash = '\0';
+    }
+
+    struct in_addr ipv4;
+    if (inet_pton(AF_INET, text, &ipv4) == 1) {
+        ipv4_to_mapped(&ipv4, address);
+        max_prefix_length = 32;
+        prefix_offset = IPV4_MAPPED_PREFIX_BITS;
+    } else if (inet_pton(AF_INET6, text, address) != 1) {
+        return false;
+    }
+
+    u32 prefix_length = max_prefix_length;
+    if (slash != NULL) {
+        char *end = NULL;
+        long value = strtol(slash + 1, &end, 10);
+        if (end == slash + 1 || *end != '\0' || value < 0 || value > (long) max_prefix_length) {
+            return false;
+        }
+        prefix_length = (u32) value;
+    }
+
+    if (prefix_length == max_prefix_length) {
+        Ip_Blacklist_Address *existing;
+        HASH_FIND(hh, blacklist->addresses, address, IP_BLACKLIST_ADDRESS_SIZE, existing);
+        if (existing == NULL) {
+            Ip_Blacklist_Address *added = (Ip_Blacklist_Address *) mem_alloc(sizeof(Ip_Blacklist_Address), MEMORY_TAG_NETWORK);
+            mem_copy(added->address, address, IP_BLACKLIST_ADDRESS_SIZE);
+            HASH_ADD(hh, blacklist->addresses, address, IP_BLACKLIST_ADDRESS_SIZE, added);
+            blacklist->address_count++;
+        }
+        return true;
+    }
+
+    ip_blacklist_add_range(blacklist, address, prefix_offset + prefix_length);
+    return true;
+}
+
+bool ip_blacklist_contains(const Ip_Blacklist *blacklist, const struct sockaddr *address)
+{
+    ASSERT(blacklist);
+    ASSERT(address);
+
+    u8 key[IP_BLACKLIST_ADDRESS_SIZE];
+    if (address->sa_family == AF_INET) {
+        ipv4_to_mapped(&((const struct sockaddr_in *) address)->sin_addr, key);
+    } else if (address->sa_family == AF_INET6) {
+        mem_copy(key, &((const struct sockaddr_in6 *) address)->sin6_addr, IP_BLACKLIST_ADDRESS_SIZE);
+    } else {
+        return false;
+    }
+
+    Ip_Blacklist_Address *entry;
+    HASH_FIND(hh, blacklist->addresses, key, IP_BLACKLIST_ADDRESS_SIZE, entry);
+    if (entry != NULL) {
+        return true;
+    }
+
+    if (blacklist->range_count == 0) {
+        return false;
+    }
+
+    u32 node = 0;
+    for (u32 i = 0; i < IP_BLACKLIST_ADDRESS_BITS; i++) {
+        if (blacklist->nodes[node].blocked) {
+            return true;
+        }
+
+        node = blacklist->nodes[node].children[address_bit(key, i)];
+        if (node == 0) {
+            return false;
+        }
+    }
+
+    return blacklist->nodes[node].blocked;
+}
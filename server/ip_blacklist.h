@@ -0,0 +1,39 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include "common/defines.h"
+#include "uthash/uthash.h"
+
+#define IP_BLACKLIST_ADDRESS_SIZE 16 // IPv4 addresses are stored IPv4-mapped, as ::ffff:a.b.c.d
+
+typedef struct {
+    u8 address[IP_BLACKLIST_ADDRESS_SIZE];
+    UT_hash_handle hh;
+} Ip_Blacklist_Address;
+
+typedef struct {
+    u32 children[2]; // indices into the node darray, 0 when absent since the root is never a child
+    bool blocked;    // a range ends here, everything below is blocked as well
+} Ip_Blacklist_Node;
+
+/*
+ * Blacklisted addresses and ranges, built once and then only read. Single addresses
+ * live in a hash set, CIDR ranges in a binary trie over the address bits, so a lookup
+ * is one hash probe plus a walk of at most 128 nodes that stops at the first range.
+ * IPv4 is handled as IPv4-mapped IPv6, which also matches IPv4 clients accepted on a
+ * dual stack IPv6 socket.
+ */
+typedef struct {
+    Ip_Blacklist_Address *addresses; // uthash keyed by address
+    Ip_Blacklist_Node *nodes;        // darray, root at index 0
+    u32 address_count;
+    u32 range_count;
+} Ip_Blacklist;
+
+Ip_Blacklist *ip_blacklist_create(void);
+void ip_blacklist_destroy(Ip_Blacklist *blacklist);
+
+// Accepts an IPv4 or IPv6 address, optionally followed by /prefix_length. Returns false if it cannot be parsed.
+bool ip_blacklist_add(Ip_Blacklist *blacklist, const char *entry);
+bool ip_blacklist_contains(const Ip_Blacklist *blacklist, const struct sockaddr *address);
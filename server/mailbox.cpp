@@ -0,0 +1,81 @@
+#include "mailbox.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "common/log.h"
+#include "common/asserts.h"
+#include "common/collections/darray.h"
+
+bool mailbox_create(Mailbox *mailbox, u64 stride)
+{
+    ASSERT(mailbox);
+    ASSERT(stride > 0);
+
+    mailbox->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mailbox->event_fd == -1) {
+        LOG_ERROR("eventfd error: %s\n", strerror(errno));
+        return false;
+    }
+
+    pthread_mutex_init(&mailbox->lock, NULL);
+    mailbox->pending = darray_create(stride);
+    return true;
+}
+
+void mailbox_destroy(Mailbox *mailbox)
+{
+    ASSERT(mailbox);
+
+    darray_destroy(mailbox->pending);
+    pthread_mutex_destroy(&mailbox->lock);
+    close(mailbox->event_fd);
+}
+
+void mailbox_post(Mailbox *mailbox, const void *items, u64 count)
+{
+    ASSERT(mailbox);
+    ASSERT(items || count == 0);
+
+    if (count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&mailbox->lock);
+    bool was_empty = darray_length(mailbox->pending) == 0;
+    u64 stride = darray_stride(mailbox->pending);
+    for (u64 i = 0; i < count; i++) {
+        mailbox->pending = _darray_push(mailbox->pending, (const u8 *) items + i * stride);
+    }
+    pthread_mutex_unlock(&mailbox->lock);
+
+    // The network thread has not taken the previous items yet, so it is already signaled.
+    if (was_empty) {
+        u64 value = 1;
+        if (write(mailbox->event_fd, &value, sizeof(value)) != sizeof(value)) {
+            LOG_ERROR("failed to signal the mailbox: %s\n", strerror(errno));
+        }
+    }
+}
+
+void *mailbox_take(Mailbox *mailbox, void *spare)
+{
+    ASSERT(mailbox);
+    ASSERT(spare && darray_length(spare) == 0);
+    ASSERT(darray_stride(spare) == darray_stride(mailbox->pending));
+
+    // Reset the counter, later posts will signal again.
+    u64 value;
+    if (read(mailbox->event_fd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+        LOG_ERROR("failed to read the mailbox signal: %s\n", strerror(errno));
+    }
+
+    pthread_mutex_lock(&mailbox->lock);
+    void *taken = mailbox->pending;
+    mailbox->pending = spare;
+    pthread_mutex_unlock(&mailbox->lock);
+
+    return taken;
+}
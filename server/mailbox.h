@@ -0,0 +1,27 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "common/defines.h"
+
+/*
+ * Hands items produced by other threads over to the network thread. Producers append under a
+ * mutex and signal 'event_fd', which the network thread registers in its reactor and drains
+ * with mailbox_take. Only the post that finds the mailbox empty signals, until the items are
+ * taken the network thread is already woken up. Items are copied by value, 'stride' bytes each.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    void *pending; // darray
+    i32 event_fd;
+} Mailbox;
+
+bool mailbox_create(Mailbox *mailbox, u64 stride);
+// Items that were not taken are dropped, the owner releases what they hold beforehand.
+void mailbox_destroy(Mailbox *mailbox);
+
+void mailbox_post(Mailbox *mailbox, const void *items, u64 count);
+
+// Swaps the pending items with the empty 'spare' darray and returns them. The caller passes the
+// returned darray back in as 'spare' next time, once it is done with the items.
+void *mailbox_take(Mailbox *mailbox, void *spare);
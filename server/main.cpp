@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <errno.h>
 #include <time.h>
 #include <pthread.h>
@@ -12,11 +13,24 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/random.h>
 #include <sqlite3.h>
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include "pollfd_set.h"
+#include "reactor.h"
+#include "connection.h"
+#include "outbox.h"
+#include "spatial_grid.h"
+#include "dirty_set.h"
+#include "state_snapshot.h"
+#include "tick_scheduler.h"
+#include "db_worker.h"
+#include "ip_blacklist.h"
+#include "auth_pool.h"
+#include "username_index.h"
+#include "player_store.h"
 #include "common/net.h"
 #include "common/log.h"
 #include "common/clock.h"
@@ -24,28 +38,64 @@
 #include "common/defines.h"
 #include "common/hexdump.h"
 #include "common/packet.h"
+#include "common/packet_framer.h"
+#include "common/send_queue.h"
+#include "common/datagram.h"
 #include "common/event.h"
 #include "common/player_types.h"
 #include "common/entity_types.h"
 #include "common/memory/memutils.h"
 #include "common/collections/darray.h"
-#include "uthash/uthash.h"
+#include "common/collections/hash_map.h"
 
 #define SERVER_BACKLOG 10
-#define INPUT_BUFFER_SIZE 1024
-#define INPUT_OVERFLOW_BUFFER_SIZE 1024
 #define DEFAULT_DATABASE_FILEPATH "db"
+#define SERVER_STATS_PERIOD_NS (5ULL * 1000 * 1000 * 1000)
+#define SERVER_LOOP_TIMEOUT_MS 1000
+#define SERVER_HANDSHAKE_TIMEOUT_NS (10ULL * 1000 * 1000 * 1000)
+#define SERVER_HANDSHAKE_CHECK_PERIOD_NS (1ULL * 1000 * 1000 * 1000)
+#define HANDSHAKE_PUZZLE_KEY 0xDEADBEEFCAFEBABE
+#define SERVER_DEFAULT_INTEREST_RADIUS 32.0f
+#define SERVER_DEFAULT_BATCH_PACKET_SIZE 1200 // bytes, stays below a typical path MTU
+#define SERVER_MAX_PLAYERS 4096
+#define SERVER_DEFAULT_TICK_RATE 60
+#define SERVER_PROFILE_FLUSH_PERIOD_NS (2ULL * 1000 * 1000 * 1000)
+#define SERVER_SNAPSHOT_PLAYERS_PER_PACKET 1024 // at most ~61 KiB per packet, well within a send queue
+#define SERVER_DATAGRAMS_PER_CALL 64
+#define SERVER_WORLD_LIMIT 1000000.0f // players moving beyond this distance from the origin on any axis are ignored
 
 typedef struct {
-    i32 socket;
+    u32 slot;
     player_id id;
-    UT_hash_handle hh;
-} Socket_Player_Id_Pair;
+} Unpublished_Move;
 
+// Tick traffic is counted apart from handshakes and replies, a single outbox drain may hold
+// the packets of several ticks when the network thread falls behind.
 typedef struct {
-    player_id id;
-    UT_hash_handle hh;
-} Player_Moved;
+    u64 packets;          // packets queued on connections
+    u64 write_calls;      // system calls that wrote them
+    u64 ticks;            // distinct processing ticks whose packets were queued
+    u64 last_tick;
+    u64 tick_packets;     // packets of those ticks queued on connections, datagrams are counted apart
+    u64 tick_write_calls; // system calls of flushes that carried packets of a tick
+} Send_Stats;
+
+typedef struct {
+    u64 received;
+    u64 rejected;   // malformed, unknown token or from another host
+    u64 stale;      // older than one already received from the same client
+    u64 sent;
+    u64 send_calls;
+    u64 send_drops; // not sent because the socket buffer was full or the address unreachable
+} Datagram_Stats;
+
+// Sent at the end of the loop iteration, to the address the recipient's datagrams came from.
+typedef struct {
+    Datagram_Header header;
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    Packet_Buffer *buffer;
+} Pending_Datagram;
 
 Net_Stat net_stat;
 Memory_Stats mem_stats;
@@ -54,14 +104,48 @@ Registered_Event registered_events[NUM_OF_EVENT_CODES];
 
 LOCAL bool running;
 LOCAL i32 server_socket;
-LOCAL Pollfd_Set server_pfds;
-LOCAL sqlite3 *server_db = NULL;
-LOCAL Player *players = NULL; // uthash
-LOCAL Socket_Player_Id_Pair *socket_to_player_id_map = NULL; // uthash
-LOCAL Player_Moved *moved_players = NULL; // uthash
-LOCAL pthread_mutex_t moved_players_lock;
-LOCAL player_id player_next_id = 1000;
+LOCAL i32 udp_socket = -1;
+LOCAL Reactor server_reactor;
+LOCAL sqlite3 *server_db = NULL; // owned by the database worker once it is started
+LOCAL Db_Worker db_worker;
+LOCAL Db_Request *db_results_spare = NULL; // darray, swapped with the worker's results on every drain
+LOCAL Ip_Blacklist *ip_blacklist = NULL; // network thread only, replaced as a whole on reload
+LOCAL i32 reload_signal_fd = -1;
+LOCAL u64 blacklist_rejections = 0;
+LOCAL Auth_Pool auth_pool;
+LOCAL Auth_Job *auth_results_spare = NULL; // darray, swapped with the pool's results on every drain
+LOCAL u32 auth_iterations = CREDENTIAL_DEFAULT_ITERATIONS;
+LOCAL u32 auth_workers = AUTH_POOL_DEFAULT_WORKERS;
+LOCAL Player_Store players;
+LOCAL Username_Index player_usernames; // owns the usernames of the players
+LOCAL Hash_Map connections; // i32 socket -> Connection *
+LOCAL Hash_Map udp_sessions; // u64 udp token -> i32 socket, joined connections only
+LOCAL Connection **closed_connections = NULL; // darray, destroyed at the end of each loop iteration
+LOCAL Connection **failed_connections = NULL; // darray, disconnected at the end of each loop iteration
+LOCAL Connection **scheduled_flushes = NULL; // darray, flushed at the end of each loop iteration
+LOCAL Send_Stats send_stats; // since the last stats log
+LOCAL Pending_Datagram *pending_datagrams = NULL; // darray, sent at the end of each loop iteration
+LOCAL Datagram_Stats datagram_stats; // since the last stats log
+LOCAL Outbox server_outbox;
+LOCAL Outbound_Packet *outbox_spare = NULL; // darray, swapped with the outbox on every drain
+LOCAL u64 send_queue_overflows = 0;
+LOCAL Dirty_Set moved_players; // marked by the network thread, drained by the processing thread
+LOCAL Snapshot_Exchange player_snapshots; // written by the network thread, read by the processing thread
+LOCAL bool snapshot_stale = false; // player state changed since the last published snapshot
+LOCAL u64 snapshot_publish_time = 0;
+LOCAL Unpublished_Move *unpublished_moves = NULL; // darray, marked as moved once published
+LOCAL player_id *dirty_profile_ids = NULL; // darray, online players whose profile changed since the last flush
+LOCAL Player_Profile *departed_profiles = NULL; // darray, profiles of players that left since the last flush
+LOCAL u64 profile_flush_time = 0;
 LOCAL Light light;
+LOCAL f32 interest_radius = SERVER_DEFAULT_INTEREST_RADIUS;
+LOCAL u32 batch_packet_size = SERVER_DEFAULT_BATCH_PACKET_SIZE;
+LOCAL u32 tick_rate = SERVER_DEFAULT_TICK_RATE;
+LOCAL Tick_Scheduler tick_scheduler; // processing thread only once started
+// Player state is published twice per tick, so a move waits at most half a tick for the processing thread to see it.
+LOCAL u64 snapshot_publish_interval_ns;
+LOCAL Spatial_Grid player_grid; // network thread only, keyed by player id
+LOCAL player_id *interest_ids = NULL; // darray, scratch for interest queries
 
 void *get_in_addr(struct sockaddr *addr)
 {
@@ -78,146 +162,500 @@ void signal_handler(i32 sig)
     running = false;
 }
 
-bool check_ip_allowed(const char *ip_addr)
+bool is_player_already_connected(const char *username)
 {
-    ASSERT_MSG(server_db != NULL, "sqlite3 handle not initialized");
+    return username_index_find(&player_usernames, username) != 0;
+}
 
-    char sql[256] = {0};
-    snprintf(sql, 256, "SELECT * FROM ip_blacklist WHERE ip_address = '%s';", ip_addr);
+void handle_client_event(i32 client_socket, u32 events, void *user_data);
 
-    sqlite3_stmt *stmt;
-    i32 rc = sqlite3_prepare_v2(server_db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        LOG_ERROR("failed to prepare statement: %s\n", sqlite3_errmsg(server_db));
-        return false;
+LOCAL void schedule_disconnect(Connection *connection)
+{
+    // Disconnecting right away is not safe, because sends happen while iterating the players
+    // and a disconnect broadcasts to (and removes from) the same players.
+    if (!connection->closed && !connection->send_failed) {
+        connection->send_failed = true;
+        darray_push(failed_connections, connection);
     }
+}
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+LOCAL void flush_connection(Connection *connection)
+{
+    u64 write_calls = connection->send_queue.write_calls;
+    Send_Queue_Flush_Result result = send_queue_flush(&connection->send_queue, connection->socket);
+    send_stats.write_calls += connection->send_queue.write_calls - write_calls;
+    if (connection->tick_data_queued) {
+        send_stats.tick_write_calls += connection->send_queue.write_calls - write_calls;
+        connection->tick_data_queued = result == SEND_QUEUE_FLUSH_PENDING;
+    }
 
-    return rc != SQLITE_ROW;
+    switch (result) {
+        case SEND_QUEUE_FLUSH_DRAINED: {
+            if (connection->write_pending) {
+                connection->write_pending = false;
+                reactor_modify(&server_reactor, connection->socket, REACTOR_EVENT_READ);
+            }
+        } break;
+        case SEND_QUEUE_FLUSH_PENDING: {
+            if (!connection->write_pending) {
+                connection->write_pending = true;
+                reactor_modify(&server_reactor, connection->socket, REACTOR_EVENT_READ | REACTOR_EVENT_WRITE);
+            }
+        } break;
+        case SEND_QUEUE_FLUSH_ERROR: {
+            LOG_ERROR("send error on socket=%d: %s\n", connection->socket, strerror(errno));
+            schedule_disconnect(connection);
+        } break;
+    }
 }
 
-bool player_authenticate(const char *username, const char *password)
+// Takes over the caller's buffer reference. The packet is only written at the end of the loop
+// iteration, together with everything else queued for the connection until then, so each
+// connection costs one system call per iteration (and so per tick) instead of one per packet.
+LOCAL bool queue_packet(Connection *connection, Packet_Buffer *buffer)
 {
-    ASSERT_MSG(server_db != NULL, "sqlite3 handle not initialized");
-
-    char sql[256] = {0};
-    snprintf(sql, 256, "SELECT * FROM users WHERE username = '%s' AND password = '%s';", username, password);
+    if (connection->closed || connection->send_failed) {
+        packet_buffer_release(buffer);
+        return false;
+    }
 
-    sqlite3_stmt *stmt;
-    i32 rc = sqlite3_prepare_v2(server_db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        LOG_ERROR("failed to prepare statement: %s\n", sqlite3_errmsg(server_db));
+    if (!send_queue_push(&connection->send_queue, buffer)) {
+        LOG_WARN("send queue of socket=%d is full (%llu packets, %llu bytes), dropping the client\n",
+                 connection->socket, send_queue_depth(&connection->send_queue), connection->send_queue.bytes_queued);
+        packet_buffer_release(buffer);
+        send_queue_overflows++;
+        schedule_disconnect(connection);
         return false;
     }
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    send_stats.packets++;
 
-    return rc == SQLITE_ROW;
+    // While a write is pending the writable event flushes the queue instead.
+    if (!connection->write_pending && !connection->flush_scheduled) {
+        connection->flush_scheduled = true;
+        darray_push(scheduled_flushes, connection);
+    }
+
+    return true;
 }
 
-bool is_player_already_connected(const char *username, u8 length)
+LOCAL void flush_scheduled_connections(void)
 {
-    // TODO: Optimize
-    // Not ideal to iterate through all players and compare strings.
-    for (Player *player = players; player != NULL; player = (Player *) player->hh.next) {
-        if (strncmp(username, player->username, length) == 0) {
-            return true;
+    for (u64 i = 0; i < darray_length(scheduled_flushes); i++) {
+        Connection *connection = scheduled_flushes[i];
+        connection->flush_scheduled = false;
+        if (!connection->closed && !connection->send_failed && !connection->write_pending) {
+            flush_connection(connection);
         }
     }
 
-    return false;
+    darray_clear(scheduled_flushes);
 }
 
-bool validate_incoming_client(i32 client_socket)
+// Takes over the caller's buffer reference. Only for connections with a bound datagram channel.
+LOCAL void queue_datagram(Connection *connection, u32 sequence, Packet_Buffer *buffer)
 {
-    u64 puzzle_value = clock_get_absolute_time_ns();
+    ASSERT(connection->udp_bound);
 
-    i64 bytes_read, bytes_sent;
+    if (connection->closed || connection->send_failed) {
+        packet_buffer_release(buffer);
+        return;
+    }
 
-    bytes_sent = net_send(client_socket, (void *) &puzzle_value, sizeof(puzzle_value), 0);
-    if (bytes_sent == -1) {
-        LOG_ERROR("validation: send error: %s\n", strerror(errno));
-        return false;
-    } else if (bytes_sent != sizeof(puzzle_value)) {
-        LOG_ERROR("validation: failed to send %lu bytes of validation data\n", sizeof(puzzle_value));
-        return false;
+    Pending_Datagram datagram = {};
+    datagram.header.token = connection->udp_token;
+    datagram.header.sequence = sequence;
+    datagram.address = connection->udp_address;
+    datagram.address_length = connection->udp_address_length;
+    datagram.buffer = buffer;
+    darray_push(pending_datagrams, datagram);
+}
+
+// Sends the pending datagrams of all connections with as few system calls as possible.
+// Nothing is ever retried, a datagram that cannot be sent now is superseded by the next tick.
+LOCAL void flush_pending_datagrams(void)
+{
+    u64 count = darray_length(pending_datagrams);
+
+    u64 next = 0;
+    while (next < count) {
+        struct mmsghdr messages[SERVER_DATAGRAMS_PER_CALL] = {};
+        struct iovec iov[SERVER_DATAGRAMS_PER_CALL][2];
+
+        u32 batch = count - next < SERVER_DATAGRAMS_PER_CALL ? (u32) (count - next) : SERVER_DATAGRAMS_PER_CALL;
+        for (u32 i = 0; i < batch; i++) {
+            Pending_Datagram *datagram = &pending_datagrams[next + i];
+            iov[i][0].iov_base = &datagram->header;
+            iov[i][0].iov_len = sizeof(Datagram_Header);
+            iov[i][1].iov_base = datagram->buffer->data;
+            iov[i][1].iov_len = datagram->buffer->size;
+            messages[i].msg_hdr.msg_name = &datagram->address;
+            messages[i].msg_hdr.msg_namelen = datagram->address_length;
+            messages[i].msg_hdr.msg_iov = iov[i];
+            messages[i].msg_hdr.msg_iovlen = 2;
+        }
+
+        i32 sent = net_sendmmsg(udp_socket, messages, batch);
+        datagram_stats.send_calls++;
+        if (sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                datagram_stats.send_drops += count - next;
+                break;
+            }
+
+            // Only the first datagram of the batch failed, the rest goes out with the next call.
+            LOG_TRACE("failed to send datagram: %s\n", strerror(errno));
+            datagram_stats.send_drops++;
+            next++;
+            continue;
+        }
+
+        datagram_stats.sent += (u64) sent;
+        next += (u64) sent;
     }
 
-    // TODO: Come up with a better validation function
-    u64 answer = puzzle_value ^ 0xDEADBEEFCAFEBABE;
+    for (u64 i = 0; i < count; i++) {
+        packet_buffer_release(pending_datagrams[i].buffer);
+    }
+    darray_clear(pending_datagrams);
+}
 
-    u64 result_buffer;
-    bytes_read = net_recv(client_socket, (void *) &result_buffer, sizeof(result_buffer), 0);
-    if (bytes_read <= 0) {
-        if (bytes_read == -1) {
-            LOG_ERROR("validation: recv error: %s\n", strerror(errno));
-        } else if (bytes_read == 0) {
-            LOG_ERROR("validation: orderly shutdown\n");
+LOCAL bool send_packet(Connection *connection, u32 type, void *packet_data)
+{
+    return queue_packet(connection, packet_buffer_create(type, packet_data));
+}
+
+LOCAL Connection *find_player_connection(u32 slot)
+{
+    Connection **connection = (Connection **) hash_map_find(&connections, &players.details[slot].socket);
+    return connection != NULL ? *connection : NULL;
+}
+
+// Serializes the packet once and queues the same buffer for every player in 'ids' except 'except'.
+LOCAL void broadcast_packet(const player_id *ids, u64 count, u32 type, void *packet_data, player_id except)
+{
+    if (count == 0) {
+        return;
+    }
+
+    Packet_Buffer *buffer = packet_buffer_create(type, packet_data);
+
+    for (u64 i = 0; i < count; i++) {
+        if (ids[i] == except) {
+            continue;
         }
-        return false;
+
+        u32 slot;
+        if (!player_store_find(&players, ids[i], &slot)) {
+            continue;
+        }
+
+        Connection *connection = find_player_connection(slot);
+        if (connection == NULL) {
+            LOG_ERROR("no connection found for player id=%u socket=%d\n", ids[i], players.details[slot].socket);
+            continue;
+        }
+
+        queue_packet(connection, packet_buffer_retain(buffer));
     }
 
-    if (bytes_read == sizeof(result_buffer)) {
-        bool status_buffer = result_buffer == answer;
-        bytes_sent = net_send(client_socket, (void *) &status_buffer, sizeof(status_buffer), 0);
-        if (bytes_sent == -1) {
-            LOG_ERROR("validation status: send error: %s\n", strerror(errno));
-            return false;
-        } else if (bytes_sent != sizeof(status_buffer)) {
-            LOG_ERROR("validation status: failed to send %lu bytes of validation data\n", sizeof(puzzle_value));
-            return false;
+    packet_buffer_release(buffer);
+}
+
+LOCAL void fill_player_add_packet(u32 slot, Packet_Player_Add *packet)
+{
+    const Player_Details *details = &players.details[slot];
+    packet->id = players.ids[slot];
+    packet->username_length = (u8) strlen(details->username);
+    memcpy(packet->username, details->username, packet->username_length);
+    memcpy(packet->color, glm::value_ptr(details->color), 3 * sizeof(f32));
+    memcpy(packet->position, glm::value_ptr(players.positions[slot]), 3 * sizeof(f32));
+}
+
+LOCAL void fill_light_update_packet(const Light *source, Packet_Light_Update *packet)
+{
+    packet->id = source->id;
+    packet->radius = source->radius;
+    packet->angular_velocity = source->angular_velocity;
+    memcpy(packet->initial_position, glm::value_ptr(source->initial_position), 3 * sizeof(f32));
+    memcpy(packet->ambient, glm::value_ptr(source->ambient), 3 * sizeof(f32));
+    memcpy(packet->diffuse, glm::value_ptr(source->diffuse), 3 * sizeof(f32));
+    memcpy(packet->specular, glm::value_ptr(source->specular), 3 * sizeof(f32));
+}
+
+// Sends the players in 'ids' (except 'self') and the lights to 'connection' in WORLD_SNAPSHOT
+// packets, split every SERVER_SNAPSHOT_PLAYERS_PER_PACKET players. The lights go in the first one.
+LOCAL void send_world_snapshot(Connection *connection, player_id self, const player_id *ids, u64 count,
+                               const Packet_Light_Update *lights, u32 light_count)
+{
+    u32 capacity = count < SERVER_SNAPSHOT_PLAYERS_PER_PACKET ? (u32) count : SERVER_SNAPSHOT_PLAYERS_PER_PACKET;
+    u32 player_size = sizeof(player_id) + 6 * sizeof(f32) + sizeof(u8) + PLAYER_USERNAME_MAX_LEN;
+    u64 block_size = capacity > 0 ? capacity * player_size : 1;
+    u8 *block = (u8 *) mem_alloc(block_size, MEMORY_TAG_NETWORK);
+
+    Packet_World_Snapshot snapshot = {};
+    snapshot.ids = (player_id *) block;
+    snapshot.colors = (f32 *) (snapshot.ids + capacity);
+    snapshot.positions = snapshot.colors + capacity * 3;
+    snapshot.username_lengths = (u8 *) (snapshot.positions + capacity * 3);
+    snapshot.usernames = (char *) (snapshot.username_lengths + capacity);
+    snapshot.light_count = light_count;
+    snapshot.lights = (Packet_Light_Update *) lights;
+
+    u32 usernames_size = 0;
+    for (u64 i = 0; i <= count; i++) {
+        bool last = i == count;
+
+        u32 other;
+        if (!last && ids[i] != self && player_store_find(&players, ids[i], &other)) {
+            u32 n = snapshot.player_count++;
+            const Player_Details *details = &players.details[other];
+            u8 length = (u8) strlen(details->username);
+            snapshot.ids[n] = ids[i];
+            memcpy(&snapshot.colors[n * 3], glm::value_ptr(details->color), 3 * sizeof(f32));
+            memcpy(&snapshot.positions[n * 3], glm::value_ptr(players.positions[other]), 3 * sizeof(f32));
+            snapshot.username_lengths[n] = length;
+            memcpy(snapshot.usernames + usernames_size, details->username, length);
+            usernames_size += length;
         }
 
-        return status_buffer;
+        bool full = snapshot.player_count == SERVER_SNAPSHOT_PLAYERS_PER_PACKET;
+        if ((full || last) && (snapshot.player_count > 0 || snapshot.light_count > 0)) {
+            send_packet(connection, PACKET_TYPE_WORLD_SNAPSHOT, &snapshot);
+            snapshot.player_count = 0;
+            snapshot.light_count = 0;
+            usernames_size = 0;
+        }
     }
 
-    LOG_WARN("validation: received incorrect number of bytes\n");
-    return false;
+    mem_free(block, block_size, MEMORY_TAG_NETWORK);
 }
 
-void handle_new_connection_request_event(void)
+// Tells the player in 'slot' about everyone in 'ids' and everyone in 'ids' about that player.
+// Players that come into view are announced with PLAYER_ADD to the others and with a single
+// WORLD_SNAPSHOT (which also carries 'lights') to the player, players that go out of view with PLAYER_REMOVE.
+LOCAL void exchange_visibility(u32 slot, Connection *connection, const player_id *ids, u64 count, bool visible,
+                               const Packet_Light_Update *lights, u32 light_count)
 {
-    struct sockaddr_storage client_addr;
-    u32 client_addr_len = sizeof(client_addr);
+    player_id id = players.ids[slot];
+
+    if (visible) {
+        Packet_Player_Add player_add = {};
+        fill_player_add_packet(slot, &player_add);
+        broadcast_packet(ids, count, PACKET_TYPE_PLAYER_ADD, &player_add, id);
+    } else {
+        Packet_Player_Remove remove = { .id = id };
+        broadcast_packet(ids, count, PACKET_TYPE_PLAYER_REMOVE, &remove, id);
+    }
 
-    i32 client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_addr_len);
-    if (client_socket == -1) {
-        LOG_ERROR("accept error: %s\n", strerror(errno));
+    if (visible) {
+        send_world_snapshot(connection, id, ids, count, lights, light_count);
         return;
     }
 
+    for (u64 i = 0; i < count; i++) {
+        u32 other;
+        if (ids[i] == id || !player_store_find(&players, ids[i], &other)) {
+            continue;
+        }
+
+        Packet_Player_Remove remove = { .id = ids[i] };
+        send_packet(connection, PACKET_TYPE_PLAYER_REMOVE, &remove);
+    }
+}
+
+// Emits enter and leave events after the player crossed from one grid cell to another.
+LOCAL void update_player_interest(u32 slot, Connection *connection, Cell_Coord from, Cell_Coord to)
+{
+    darray_clear(interest_ids);
+    spatial_grid_query(&player_grid, to, &from, &interest_ids);
+    exchange_visibility(slot, connection, interest_ids, darray_length(interest_ids), true, NULL, 0);
+
+    darray_clear(interest_ids);
+    spatial_grid_query(&player_grid, from, &to, &interest_ids);
+    exchange_visibility(slot, connection, interest_ids, darray_length(interest_ids), false, NULL, 0);
+}
+
+void handle_outbox_event(i32 fd, u32 events, void *user_data)
+{
+    UNUSED(fd); UNUSED(events); UNUSED(user_data);
+
+    Outbound_Packet *packets = outbox_take(&server_outbox, outbox_spare);
+
+    for (u64 i = 0; i < darray_length(packets); i++) {
+        // Ticks are submitted in order, so every new tick starts where the previous one ends.
+        if (packets[i].tick != send_stats.last_tick) {
+            send_stats.last_tick = packets[i].tick;
+            send_stats.ticks++;
+        }
+
+        u32 slot;
+        Connection *connection = player_store_find(&players, packets[i].recipient, &slot) ? find_player_connection(slot) : NULL;
+        if (connection == NULL) {
+            // The player disconnected after the packet was produced.
+            packet_buffer_release(packets[i].buffer);
+            continue;
+        }
+
+        // Until the client's first datagram arrives, or for batches too big for one datagram, TCP it is.
+        if (packets[i].unreliable && connection->udp_bound &&
+            sizeof(Datagram_Header) + packets[i].buffer->size <= DATAGRAM_MAX_SIZE) {
+            queue_datagram(connection, packets[i].sequence, packets[i].buffer);
+            continue;
+        }
+
+        if (queue_packet(connection, packets[i].buffer)) {
+            connection->tick_data_queued = true;
+            send_stats.tick_packets++;
+        }
+    }
+
+    darray_clear(packets);
+    outbox_spare = packets;
+}
+
+LOCAL void log_send_queue_stats(void)
+{
+    u32 connection_count = 0;
+    u64 waiting_count = 0, queued_packets = 0, queued_bytes = 0, max_depth = 0, peak_depth = 0;
+
+    u64 it = 0;
+    void *value;
+    while (hash_map_next(&connections, &it, NULL, &value)) {
+        Connection *c = *(Connection **) value;
+        u64 depth = send_queue_depth(&c->send_queue);
+        connection_count++;
+        waiting_count += c->write_pending ? 1 : 0;
+        queued_packets += depth;
+        queued_bytes += c->send_queue.bytes_queued;
+        if (depth > max_depth) max_depth = depth;
+        if (c->send_queue.peak_depth > peak_depth) peak_depth = c->send_queue.peak_depth;
+    }
+
+    UNUSED(connection_count); UNUSED(waiting_count); UNUSED(queued_packets); UNUSED(queued_bytes);
+    UNUSED(max_depth); UNUSED(peak_depth);
+    LOG_DEBUG("send queues: connections=%u waiting=%llu queued_packets=%llu queued_bytes=%llu max_depth=%llu peak_depth=%llu overflows=%llu\n",
+              connection_count, waiting_count, queued_packets, queued_bytes, max_depth, peak_depth, send_queue_overflows);
+
+    f64 ticks = send_stats.ticks > 0 ? (f64) send_stats.ticks : 1.0;
+    f64 write_calls = send_stats.write_calls > 0 ? (f64) send_stats.write_calls : 1.0;
+    UNUSED(ticks); UNUSED(write_calls);
+    LOG_DEBUG("sends: packets=%llu write_calls=%llu packets_per_write=%.1f ticks=%llu packets_per_tick=%.1f write_calls_per_tick=%.1f\n",
+              send_stats.packets, send_stats.write_calls, (f64) send_stats.packets / write_calls, send_stats.ticks,
+              (f64) send_stats.tick_packets / ticks, (f64) send_stats.tick_write_calls / ticks);
+    u64 last_tick = send_stats.last_tick;
+    mem_zero(&send_stats, sizeof(Send_Stats));
+    send_stats.last_tick = last_tick;
+
+    LOG_DEBUG("datagrams: sessions=%llu received=%llu rejected=%llu stale=%llu sent=%llu send_calls=%llu send_drops=%llu\n",
+              hash_map_length(&udp_sessions), datagram_stats.received, datagram_stats.rejected, datagram_stats.stale,
+              datagram_stats.sent, datagram_stats.send_calls, datagram_stats.send_drops);
+    mem_zero(&datagram_stats, sizeof(Datagram_Stats));
+}
+
+LOCAL void publish_player_state(void)
+{
+    State_Snapshot *snapshot = snapshot_exchange_begin_write(&player_snapshots);
+    for (u32 i = 0; i < players.count; i++) {
+        u32 slot = players.live[i];
+        snapshot_write_player(snapshot, slot, players.ids[slot], glm::value_ptr(players.positions[slot]));
+    }
+    snapshot_exchange_publish(&player_snapshots);
+
+    // The moves are part of a published snapshot now, so the processing thread may pick them up.
+    for (u64 i = 0; i < darray_length(unpublished_moves); i++) {
+        dirty_set_mark(&moved_players, unpublished_moves[i].slot, unpublished_moves[i].id);
+        players.flags[unpublished_moves[i].slot] &= (u8) ~PLAYER_FLAG_MOVE_UNPUBLISHED;
+    }
+    darray_clear(unpublished_moves);
+
+    snapshot_stale = false;
+}
+
+LOCAL i32 get_loop_timeout_ms(u64 now)
+{
+    if (!snapshot_stale) {
+        return SERVER_LOOP_TIMEOUT_MS;
+    }
+
+    // Wake up in time for the next publish.
+    u64 next_publish_time = snapshot_publish_time + snapshot_publish_interval_ns;
+    if (now >= next_publish_time) {
+        return 0;
+    }
+
+    return (i32) ((next_publish_time - now + 999999) / 1000000);
+}
+
+LOCAL void accept_client(i32 client_socket, struct sockaddr_storage *client_addr)
+{
     char client_ip[INET6_ADDRSTRLEN] = {0};
-    inet_ntop(client_addr.ss_family,
-              get_in_addr((struct sockaddr *)&client_addr),
+    inet_ntop(client_addr->ss_family,
+              get_in_addr((struct sockaddr *)client_addr),
               client_ip,
               INET6_ADDRSTRLEN);
 
-    u16 port = client_addr.ss_family == AF_INET ?
-               ((struct sockaddr_in *)&client_addr)->sin_port :
-               ((struct sockaddr_in6 *)&client_addr)->sin6_port;
+    u16 port = client_addr->ss_family == AF_INET ?
+               ((struct sockaddr_in *)client_addr)->sin_port :
+               ((struct sockaddr_in6 *)client_addr)->sin6_port;
     UNUSED(port);
-    LOG_INFO("new connection from %s:%hu\n", client_ip, port);
 
-    if (!check_ip_allowed(client_ip)) {
+    if (ip_blacklist_contains(ip_blacklist, (struct sockaddr *) client_addr)) {
+        blacklist_rejections++;
         LOG_WARN("rejected connection from %s because the ip address is blacklisted\n", client_ip);
         close(client_socket);
         return;
     }
 
-    LOG_INFO("ip address %s is allowed\n", client_ip);
+    LOG_INFO("new connection from %s:%hu\n", client_ip, port);
+
+    if (!net_set_nonblocking(client_socket)) {
+        LOG_ERROR("failed to set socket=%d to non-blocking mode: %s\n", client_socket, strerror(errno));
+        close(client_socket);
+        return;
+    }
+
+    // Writes are already coalesced per loop iteration, Nagle's algorithm would only hold them back further.
+    if (!net_set_nodelay(client_socket)) {
+        LOG_WARN("failed to disable nagle's algorithm on socket=%d: %s\n", client_socket, strerror(errno));
+    }
 
-    if (!validate_incoming_client(client_socket)) {
-        LOG_WARN("%s:%hu failed validation\n", client_ip, port);
+    Connection *connection = connection_create(client_socket, client_addr);
+    if (!reactor_add(&server_reactor, client_socket, REACTOR_EVENT_READ, handle_client_event, connection)) {
+        connection_destroy(connection);
         close(client_socket);
         return;
     }
 
-    LOG_INFO("%s:%hu passed validation\n", client_ip, port);
+    hash_map_insert(&connections, &client_socket, &connection);
 
-    pollfd_set_add(&server_pfds, client_socket);
+    // The rest of the handshake is driven by the client's readiness events, the loop never waits for it.
+    // TODO: Come up with a better validation function
+    u64 puzzle = clock_get_absolute_time_ns();
+    connection->puzzle_answer = puzzle ^ HANDSHAKE_PUZZLE_KEY;
+    connection->handshake_deadline = clock_get_absolute_time_ns() + SERVER_HANDSHAKE_TIMEOUT_NS;
+    queue_packet(connection, packet_buffer_create_raw(&puzzle, sizeof(puzzle)));
+}
+
+void handle_new_connection_request_event(i32 fd, u32 events, void *user_data)
+{
+    UNUSED(events); UNUSED(user_data);
+
+    // The listening socket is edge-triggered, so accept until the backlog is empty.
+    for (;;) {
+        struct sockaddr_storage client_addr;
+        u32 client_addr_len = sizeof(client_addr);
+
+        i32 client_socket = accept(fd, (struct sockaddr *)&client_addr, &client_addr_len);
+        if (client_socket == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("accept error: %s\n", strerror(errno));
+            }
+            return;
+        }
+
+        accept_client(client_socket, &client_addr);
+    }
 }
 
 LOCAL glm::vec3 get_random_color(void)
@@ -235,29 +673,140 @@ LOCAL glm::vec3 get_random_color(void)
     return glm::vec3(r, g, b);
 }
 
-LOCAL void handle_player_join_request(i32 client_socket, Packet_Player_Join_Req *packet)
+LOCAL void handle_player_join_request(Connection *connection, Packet_Player_Join_Req *packet)
 {
     ASSERT(packet->username_length <= PLAYER_USERNAME_MAX_LEN && packet->password_length <= PLAYER_PASSWORD_MAX_LEN);
 
-    char username[PLAYER_USERNAME_MAX_LEN + 1] = {};
-    char password[PLAYER_PASSWORD_MAX_LEN + 1] = {};
-    memcpy(username, packet->username, packet->username_length);
-    memcpy(password, packet->password, packet->password_length);
+    if (connection->state != CONNECTION_STATE_AWAITING_JOIN) {
+        LOG_WARN("ignoring join request from socket=%d, which is already joined or being authenticated\n", connection->socket);
+        return;
+    }
+
+    // The stored credential is loaded by the database worker, then verified by the authentication
+    // pool, and the join completes in complete_player_join.
+    Db_Request request = {};
+    request.type = DB_REQUEST_LOAD_CREDENTIAL;
+    request.socket = connection->socket;
+    request.connection_serial = connection->serial;
+    memcpy(request.username, packet->username, packet->username_length);
+    memcpy(request.password, packet->password, packet->password_length);
+
+    if (!db_worker_submit(&db_worker, &request)) {
+        LOG_WARN("rejected join request of `%s` because the database queue is full\n", request.username);
+        Packet_Player_Join_Res response = {};
+        response.approved = false;
+        if (!send_packet(connection, PACKET_TYPE_PLAYER_JOIN_RES, &response)) {
+            LOG_ERROR("failed to send player join response packet\n");
+        }
+        return;
+    }
+
+    connection->state = CONNECTION_STATE_AUTHENTICATING;
+}
+
+LOCAL Player_Profile make_player_profile(u32 slot)
+{
+    const Player_Details *details = &players.details[slot];
+    Player_Profile profile = {};
+    memcpy(profile.username, details->username, strlen(details->username));
+    memcpy(profile.position, glm::value_ptr(players.positions[slot]), 3 * sizeof(f32));
+    memcpy(profile.color, glm::value_ptr(details->color), 3 * sizeof(f32));
+    return profile;
+}
+
+LOCAL void mark_profile_dirty(u32 slot)
+{
+    if (!(players.flags[slot] & PLAYER_FLAG_PROFILE_DIRTY)) {
+        players.flags[slot] |= PLAYER_FLAG_PROFILE_DIRTY;
+        darray_push(dirty_profile_ids, players.ids[slot]);
+    }
+}
+
+/*
+ * Hands the profiles that changed since the last flush to the database worker, which writes
+ * them in one transaction. However often a player moved in between, it is stored once.
+ * Nothing here touches the disk, the profiles are only copied into the request.
+ */
+LOCAL void flush_player_profiles(void)
+{
+    Player_Profile *batch = departed_profiles;
+
+    for (u64 i = 0; i < darray_length(dirty_profile_ids); i++) {
+        u32 slot;
+        if (!player_store_find(&players, dirty_profile_ids[i], &slot)) {
+            // Left since, its profile was taken when it disconnected.
+            continue;
+        }
+
+        players.flags[slot] &= (u8) ~PLAYER_FLAG_PROFILE_DIRTY;
+        Player_Profile profile = make_player_profile(slot);
+        darray_push(batch, profile);
+    }
+    darray_clear(dirty_profile_ids);
+
+    if (darray_length(batch) == 0) {
+        departed_profiles = batch;
+        return;
+    }
+
+    Db_Request request = {};
+    request.type = DB_REQUEST_STORE_PROFILES;
+    request.socket = -1;
+    request.profiles = batch;
+    if (!db_worker_submit(&db_worker, &request)) {
+        // Kept in order, so newer copies of the same profiles appended later still win.
+        LOG_WARN("could not store %llu player profiles, the database queue is full\n", darray_length(batch));
+        departed_profiles = batch;
+        return;
+    }
+
+    departed_profiles = (Player_Profile *) darray_create(sizeof(Player_Profile));
+}
+
+// Random, so that only the client told the token over TCP can send datagrams for the session.
+// Returns 0 when no randomness is available, the session then only uses TCP.
+LOCAL u64 create_udp_token(void)
+{
+    u64 token = 0;
+    while (token == 0 || hash_map_contains(&udp_sessions, &token)) {
+        if (getrandom(&token, sizeof(token), 0) != (i64) sizeof(token)) {
+            LOG_ERROR("failed to generate a udp token: %s\n", strerror(errno));
+            return 0;
+        }
+    }
+
+    return token;
+}
+
+// 'profile' is NULL for a player that has never joined before.
+LOCAL void complete_player_join(Connection *connection, const char *username, bool authenticated, const Player_Profile *profile)
+{
+    // Whatever the outcome, the client may try again.
+    connection->state = CONNECTION_STATE_AWAITING_JOIN;
 
     Packet_Player_Join_Res response = {};
-    if (!player_authenticate(username, password)) {
+    if (!authenticated) {
         LOG_WARN("player authentication failed for `%s`\n", username);
         response.approved = false;
-        if (!packet_send(client_socket, PACKET_TYPE_PLAYER_JOIN_RES, &response)) {
+        if (!send_packet(connection, PACKET_TYPE_PLAYER_JOIN_RES, &response)) {
             LOG_ERROR("failed to send player join response packet\n");
         }
         return;
     }
 
-    if (is_player_already_connected(username, packet->username_length)) {
+    if (is_player_already_connected(username)) {
         LOG_WARN("player `%s` already connected\n", username);
         response.approved = false;
-        if (!packet_send(client_socket, PACKET_TYPE_PLAYER_JOIN_RES, &response)) {
+        if (!send_packet(connection, PACKET_TYPE_PLAYER_JOIN_RES, &response)) {
+            LOG_ERROR("failed to send player join response packet\n");
+        }
+        return;
+    }
+
+    if (players.count == players.capacity) {
+        LOG_WARN("rejected player `%s` because the server is full\n", username);
+        response.approved = false;
+        if (!send_packet(connection, PACKET_TYPE_PLAYER_JOIN_RES, &response)) {
             LOG_ERROR("failed to send player join response packet\n");
         }
         return;
@@ -267,84 +816,130 @@ LOCAL void handle_player_join_request(i32 client_socket, Packet_Player_Join_Req
 
     glm::vec3 color = get_random_color();
     glm::vec3 position = glm::vec3(0.0f);
+    if (profile != NULL) {
+        memcpy(glm::value_ptr(color), profile->color, 3 * sizeof(f32));
+        memcpy(glm::value_ptr(position), profile->position, 3 * sizeof(f32));
+    }
 
-    Player *new_player = (Player *) malloc(sizeof(Player));
-    new_player->socket = client_socket;
-    new_player->id = player_next_id++;
-    memcpy(new_player->username, packet->username, packet->username_length);
-    new_player->color = color;
-    new_player->position = position;
+    u32 slot;
+    player_id id = player_store_add(&players, &slot);
+    ASSERT(id != 0);
+    Player_Details *details = &players.details[slot];
+    details->socket = connection->socket;
+    details->username = username_index_insert(&player_usernames, username, id);
+    details->color = color;
+    players.positions[slot] = position;
+
+    connection->udp_token = create_udp_token();
+    if (connection->udp_token != 0) {
+        hash_map_insert(&udp_sessions, &connection->udp_token, &connection->socket);
+    }
 
     response.approved = true;
-    response.id = new_player->id;
-    memcpy(response.color, glm::value_ptr(new_player->color), 3 * sizeof(f32));
-    memcpy(response.position, glm::value_ptr(new_player->position), 3 * sizeof(f32));
+    response.id = id;
+    response.udp_token = connection->udp_token;
+    memcpy(response.color, glm::value_ptr(color), 3 * sizeof(f32));
+    memcpy(response.position, glm::value_ptr(position), 3 * sizeof(f32));
 
-    if (!packet_send(client_socket, PACKET_TYPE_PLAYER_JOIN_RES, &response)) {
+    if (!send_packet(connection, PACKET_TYPE_PLAYER_JOIN_RES, &response)) {
         LOG_ERROR("failed to send player join response packet\n");
     }
 
     {
-        // Send new player to all existing players
-        Packet_Player_Add player_add = {};
-        player_add.id = new_player->id;
-        player_add.username_length = packet->username_length;
-        memcpy(player_add.username, new_player->username, player_add.username_length);
-        memcpy(player_add.color, glm::value_ptr(new_player->color), 3 * sizeof(f32));
-        memcpy(player_add.position, glm::value_ptr(new_player->position), 3 * sizeof(f32));
-
-        Player *player;
-        for (player = players; player != NULL; player = (Player *) player->hh.next) {
-            if (!packet_send(player->socket, PACKET_TYPE_PLAYER_ADD, &player_add)) {
-                LOG_ERROR("failed to send new player to existing player socket=%d id=%u\n", player->socket, player->id);
-            }
-        }
+        // Exchange the new player with the existing players within the interest radius,
+        // the new player gets all of them and the light in one snapshot.
+        spatial_grid_insert(&player_grid, id, glm::value_ptr(position));
+
+        Cell_Coord cell;
+        spatial_grid_find(&player_grid, id, &cell);
+
+        darray_clear(interest_ids);
+        spatial_grid_query(&player_grid, cell, NULL, &interest_ids);
+
+        Packet_Light_Update light_update = {};
+        fill_light_update_packet(&light, &light_update);
+        exchange_visibility(slot, connection, interest_ids, darray_length(interest_ids), true, &light_update, 1);
     }
 
-    {
-        // Send all existing players to the new player
-        Player *player;
-        for (player = players; player != NULL; player = (Player *) player->hh.next) {
-            Packet_Player_Add player_add = {};
-            player_add.id = player->id;
-            player_add.username_length = (u8) strlen(player->username);
-            memcpy(player_add.username, player->username, player_add.username_length);
-            memcpy(player_add.color, glm::value_ptr(player->color), 3 * sizeof(f32));
-            memcpy(player_add.position, glm::value_ptr(player->position), 3 * sizeof(f32));
-
-            if (!packet_send(client_socket, PACKET_TYPE_PLAYER_ADD, &player_add)) {
-                LOG_ERROR("failed to send player add packet\n");
+    snapshot_stale = true;
+    if (profile == NULL) {
+        mark_profile_dirty(slot);
+    }
+
+    connection->id = id;
+    connection->state = CONNECTION_STATE_JOINED;
+    LOG_DEBUG("added mapping between socket=%d -> player_id=%u\n", connection->socket, connection->id);
+}
+
+LOCAL void disconnect_client(Connection *connection)
+{
+    if (connection->closed) {
+        return;
+    }
+
+    // Update other players that the user disconnected if the player has joined
+    if (connection->id != 0) {
+        Packet_Player_Remove remove = { .id = connection->id };
+
+        Cell_Coord cell;
+        if (spatial_grid_find(&player_grid, connection->id, &cell)) {
+            darray_clear(interest_ids);
+            spatial_grid_query(&player_grid, cell, NULL, &interest_ids);
+
+            // Do not send remove packet to the player who is disconnecting
+            broadcast_packet(interest_ids, darray_length(interest_ids), PACKET_TYPE_PLAYER_REMOVE, &remove, connection->id);
+            spatial_grid_remove(&player_grid, connection->id);
+        }
+
+        u32 slot;
+        if (player_store_find(&players, connection->id, &slot)) {
+            if (players.flags[slot] & PLAYER_FLAG_PROFILE_DIRTY) {
+                Player_Profile profile = make_player_profile(slot);
+                darray_push(departed_profiles, profile);
             }
+            username_index_remove(&player_usernames, players.details[slot].username);
+            player_store_remove(&players, connection->id);
+            snapshot_stale = true;
+            LOG_DEBUG("removed player with id=%u from server\n", connection->id);
+        } else {
+            LOG_ERROR("player with id=%u not found\n", connection->id);
         }
     }
 
-    // Add at the end so that the iteration above does not include the new player.
-    HASH_ADD_INT(players, id, new_player);
+    // Queued packets are normally written at the end of the loop iteration, so whatever was
+    // queued last (like a rejection) gets one best effort write before the socket is closed.
+    if (!connection->send_failed && !send_queue_is_empty(&connection->send_queue)) {
+        u64 write_calls = connection->send_queue.write_calls;
+        send_queue_flush(&connection->send_queue, connection->socket);
+        send_stats.write_calls += connection->send_queue.write_calls - write_calls;
+    }
 
-    {
-        // Send light update
-        Packet_Light_Update light_update = {};
-        light_update.id = light.id;
-        light_update.radius = light.radius;
-        light_update.angular_velocity = light.angular_velocity;
-        memcpy(light_update.initial_position, glm::value_ptr(light.initial_position), 3 * sizeof(f32));
-        memcpy(light_update.ambient, glm::value_ptr(light.ambient), 3 * sizeof(f32));
-        memcpy(light_update.diffuse, glm::value_ptr(light.diffuse), 3 * sizeof(f32));
-        memcpy(light_update.specular, glm::value_ptr(light.specular), 3 * sizeof(f32));
-        if (!packet_send(client_socket, PACKET_TYPE_LIGHT_UPDATE, &light_update)) {
-            LOG_ERROR("failed to send light_update update packet\n");
-        }
-    }
-
-    // Add mapping of client socket to player id
-    Socket_Player_Id_Pair *mapping = (Socket_Player_Id_Pair *) malloc(sizeof(Socket_Player_Id_Pair));
-    mapping->socket = client_socket;
-    mapping->id = new_player->id;
-    HASH_ADD_INT(socket_to_player_id_map, socket, mapping);
-    LOG_DEBUG("added mapping between socket=%d -> player_id=%u\n", mapping->socket, mapping->id);
+    if (connection->udp_token != 0) {
+        hash_map_remove(&udp_sessions, &connection->udp_token, NULL);
+    }
+
+    hash_map_remove(&connections, &connection->socket, NULL);
+    reactor_remove(&server_reactor, connection->socket);
+    close(connection->socket);
+
+    // Packets of this connection may still be in the middle of being parsed,
+    // so the memory is released only at the end of the loop iteration.
+    connection->closed = true;
+    darray_push(closed_connections, connection);
 }
 
-LOCAL void process_network_packet(i32 client_socket, u32 type, void *data)
+// Also false for NaN and infinities, which every comparison fails.
+LOCAL bool position_is_in_world(const f32 *position)
+{
+    for (u32 i = 0; i < 3; i++) {
+        if (!(fabsf(position[i]) <= SERVER_WORLD_LIMIT)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+LOCAL void process_network_packet(Connection *connection, u32 type, void *data)
 {
     switch (type) {
         case PACKET_TYPE_NONE: {
@@ -352,203 +947,474 @@ LOCAL void process_network_packet(i32 client_socket, u32 type, void *data)
         } break;
         case PACKET_TYPE_PING: {
             LOG_TRACE("received ping packet\n");
-            packet_send(client_socket, PACKET_TYPE_PING, (Packet_Ping *) data);
+            send_packet(connection, PACKET_TYPE_PING, (Packet_Ping *) data);
         } break;
         case PACKET_TYPE_TXT_MSG: {
             Packet_Text_Message packet;
             deserialize_packet_txt_msg(data, &packet);
-            LOG_TRACE("received text message of length %lu: %s\n", packet.length, packet.message);
+            LOG_TRACE("received text message of length %u: %.*s\n", packet.length, (i32) packet.length, packet.message);
         } break;
         case PACKET_TYPE_PLAYER_JOIN_REQ: {
             Packet_Player_Join_Req *packet = (Packet_Player_Join_Req *) data;
-            handle_player_join_request(client_socket, packet);
+            handle_player_join_request(connection, packet);
         } break;
         case PACKET_TYPE_PLAYER_REMOVE: {
-            Packet_Player_Remove *remove = (Packet_Player_Remove *) data;
-
-            Player *player;
-            for (player = players; player != NULL; player = (Player *) player->hh.next) {
-                // Do not send remove packet to the player who is disconnecting (client_socket)
-                if (player->socket != client_socket) {
-                    if (!packet_send(player->socket, PACKET_TYPE_PLAYER_REMOVE, remove)) {
-                        LOG_ERROR("failed to send player remove packet\n");
-                    }
-                }
+            // The player is identified by the connection, not by the id in the packet.
+            disconnect_client(connection);
+        } break;
+        case PACKET_TYPE_PLAYER_MOVE: {
+            Packet_Player_Move *packet = (Packet_Player_Move *) data;
+
+            if (packet->id != connection->id) {
+                LOG_WARN("socket=%d tried to move player id=%u\n", connection->socket, packet->id);
+                break;
+            }
+
+            f32 position[3];
+            memcpy(position, packet->position, sizeof(position));
+            if (!position_is_in_world(position)) {
+                LOG_WARN("socket=%d sent a position outside of the world\n", connection->socket);
+                break;
             }
 
-            Socket_Player_Id_Pair *mapping = NULL;
-            HASH_FIND_INT(socket_to_player_id_map, &client_socket, mapping);
-            ASSERT(mapping != NULL);
-            LOG_DEBUG("removed mapping between socket=%d -> player_id=%u\n", mapping->socket, mapping->id);
-            HASH_DEL(socket_to_player_id_map, mapping);
-            free(mapping);
-
-            Player *p;
-            HASH_FIND_INT(players, &remove->id, p);
-            if (p) {
-                HASH_DEL(players, p);
-                free(p);
-                LOG_DEBUG("removed player with id=%u from server\n", remove->id);
+            // Update locally
+            u32 slot;
+            if (player_store_find(&players, packet->id, &slot)) {
+                memcpy(glm::value_ptr(players.positions[slot]), position, sizeof(position));
             } else {
-                LOG_ERROR("player with id=%u not found\n", remove->id);
+                LOG_ERROR("player with id=%u not found\n", packet->id);
+                break;
             }
 
-            pollfd_set_remove(&server_pfds, client_socket);
-            close(client_socket);
+            Cell_Coord from, to;
+            if (spatial_grid_update(&player_grid, packet->id, glm::value_ptr(players.positions[slot]), &from, &to)) {
+                update_player_interest(slot, connection, from, to);
+                if (connection->closed || connection->send_failed) {
+                    break;
+                }
+            }
+
+            // Aggregate player moves by marking players that moved within the interval
+            // instead of sending updates right away. The mark waits for the next published snapshot.
+            snapshot_stale = true;
+            if (!(players.flags[slot] & PLAYER_FLAG_MOVE_UNPUBLISHED)) {
+                players.flags[slot] |= PLAYER_FLAG_MOVE_UNPUBLISHED;
+                Unpublished_Move move = { .slot = slot, .id = packet->id };
+                darray_push(unpublished_moves, move);
+            }
+            mark_profile_dirty(slot);
         } break;
-        case PACKET_TYPE_PLAYER_MOVE: {
-            Packet_Player_Move *packet = (Packet_Player_Move *) data;
+        default: {
+            LOG_ERROR("unknown packet type value `%u`\n", type);
+        }
+    }
+}
+
+LOCAL bool is_same_host(const struct sockaddr_storage *a, const struct sockaddr_storage *b)
+{
+    if (a->ss_family != b->ss_family) {
+        return false;
+    }
+
+    if (a->ss_family == AF_INET) {
+        return memcmp(&((const struct sockaddr_in *) a)->sin_addr, &((const struct sockaddr_in *) b)->sin_addr, sizeof(struct in_addr)) == 0;
+    }
+
+    if (a->ss_family == AF_INET6) {
+        return memcmp(&((const struct sockaddr_in6 *) a)->sin6_addr, &((const struct sockaddr_in6 *) b)->sin6_addr, sizeof(struct in6_addr)) == 0;
+    }
+
+    return false;
+}
+
+void handle_datagram_event(i32 fd, u32 events, void *user_data)
+{
+    UNUSED(events); UNUSED(user_data);
+
+    PERSIST u8 data[DATAGRAM_MAX_SIZE];
+
+    // Edge-triggered, so read until the socket is empty.
+    for (;;) {
+        struct sockaddr_storage address;
+        socklen_t address_length;
+        i64 bytes_read = net_recvfrom(fd, data, sizeof(data), &address, &address_length);
+        if (bytes_read == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("recvfrom error: %s\n", strerror(errno));
+            }
+            return;
+        }
+
+        datagram_stats.received++;
+
+        Datagram_Header header;
+        Packet_Header packet_header;
+        u8 *payload;
+        if (!datagram_parse(data, (u64) bytes_read, &header, &packet_header, &payload)) {
+            datagram_stats.rejected++;
+            continue;
+        }
+
+        i32 *socket = (i32 *) hash_map_find(&udp_sessions, &header.token);
+        Connection **found = socket != NULL ? (Connection **) hash_map_find(&connections, socket) : NULL;
+        if (found == NULL || (*found)->state != CONNECTION_STATE_JOINED || !is_same_host(&(*found)->address, &address)) {
+            datagram_stats.rejected++;
+            continue;
+        }
+
+        Connection *connection = *found;
+        if (!datagram_window_accept(&connection->udp_window, header.sequence)) {
+            datagram_stats.stale++;
+            continue;
+        }
+
+        // Always replies to where the newest datagram came from, which follows a NAT rebinding.
+        connection->udp_bound = true;
+        connection->udp_address = address;
+        connection->udp_address_length = address_length;
+
+        switch (packet_header.type) {
+            case PACKET_TYPE_PING: {
+                // Sent to bind the channel and to keep it open, there is nothing else to do.
+            } break;
+            case PACKET_TYPE_PLAYER_MOVE: {
+                process_network_packet(connection, packet_header.type, payload);
+            } break;
+            default: {
+                datagram_stats.rejected++;
+            }
+        }
+    }
+}
+
+LOCAL bool request_ip_blacklist_load(void)
+{
+    Db_Request request = {};
+    request.type = DB_REQUEST_LOAD_IP_BLACKLIST;
+    request.socket = -1;
+    if (!db_worker_submit(&db_worker, &request)) {
+        LOG_ERROR("failed to request an ip blacklist reload, the database queue is full\n");
+        return false;
+    }
+    return true;
+}
+
+LOCAL void swap_ip_blacklist(const Db_Request *request)
+{
+    if (!request->result) {
+        // Without a first blacklist the listening socket is never registered, the server would run
+        // without ever accepting a connection.
+        if (ip_blacklist == NULL) {
+            LOG_FATAL("failed to load the ip blacklist\n");
+            exit(EXIT_FAILURE);
+        }
+        LOG_ERROR("failed to load the ip blacklist, keeping the current one\n");
+        return;
+    }
+
+    // Only the network thread reads the blacklist, so replacing the pointer swaps it for every
+    // connection accepted from now on, with no lookup ever seeing a half loaded blacklist.
+    Ip_Blacklist *previous = ip_blacklist;
+    ip_blacklist = request->blacklist;
+    LOG_INFO("loaded ip blacklist with %u addresses and %u ranges\n", ip_blacklist->address_count, ip_blacklist->range_count);
+
+    if (previous != NULL) {
+        ip_blacklist_destroy(previous);
+        return;
+    }
+
+    // Connections are accepted once the first blacklist is in place, until then they wait in the backlog.
+    if (!reactor_add(&server_reactor, server_socket, REACTOR_EVENT_READ, handle_new_connection_request_event, NULL)) {
+        LOG_FATAL("failed to register the listening socket\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void handle_reload_signal_event(i32 fd, u32 events, void *user_data)
+{
+    UNUSED(events); UNUSED(user_data);
+
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        LOG_INFO("received SIGHUP, reloading the ip blacklist\n");
+        request_ip_blacklist_load();
+    }
+}
+
+void handle_db_event(i32 fd, u32 events, void *user_data)
+{
+    UNUSED(fd); UNUSED(events); UNUSED(user_data);
+
+    Db_Request *results = db_worker_take(&db_worker, db_results_spare);
+
+    for (u64 i = 0; i < darray_length(results); i++) {
+        Db_Request *request = &results[i];
+
+        if (request->type == DB_REQUEST_LOAD_IP_BLACKLIST) {
+            swap_ip_blacklist(request);
+            continue;
+        }
+
+        if (request->type == DB_REQUEST_STORE_CREDENTIAL) {
+            if (!request->result) {
+                LOG_ERROR("failed to store the upgraded credential of `%s`\n", request->username);
+            }
+            continue;
+        }
+
+        if (request->type == DB_REQUEST_STORE_PROFILES) {
+            if (!request->result) {
+                LOG_ERROR("failed to store %llu player profiles\n", darray_length(request->profiles));
+            }
+            darray_destroy(request->profiles);
+            continue;
+        }
+
+        Connection **found = (Connection **) hash_map_find(&connections, &request->socket);
+        Connection *connection = found != NULL ? *found : NULL;
+        if (connection == NULL || connection->serial != request->connection_serial) {
+            // The client disconnected while the query was running.
+            continue;
+        }
+
+        switch (request->type) {
+            case DB_REQUEST_LOAD_IP_BLACKLIST:
+            case DB_REQUEST_STORE_CREDENTIAL:
+            case DB_REQUEST_STORE_PROFILES: {
+                ASSERT_MSG(false, "not a connection request");
+            } break;
+            case DB_REQUEST_LOAD_CREDENTIAL: {
+                ASSERT(connection->state == CONNECTION_STATE_AUTHENTICATING);
+
+                // An unknown user is verified against a dummy credential too, so it is refused
+                // as slowly as a wrong password and does not reveal which usernames exist.
+                Auth_Job job = {};
+                job.socket = request->socket;
+                job.connection_serial = request->connection_serial;
+                job.unknown_user = !request->result;
+                memcpy(job.username, request->username, sizeof(job.username));
+                memcpy(job.password, request->password, sizeof(job.password));
+                memcpy(job.credential, request->credential, sizeof(job.credential));
+
+                if (!auth_pool_submit(&auth_pool, &job)) {
+                    LOG_WARN("rejected join request of `%s` because too many logins are being verified\n", request->username);
+                    complete_player_join(connection, request->username, false, NULL);
+                }
+                mem_zero(job.password, sizeof(job.password));
+            } break;
+            case DB_REQUEST_LOAD_PROFILE: {
+                ASSERT(connection->state == CONNECTION_STATE_LOADING_PROFILE);
+                if (!request->result) {
+                    // Joining without it would overwrite the stored profile with a fresh one.
+                    LOG_ERROR("failed to load the profile of `%s`\n", request->username);
+                    complete_player_join(connection, request->username, false, NULL);
+                    break;
+                }
+
+                complete_player_join(connection, request->username, true, request->found ? &request->profile : NULL);
+            } break;
+            case NUM_OF_DB_REQUEST_TYPES: {
+                ASSERT_MSG(false, "invalid database request type");
+            } break;
+        }
+    }
+
+    // The passwords were only carried for the verification.
+    for (u64 i = 0; i < darray_length(results); i++) {
+        mem_zero(results[i].password, sizeof(results[i].password));
+    }
 
-            // Update locally
-            Player *player;
-            HASH_FIND_INT(players, &packet->id, player);
-            if (player != NULL) {
-                memcpy(glm::value_ptr(player->position), packet->position, 3 * sizeof(f32));
-            } else {
-                LOG_ERROR("player with id=%u not found\n", packet->id);
-                break;
-            }
+    darray_clear(results);
+    db_results_spare = results;
+}
 
-            // Aggregate player moves by saving ids of players that moved within the interval
-            // instead of sending updates right away.
-            Player_Moved *player_moved = NULL;
-            pthread_mutex_lock(&moved_players_lock);
-            HASH_FIND_INT(moved_players, &packet->id, player_moved);
-            if (player_moved == NULL) {
-                // TODO: Replace malloc with scratch buffer, because the elements are short lived
-                // (they need to be valid only until the aggregated moves are broadcasted to players)
-                // and to make the allocation faster, since it's inside a mutex.
-                player_moved = (Player_Moved *) malloc(sizeof(Player_Moved));
-                player_moved->id = packet->id;
-                HASH_ADD_INT(moved_players, id, player_moved);
-            }
-            pthread_mutex_unlock(&moved_players_lock);
-        } break;
-        default: {
-            LOG_ERROR("unknown packet type value `%u`\n", type);
+LOCAL void load_player_profile(Connection *connection, const char *username)
+{
+    // The database worker executes requests in order, so flushing the profile of a player
+    // that left and is joining again before its load makes the load see the latest state.
+    for (u64 i = 0; i < darray_length(departed_profiles); i++) {
+        if (strcmp(departed_profiles[i].username, username) == 0) {
+            flush_player_profiles();
+            break;
         }
     }
+
+    Db_Request request = {};
+    request.type = DB_REQUEST_LOAD_PROFILE;
+    request.socket = connection->socket;
+    request.connection_serial = connection->serial;
+    memcpy(request.username, username, strlen(username));
+
+    if (!db_worker_submit(&db_worker, &request)) {
+        LOG_WARN("rejected join request of `%s` because the database queue is full\n", username);
+        complete_player_join(connection, username, false, NULL);
+        return;
+    }
+
+    connection->state = CONNECTION_STATE_LOADING_PROFILE;
 }
 
-bool receive_client_data(i32 client_socket, u8 *recv_buffer, u32 buffer_size, i64 *bytes_read)
+void handle_auth_event(i32 fd, u32 events, void *user_data)
 {
-    ASSERT(client_socket > 2 && recv_buffer && bytes_read);
-
-    *bytes_read = net_recv(client_socket, recv_buffer, buffer_size, 0);
-    if (*bytes_read <= 0) {
-        if (*bytes_read == -1) {
-            LOG_ERROR("recv error: %s\n", strerror(errno));
-        } else if (*bytes_read == 0) {
-            LOG_INFO("orderly shutdown of client with socket=%d\n", client_socket);
-
-            // Update other players that the user disconnected if the mapping exists
-            Socket_Player_Id_Pair *mapping;
-            HASH_FIND_INT(socket_to_player_id_map, &client_socket, mapping);
-
-            if (mapping != NULL) {
-                LOG_DEBUG("removed mapping between socket=%d -> player_id=%u\n", mapping->socket, mapping->id);
-                Packet_Player_Remove remove = { .id = mapping->id };
-
-                Player *player;
-                for (player = players; player != NULL; player = (Player *) player->hh.next) {
-                    // Do not send remove packet to the player who is disconnecting (client_socket)
-                    if (player->socket != client_socket) {
-                        if (!packet_send(player->socket, PACKET_TYPE_PLAYER_REMOVE, &remove)) {
-                            LOG_ERROR("failed to send player remove packet\n");
-                        }
-                    }
-                }
+    UNUSED(fd); UNUSED(events); UNUSED(user_data);
 
-                HASH_FIND_INT(players, &mapping->id, player);
-                if (player) {
-                    HASH_DEL(players, player);
-                    free(player);
-                    LOG_DEBUG("removed player with id=%u from server\n", mapping->id);
-                } else {
-                    LOG_ERROR("player with id=%u not found\n", mapping->id);
-                }
+    Auth_Job *results = auth_pool_take(&auth_pool, auth_results_spare);
 
-                HASH_DEL(socket_to_player_id_map, mapping);
-                free(mapping);
+    for (u64 i = 0; i < darray_length(results); i++) {
+        const Auth_Job *job = &results[i];
+
+        if (job->upgraded) {
+            Db_Request request = {};
+            request.type = DB_REQUEST_STORE_CREDENTIAL;
+            request.socket = -1;
+            memcpy(request.username, job->username, sizeof(request.username));
+            memcpy(request.credential, job->credential, sizeof(request.credential));
+            if (!db_worker_submit(&db_worker, &request)) {
+                LOG_WARN("could not store the upgraded credential of `%s`, the database queue is full\n", job->username);
             }
+        }
 
-            pollfd_set_remove(&server_pfds, client_socket);
-            close(client_socket);
+        Connection **found = (Connection **) hash_map_find(&connections, &job->socket);
+        Connection *connection = found != NULL ? *found : NULL;
+        if (connection == NULL || connection->serial != job->connection_serial) {
+            // The client disconnected while the password was being verified.
+            continue;
         }
 
-        return false;
+        ASSERT(connection->state == CONNECTION_STATE_AUTHENTICATING);
+        if (!job->approved) {
+            complete_player_join(connection, job->username, false, NULL);
+            continue;
+        }
+
+        load_player_profile(connection, job->username);
     }
 
-    return true;
+    darray_clear(results);
+    auth_results_spare = results;
 }
 
-void handle_client_event(i32 client_socket)
+LOCAL void log_auth_stats(u64 elapsed_ns)
 {
-    u8 recv_buffer[INPUT_BUFFER_SIZE + INPUT_OVERFLOW_BUFFER_SIZE] = {0};
-    i64 bytes_read;
-    if (!receive_client_data(client_socket, recv_buffer, INPUT_BUFFER_SIZE, &bytes_read)) {
-        return;
-    }
+    Auth_Pool_Stats stats = auth_pool_take_stats(&auth_pool);
+    u64 completed = stats.completed > 0 ? stats.completed : 1;
+    u64 elapsed_ms = elapsed_ns / (1000 * 1000) > 0 ? elapsed_ns / (1000 * 1000) : 1;
+
+    LOG_DEBUG("authentication: in_flight=%llu peak_in_flight=%llu rejected=%llu completed=%llu per_sec=%.1f latency_avg_ms=%llu latency_max_ms=%llu hash_avg_ms=%llu\n",
+              stats.in_flight, stats.peak_in_flight, stats.rejected, stats.completed,
+              (f64) stats.completed * 1000.0 / (f64) elapsed_ms,
+              stats.latency_total_ns / completed / (1000 * 1000), stats.latency_max_ns / (1000 * 1000),
+              stats.hash_total_ns / completed / (1000 * 1000));
+}
 
-#if 0
-    LOG_DEBUG("read %lld bytes of data:\n", bytes_read);
-    hexdump(stdout, recv_buffer, bytes_read, HEXDUMP_FLAG_CANONICAL);
-#endif
+LOCAL void log_db_stats(void)
+{
+    PERSIST const char *names[NUM_OF_DB_REQUEST_TYPES] = {
+        "load_ip_blacklist", "load_credential", "store_credential", "load_profile", "store_profiles"
+    };
+
+    Db_Worker_Stats stats = db_worker_get_stats(&db_worker);
+    LOG_DEBUG("database: depth=%llu peak_depth=%llu rejected=%llu\n", stats.depth, stats.peak_depth, stats.rejected);
+
+    for (u32 i = 0; i < NUM_OF_DB_REQUEST_TYPES; i++) {
+        const Db_Query_Stats *query = &stats.queries[i];
+        u64 count = query->count > 0 ? query->count : 1;
+        UNUSED(names); UNUSED(query); UNUSED(count);
+        LOG_DEBUG("database %s: count=%llu failures=%llu latency_avg_us=%llu latency_max_us=%llu execute_avg_us=%llu\n",
+                  names[i], query->count, query->failures, query->latency_total_ns / count / 1000,
+                  query->latency_max_ns / 1000, query->execute_total_ns / count / 1000);
+    }
+}
 
-    PERSIST const u32 header_size = PACKET_TYPE_SIZE[PACKET_TYPE_HEADER];
+LOCAL void expire_handshakes(u64 now)
+{
+    // Disconnecting removes from the map, which must not change while iterating it.
+    Connection **expired = (Connection **) darray_create(sizeof(Connection *));
+
+    u64 it = 0;
+    void *value;
+    while (hash_map_next(&connections, &it, NULL, &value)) {
+        Connection *connection = *(Connection **) value;
+        if (connection->state != CONNECTION_STATE_JOINED && now >= connection->handshake_deadline) {
+            darray_push(expired, connection);
+        }
+    }
 
-    ASSERT_MSG(bytes_read >= header_size, "unhandled: read fewer bytes than the header size");
+    for (u64 i = 0; i < darray_length(expired); i++) {
+        LOG_WARN("handshake of socket=%d timed out\n", expired[i]->socket);
+        disconnect_client(expired[i]);
+    }
 
-    i64 remaining_bytes_to_parse = bytes_read;
-    u8 *bufptr = recv_buffer;
+    darray_destroy(expired);
+}
 
-    // Iterate over all the packets included in single TCP data reception.
-    // Optionally, read more data to complete the payload.
-    for (;;) {
-        Packet_Header *header = (Packet_Header *) bufptr;
+void handle_client_event(i32 client_socket, u32 events, void *user_data)
+{
+    Connection *connection = (Connection *) user_data;
+    ASSERT(connection && connection->socket == client_socket);
 
-        if (header->type >= NUM_OF_PACKET_TYPES) {
-            LOG_ERROR("received unknown header type `%u`\n", header->type);
-            break;
+    if (events & REACTOR_EVENT_WRITE) {
+        flush_connection(connection);
+        if (events == REACTOR_EVENT_WRITE) {
+            return;
         }
+    }
 
-        // Verify whether all the payload data is present in the receive buffer.
-        // If it’s not, read the remaining bytes from the socket that are needed to complete the payload.
-        if (remaining_bytes_to_parse - header_size < header->payload_size) {
-            i64 missing_bytes = header->payload_size - (remaining_bytes_to_parse - header_size);
+    // The socket is edge-triggered, so keep reading until the kernel buffer is drained.
+    for (;;) {
+        i64 bytes_read = packet_framer_recv(&connection->framer, client_socket);
+        if (bytes_read <= 0) {
+            if (bytes_read == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return;
+                }
+                LOG_ERROR("recv error on socket=%d: %s\n", client_socket, strerror(errno));
+            } else {
+                LOG_INFO("orderly shutdown of client with socket=%d\n", client_socket);
+            }
+            disconnect_client(connection);
+            return;
+        }
 
-            LOG_DEBUG("reading %lu more bytes to complete payload\n", missing_bytes);
+        if (connection->state == CONNECTION_STATE_AWAITING_PUZZLE_ANSWER) {
+            u64 answer;
+            if (!packet_framer_take(&connection->framer, &answer, sizeof(answer))) {
+                continue;
+            }
 
-            ASSERT_MSG(missing_bytes <= INPUT_OVERFLOW_BUFFER_SIZE, "not enough space in overflow buffer");
+            bool status_buffer = answer == connection->puzzle_answer;
+            queue_packet(connection, packet_buffer_create_raw(&status_buffer, sizeof(status_buffer)));
+            if (!status_buffer) {
+                LOG_WARN("socket=%d failed validation\n", client_socket);
+                disconnect_client(connection);
+                return;
+            }
 
-            // Read into INPUT_OVERFLOW_BUFFER of the recv_buffer and proceed to packet interpretation.
-            i64 new_bytes_read = net_recv(client_socket, &recv_buffer[INPUT_BUFFER_SIZE], missing_bytes, 0);
-            UNUSED(new_bytes_read);
-            ASSERT(new_bytes_read == missing_bytes);
+            LOG_INFO("socket=%d passed validation\n", client_socket);
+            connection->state = CONNECTION_STATE_AWAITING_JOIN;
         }
 
-        process_network_packet(client_socket, header->type, bufptr + header_size);
+        // Iterate over all the complete packets received so far. A partial packet stays
+        // in the framer until the rest of it arrives.
+        Packet_Header header;
+        u8 *payload;
+        Packet_Framer_Status status;
+        while ((status = packet_framer_next(&connection->framer, &header, &payload)) == PACKET_FRAMER_STATUS_READY) {
+            if (connection->state != CONNECTION_STATE_JOINED && header.type != PACKET_TYPE_PLAYER_JOIN_REQ) {
+                LOG_WARN("ignoring packet of type %u from socket=%d, which has not joined yet\n", header.type, client_socket);
+                continue;
+            }
 
-        // Check if there are more bytes to parse.
-        u64 parsed_packet_size = header_size + header->payload_size;
-        bufptr = (bufptr + parsed_packet_size);
-        remaining_bytes_to_parse -= parsed_packet_size;
-        if (remaining_bytes_to_parse > 0) {
-            // LOG_DEBUG("remaining_bytes_to_parse = %lu\n", remaining_bytes_to_parse);
-            if (remaining_bytes_to_parse >= header_size) {
-                // Enough unparsed bytes to read the header.
-                Packet_Header *next_header = (Packet_Header *) bufptr;
-                if (next_header->type <= PACKET_TYPE_NONE || next_header->type >= NUM_OF_PACKET_TYPES) {
-                    break;
-                }
-                // LOG_DEBUG("next header is valid\n");
-            } else {
-                // Not enough remaining unparsed bytes to read a complete header.
-                ASSERT_MSG(0, "unhandled: fewer bytes than header size");
+            process_network_packet(connection, header.type, payload);
+            if (connection->closed) {
+                return;
             }
-        } else {
-            // No more bytes to parse.
-            break;
+        }
+
+        if (status == PACKET_FRAMER_STATUS_ERROR) {
+            LOG_ERROR("received malformed packet from socket=%d\n", client_socket);
+            disconnect_client(connection);
+            return;
         }
     }
 }
@@ -630,6 +1496,28 @@ LOCAL bool db_verify_tables(sqlite3 *db)
         }
     }
 
+    if (!db_table_exists(db, "player_profiles")) {
+        const char *sql_create_player_profiles_table =
+            "CREATE TABLE player_profiles (\n"
+            "    username TEXT PRIMARY KEY,\n"
+            "    position_x REAL NOT NULL,\n"
+            "    position_y REAL NOT NULL,\n"
+            "    position_z REAL NOT NULL,\n"
+            "    color_r REAL NOT NULL,\n"
+            "    color_g REAL NOT NULL,\n"
+            "    color_b REAL NOT NULL,\n"
+            "    updated_at DATETIME DEFAULT (DATETIME('now', 'localtime'))\n"
+            ");";
+
+        LOG_INFO("creating 'player_profiles' table...");
+        if (!db_execute_sql(db, sql_create_player_profiles_table)) {
+            printf(ERROR_COLOR " ERROR" RESET_COLOR "\n");
+            return false;
+        } else {
+            printf(INFO_COLOR " OK" RESET_COLOR "\n");
+        }
+    }
+
     LOG_INFO("database verification completed successfully\n");
     return true;
 }
@@ -697,70 +1585,258 @@ LOCAL bool db_print_query_result(FILE *stream, sqlite3 *db, const char *const sq
     return true;
 }
 
-#define MAX_MOVED_IDS 256
-#define PROCESSING_LOOP_UPS 60
+LOCAL int compare_u32(const void *a, const void *b)
+{
+    u32 lhs = *(const u32 *) a;
+    u32 rhs = *(const u32 *) b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+// Number of moves that fit in a batch packet of 'packet_size' bytes, header included, at least one.
+LOCAL u32 batch_moves_per_packet(u32 packet_size)
+{
+    u32 fixed_size = sizeof(Packet_Header) + sizeof(((Packet_Player_Batch_Move *) 0)->count);
+    u32 move_size = sizeof(player_id) + 3 * sizeof(f32);
+    if (packet_size <= fixed_size + move_size) {
+        return 1;
+    }
+
+    return (packet_size - fixed_size) / move_size;
+}
+
+/*
+ * Builds the batch of moves visible from 'cell' as a sequence of packets of at most
+ * 'moves_per_packet' moves each. The ids in 'moved_grid' are indices into 'moved', which
+ * holds the most recently moved players first, so sorting the indices keeps that order
+ * across packets and the freshest moves go out in the first packet.
+ */
+LOCAL void build_interest_batch(Spatial_Grid *moved_grid, Cell_Coord cell, const Snapshot_Player *moved,
+                                u32 moves_per_packet, u32 **nearby, player_id **ids, f32 **positions,
+                                Packet_Buffer ***out_buffers)
+{
+    darray_clear(*nearby);
+    spatial_grid_query(moved_grid, cell, NULL, nearby);
+
+    u32 count = (u32) darray_length(*nearby);
+    if (count == 0) {
+        return;
+    }
+
+    qsort(*nearby, count, sizeof(u32), compare_u32);
+
+    player_id *batch_ids = *ids;
+    f32 *batch_positions = *positions;
+    Packet_Buffer **buffers = *out_buffers;
+    for (u32 first = 0; first < count; first += moves_per_packet) {
+        u32 packet_count = count - first;
+        if (packet_count > moves_per_packet) {
+            packet_count = moves_per_packet;
+        }
+
+        darray_clear(batch_ids);
+        darray_clear(batch_positions);
+        for (u32 i = first; i < first + packet_count; i++) {
+            const Snapshot_Player *player = &moved[(*nearby)[i]];
+            darray_push(batch_ids, player->id);
+            darray_push(batch_positions, player->position[0]);
+            darray_push(batch_positions, player->position[1]);
+            darray_push(batch_positions, player->position[2]);
+        }
+
+        Packet_Player_Batch_Move packet = {};
+        packet.count = packet_count;
+        packet.ids = batch_ids;
+        packet.positions = batch_positions;
+        darray_push(buffers, packet_buffer_create(PACKET_TYPE_PLAYER_BATCH_MOVE, &packet));
+    }
+
+    *ids = batch_ids;
+    *positions = batch_positions;
+    *out_buffers = buffers;
+}
+
+LOCAL void log_tick_stats(u64 tick)
+{
+    Tick_Stats stats = tick_scheduler_take_stats(&tick_scheduler);
+    u64 ticks = stats.ticks > 0 ? stats.ticks : 1;
+
+    UNUSED(tick); UNUSED(ticks);
+    LOG_DEBUG("ticks: tick=%llu rate=%u ran=%llu skipped=%llu overruns=%llu duration_avg_us=%llu duration_max_us=%llu lateness_avg_us=%llu lateness_max_us=%llu\n",
+              tick, tick_scheduler.rate, stats.ticks, stats.skipped, stats.overruns,
+              stats.duration_total_ns / ticks / 1000, stats.duration_max_ns / 1000,
+              stats.lateness_total_ns / ticks / 1000, stats.lateness_max_ns / 1000);
+}
 
 void *processing_loop(void *args)
 {
     UNUSED(args);
 
-    PERSIST u32 us_to_sleep = (u32) (1.0f / (f32) PROCESSING_LOOP_UPS * 1000 * 1000);
+    u64 stats_period_ticks = SERVER_STATS_PERIOD_NS / tick_scheduler.period_ns;
+    u64 next_stats_tick = stats_period_ticks;
+
+    u32 moves_per_packet = batch_moves_per_packet(batch_packet_size);
+    LOG_INFO("player batch moves split into packets of up to %u bytes, %u moves each\n", batch_packet_size, moves_per_packet);
 
-    u32 moved_ids_count = 0;
-    player_id moved_ids[MAX_MOVED_IDS];
+    Snapshot_Player *moved = (Snapshot_Player *) darray_create(sizeof(Snapshot_Player)); // most recent first
+    player_id *batch_ids = (player_id *) darray_create(sizeof(player_id));
+    f32 *batch_positions = (f32 *) darray_create(sizeof(f32));
+
+    Outbound_Packet *outbound_packets = (Outbound_Packet *) darray_create(sizeof(Outbound_Packet));
+    u32 *nearby = (u32 *) darray_create(sizeof(u32));
+    // Cell_Coord -> Packet_Buffer ** (darray, empty when nobody moved within the interest radius of the cell)
+    Hash_Map batches;
+    hash_map_create_tagged(&batches, sizeof(Cell_Coord), sizeof(Packet_Buffer **), MEMORY_TAG_NETWORK);
+
+    // Separate from the network thread's grid, rebuilt every tick from the players that moved.
+    Spatial_Grid moved_grid;
+    spatial_grid_create(&moved_grid, interest_radius);
 
     while (running) {
-        // Copy moved player ids for later processing to unlock the mutex quicker.
-        pthread_mutex_lock(&moved_players_lock);
-        for (Player_Moved *pm = moved_players; pm != NULL; pm = (Player_Moved *) pm->hh.next) {
-            ASSERT(moved_ids_count < MAX_MOVED_IDS);
-            moved_ids[moved_ids_count++] = pm->id;
-        }
-
-        if (moved_ids_count > 0) {
-            // Clear the moved players uthash.
-            Player_Moved *pm, *tmp;
-            HASH_ITER(hh, moved_players, pm, tmp) {
-                HASH_DEL(moved_players, pm);
-                free(pm);
+        u64 tick = tick_scheduler_wait(&tick_scheduler);
+
+        // Take all players marked since the last tick in one step, the network thread keeps marking meanwhile.
+        // Players are only marked once their move is published, so the snapshot read after this has them.
+        // The dirty set is a stack, so the walk yields the most recently moved players first.
+        u32 cursor = dirty_set_detach(&moved_players);
+        const State_Snapshot *snapshot = snapshot_exchange_read(&player_snapshots);
+
+        u32 moved_slot;
+        player_id moved_id;
+        while (dirty_set_next(&moved_players, &cursor, &moved_slot, &moved_id)) {
+            const Snapshot_Player *player = &snapshot->players[moved_slot];
+            if (player->id != moved_id) {
+                // Disconnected after moving.
+                continue;
             }
+
+            spatial_grid_insert(&moved_grid, (u32) darray_length(moved), player->position);
+            darray_push(moved, *player);
         }
 
-        pthread_mutex_unlock(&moved_players_lock);
-
-        // NOTE: Perhaps we should also copy players uthash before copying values from it.
-        if (moved_ids_count > 0) {
-            // Prepare batch move packet.
-            Packet_Player_Batch_Move packet = {};
-            packet.count = moved_ids_count;
-            packet.ids = (player_id *) malloc(packet.count * sizeof(player_id));
-            packet.positions = (f32 *) malloc(packet.count * 3 * sizeof(f32));
-            for (u32 i = 0; i < moved_ids_count; i++) {
-                packet.ids[i] = moved_ids[i];
-                Player *player = NULL;
-                HASH_FIND_INT(players, &moved_ids[i], player);
-                ASSERT(player != NULL);
-                memcpy(&packet.positions[i * 3], glm::value_ptr(player->position), 3 * sizeof(f32));
+        if (darray_length(moved) > 0) {
+            // Each player only receives the moves within its interest radius. Everyone in the
+            // same cell sees the same moves, so a batch is built and serialized once per cell.
+            for (u32 i = 0; i < snapshot->count; i++) {
+                const Snapshot_Player *player = &snapshot->players[snapshot->occupied[i]];
+                Cell_Coord cell = spatial_grid_cell_of(&moved_grid, player->position);
+
+                Packet_Buffer **buffers;
+                Packet_Buffer ***found = (Packet_Buffer ***) hash_map_find(&batches, &cell);
+                if (found != NULL) {
+                    buffers = *found;
+                } else {
+                    buffers = (Packet_Buffer **) darray_create(sizeof(Packet_Buffer *));
+                    build_interest_batch(&moved_grid, cell, moved, moves_per_packet,
+                                         &nearby, &batch_ids, &batch_positions, &buffers);
+                    hash_map_insert(&batches, &cell, &buffers);
+                }
+
+                for (u64 j = 0; j < darray_length(buffers); j++) {
+                    Outbound_Packet outbound = {};
+                    outbound.recipient = player->id;
+                    outbound.buffer = packet_buffer_retain(buffers[j]);
+                    outbound.unreliable = true;
+                    outbound.sequence = (u32) tick;
+                    outbound.tick = tick;
+                    darray_push(outbound_packets, outbound);
+                }
             }
 
-            // Send batch updates to players.
-            for (Player *player = players; player != NULL; player = (Player *) player->hh.next) {
-                if (!packet_send(player->socket, PACKET_TYPE_PLAYER_BATCH_MOVE, &packet)) {
-                    LOG_ERROR("failed to send player batch move packet\n");
+            outbox_submit(&server_outbox, outbound_packets, darray_length(outbound_packets));
+            darray_clear(outbound_packets);
+
+            u64 it = 0;
+            void *value;
+            while (hash_map_next(&batches, &it, NULL, &value)) {
+                Packet_Buffer **buffers = *(Packet_Buffer ***) value;
+                for (u64 j = 0; j < darray_length(buffers); j++) {
+                    packet_buffer_release(buffers[j]);
                 }
+                darray_destroy(buffers);
             }
+            hash_map_clear(&batches);
 
-            free(packet.ids);
-            free(packet.positions);
-            moved_ids_count = 0;
+            spatial_grid_clear(&moved_grid);
+            darray_clear(moved);
         }
 
-        usleep(us_to_sleep);
+        tick_scheduler_end(&tick_scheduler);
+
+        if (tick >= next_stats_tick) {
+            log_tick_stats(tick);
+            next_stats_tick = tick + stats_period_ticks;
+        }
     }
 
+    spatial_grid_destroy(&moved_grid);
+    hash_map_destroy(&batches);
+    darray_destroy(nearby);
+    darray_destroy(outbound_packets);
+    darray_destroy(batch_positions);
+    darray_destroy(batch_ids);
+    darray_destroy(moved);
+
     return NULL;
 }
 
+// Creates a socket of 'socktype' bound to 'port' on all addresses, exits on failure.
+LOCAL i32 create_server_socket(const char *port_as_cstr, i32 socktype)
+{
+    struct addrinfo hints;
+    struct addrinfo *result, *rp;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = socktype;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_flags = AI_PASSIVE;
+
+    i32 status = getaddrinfo(NULL, port_as_cstr, &hints, &result);
+    if (status != 0) {
+        LOG_FATAL("getaddrinfo error: %s\n", gai_strerror(status));
+        exit(EXIT_FAILURE);
+    }
+
+    i32 bound_socket = -1;
+    for (rp = result; rp != NULL; rp = rp->ai_next) {
+        bound_socket = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+        if (bound_socket == -1) {
+            continue;
+        }
+
+        const char *ip_version = rp->ai_family == AF_INET  ? "IPv4" :
+                                 rp->ai_family == AF_INET6 ? "IPv6" : "UNKNOWN";
+        const char *socktype_str = rp->ai_socktype == SOCK_STREAM ? "TCP" :
+                                   rp->ai_socktype == SOCK_DGRAM  ? "UDP" : "UNKNOWN";
+        UNUSED(ip_version); UNUSED(socktype_str);
+        LOG_INFO("successfully created an %s %s socket(fd=%d)\n", ip_version, socktype_str, bound_socket);
+
+        PERSIST i32 yes = 1;
+        if (setsockopt(bound_socket, SOL_SOCKET, SO_REUSEADDR, (void *)&yes, sizeof(i32)) == -1) {
+            LOG_ERROR("setsockopt reuse address error: %s\n", strerror(errno));
+        }
+
+        if (bind(bound_socket, rp->ai_addr, rp->ai_addrlen) == 0) {
+            LOG_INFO("successfully bound socket(fd=%d)\n", bound_socket);
+            break;
+        } else {
+            LOG_ERROR("failed to bind socket with fd=%d\n", bound_socket);
+            close(bound_socket);
+        }
+    }
+
+    if (rp == NULL) {
+        LOG_FATAL("could not bind to port %s\n", port_as_cstr);
+        exit(EXIT_FAILURE);
+    }
+
+    char ip_buffer[INET6_ADDRSTRLEN] = {0};
+    inet_ntop(rp->ai_family, get_in_addr(rp->ai_addr), ip_buffer, INET6_ADDRSTRLEN);
+    LOG_INFO("socket(fd=%d) bound to %s port %s\n", bound_socket, ip_buffer, port_as_cstr);
+
+    freeaddrinfo(result);
+    return bound_socket;
+}
+
 LOCAL bool server_on_app_log_event(Event_Code code, Event_Data data)
 {
     UNUSED(code); UNUSED(data);
@@ -778,7 +1854,7 @@ LOCAL char *shift(int *argc, char ***argv)
 
 LOCAL void usage(FILE *stream, const char *const program)
 {
-    fprintf(stream, "usage: %s -p <port> [-d <database_filepath>] [-h]\n", program);
+    fprintf(stream, "usage: %s -p <port> [-d <database_filepath>] [-r <interest_radius>] [-b <batch_packet_size>] [-u <tick_rate>] [-k <pbkdf2_iterations>] [-w <auth_workers>] [-h]\n", program);
 }
 
 int main(int argc, char **argv)
@@ -820,6 +1896,75 @@ int main(int argc, char **argv)
             }
 
             database_filepath = shift(&argc, &argv);
+        } else if (strcmp(flag, "-r") == 0) {
+            if (argc == 0) {
+                LOG_FATAL("missing argument for flag `%s`\n", flag);
+                usage(stderr, program);
+                exit(EXIT_FAILURE);
+            }
+
+            const char *radius_as_cstr = shift(&argc, &argv);
+            interest_radius = strtof(radius_as_cstr, NULL);
+            if (interest_radius <= 0.0f) {
+                LOG_FATAL("invalid interest radius `%s`\n", radius_as_cstr);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(flag, "-b") == 0) {
+            if (argc == 0) {
+                LOG_FATAL("missing argument for flag `%s`\n", flag);
+                usage(stderr, program);
+                exit(EXIT_FAILURE);
+            }
+
+            const char *size_as_cstr = shift(&argc, &argv);
+            i64 size = strtol(size_as_cstr, NULL, 10);
+            if (size <= 0 || size > (i64) KiB(64)) {
+                LOG_FATAL("invalid batch packet size `%s`\n", size_as_cstr);
+                exit(EXIT_FAILURE);
+            }
+            batch_packet_size = (u32) size;
+        } else if (strcmp(flag, "-u") == 0) {
+            if (argc == 0) {
+                LOG_FATAL("missing argument for flag `%s`\n", flag);
+                usage(stderr, program);
+                exit(EXIT_FAILURE);
+            }
+
+            const char *rate_as_cstr = shift(&argc, &argv);
+            i64 rate = strtol(rate_as_cstr, NULL, 10);
+            if (rate <= 0 || rate > 1000) {
+                LOG_FATAL("invalid tick rate `%s`, expected 1 to 1000 ticks per second\n", rate_as_cstr);
+                exit(EXIT_FAILURE);
+            }
+            tick_rate = (u32) rate;
+        } else if (strcmp(flag, "-k") == 0) {
+            if (argc == 0) {
+                LOG_FATAL("missing argument for flag `%s`\n", flag);
+                usage(stderr, program);
+                exit(EXIT_FAILURE);
+            }
+
+            const char *iterations_as_cstr = shift(&argc, &argv);
+            i64 iterations = strtol(iterations_as_cstr, NULL, 10);
+            if (iterations <= 0 || iterations > 100000000) {
+                LOG_FATAL("invalid pbkdf2 iteration count `%s`\n", iterations_as_cstr);
+                exit(EXIT_FAILURE);
+            }
+            auth_iterations = (u32) iterations;
+        } else if (strcmp(flag, "-w") == 0) {
+            if (argc == 0) {
+                LOG_FATAL("missing argument for flag `%s`\n", flag);
+                usage(stderr, program);
+                exit(EXIT_FAILURE);
+            }
+
+            const char *workers_as_cstr = shift(&argc, &argv);
+            i64 workers = strtol(workers_as_cstr, NULL, 10);
+            if (workers <= 0 || workers > AUTH_POOL_MAX_WORKERS) {
+                LOG_FATAL("invalid authentication worker count `%s`, expected 1 to %d\n", workers_as_cstr, AUTH_POOL_MAX_WORKERS);
+                exit(EXIT_FAILURE);
+            }
+            auth_workers = (u32) workers;
         } else if (strcmp(flag, "-h") == 0) {
             usage(stdout, program);
             exit(EXIT_SUCCESS);
@@ -855,6 +2000,13 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
+    // Profiles are committed every few seconds, in WAL mode a commit only appends to the log.
+    if (!db_execute_sql(server_db, "PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL;")) {
+        LOG_FATAL("failed to enable write-ahead logging for database `%s`\n", database_filepath);
+        sqlite3_close(server_db);
+        exit(EXIT_FAILURE);
+    }
+
     if (!db_verify_tables(server_db)) {
         LOG_FATAL("database verification failed\n");
         sqlite3_close(server_db);
@@ -881,65 +2033,88 @@ int main(int argc, char **argv)
     gethostname(hostname, 256);
     LOG_INFO("starting the game server on host `%s`\n", hostname);
 
-    struct addrinfo hints;
-    struct addrinfo *result, *rp;
+    server_socket = create_server_socket(port_as_cstr, SOCK_STREAM);
+    if (listen(server_socket, SERVER_BACKLOG) == -1) {
+        LOG_FATAL("failed to start listening: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
 
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_flags = AI_PASSIVE;
+    // Same port as the listening socket, for the datagram channel of the joined players.
+    udp_socket = create_server_socket(port_as_cstr, SOCK_DGRAM);
+
+    hash_map_create_tagged(&connections, sizeof(i32), sizeof(Connection *), MEMORY_TAG_NETWORK);
+    hash_map_create_tagged(&udp_sessions, sizeof(u64), sizeof(i32), MEMORY_TAG_NETWORK);
+    pending_datagrams = (Pending_Datagram *) darray_create(sizeof(Pending_Datagram));
+    closed_connections = (Connection **) darray_create(sizeof(Connection *));
+    failed_connections = (Connection **) darray_create(sizeof(Connection *));
+    scheduled_flushes = (Connection **) darray_create(sizeof(Connection *));
+    outbox_spare = (Outbound_Packet *) darray_create(sizeof(Outbound_Packet));
+    interest_ids = (player_id *) darray_create(sizeof(player_id));
+    spatial_grid_create(&player_grid, interest_radius);
+    username_index_create(&player_usernames);
+    LOG_INFO("interest radius set to %.2f\n", interest_radius);
+
+    if (!reactor_init(&server_reactor, REACTOR_DEFAULT_MAX_EVENTS)) {
+        LOG_FATAL("failed to initialize the reactor\n");
+        exit(EXIT_FAILURE);
+    }
 
-    i32 status = getaddrinfo(NULL, port_as_cstr, &hints, &result);
-    if (status != 0) {
-        LOG_FATAL("getaddrinfo error: %s\n", gai_strerror(status));
+    if (!net_set_nonblocking(server_socket)) {
+        LOG_FATAL("failed to set the listening socket to non-blocking mode: %s\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
 
-    for (rp = result; rp != NULL; rp = rp->ai_next) {
-        server_socket = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (server_socket == -1) {
-            continue;
-        }
+    // Blocked in every thread, so it is only delivered through the signalfd. Set before any thread is started.
+    sigset_t reload_signals;
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &reload_signals, NULL);
 
-        const char *ip_version = rp->ai_family == AF_INET  ? "IPv4" :
-                                 rp->ai_family == AF_INET6 ? "IPv6" : "UNKNOWN";
-        const char *socktype_str = rp->ai_socktype == SOCK_STREAM ? "TCP" :
-                                   rp->ai_socktype == SOCK_DGRAM  ? "UDP" : "UNKNOWN";
-        UNUSED(ip_version); UNUSED(socktype_str);
-        LOG_INFO("successfully created an %s %s socket(fd=%d)\n", ip_version, socktype_str, server_socket);
+    reload_signal_fd = signalfd(-1, &reload_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (reload_signal_fd == -1 ||
+        !reactor_add(&server_reactor, reload_signal_fd, REACTOR_EVENT_READ, handle_reload_signal_event, NULL)) {
+        LOG_FATAL("failed to set up the reload signal: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
 
-        PERSIST i32 yes = 1;
-        if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, (void *)&yes, sizeof(i32)) == -1) {
-            LOG_ERROR("setsockopt reuse address error: %s\n", strerror(errno));
-        }
+    if (!db_worker_create(&db_worker, server_db)) {
+        LOG_FATAL("failed to start the database worker\n");
+        sqlite3_close(server_db);
+        exit(EXIT_FAILURE);
+    }
+    server_db = NULL;
 
-        if (bind(server_socket, rp->ai_addr, rp->ai_addrlen) == 0) {
-            LOG_INFO("successfully bound socket(fd=%d)\n", server_socket);
-            break;
-        } else {
-            LOG_ERROR("failed to bind socket with fd=%d\n", server_socket);
-            close(server_socket);
-        }
+    db_results_spare = (Db_Request *) darray_create(sizeof(Db_Request));
+    if (!reactor_add(&server_reactor, db_worker.results.event_fd, REACTOR_EVENT_READ, handle_db_event, NULL)) {
+        LOG_FATAL("failed to register the database worker\n");
+        exit(EXIT_FAILURE);
     }
 
-    if (rp == NULL) {
-        LOG_FATAL("could not bind to port %s\n", port_as_cstr);
+    // The listening socket is registered once this is loaded.
+    if (!request_ip_blacklist_load()) {
+        LOG_FATAL("failed to request the ip blacklist\n");
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_socket, SERVER_BACKLOG) == -1) {
-        LOG_FATAL("failed to start listening: %s\n", strerror(errno));
+    auth_results_spare = (Auth_Job *) darray_create(sizeof(Auth_Job));
+    if (!auth_pool_create(&auth_pool, auth_workers, auth_iterations) ||
+        !reactor_add(&server_reactor, auth_pool.results.event_fd, REACTOR_EVENT_READ, handle_auth_event, NULL)) {
+        LOG_FATAL("failed to start the authentication pool\n");
         exit(EXIT_FAILURE);
-    } else {
-        char ip_buffer[INET6_ADDRSTRLEN] = {0};
-        inet_ntop(rp->ai_family, get_in_addr(rp->ai_addr), ip_buffer, INET6_ADDRSTRLEN);
-        LOG_INFO("socket listening on %s port %s\n", ip_buffer, port_as_cstr);
     }
+    LOG_INFO("verifying passwords on %u threads, new credentials use %u iterations\n", auth_pool.worker_count, auth_iterations);
 
-    freeaddrinfo(result);
+    if (!outbox_create(&server_outbox) ||
+        !reactor_add(&server_reactor, server_outbox.mailbox.event_fd, REACTOR_EVENT_READ, handle_outbox_event, NULL)) {
+        LOG_FATAL("failed to set up the outbox\n");
+        exit(EXIT_FAILURE);
+    }
 
-    pollfd_set_init(5, &server_pfds);
-    pollfd_set_add(&server_pfds, server_socket);
+    if (!net_set_nonblocking(udp_socket) ||
+        !reactor_add(&server_reactor, udp_socket, REACTOR_EVENT_READ, handle_datagram_event, NULL)) {
+        LOG_FATAL("failed to set up the datagram socket: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
 
     struct sigaction sa = {};
     sa.sa_flags = SA_RESTART;
@@ -956,64 +2131,128 @@ int main(int argc, char **argv)
     light.diffuse = glm::vec3(0.5f, 0.5f, 0.5f);
     light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
 
-    pthread_mutex_init(&moved_players_lock, NULL);
+    dirty_set_create(&moved_players, SERVER_MAX_PLAYERS);
+    snapshot_exchange_create(&player_snapshots, SERVER_MAX_PLAYERS);
+    unpublished_moves = (Unpublished_Move *) darray_create(sizeof(Unpublished_Move));
+    dirty_profile_ids = (player_id *) darray_create(sizeof(player_id));
+    departed_profiles = (Player_Profile *) darray_create(sizeof(Player_Profile));
+    player_store_create(&players, SERVER_MAX_PLAYERS);
+
+    snapshot_publish_interval_ns = 1000ULL * 1000 * 1000 / (2 * tick_rate);
+    if (!tick_scheduler_create(&tick_scheduler, tick_rate)) {
+        LOG_FATAL("failed to create the tick scheduler\n");
+        exit(EXIT_FAILURE);
+    }
+    LOG_INFO("tick rate set to %u ticks per second\n", tick_rate);
 
     pthread_t processing_thread;
     pthread_create(&processing_thread, NULL, processing_loop, NULL);
 
-    while (running) {
-        i32 num_events = poll(server_pfds.fds, server_pfds.count, POLL_INFINITE_TIMEOUT);
+    u64 last_stats_time = clock_get_absolute_time_ns();
+    profile_flush_time = last_stats_time;
+    u64 last_handshake_check_time = last_stats_time;
 
-        if (num_events == -1) {
+    while (running) {
+        if (reactor_wait(&server_reactor, get_loop_timeout_ms(clock_get_absolute_time_ns())) == -1) {
             if (errno == EINTR) {
-                LOG_INFO("interrupted 'poll' system call\n");
+                LOG_INFO("interrupted 'epoll_wait' system call\n");
                 break;
             }
-            LOG_FATAL("poll error: %s\n", strerror(errno));
+            LOG_FATAL("epoll_wait error: %s\n", strerror(errno));
             exit(EXIT_FAILURE);
         }
 
-        for (u32 i = 0; i < server_pfds.count; i++) {
-            if (server_pfds.fds[i].revents & POLLIN) {
-                if (server_pfds.fds[i].fd == server_socket) {
-                    handle_new_connection_request_event();
-                } else {
-                    handle_client_event(server_pfds.fds[i].fd);
-                }
+        // Flushing may fail sends and disconnecting queues packets for the remaining players,
+        // so both repeat until nothing is left. Disconnecting may also fail more sends, which
+        // append to the same darray.
+        do {
+            flush_scheduled_connections();
+            for (u64 i = 0; i < darray_length(failed_connections); i++) {
+                disconnect_client(failed_connections[i]);
             }
+            darray_clear(failed_connections);
+        } while (darray_length(scheduled_flushes) > 0);
+        flush_pending_datagrams();
+
+        for (u64 i = 0; i < darray_length(closed_connections); i++) {
+            connection_destroy(closed_connections[i]);
+        }
+        darray_clear(closed_connections);
+
+        u64 now = clock_get_absolute_time_ns();
+        if (snapshot_stale && now - snapshot_publish_time >= snapshot_publish_interval_ns) {
+            publish_player_state();
+            snapshot_publish_time = now;
+        }
+
+        if (now - profile_flush_time >= SERVER_PROFILE_FLUSH_PERIOD_NS) {
+            flush_player_profiles();
+            profile_flush_time = now;
+        }
+
+        if (now - last_handshake_check_time >= SERVER_HANDSHAKE_CHECK_PERIOD_NS) {
+            expire_handshakes(now);
+            last_handshake_check_time = now;
+        }
+
+        if (now - last_stats_time >= SERVER_STATS_PERIOD_NS) {
+            log_send_queue_stats();
+            log_db_stats();
+            log_auth_stats(now - last_stats_time);
+            LOG_DEBUG("ip blacklist: rejections=%llu\n", blacklist_rejections);
+            last_stats_time = now;
         }
     }
 
     LOG_INFO("server shutting down\n");
 
-    sqlite3_close(server_db);
-
     pthread_join(processing_thread, NULL);
+    tick_scheduler_destroy(&tick_scheduler);
 
-    pollfd_set_shutdown(&server_pfds);
+    // Store everyone who is still online, the database worker executes it before it stops.
+    for (u32 i = 0; i < players.count; i++) {
+        mark_profile_dirty(players.live[i]);
+    }
+    flush_player_profiles();
+
+    reactor_shutdown(&server_reactor);
+    outbox_destroy(&server_outbox);
+    auth_pool_destroy(&auth_pool);
+    darray_destroy(auth_results_spare);
+    db_worker_destroy(&db_worker);
+    darray_destroy(dirty_profile_ids);
+    darray_destroy(departed_profiles);
+    darray_destroy(db_results_spare);
+    close(reload_signal_fd);
+    if (ip_blacklist != NULL) {
+        ip_blacklist_destroy(ip_blacklist);
+    }
+    darray_destroy(outbox_spare);
+    darray_destroy(closed_connections);
+    darray_destroy(failed_connections);
+    darray_destroy(scheduled_flushes);
+    flush_pending_datagrams();
+    darray_destroy(pending_datagrams);
+    darray_destroy(interest_ids);
+    spatial_grid_destroy(&player_grid);
+    username_index_destroy(&player_usernames);
 
     {
-        // uthash cleanup
-        Player *p, *tmp1;
-        HASH_ITER(hh, players, p, tmp1) {
-            HASH_DEL(players, p);
-            free(p);
-        }
-
-        Socket_Player_Id_Pair *s, *tmp2;
-        HASH_ITER(hh, socket_to_player_id_map, s, tmp2) {
-            HASH_DEL(socket_to_player_id_map, s);
-            free(s);
-        }
-
-        Player_Moved *pm, *tmp3;
-        HASH_ITER(hh, moved_players, pm, tmp3) {
-            HASH_DEL(moved_players, pm);
-            free(pm);
+        u64 it = 0;
+        void *value;
+        while (hash_map_next(&connections, &it, NULL, &value)) {
+            Connection *c = *(Connection **) value;
+            close(c->socket);
+            connection_destroy(c);
         }
+        hash_map_destroy(&connections);
+        hash_map_destroy(&udp_sessions);
     }
 
-    pthread_mutex_destroy(&moved_players_lock);
+    dirty_set_destroy(&moved_players);
+    snapshot_exchange_destroy(&player_snapshots);
+    darray_destroy(unpublished_moves);
+    player_store_destroy(&players);
 
     event_system_unregister(EVENT_CODE_APP_LOG, server_on_app_log_event);
     event_system_shutdown();
@@ -1024,6 +2263,7 @@ int main(int argc, char **argv)
     if (close(server_socket) == -1) {
         LOG_ERROR("error while closing the socket: %s\n", strerror(errno));
     }
+    close(udp_socket);
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,34 @@
+#include "outbox.h"
+
+#include "common/asserts.h"
+#include "common/collections/darray.h"
+
+bool outbox_create(Outbox *outbox)
+{
+    ASSERT(outbox);
+    return mailbox_create(&outbox->mailbox, sizeof(Outbound_Packet));
+}
+
+void outbox_destroy(Outbox *outbox)
+{
+    ASSERT(outbox);
+
+    Outbound_Packet *pending = (Outbound_Packet *) outbox->mailbox.pending;
+    for (u64 i = 0; i < darray_length(pending); i++) {
+        packet_buffer_release(pending[i].buffer);
+    }
+
+    mailbox_destroy(&outbox->mailbox);
+}
+
+void outbox_submit(Outbox *outbox, const Outbound_Packet *packets, u64 count)
+{
+    ASSERT(outbox);
+    mailbox_post(&outbox->mailbox, packets, count);
+}
+
+Outbound_Packet *outbox_take(Outbox *outbox, Outbound_Packet *spare)
+{
+    ASSERT(outbox);
+    return (Outbound_Packet *) mailbox_take(&outbox->mailbox, spare);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common/defines.h"
+#include "common/packet.h"
+#include "common/player_types.h"
+#include "mailbox.h"
+
+typedef struct {
+    player_id recipient;
+    Packet_Buffer *buffer;
+    bool unreliable; // may go over the recipient's datagram channel, superseded by the next one with a newer sequence
+    u32 sequence;
+    u64 tick; // processing tick that produced the packet
+} Outbound_Packet;
+
+// Packets produced by other threads for the network thread, which is the only one that touches
+// sockets and send queues. Packets are addressed by player id rather than by socket, so a
+// packet for a player that left in the meantime is simply dropped.
+typedef struct {
+    Mailbox mailbox; // Outbound_Packet
+} Outbox;
+
+bool outbox_create(Outbox *outbox);
+void outbox_destroy(Outbox *outbox); // Releases the packets that were not taken.
+
+// Takes over one buffer reference per packet.
+void outbox_submit(Outbox *outbox, const Outbound_Packet *packets, u64 count);
+
+// Swaps the pending packets with the empty 'spare' darray and returns them.
+// The caller owns the buffer references of the returned packets and passes the darray back in as 'spare' next time.
+Outbound_Packet *outbox_take(Outbox *outbox, Outbound_Packet *spare);
@@ -0,0 +1,116 @@
+#include "player_store.h"
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+#include "common/collections/darray.h"
+
+void player_store_create(Player_Store *store, u32 capacity)
+{
+    ASSERT(store);
+    ASSERT(capacity > 0 && capacity <= PLAYER_STORE_MAX_CAPACITY);
+
+    store->capacity = capacity;
+    store->count = 0;
+
+    store->positions = (glm::vec3 *) mem_alloc(capacity * sizeof(glm::vec3), MEMORY_TAG_GAME);
+    store->flags = (u8 *) mem_alloc(capacity * sizeof(u8), MEMORY_TAG_GAME);
+    store->details = (Player_Details *) mem_alloc(capacity * sizeof(Player_Details), MEMORY_TAG_GAME);
+    store->ids = (player_id *) mem_alloc(capacity * sizeof(player_id), MEMORY_TAG_GAME);
+    store->generations = (u16 *) mem_alloc(capacity * sizeof(u16), MEMORY_TAG_GAME);
+    store->live = (u32 *) mem_alloc(capacity * sizeof(u32), MEMORY_TAG_GAME);
+    store->live_index = (u32 *) mem_alloc(capacity * sizeof(u32), MEMORY_TAG_GAME);
+
+    mem_zero(store->ids, capacity * sizeof(player_id));
+    mem_zero(store->generations, capacity * sizeof(u16));
+
+    // Popped from the end, so the lowest slots are handed out first and the hot arrays stay dense.
+    store->free_slots = (u32 *) darray_reserve(capacity, sizeof(u32));
+    for (u32 slot = capacity; slot > 0; slot--) {
+        darray_push(store->free_slots, slot - 1);
+    }
+}
+
+void player_store_destroy(Player_Store *store)
+{
+    ASSERT(store);
+
+    u32 capacity = store->capacity;
+    mem_free(store->positions, capacity * sizeof(glm::vec3), MEMORY_TAG_GAME);
+    mem_free(store->flags, capacity * sizeof(u8), MEMORY_TAG_GAME);
+    mem_free(store->details, capacity * sizeof(Player_Details), MEMORY_TAG_GAME);
+    mem_free(store->ids, capacity * sizeof(player_id), MEMORY_TAG_GAME);
+    mem_free(store->generations, capacity * sizeof(u16), MEMORY_TAG_GAME);
+    mem_free(store->live, capacity * sizeof(u32), MEMORY_TAG_GAME);
+    mem_free(store->live_index, capacity * sizeof(u32), MEMORY_TAG_GAME);
+    darray_destroy(store->free_slots);
+    mem_zero(store, sizeof(Player_Store));
+}
+
+player_id player_store_add(Player_Store *store, u32 *out_slot)
+{
+    ASSERT(store);
+    ASSERT(out_slot);
+
+    if (darray_length(store->free_slots) == 0) {
+        return 0;
+    }
+
+    u32 slot;
+    darray_pop(store->free_slots, &slot);
+
+    // Generation 0 is skipped, so no id is ever 0.
+    u16 generation = (u16) (store->generations[slot] + 1);
+    if (generation == 0) {
+        generation = 1;
+    }
+    store->generations[slot] = generation;
+
+    player_id id = ((u32) generation << PLAYER_STORE_SLOT_BITS) | slot;
+    store->ids[slot] = id;
+    store->positions[slot] = glm::vec3(0.0f);
+    store->flags[slot] = 0;
+    mem_zero(&store->details[slot], sizeof(Player_Details));
+
+    store->live[store->count] = slot;
+    store->live_index[slot] = store->count;
+    store->count++;
+
+    *out_slot = slot;
+    return id;
+}
+
+void player_store_remove(Player_Store *store, player_id id)
+{
+    ASSERT(store);
+
+    u32 slot;
+    bool found = player_store_find(store, id, &slot);
+    ASSERT_MSG(found, "player id=%u is not in the store", id);
+    if (!found) {
+        return;
+    }
+
+    // Swap the last live slot into the hole.
+    u32 index = store->live_index[slot];
+    u32 last = store->live[store->count - 1];
+    store->live[index] = last;
+    store->live_index[last] = index;
+    store->count--;
+
+    store->ids[slot] = 0;
+    darray_push(store->free_slots, slot);
+}
+
+bool player_store_find(const Player_Store *store, player_id id, u32 *out_slot)
+{
+    ASSERT(store);
+    ASSERT(out_slot);
+
+    u32 slot = id & PLAYER_STORE_SLOT_MASK;
+    if (id == 0 || slot >= store->capacity || store->ids[slot] != id) {
+        return false;
+    }
+
+    *out_slot = slot;
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "common/defines.h"
+#include "common/player_types.h"
+
+#define PLAYER_STORE_SLOT_BITS 16
+#define PLAYER_STORE_SLOT_MASK ((1u << PLAYER_STORE_SLOT_BITS) - 1)
+#define PLAYER_STORE_MAX_CAPACITY (1u << PLAYER_STORE_SLOT_BITS)
+
+typedef enum {
+    PLAYER_FLAG_MOVE_UNPUBLISHED = BIT(0), // queued to be marked as moved once the next snapshot is published
+    PLAYER_FLAG_PROFILE_DIRTY    = BIT(1), // queued for the next profile flush
+} Player_Flag;
+
+// Fields that are only read when a player joins, leaves or comes into someone's view.
+typedef struct {
+    i32 socket;
+    const char *username; // interned by the server's username index
+    glm::vec3 color;
+} Player_Details;
+
+/*
+ * Fixed-capacity player storage, with every field in a preallocated array indexed by slot.
+ * The fields touched on every move or publish (position and flags) live in arrays of their
+ * own, so passes over them stream through memory instead of chasing per-player allocations,
+ * and the rarely used details are kept apart so they do not dilute the cache lines.
+ * The occupied slots are also kept densely packed in 'live' for iteration.
+ * A player id is the handle: the slot in the low bits and the slot's generation in the high
+ * bits. The generation changes every time a slot is reused, so an id kept after its player
+ * left no longer resolves, until the 16 bit generation wraps around.
+ */
+typedef struct {
+    u32 capacity;
+    u32 count;
+
+    // Hot, per slot.
+    glm::vec3 *positions;
+    u8 *flags; // Player_Flag bits
+
+    // Cold, per slot.
+    Player_Details *details;
+
+    player_id *ids;   // per slot, 0 when the slot is free
+    u16 *generations; // per slot, of the last id handed out for it
+    u32 *live;        // the occupied slots, 'count' of them
+    u32 *live_index;  // per slot, position in 'live'
+    u32 *free_slots;  // darray, popped from the end
+} Player_Store;
+
+void player_store_create(Player_Store *store, u32 capacity);
+void player_store_destroy(Player_Store *store);
+
+// Returns 0 when the store is full. The fields of the new slot are zeroed.
+player_id player_store_add(Player_Store *store, u32 *out_slot);
+void player_store_remove(Player_Store *store, player_id id);
+
+// Returns false when the id does not belong to a player in the store.
+bool player_store_find(const Player_Store *store, player_id id, u32 *out_slot);
@@ -0,0 +1,187 @@
+#include "reactor.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/log.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+#define REACTOR_INITIAL_ENTRIES_CAPACITY 64
+
+LOCAL u32 reactor_events_to_epoll(u32 events)
+{
+    u32 epoll_events = EPOLLET;
+    if (events & REACTOR_EVENT_READ)  epoll_events |= EPOLLIN | EPOLLRDHUP;
+    if (events & REACTOR_EVENT_WRITE) epoll_events |= EPOLLOUT;
+    return epoll_events;
+}
+
+LOCAL u32 reactor_events_from_epoll(u32 epoll_events)
+{
+    u32 events = 0;
+    if (epoll_events & EPOLLIN)                 events |= REACTOR_EVENT_READ;
+    if (epoll_events & EPOLLOUT)                events |= REACTOR_EVENT_WRITE;
+    if (epoll_events & (EPOLLHUP | EPOLLRDHUP)) events |= REACTOR_EVENT_HANGUP;
+    if (epoll_events & EPOLLERR)                events |= REACTOR_EVENT_ERROR;
+    return events;
+}
+
+LOCAL void reactor_ensure_capacity(Reactor *reactor, i32 fd)
+{
+    if ((u32) fd < reactor->entries_capacity) {
+        return;
+    }
+
+    u32 new_capacity = reactor->entries_capacity;
+    while (new_capacity <= (u32) fd) {
+        new_capacity *= 2;
+    }
+
+    Reactor_Entry *new_entries = (Reactor_Entry *) mem_alloc(new_capacity * sizeof(Reactor_Entry), MEMORY_TAG_NETWORK);
+    mem_copy(new_entries, reactor->entries, reactor->entries_capacity * sizeof(Reactor_Entry));
+    mem_free(reactor->entries, reactor->entries_capacity * sizeof(Reactor_Entry), MEMORY_TAG_NETWORK);
+
+    reactor->entries = new_entries;
+    reactor->entries_capacity = new_capacity;
+}
+
+bool reactor_init(Reactor *reactor, u32 max_events)
+{
+    ASSERT(reactor);
+    ASSERT(max_events > 0);
+
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd == -1) {
+        LOG_ERROR("epoll_create1 error: %s\n", strerror(errno));
+        return false;
+    }
+
+    reactor->fd_count = 0;
+    reactor->max_events = max_events;
+    reactor->ready_events = (struct epoll_event *) mem_alloc(max_events * sizeof(struct epoll_event), MEMORY_TAG_NETWORK);
+    reactor->entries_capacity = REACTOR_INITIAL_ENTRIES_CAPACITY;
+    reactor->entries = (Reactor_Entry *) mem_alloc(reactor->entries_capacity * sizeof(Reactor_Entry), MEMORY_TAG_NETWORK);
+
+    return true;
+}
+
+void reactor_shutdown(Reactor *reactor)
+{
+    ASSERT(reactor);
+
+    close(reactor->epoll_fd);
+    mem_free(reactor->ready_events, reactor->max_events * sizeof(struct epoll_event), MEMORY_TAG_NETWORK);
+    mem_free(reactor->entries, reactor->entries_capacity * sizeof(Reactor_Entry), MEMORY_TAG_NETWORK);
+    mem_zero(reactor, sizeof(Reactor));
+}
+
+bool reactor_add(Reactor *reactor, i32 fd, u32 events, pfn_reactor_handler handler, void *user_data)
+{
+    ASSERT(reactor);
+    ASSERT(fd >= 0);
+    ASSERT(handler);
+
+    reactor_ensure_capacity(reactor, fd);
+
+    Reactor_Entry *entry = &reactor->entries[fd];
+    ASSERT_MSG(!entry->registered, "fd=%d is already registered in the reactor", fd);
+
+    // The generation travels with the epoll event, so events still pending for a closed fd
+    // are not dispatched to a new descriptor that happens to reuse the same number.
+    entry->generation += 1;
+
+    struct epoll_event ev = {};
+    ev.events = reactor_events_to_epoll(events);
+    ev.data.u64 = ((u64) entry->generation << 32) | (u32) fd;
+
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        LOG_ERROR("epoll_ctl add fd=%d error: %s\n", fd, strerror(errno));
+        return false;
+    }
+
+    entry->handler = handler;
+    entry->user_data = user_data;
+    entry->registered = true;
+    reactor->fd_count++;
+
+    return true;
+}
+
+bool reactor_modify(Reactor *reactor, i32 fd, u32 events)
+{
+    ASSERT(reactor);
+    ASSERT(fd >= 0 && (u32) fd < reactor->entries_capacity);
+
+    Reactor_Entry *entry = &reactor->entries[fd];
+    ASSERT(entry->registered);
+
+    struct epoll_event ev = {};
+    ev.events = reactor_events_to_epoll(events);
+    ev.data.u64 = ((u64) entry->generation << 32) | (u32) fd;
+
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+        LOG_ERROR("epoll_ctl modify fd=%d error: %s\n", fd, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool reactor_remove(Reactor *reactor, i32 fd)
+{
+    ASSERT(reactor);
+
+    if (!reactor_is_registered(reactor, fd)) {
+        LOG_ERROR("did not find fd=%d in the reactor\n", fd);
+        return false;
+    }
+
+    Reactor_Entry *entry = &reactor->entries[fd];
+    entry->registered = false;
+    entry->handler = NULL;
+    entry->user_data = NULL;
+    reactor->fd_count--;
+
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1) {
+        LOG_ERROR("epoll_ctl delete fd=%d error: %s\n", fd, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool reactor_is_registered(Reactor *reactor, i32 fd)
+{
+    ASSERT(reactor);
+    return fd >= 0 && (u32) fd < reactor->entries_capacity && reactor->entries[fd].registered;
+}
+
+i32 reactor_wait(Reactor *reactor, i32 timeout_ms)
+{
+    ASSERT(reactor);
+
+    i32 num_events = epoll_wait(reactor->epoll_fd, reactor->ready_events, (i32) reactor->max_events, timeout_ms);
+    if (num_events == -1) {
+        return -1;
+    }
+
+    i32 dispatched = 0;
+    for (i32 i = 0; i < num_events; i++) {
+        u64 data = reactor->ready_events[i].data.u64;
+        i32 fd = (i32) (data & 0xFFFFFFFF);
+        u32 generation = (u32) (data >> 32);
+
+        // Handlers may remove (and close) other descriptors that are still in this batch.
+        Reactor_Entry *entry = &reactor->entries[fd];
+        if (!entry->registered || entry->generation != generation) {
+            continue;
+        }
+
+        entry->handler(fd, reactor_events_from_epoll(reactor->ready_events[i].events), entry->user_data);
+        dispatched++;
+    }
+
+    return dispatched;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <sys/epoll.h>
+
+#include "common/defines.h"
+
+#define REACTOR_INFINITE_TIMEOUT -1
+#define REACTOR_DEFAULT_MAX_EVENTS 256
+
+typedef enum {
+    REACTOR_EVENT_READ   = BIT(0),
+    REACTOR_EVENT_WRITE  = BIT(1),
+    REACTOR_EVENT_HANGUP = BIT(2),
+    REACTOR_EVENT_ERROR  = BIT(3)
+} Reactor_Event;
+
+typedef void (*pfn_reactor_handler)(i32 fd, u32 events, void *user_data);
+
+typedef struct {
+    pfn_reactor_handler handler;
+    void *user_data;
+    u32 generation;
+    bool registered;
+} Reactor_Entry;
+
+/*
+ * Edge-triggered epoll wrapper. Registered file descriptors must be non-blocking
+ * and handlers have to drain them (read/accept until EAGAIN), because the reactor
+ * reports each readiness transition only once.
+ * Entries are indexed directly by fd, so add and remove are O(1).
+ */
+typedef struct {
+    i32 epoll_fd;
+    u32 fd_count;
+    u32 max_events;
+    struct epoll_event *ready_events;
+    Reactor_Entry *entries; // indexed by fd
+    u32 entries_capacity;
+} Reactor;
+
+bool reactor_init(Reactor *reactor, u32 max_events);
+void reactor_shutdown(Reactor *reactor);
+bool reactor_add(Reactor *reactor, i32 fd, u32 events, pfn_reactor_handler handler, void *user_data);
+bool reactor_modify(Reactor *reactor, i32 fd, u32 events);
+bool reactor_remove(Reactor *reactor, i32 fd);
+bool reactor_is_registered(Reactor *reactor, i32 fd);
+i32  reactor_wait(Reactor *reactor, i32 timeout_ms); // Returns the number of dispatched events or -1 on error.
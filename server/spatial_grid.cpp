@@ -0,0 +1,209 @@
+#include "spatial_grid.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+#include "common/collections/darray.h"
+
+void spatial_grid_create(Spatial_Grid *grid, f32 cell_size)
+{
+    ASSERT(grid);
+    ASSERT(cell_size > 0.0f);
+
+    grid->cell_size = cell_size;
+    grid->count = 0;
+    hash_map_create_tagged(&grid->cells, sizeof(Cell_Coord), sizeof(u32 *), MEMORY_TAG_GAME);
+    hash_map_create_tagged(&grid->entries, sizeof(u32), sizeof(Cell_Coord), MEMORY_TAG_GAME);
+}
+
+void spatial_grid_destroy(Spatial_Grid *grid)
+{
+    ASSERT(grid);
+
+    spatial_grid_clear(grid);
+    hash_map_destroy(&grid->cells);
+    hash_map_destroy(&grid->entries);
+    mem_zero(grid, sizeof(Spatial_Grid));
+}
+
+void spatial_grid_clear(Spatial_Grid *grid)
+{
+    ASSERT(grid);
+
+    u64 it = 0;
+    void *value;
+    while (hash_map_next(&grid->cells, &it, NULL, &value)) {
+        darray_destroy(*(u32 **) value);
+    }
+
+    hash_map_clear(&grid->cells);
+    hash_map_clear(&grid->entries);
+    grid->count = 0;
+}
+
+// Clamped before the conversion, since converting a float outside the range of i32 is undefined.
+LOCAL i32 spatial_grid_axis_cell(f32 position, f32 cell_size)
+{
+    f32 cell = floorf(position / cell_size);
+    if (!(cell > (f32) -SPATIAL_GRID_MAX_CELL)) {
+        return isnan(cell) ? 0 : -SPATIAL_GRID_MAX_CELL;
+    }
+    if (cell > (f32) SPATIAL_GRID_MAX_CELL) {
+        return SPATIAL_GRID_MAX_CELL;
+    }
+    return (i32) cell;
+}
+
+Cell_Coord spatial_grid_cell_of(const Spatial_Grid *grid, const f32 *position)
+{
+    ASSERT(grid);
+    ASSERT(position);
+
+    Cell_Coord coord;
+    coord.x = spatial_grid_axis_cell(position[0], grid->cell_size);
+    coord.y = spatial_grid_axis_cell(position[1], grid->cell_size);
+    coord.z = spatial_grid_axis_cell(position[2], grid->cell_size);
+    return coord;
+}
+
+bool spatial_grid_are_neighbors(Cell_Coord a, Cell_Coord b)
+{
+    return abs(a.x - b.x) <= SPATIAL_GRID_NEIGHBORHOOD &&
+           abs(a.y - b.y) <= SPATIAL_GRID_NEIGHBORHOOD &&
+           abs(a.z - b.z) <= SPATIAL_GRID_NEIGHBORHOOD;
+}
+
+LOCAL void spatial_grid_cell_add(Spatial_Grid *grid, Cell_Coord coord, u32 id)
+{
+    u32 **cell = (u32 **) hash_map_find(&grid->cells, &coord);
+    if (cell == NULL) {
+        u32 *empty = (u32 *) darray_create(sizeof(u32));
+        cell = (u32 **) hash_map_insert(&grid->cells, &coord, &empty);
+    }
+
+    // The push may move the darray, so the pointer stored in the map is updated.
+    u32 *ids = *cell;
+    darray_push(ids, id);
+    *cell = ids;
+}
+
+LOCAL void spatial_grid_cell_remove(Spatial_Grid *grid, Cell_Coord coord, u32 id)
+{
+    u32 **cell = (u32 **) hash_map_find(&grid->cells, &coord);
+    ASSERT(cell != NULL);
+
+    u32 *ids = *cell;
+    u64 length = darray_length(ids);
+    for (u64 i = 0; i < length; i++) {
+        if (ids[i] == id) {
+            // Order within a cell does not matter, so swap with the last one.
+            ids[i] = ids[length - 1];
+            darray_pop(ids, NULL);
+            break;
+        }
+    }
+
+    if (darray_length(ids) == 0) {
+        darray_destroy(ids);
+        hash_map_remove(&grid->cells, &coord, NULL);
+    }
+}
+
+void spatial_grid_insert(Spatial_Grid *grid, u32 id, const f32 *position)
+{
+    ASSERT(grid);
+
+    ASSERT_MSG(!hash_map_contains(&grid->entries, &id), "id=%u is already in the spatial grid", id);
+
+    Cell_Coord coord = spatial_grid_cell_of(grid, position);
+    hash_map_insert(&grid->entries, &id, &coord);
+
+    spatial_grid_cell_add(grid, coord, id);
+    grid->count++;
+}
+
+bool spatial_grid_remove(Spatial_Grid *grid, u32 id)
+{
+    ASSERT(grid);
+
+    Cell_Coord coord;
+    if (!hash_map_remove(&grid->entries, &id, &coord)) {
+        return false;
+    }
+
+    spatial_grid_cell_remove(grid, coord, id);
+    grid->count--;
+
+    return true;
+}
+
+bool spatial_grid_find(Spatial_Grid *grid, u32 id, Cell_Coord *out_coord)
+{
+    ASSERT(grid);
+    ASSERT(out_coord);
+
+    Cell_Coord *coord = (Cell_Coord *) hash_map_find(&grid->entries, &id);
+    if (coord == NULL) {
+        return false;
+    }
+
+    *out_coord = *coord;
+    return true;
+}
+
+bool spatial_grid_update(Spatial_Grid *grid, u32 id, const f32 *position, Cell_Coord *out_from, Cell_Coord *out_to)
+{
+    ASSERT(grid);
+    ASSERT(out_from && out_to);
+
+    Cell_Coord *entry = (Cell_Coord *) hash_map_find(&grid->entries, &id);
+    ASSERT_MSG(entry != NULL, "id=%u is not in the spatial grid", id);
+
+    Cell_Coord from = *entry;
+    Cell_Coord coord = spatial_grid_cell_of(grid, position);
+    *out_from = from;
+    *out_to = coord;
+
+    if (coord.x == from.x && coord.y == from.y && coord.z == from.z) {
+        return false;
+    }
+
+    // Only the cells map changes below, so the entry pointer stays valid.
+    *entry = coord;
+    spatial_grid_cell_remove(grid, from, id);
+    spatial_grid_cell_add(grid, coord, id);
+
+    return true;
+}
+
+void spatial_grid_query(Spatial_Grid *grid, Cell_Coord center, const Cell_Coord *exclude, u32 **out_ids)
+{
+    ASSERT(grid);
+    ASSERT(out_ids && *out_ids);
+
+    u32 *ids = *out_ids;
+
+    for (i32 dz = -SPATIAL_GRID_NEIGHBORHOOD; dz <= SPATIAL_GRID_NEIGHBORHOOD; dz++) {
+        for (i32 dy = -SPATIAL_GRID_NEIGHBORHOOD; dy <= SPATIAL_GRID_NEIGHBORHOOD; dy++) {
+            for (i32 dx = -SPATIAL_GRID_NEIGHBORHOOD; dx <= SPATIAL_GRID_NEIGHBORHOOD; dx++) {
+                Cell_Coord coord = { center.x + dx, center.y + dy, center.z + dz };
+                if (exclude != NULL && spatial_grid_are_neighbors(coord, *exclude)) {
+                    continue;
+                }
+
+                u32 **cell = (u32 **) hash_map_find(&grid->cells, &coord);
+                if (cell == NULL) {
+                    continue;
+                }
+
+                for (u64 i = 0; i < darray_length(*cell); i++) {
+                    darray_push(ids, (*cell)[i]);
+                }
+            }
+        }
+    }
+
+    *out_ids = ids;
+}
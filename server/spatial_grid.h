@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common/defines.h"
+#include "common/collections/hash_map.h"
+
+#define SPATIAL_GRID_NEIGHBORHOOD 1 // cells in each direction, 1 means 3x3x3 cells
+#define SPATIAL_GRID_MAX_CELL (1 << 24) // cell coordinates are clamped to this in each direction, far from any overflow
+
+typedef struct {
+    i32 x, y, z;
+} Cell_Coord;
+
+/*
+ * Sparse uniform grid of ids, with a cell only allocated while it holds something.
+ * With the cell size equal to the interest radius, everything within the radius of a
+ * point lies in the 3x3x3 cells around the point's cell, so visibility is decided per
+ * cell: two ids see each other when their cells are neighbors. This is symmetric and
+ * only changes when an id crosses a cell boundary, at the cost of also including some
+ * ids that are up to twice the radius away along each axis.
+ */
+typedef struct {
+    f32 cell_size;
+    Hash_Map cells;    // Cell_Coord -> u32 *ids (darray)
+    Hash_Map entries;  // u32 id -> Cell_Coord
+    u32 count;
+} Spatial_Grid;
+
+void spatial_grid_create(Spatial_Grid *grid, f32 cell_size);
+void spatial_grid_destroy(Spatial_Grid *grid);
+void spatial_grid_clear(Spatial_Grid *grid);
+
+// Position is f32[3]. Anything outside the clamped range shares the outermost cells, and
+// NaN ends up in cell 0, callers are expected to reject such positions before they get here.
+Cell_Coord spatial_grid_cell_of(const Spatial_Grid *grid, const f32 *position);
+bool spatial_grid_are_neighbors(Cell_Coord a, Cell_Coord b);
+
+void spatial_grid_insert(Spatial_Grid *grid, u32 id, const f32 *position);
+bool spatial_grid_remove(Spatial_Grid *grid, u32 id);
+bool spatial_grid_find(Spatial_Grid *grid, u32 id, Cell_Coord *out_coord);
+
+// Moves the id to the cell of the new position. Returns true when the cell changed.
+bool spatial_grid_update(Spatial_Grid *grid, u32 id, const f32 *position, Cell_Coord *out_from, Cell_Coord *out_to);
+
+// Appends the ids in the neighborhood of 'center' to the 'out_ids' darray. When 'exclude' is
+// not NULL, cells that are also in the neighborhood of 'exclude' are skipped, which yields
+// what came into view (or went out of view) when moving from 'exclude' to 'center'.
+void spatial_grid_query(Spatial_Grid *grid, Cell_Coord center, const Cell_Coord *exclude, u32 **out_ids);
@@ -0,0 +1,90 @@
+#include "state_snapshot.h"
+
+#include <string.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+void snapshot_exchange_create(Snapshot_Exchange *exchange, u32 capacity)
+{
+    ASSERT(exchange);
+    ASSERT(capacity > 0);
+
+    for (u32 i = 0; i < ARRAY_LEN(exchange->buffers); i++) {
+        State_Snapshot *snapshot = &exchange->buffers[i];
+        snapshot->version = 0;
+        snapshot->count = 0;
+        snapshot->occupied = (u32 *) mem_alloc(capacity * sizeof(u32), MEMORY_TAG_GAME);
+        snapshot->players = (Snapshot_Player *) mem_alloc(capacity * sizeof(Snapshot_Player), MEMORY_TAG_GAME);
+    }
+
+    exchange->capacity = capacity;
+    exchange->next_version = 1;
+    exchange->back = 0;
+    exchange->middle = 1;
+    exchange->front = 2;
+}
+
+void snapshot_exchange_destroy(Snapshot_Exchange *exchange)
+{
+    ASSERT(exchange);
+
+    for (u32 i = 0; i < ARRAY_LEN(exchange->buffers); i++) {
+        State_Snapshot *snapshot = &exchange->buffers[i];
+        mem_free(snapshot->occupied, exchange->capacity * sizeof(u32), MEMORY_TAG_GAME);
+        mem_free(snapshot->players, exchange->capacity * sizeof(Snapshot_Player), MEMORY_TAG_GAME);
+    }
+
+    mem_zero(exchange, sizeof(Snapshot_Exchange));
+}
+
+State_Snapshot *snapshot_exchange_begin_write(Snapshot_Exchange *exchange)
+{
+    ASSERT(exchange);
+
+    State_Snapshot *snapshot = &exchange->buffers[exchange->back];
+
+    // Only the slots occupied in the previous use of this buffer need clearing.
+    for (u32 i = 0; i < snapshot->count; i++) {
+        snapshot->players[snapshot->occupied[i]].id = 0;
+    }
+
+    snapshot->count = 0;
+    snapshot->version = exchange->next_version;
+    return snapshot;
+}
+
+void snapshot_write_player(State_Snapshot *snapshot, u32 slot, player_id id, const f32 *position)
+{
+    ASSERT(snapshot);
+    ASSERT(id != 0);
+    ASSERT(snapshot->players[slot].id == 0);
+
+    Snapshot_Player *player = &snapshot->players[slot];
+    player->id = id;
+    memcpy(player->position, position, 3 * sizeof(f32));
+    snapshot->occupied[snapshot->count++] = slot;
+}
+
+void snapshot_exchange_publish(Snapshot_Exchange *exchange)
+{
+    ASSERT(exchange);
+
+    // Release makes the writes to the back buffer visible to the reader that acquires it.
+    u32 fresh = exchange->back | SNAPSHOT_EXCHANGE_FRESH;
+    u32 previous = __atomic_exchange_n(&exchange->middle, fresh, __ATOMIC_ACQ_REL);
+    exchange->back = previous & ~SNAPSHOT_EXCHANGE_FRESH;
+    exchange->next_version++;
+}
+
+const State_Snapshot *snapshot_exchange_read(Snapshot_Exchange *exchange)
+{
+    ASSERT(exchange);
+
+    if (__atomic_load_n(&exchange->middle, __ATOMIC_RELAXED) & SNAPSHOT_EXCHANGE_FRESH) {
+        u32 previous = __atomic_exchange_n(&exchange->middle, exchange->front, __ATOMIC_ACQ_REL);
+        exchange->front = previous & ~SNAPSHOT_EXCHANGE_FRESH;
+    }
+
+    return &exchange->buffers[exchange->front];
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "common/defines.h"
+#include "common/player_types.h"
+
+#define SNAPSHOT_EXCHANGE_FRESH BIT(2)
+
+typedef struct {
+    player_id id; // 0 when the slot is free
+    f32 position[3];
+} Snapshot_Player;
+
+// Immutable copy of the player state as of one point in time, indexed by player slot.
+typedef struct {
+    u64 version;
+    u32 count;                // number of occupied slots
+    u32 *occupied;            // the occupied slots, 'count' of them
+    Snapshot_Player *players; // 'capacity' of them
+} State_Snapshot;
+
+/*
+ * Triple buffer that hands snapshots from one writer thread to one reader thread without locks.
+ * The writer fills its private back buffer and publishes it by exchanging it with the shared
+ * middle buffer. The reader swaps the middle buffer for its front buffer whenever a newer one was
+ * published, and otherwise keeps reading the same front buffer. Neither side ever waits for the
+ * other, and a snapshot being read is never written, so the reader sees a consistent state.
+ */
+typedef struct {
+    State_Snapshot buffers[3];
+    u32 capacity;
+    u64 next_version; // writer only
+    u32 back;         // writer only
+    u32 front;        // reader only
+    u32 middle;       // atomic, buffer index with SNAPSHOT_EXCHANGE_FRESH when not yet seen by the reader
+} Snapshot_Exchange;
+
+void snapshot_exchange_create(Snapshot_Exchange *exchange, u32 capacity);
+void snapshot_exchange_destroy(Snapshot_Exchange *exchange);
+
+// Writer side: returns the emptied back buffer, which is made visible to the reader by publish.
+State_Snapshot *snapshot_exchange_begin_write(Snapshot_Exchange *exchange);
+void snapshot_write_player(State_Snapshot *snapshot, u32 slot, player_id id, const f32 *position);
+void snapshot_exchange_publish(Snapshot_Exchange *exchange);
+
+// Reader side: returns the newest published snapshot, valid until the next call.
+const State_Snapshot *snapshot_exchange_read(Snapshot_Exchange *exchange);
@@ -0,0 +1,130 @@
+#include "tick_scheduler.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "common/log.h"
+#include "common/clock.h"
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+#define NS_PER_SEC (1000ULL * 1000 * 1000)
+
+bool tick_scheduler_create(Tick_Scheduler *scheduler, u32 rate)
+{
+    ASSERT(scheduler);
+    ASSERT(rate > 0);
+
+    mem_zero(scheduler, sizeof(Tick_Scheduler));
+
+    scheduler->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (scheduler->timer_fd == -1) {
+        LOG_ERROR("timerfd_create error: %s\n", strerror(errno));
+        return false;
+    }
+
+    scheduler->rate = rate;
+    scheduler->period_ns = NS_PER_SEC / rate;
+    scheduler->start_time = clock_get_absolute_time_ns();
+
+    u64 first_deadline = scheduler->start_time + scheduler->period_ns;
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = (time_t) (first_deadline / NS_PER_SEC);
+    spec.it_value.tv_nsec = (long) (first_deadline % NS_PER_SEC);
+    spec.it_interval.tv_sec = (time_t) (scheduler->period_ns / NS_PER_SEC);
+    spec.it_interval.tv_nsec = (long) (scheduler->period_ns % NS_PER_SEC);
+
+    if (timerfd_settime(scheduler->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+        LOG_ERROR("timerfd_settime error: %s\n", strerror(errno));
+        close(scheduler->timer_fd);
+        return false;
+    }
+
+    return true;
+}
+
+void tick_scheduler_destroy(Tick_Scheduler *scheduler)
+{
+    ASSERT(scheduler);
+
+    close(scheduler->timer_fd);
+    mem_zero(scheduler, sizeof(Tick_Scheduler));
+}
+
+u64 tick_scheduler_wait(Tick_Scheduler *scheduler)
+{
+    ASSERT(scheduler);
+
+    if (scheduler->pending == 0) {
+        u64 expirations = 0;
+        for (;;) {
+            i64 bytes_read = read(scheduler->timer_fd, &expirations, sizeof(expirations));
+            if (bytes_read == sizeof(expirations)) {
+                break;
+            }
+
+            if (bytes_read == -1 && errno == EINTR) {
+                continue;
+            }
+
+            // Should never happen, run the tick anyway rather than stall the server.
+            LOG_ERROR("timerfd read error: %s\n", strerror(errno));
+            expirations = 1;
+            break;
+        }
+
+        ASSERT(expirations > 0);
+        if (expirations > 1) {
+            scheduler->stats.overruns++;
+        }
+
+        if (expirations > 1 + TICK_SCHEDULER_MAX_CATCH_UP) {
+            // Too far behind to catch up, drop the oldest ticks and keep the numbering in step with time.
+            u64 skipped = expirations - 1 - TICK_SCHEDULER_MAX_CATCH_UP;
+            scheduler->stats.skipped += skipped;
+            scheduler->next_tick += skipped;
+            expirations -= skipped;
+        }
+
+        scheduler->pending = expirations;
+    }
+
+    scheduler->pending--;
+    u64 tick = scheduler->next_tick++;
+
+    u64 now = clock_get_absolute_time_ns();
+    u64 deadline = scheduler->start_time + (tick + 1) * scheduler->period_ns;
+    u64 lateness = now > deadline ? now - deadline : 0;
+
+    scheduler->tick_start = now;
+    scheduler->stats.lateness_total_ns += lateness;
+    if (lateness > scheduler->stats.lateness_max_ns) {
+        scheduler->stats.lateness_max_ns = lateness;
+    }
+
+    return tick;
+}
+
+void tick_scheduler_end(Tick_Scheduler *scheduler)
+{
+    ASSERT(scheduler);
+
+    u64 duration = clock_get_absolute_time_ns() - scheduler->tick_start;
+
+    scheduler->stats.ticks++;
+    scheduler->stats.duration_total_ns += duration;
+    if (duration > scheduler->stats.duration_max_ns) {
+        scheduler->stats.duration_max_ns = duration;
+    }
+}
+
+Tick_Stats tick_scheduler_take_stats(Tick_Scheduler *scheduler)
+{
+    ASSERT(scheduler);
+
+    Tick_Stats stats = scheduler->stats;
+    mem_zero(&scheduler->stats, sizeof(Tick_Stats));
+    return stats;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common/defines.h"
+
+#define TICK_SCHEDULER_MAX_CATCH_UP 4 // late ticks run back to back before the rest are skipped
+
+typedef struct {
+    u64 ticks;             // ticks run
+    u64 skipped;           // ticks dropped because they were too far behind
+    u64 overruns;          // wakeups that found more than one tick due
+    u64 duration_total_ns; // time between tick_scheduler_wait returning and tick_scheduler_end
+    u64 duration_max_ns;
+    u64 lateness_total_ns; // time between a tick's deadline and the tick starting
+    u64 lateness_max_ns;
+} Tick_Stats;
+
+/*
+ * Fixed timestep driven by an absolute timerfd, so the deadlines stay on the grid laid
+ * out at creation no matter how long a tick takes. Every tick gets the next number in
+ * sequence. When a wakeup finds several ticks due, up to TICK_SCHEDULER_MAX_CATCH_UP of
+ * them are run back to back without waiting, and the rest are skipped: their numbers are
+ * consumed and counted, but they never run.
+ */
+typedef struct {
+    i32 timer_fd;
+    u32 rate;        // ticks per second
+    u64 period_ns;
+    u64 start_time;  // tick n is due at start_time + (n + 1) * period_ns
+    u64 next_tick;
+    u64 pending;     // ticks due that have not run yet
+    u64 tick_start;  // when the current tick started
+    Tick_Stats stats; // since the last tick_scheduler_take_stats
+} Tick_Scheduler;
+
+bool tick_scheduler_create(Tick_Scheduler *scheduler, u32 rate);
+void tick_scheduler_destroy(Tick_Scheduler *scheduler);
+
+// Blocks until the next tick is due and returns its number.
+u64  tick_scheduler_wait(Tick_Scheduler *scheduler);
+void tick_scheduler_end(Tick_Scheduler *scheduler);
+
+// Returns the stats collected since the previous call and starts collecting anew.
+Tick_Stats tick_scheduler_take_stats(Tick_Scheduler *scheduler);
@@ -0,0 +1,76 @@
+#include "username_index.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "common/asserts.h"
+#include "common/memory/memutils.h"
+
+STATIC_ASSERT(offsetof(Username_Entry, username) == 0, "interned username must be the first member of Username_Entry");
+
+void username_index_create(Username_Index *index)
+{
+    ASSERT(index);
+
+    index->entries = NULL;
+    index->count = 0;
+}
+
+void username_index_destroy(Username_Index *index)
+{
+    ASSERT(index);
+
+    Username_Entry *entry, *tmp;
+    HASH_ITER(hh, index->entries, entry, tmp) {
+        HASH_DEL(index->entries, entry);
+        mem_free(entry, sizeof(Username_Entry), MEMORY_TAG_GAME);
+    }
+
+    mem_zero(index, sizeof(Username_Index));
+}
+
+player_id username_index_find(Username_Index *index, const char *username)
+{
+    ASSERT(index);
+    ASSERT(username);
+
+    Username_Entry *entry;
+    HASH_FIND_STR(index->entries, username, entry);
+    return entry != NULL ? entry->id : 0;
+}
+
+const char *username_index_insert(Username_Index *index, const char *username, player_id id)
+{
+    ASSERT(index);
+    ASSERT(username && id != 0);
+
+    u64 length = strlen(username);
+    ASSERT(length <= PLAYER_USERNAME_MAX_LEN);
+    ASSERT_MSG(username_index_find(index, username) == 0, "username `%s` is already in the index", username);
+
+    Username_Entry *entry = (Username_Entry *) mem_alloc(sizeof(Username_Entry), MEMORY_TAG_GAME);
+    mem_zero(entry, sizeof(Username_Entry));
+    mem_copy(entry->username, username, length);
+    entry->id = id;
+    HASH_ADD_KEYPTR(hh, index->entries, entry->username, (u32) length, entry);
+    index->count++;
+
+    return entry->username;
+}
+
+void username_index_remove(Username_Index *index, const char *interned_username)
+{
+    ASSERT(index);
+    ASSERT(interned_username);
+
+    Username_Entry *entry = (Username_Entry *) interned_username;
+#if ENABLE_ASSERTIONS
+    Username_Entry *found;
+    HASH_FIND_STR(index->entries, interned_username, found);
+    ASSERT_MSG(found == entry, "`%s` is not an interned username", interned_username);
+#endif
+
+    HASH_DEL(index->entries, entry);
+    mem_free(entry, sizeof(Username_Entry), MEMORY_TAG_GAME);
+    index->count--;
+}
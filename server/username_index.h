@@ -0,0 +1,33 @@
+#pragma once
+
+#include "common/defines.h"
+#include "common/player_types.h"
+#include "uthash/uthash.h"
+
+typedef struct {
+    char username[PLAYER_USERNAME_MAX_LEN + 1]; // the interned string, must stay the first member
+    player_id id;
+    UT_hash_handle hh;
+} Username_Entry;
+
+/*
+ * Players by username, holding the one copy of every online player's username.
+ * Inserting interns the username and the player refers to the interned string,
+ * so the player and the index share it and removal needs no string lookup,
+ * the entry is found from the interned pointer alone.
+ */
+typedef struct {
+    Username_Entry *entries; // uthash keyed by username
+    u32 count;
+} Username_Index;
+
+void username_index_create(Username_Index *index);
+void username_index_destroy(Username_Index *index);
+
+// Returns 0 when no player has the username.
+player_id username_index_find(Username_Index *index, const char *username);
+
+// Returns the interned username, valid until it is removed. The username must not be in the index yet.
+const char *username_index_insert(Username_Index *index, const char *username, player_id id);
+// Takes a username returned by username_index_insert.
+void username_index_remove(Username_Index *index, const char *interned_username);
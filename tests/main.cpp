@@ -3,7 +3,15 @@
 #include "common/memory/memutils.h"
 #include "src/collections/darray_tests.h"
 #include "src/collections/ring_queue_tests.h"
+#include "src/collections/hash_map_tests.h"
 #include "src/memory/arena_allocator_tests.h"
+#include "src/network/packet_framer_tests.h"
+#include "src/network/send_queue_tests.h"
+#include "src/network/datagram_tests.h"
+#include "src/crypto/crypto_tests.h"
+#include "src/job/job_tests.h"
+#include "src/server/credentials_tests.h"
+#include "src/server/ip_blacklist_tests.h"
 
 int main(void)
 {
@@ -14,7 +22,15 @@ int main(void)
 
     darray_register_tests();
     ring_queue_register_tests();
+    hash_map_register_tests();
     arena_allocator_register_tests();
+    packet_framer_register_tests();
+    send_queue_register_tests();
+    datagram_register_tests();
+    crypto_register_tests();
+    job_register_tests();
+    credentials_register_tests();
+    ip_blacklist_register_tests();
 
     test_manager_run_all_tests();
     test_manager_shutdown();
@@ -0,0 +1,247 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include "common/collections/hash_map.h"
+
+u8 hash_map_create_and_destroy(void)
+{
+    Hash_Map map;
+    hash_map_create(&map, sizeof(u32), sizeof(u64));
+
+    expect_true(map.distances != 0);
+    expect_equal(map.capacity, HASH_MAP_DEFAULT_CAPACITY);
+    expect_equal(map.key_size, sizeof(u32));
+    expect_equal(map.value_size, sizeof(u64));
+    expect_equal(hash_map_length(&map), 0);
+
+    hash_map_destroy(&map);
+    expect_true(map.distances == 0);
+    expect_equal(map.capacity, 0);
+    expect_equal(map.count, 0);
+
+    Hash_Map reserved;
+    hash_map_reserve(&reserved, 1000, sizeof(u32), sizeof(u32));
+    expect_true(reserved.capacity * HASH_MAP_MAX_LOAD_NUMERATOR >= 1000 * HASH_MAP_MAX_LOAD_DENOMINATOR);
+    hash_map_destroy(&reserved);
+
+    return true;
+}
+
+u8 hash_map_insert_and_find(void)
+{
+    Hash_Map map;
+    hash_map_create(&map, sizeof(u32), sizeof(u64));
+
+    u32 key = 7;
+    u64 value = 700;
+    u64 *stored = (u64 *) hash_map_insert(&map, &key, &value);
+    expect_true(stored != 0);
+    expect_equal(*stored, 700);
+    expect_equal(hash_map_length(&map), 1);
+
+    u32 missing = 8;
+    expect_true(hash_map_find(&map, &missing) == 0);
+    expect_false(hash_map_contains(&map, &missing));
+    expect_true(hash_map_contains(&map, &key));
+
+    // Inserting an existing key overwrites its value.
+    value = 701;
+    hash_map_insert(&map, &key, &value);
+    expect_equal(hash_map_length(&map), 1);
+    expect_equal(*(u64 *) hash_map_find(&map, &key), 701);
+
+    // Values can be changed in place.
+    *(u64 *) hash_map_find(&map, &key) = 702;
+    expect_equal(*(u64 *) hash_map_find(&map, &key), 702);
+
+    hash_map_destroy(&map);
+
+    return true;
+}
+
+u8 hash_map_grows(void)
+{
+    Hash_Map map;
+    hash_map_create(&map, sizeof(u32), sizeof(u32));
+
+    for (u32 i = 0; i < 10000; i++) {
+        u32 value = i * 3;
+        hash_map_insert(&map, &i, &value);
+    }
+
+    expect_equal(hash_map_length(&map), 10000);
+    expect_true(map.capacity * HASH_MAP_MAX_LOAD_NUMERATOR >= 10000 * HASH_MAP_MAX_LOAD_DENOMINATOR);
+
+    for (u32 i = 0; i < 10000; i++) {
+        u32 *value = (u32 *) hash_map_find(&map, &i);
+        expect_true(value != 0);
+        expect_equal(*value, i * 3);
+    }
+
+    u32 missing = 10000;
+    expect_false(hash_map_contains(&map, &missing));
+
+    hash_map_destroy(&map);
+
+    return true;
+}
+
+u8 hash_map_remove_keeps_the_rest(void)
+{
+    Hash_Map map;
+    hash_map_create(&map, sizeof(u32), sizeof(u32));
+
+    for (u32 i = 0; i < 2000; i++) {
+        hash_map_insert(&map, &i, &i);
+    }
+
+    // Every removal shifts the following entries of its probe back.
+    for (u32 i = 0; i < 2000; i += 2) {
+        u32 value = 0;
+        expect_true(hash_map_remove(&map, &i, &value));
+        expect_equal(value, i);
+    }
+
+    u32 removed = 0;
+    expect_false(hash_map_remove(&map, &removed, 0));
+    expect_equal(hash_map_length(&map), 1000);
+
+    for (u32 i = 0; i < 2000; i++) {
+        if (i % 2 == 0) {
+            expect_false(hash_map_contains(&map, &i));
+        } else {
+            u32 *value = (u32 *) hash_map_find(&map, &i);
+            expect_true(value != 0);
+            expect_equal(*value, i);
+        }
+    }
+
+    // Removed keys can be inserted again.
+    for (u32 i = 0; i < 2000; i += 2) {
+        hash_map_insert(&map, &i, &i);
+    }
+    expect_equal(hash_map_length(&map), 2000);
+
+    hash_map_clear(&map);
+    expect_equal(hash_map_length(&map), 0);
+    expect_false(hash_map_contains(&map, &removed));
+
+    hash_map_destroy(&map);
+
+    return true;
+}
+
+u8 hash_map_iterates_every_entry_once(void)
+{
+    Hash_Map map;
+    hash_map_create(&map, sizeof(u32), sizeof(u32));
+
+    u64 it = 0;
+    expect_false(hash_map_next(&map, &it, 0, 0));
+
+    u8 seen[500] = {0};
+    for (u32 i = 0; i < 500; i++) {
+        u32 value = i + 1;
+        hash_map_insert(&map, &i, &value);
+    }
+
+    it = 0;
+    u32 visited = 0;
+    void *key, *value;
+    while (hash_map_next(&map, &it, &key, &value)) {
+        u32 k = *(u32 *) key;
+        expect_true(k < 500);
+        expect_equal(*(u32 *) value, k + 1);
+        expect_equal(seen[k], 0);
+        seen[k] = 1;
+        visited++;
+    }
+
+    expect_equal(visited, 500);
+
+    hash_map_destroy(&map);
+
+    return true;
+}
+
+u8 hash_map_struct_keys(void)
+{
+    typedef struct {
+        i32 x, y, z;
+    } Coord;
+
+    typedef struct {
+        u64 count;
+        f32 weight;
+    } Cell;
+
+    Hash_Map map;
+    hash_map_create(&map, sizeof(Coord), sizeof(Cell));
+
+    for (i32 x = -5; x <= 5; x++) {
+        for (i32 z = -5; z <= 5; z++) {
+            Coord coord = { x, 0, z };
+            Cell cell = { (u64) ((x + 5) * 11 + (z + 5)), 0.5f };
+            hash_map_insert(&map, &coord, &cell);
+        }
+    }
+
+    expect_equal(hash_map_length(&map), 121);
+
+    Coord coord = { -3, 0, 4 };
+    Cell *cell = (Cell *) hash_map_find(&map, &coord);
+    expect_true(cell != 0);
+    expect_equal(cell->count, 2 * 11 + 9);
+
+    Coord other_y = { -3, 1, 4 };
+    expect_false(hash_map_contains(&map, &other_y));
+
+    hash_map_destroy(&map);
+
+    return true;
+}
+
+u8 hash_map_resize_keeps_entries(void)
+{
+    Hash_Map map;
+    hash_map_create(&map, sizeof(u32), sizeof(u32));
+
+    for (u32 i = 0; i < 10; i++) {
+        u32 value = i * 3;
+        hash_map_insert(&map, &i, &value);
+    }
+
+    hash_map_resize(&map, 1000);
+    u64 capacity = map.capacity;
+    expect_true(capacity * HASH_MAP_MAX_LOAD_NUMERATOR >= 1000 * HASH_MAP_MAX_LOAD_DENOMINATOR);
+    expect_equal(hash_map_length(&map), 10);
+
+    for (u32 i = 0; i < 10; i++) {
+        expect_equal(*(u32 *) hash_map_find(&map, &i), i * 3);
+    }
+
+    // Inserting up to the requested size does not grow the map again, and it never shrinks.
+    for (u32 i = 10; i < 1000; i++) {
+        hash_map_insert(&map, &i, &i);
+    }
+    expect_equal(map.capacity, capacity);
+
+    hash_map_resize(&map, 1);
+    expect_equal(map.capacity, capacity);
+    expect_equal(hash_map_length(&map), 1000);
+
+    hash_map_destroy(&map);
+
+    return true;
+}
+
+void hash_map_register_tests(void)
+{
+    test_manager_register_test(hash_map_create_and_destroy, "hash map: create and destroy");
+    test_manager_register_test(hash_map_insert_and_find, "hash map: insert and find");
+    test_manager_register_test(hash_map_grows, "hash map: grows");
+    test_manager_register_test(hash_map_remove_keeps_the_rest, "hash map: remove keeps the rest");
+    test_manager_register_test(hash_map_iterates_every_entry_once, "hash map: iterates every entry once");
+    test_manager_register_test(hash_map_struct_keys, "hash map: struct keys");
+    test_manager_register_test(hash_map_resize_keeps_entries, "hash map: resize keeps entries");
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void hash_map_register_tests(void);
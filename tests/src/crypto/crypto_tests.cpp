@@ -0,0 +1,137 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/crypto/sha256.h"
+#include "common/crypto/pbkdf2.h"
+
+LOCAL bool matches_hex(const u8 *bytes, u64 size, const char *expected_hex)
+{
+    if (strlen(expected_hex) != size * 2) {
+        return false;
+    }
+
+    char hex[3];
+    for (u64 i = 0; i < size; i++) {
+        snprintf(hex, sizeof(hex), "%02x", bytes[i]);
+        if (hex[0] != expected_hex[i * 2] || hex[1] != expected_hex[i * 2 + 1]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+u8 sha256_matches_known_digests(void)
+{
+    u8 digest[SHA256_DIGEST_SIZE];
+
+    sha256("", 0, digest);
+    expect_true(matches_hex(digest, sizeof(digest), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+
+    sha256("abc", 3, digest);
+    expect_true(matches_hex(digest, sizeof(digest), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+
+    // 56 bytes, so the padding spills into a second block.
+    const char *two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    sha256(two_blocks, strlen(two_blocks), digest);
+    expect_true(matches_hex(digest, sizeof(digest), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+
+    return true;
+}
+
+u8 sha256_incremental_matches_one_shot(void)
+{
+    u8 data[300];
+    for (u32 i = 0; i < sizeof(data); i++) {
+        data[i] = (u8) (i * 7);
+    }
+
+    u8 expected[SHA256_DIGEST_SIZE];
+    sha256(data, sizeof(data), expected);
+
+    // Odd chunk sizes cross the block boundaries at different offsets.
+    Sha256_Context context;
+    sha256_init(&context);
+    u64 offset = 0, chunk = 1;
+    while (offset < sizeof(data)) {
+        u64 size = sizeof(data) - offset < chunk ? sizeof(data) - offset : chunk;
+        sha256_update(&context, data + offset, size);
+        offset += size;
+        chunk += 13;
+    }
+
+    u8 digest[SHA256_DIGEST_SIZE];
+    sha256_final(&context, digest);
+    expect_true(memcmp(digest, expected, SHA256_DIGEST_SIZE) == 0);
+
+    return true;
+}
+
+u8 hmac_sha256_matches_rfc4231(void)
+{
+    Hmac_Sha256_Key key;
+    u8 mac[SHA256_DIGEST_SIZE];
+
+    hmac_sha256_key(&key, "Jefe", 4);
+    const char *data = "what do ya want for nothing?";
+    hmac_sha256(&key, data, strlen(data), mac);
+    expect_true(matches_hex(mac, sizeof(mac), "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"));
+
+    // Keys longer than a block are hashed first.
+    u8 long_key[131];
+    memset(long_key, 0xaa, sizeof(long_key));
+    hmac_sha256_key(&key, long_key, sizeof(long_key));
+    const char *long_data = "Test Using Larger Than Block-Size Key - Hash Key First";
+    hmac_sha256(&key, long_data, strlen(long_data), mac);
+    expect_true(matches_hex(mac, sizeof(mac), "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54"));
+
+    return true;
+}
+
+u8 pbkdf2_matches_known_keys(void)
+{
+    u8 key[40];
+
+    pbkdf2_hmac_sha256("password", 8, "salt", 4, 1, key, 32);
+    expect_true(matches_hex(key, 32, "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b"));
+
+    pbkdf2_hmac_sha256("password", 8, "salt", 4, 2, key, 32);
+    expect_true(matches_hex(key, 32, "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43"));
+
+    pbkdf2_hmac_sha256("password", 8, "salt", 4, 4096, key, 32);
+    expect_true(matches_hex(key, 32, "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a"));
+
+    // Longer than one digest, so a second block is derived.
+    const char *password = "passwordPASSWORDpassword";
+    const char *salt = "saltSALTsaltSALTsaltSALTsaltSALTsalt";
+    pbkdf2_hmac_sha256(password, strlen(password), salt, strlen(salt), 4096, key, 40);
+    expect_true(matches_hex(key, 40, "348c89dbcbd32b2f32d814b8116e84cf2b17347ebc1800181c4e2a1fb8dd53e1c635518c7dac47e9"));
+
+    return true;
+}
+
+u8 constant_time_equal_compares_all_bytes(void)
+{
+    u8 a[16] = {0};
+    u8 b[16] = {0};
+
+    expect_true(constant_time_equal(a, b, sizeof(a)));
+
+    b[15] = 1;
+    expect_false(constant_time_equal(a, b, sizeof(a)));
+    expect_true(constant_time_equal(a, b, sizeof(a) - 1));
+
+    return true;
+}
+
+void crypto_register_tests(void)
+{
+    test_manager_register_test(sha256_matches_known_digests, "crypto: sha256 matches known digests");
+    test_manager_register_test(sha256_incremental_matches_one_shot, "crypto: sha256 incremental matches one shot");
+    test_manager_register_test(hmac_sha256_matches_rfc4231, "crypto: hmac sha256 matches rfc 4231");
+    test_manager_register_test(pbkdf2_matches_known_keys, "crypto: pbkdf2 matches known keys");
+    test_manager_register_test(constant_time_equal_compares_all_bytes, "crypto: constant time equal compares all bytes");
+}
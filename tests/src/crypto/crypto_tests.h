@@ -0,0 +1,3 @@
+#pragma once
+
+void crypto_register_tests(void);
@@ -0,0 +1,733 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <time.h>
+#include <stddef.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "common/job.h"
+#include "common/memory/memutils.h"
+
+#define JOB_TEST_TIMEOUT_MS 10000
+#define STRESS_ITEMS 100000
+#define STRESS_THIEVES 3
+
+LOCAL Job make_job(u64 id)
+{
+    Job job = {};
+    job.param_data_size = id;
+    return job;
+}
+
+u8 job_deque_pop_lifo_steal_fifo(void)
+{
+    Job_Deque deque;
+    job_deque_create(&deque);
+
+    Job job;
+    expect_true(job_deque_is_empty(&deque));
+    expect_false(job_deque_pop(&deque, &job));
+    expect_false(job_deque_steal(&deque, &job));
+
+    for (u64 i = 1; i <= 4; i++) {
+        Job pushed = make_job(i);
+        expect_true(job_deque_push(&deque, &pushed));
+    }
+
+    // The owner takes the newest, thieves take the oldest.
+    expect_true(job_deque_pop(&deque, &job));
+    expect_equal(job.param_data_size, 4);
+    expect_true(job_deque_steal(&deque, &job));
+    expect_equal(job.param_data_size, 1);
+    expect_true(job_deque_steal(&deque, &job));
+    expect_equal(job.param_data_size, 2);
+    expect_true(job_deque_pop(&deque, &job));
+    expect_equal(job.param_data_size, 3);
+    expect_true(job_deque_is_empty(&deque));
+    expect_false(job_deque_pop(&deque, &job));
+
+    job_deque_destroy(&deque);
+    return true;
+}
+
+u8 job_deque_rejects_push_when_full(void)
+{
+    Job_Deque deque;
+    job_deque_create(&deque);
+
+    for (u64 i = 0; i < JOB_DEQUE_CAPACITY; i++) {
+        Job pushed = make_job(i);
+        expect_true(job_deque_push(&deque, &pushed));
+    }
+
+    Job job = make_job(JOB_DEQUE_CAPACITY);
+    expect_false(job_deque_push(&deque, &job));
+
+    // A steal makes room, and the indices keep going past the end of the buffer.
+    expect_true(job_deque_steal(&deque, &job));
+    expect_equal(job.param_data_size, 0);
+    job = make_job(JOB_DEQUE_CAPACITY);
+    expect_true(job_deque_push(&deque, &job));
+    expect_true(job_deque_pop(&deque, &job));
+    expect_equal(job.param_data_size, JOB_DEQUE_CAPACITY);
+
+    job_deque_destroy(&deque);
+    return true;
+}
+
+typedef struct {
+    Job_Deque *deque;
+    u8 *taken; // STRESS_ITEMS counters
+    bool *done;
+} Stress_Context;
+
+LOCAL void *stress_thief(void *arg)
+{
+    Stress_Context *context = (Stress_Context *) arg;
+    Job job;
+    while (!__atomic_load_n(context->done, __ATOMIC_ACQUIRE) || !job_deque_is_empty(context->deque)) {
+        if (job_deque_steal(context->deque, &job)) {
+            __atomic_add_fetch(&context->taken[job.param_data_size], 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+u8 job_deque_concurrent_steals_take_every_job_once(void)
+{
+    Job_Deque deque;
+    job_deque_create(&deque);
+
+    u8 *taken = (u8 *) mem_alloc(STRESS_ITEMS, MEMORY_TAG_JOB);
+    bool done = false;
+    Stress_Context context = { .deque = &deque, .taken = taken, .done = &done };
+
+    pthread_t thieves[STRESS_THIEVES];
+    for (u32 i = 0; i < STRESS_THIEVES; i++) {
+        pthread_create(&thieves[i], NULL, stress_thief, &context);
+    }
+
+    // The owner keeps the deque short, so pops and steals often race for the last job.
+    Job job;
+    for (u64 i = 0; i < STRESS_ITEMS; i++) {
+        Job pushed = make_job(i);
+        while (!job_deque_push(&deque, &pushed)) {
+            if (job_deque_pop(&deque, &job)) {
+                __atomic_add_fetch(&taken[job.param_data_size], 1, __ATOMIC_RELAXED);
+            }
+        }
+        if (i % 3 == 0 && job_deque_pop(&deque, &job)) {
+            __atomic_add_fetch(&taken[job.param_data_size], 1, __ATOMIC_RELAXED);
+        }
+    }
+    while (job_deque_pop(&deque, &job)) {
+        __atomic_add_fetch(&taken[job.param_data_size], 1, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+    for (u32 i = 0; i < STRESS_THIEVES; i++) {
+        pthread_join(thieves[i], NULL);
+    }
+
+    u64 wrong = 0;
+    for (u64 i = 0; i < STRESS_ITEMS; i++) {
+        if (taken[i] != 1) {
+            wrong++;
+        }
+    }
+    expect_equal(wrong, 0);
+
+    mem_free(taken, STRESS_ITEMS, MEMORY_TAG_JOB);
+    job_deque_destroy(&deque);
+    return true;
+}
+
+LOCAL bool wait_for_count(u32 *counter, u32 expected)
+{
+    struct timespec pause = { .tv_sec = 0, .tv_nsec = 100000 };
+    for (u32 waited = 0; waited < JOB_TEST_TIMEOUT_MS * 10; waited++) {
+        if (__atomic_load_n(counter, __ATOMIC_ACQUIRE) == expected) {
+            return true;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return false;
+}
+
+typedef struct {
+    u32 *counter;
+    u32 children;
+} Count_Params;
+
+LOCAL bool count_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Count_Params *params = (Count_Params *) param_data;
+
+    // Submitted from a worker, so these go to its own deque and the others steal them.
+    Count_Params child = { .counter = params->counter, .children = 0 };
+    for (u32 i = 0; i < params->children; i++) {
+        job_system_submit(count_job, &child, sizeof(child), NULL, 0);
+    }
+
+    __atomic_add_fetch(params->counter, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+u8 job_system_runs_every_job(void)
+{
+    Job_System job_system = {};
+    expect_true(job_system_init(&job_system, 4));
+
+    u32 counter = 0;
+    Count_Params params = { .counter = &counter, .children = 0 };
+    for (u32 i = 0; i < 500; i++) {
+        job_system_submit(count_job, &params, sizeof(params), NULL, 0);
+    }
+    expect_true(wait_for_count(&counter, 500));
+
+    // Fan out from inside the jobs, past the capacity of one deque.
+    counter = 0;
+    params.children = 100;
+    for (u32 i = 0; i < 50; i++) {
+        job_system_submit(count_job, &params, sizeof(params), NULL, 0);
+    }
+    expect_true(wait_for_count(&counter, 50 * 101));
+
+    job_system_shutdown();
+
+    // Parked workers come back after a restart.
+    expect_true(job_system_init(&job_system, 2));
+    counter = 0;
+    params.children = 0;
+    job_system_submit(count_job, &params, sizeof(params), NULL, 0);
+    expect_true(wait_for_count(&counter, 1));
+    job_system_shutdown();
+
+    return true;
+}
+
+#define GRAPH_LEAVES 64
+
+typedef struct {
+    u32 *values;
+    u32 index;
+    u64 *sum;
+    bool *checked;
+} Graph_Params;
+
+LOCAL bool graph_fill_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Graph_Params *params = (Graph_Params *) param_data;
+    params->values[params->index] = params->index + 1;
+    return true;
+}
+
+LOCAL bool graph_sum_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Graph_Params *params = (Graph_Params *) param_data;
+    for (u32 i = 0; i < GRAPH_LEAVES; i++) {
+        *params->sum += params->values[i];
+    }
+    return true;
+}
+
+LOCAL bool graph_check_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Graph_Params *params = (Graph_Params *) param_data;
+    *params->checked = *params->sum == GRAPH_LEAVES * (GRAPH_LEAVES + 1) / 2;
+    return true;
+}
+
+u8 job_system_runs_jobs_after_their_dependencies(void)
+{
+    Job_System job_system = {};
+    expect_true(job_system_init(&job_system, 4));
+
+    for (u32 round = 0; round < 20; round++) {
+        u32 values[GRAPH_LEAVES] = {};
+        u64 sum = 0;
+        bool checked = false;
+        Graph_Params params = { .values = values, .index = 0, .sum = &sum, .checked = &checked };
+
+        Job_Counter filled = {};
+        Job_Counter summed = {};
+        Job_Counter done = {};
+
+        // A counter releases its waiters whenever it reaches zero, so the whole stage is
+        // submitted before anything waits on it.
+        for (u32 i = 0; i < GRAPH_LEAVES; i++) {
+            params.index = i;
+            job_system_submit_counted(graph_fill_job, &params, sizeof(params), &filled);
+        }
+        Job_Counter *sum_dependencies[] = { &filled };
+        job_system_submit_after(sum_dependencies, ARRAY_LEN(sum_dependencies), graph_sum_job, &params, sizeof(params), &summed);
+
+        // NULL and finished dependencies do not hold anything back.
+        Job_Counter finished = {};
+        Job_Counter *check_dependencies[] = { &summed, NULL, &finished, &filled };
+        job_system_submit_after(check_dependencies, ARRAY_LEN(check_dependencies), graph_check_job, &params, sizeof(params), &done);
+
+        job_system_wait(&done);
+        expect_true(job_counter_is_done(&filled));
+        expect_true(job_counter_is_done(&summed));
+        expect_true(checked);
+    }
+
+    job_system_shutdown();
+    return true;
+}
+
+typedef struct {
+    u32 *counter;
+    u32 depth;
+} Tree_Params;
+
+LOCAL bool tree_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Tree_Params *params = (Tree_Params *) param_data;
+
+    if (params->depth > 0) {
+        Tree_Params child = { .counter = params->counter, .depth = params->depth - 1 };
+        for (u32 i = 0; i < 4; i++) {
+            job_system_submit_child(tree_job, &child, sizeof(child));
+        }
+    }
+
+    __atomic_add_fetch(params->counter, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+u8 job_system_waits_for_children(void)
+{
+    Job_System job_system = {};
+    expect_true(job_system_init(&job_system, 3));
+
+    expect_true(job_system_current_counter() == NULL);
+
+    u32 count = 0;
+    Tree_Params params = { .counter = &count, .depth = 4 };
+    Job_Counter tree = {};
+    job_system_submit_counted(tree_job, &params, sizeof(params), &tree);
+    job_system_wait(&tree);
+
+    // 1 + 4 + 16 + 64 + 256, all of them counted before the wait returned.
+    expect_equal(__atomic_load_n(&count, __ATOMIC_RELAXED), 341);
+
+    job_system_shutdown();
+    return true;
+}
+
+typedef struct {
+    bool *started;
+    bool *release;
+} Blocker_Params;
+
+LOCAL bool blocker_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Blocker_Params *params = (Blocker_Params *) param_data;
+    __atomic_store_n(params->started, true, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(params->release, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+    return true;
+}
+
+LOCAL bool release_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Blocker_Params *params = (Blocker_Params *) param_data;
+    __atomic_store_n(params->release, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+u8 job_system_wait_runs_jobs(void)
+{
+    Job_System job_system = {};
+    expect_true(job_system_init(&job_system, 1));
+
+    bool started = false;
+    bool release = false;
+    Blocker_Params params = { .started = &started, .release = &release };
+
+    // With the only worker stuck, the release job only runs if the waiting thread runs it.
+    Job_Counter blocked = {};
+    job_system_submit_counted(blocker_job, &params, sizeof(params), &blocked);
+    while (!__atomic_load_n(&started, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+
+    Job_Counter released = {};
+    job_system_submit_counted(release_job, &params, sizeof(params), &released);
+    job_system_wait(&released);
+    job_system_wait(&blocked);
+    expect_true(release);
+
+    job_system_shutdown();
+    return true;
+}
+
+LOCAL u32 callbacks_completed;
+LOCAL u32 callbacks_failed;
+LOCAL u64 callbacks_sum;
+
+LOCAL bool result_job(void *param_data, void *result_data)
+{
+    u32 value = *(u32 *) param_data;
+    if (result_data != NULL) {
+        *(u32 *) result_data = value;
+    }
+    return value % 2 == 0;
+}
+
+LOCAL void result_callback(Job_Status status, void *result_data)
+{
+    if (status == JOB_STATUS_COMPLETED) {
+        callbacks_completed++;
+    } else {
+        callbacks_failed++;
+    }
+    callbacks_sum += *(u32 *) result_data;
+}
+
+u8 job_system_update_runs_every_callback(void)
+{
+    Job_System job_system = {};
+    expect_true(job_system_init(&job_system, 2));
+
+    callbacks_completed = 0;
+    callbacks_failed = 0;
+    callbacks_sum = 0;
+
+    // Every slot is taken until its callback ran, the next submission is refused instead of
+    // its result getting lost.
+    for (u32 i = 0; i < JOB_SYSTEM_MAX_NUM_RESULTS; i++) {
+        expect_true(job_system_submit(result_job, &i, sizeof(i), result_callback, sizeof(u32)));
+    }
+    u32 extra = 0;
+    expect_false(job_system_submit(result_job, &extra, sizeof(extra), result_callback, sizeof(u32)));
+    // Jobs without a callback take no slot.
+    expect_true(job_system_submit(result_job, &extra, sizeof(extra), NULL, sizeof(u32)));
+
+    struct timespec pause = { .tv_sec = 0, .tv_nsec = 100000 };
+    for (u32 waited = 0; waited < JOB_TEST_TIMEOUT_MS * 10 && callbacks_completed + callbacks_failed < JOB_SYSTEM_MAX_NUM_RESULTS; waited++) {
+        job_system_update(0);
+        nanosleep(&pause, NULL);
+    }
+    expect_equal(callbacks_completed, JOB_SYSTEM_MAX_NUM_RESULTS / 2);
+    expect_equal(callbacks_failed, JOB_SYSTEM_MAX_NUM_RESULTS / 2);
+    expect_equal(callbacks_sum, JOB_SYSTEM_MAX_NUM_RESULTS * (JOB_SYSTEM_MAX_NUM_RESULTS - 1) / 2);
+
+    expect_true(job_system_submit(result_job, &extra, sizeof(extra), result_callback, sizeof(u32)));
+
+    job_system_shutdown();
+    return true;
+}
+
+u8 job_system_update_keeps_to_budget(void)
+{
+    // Without workers the waiting thread runs everything, in the order it was submitted.
+    Job_System job_system = {};
+    expect_true(job_system_init(&job_system, 0));
+
+    callbacks_completed = 0;
+    callbacks_failed = 0;
+    callbacks_sum = 0;
+
+    Job_Counter counter = {};
+    u32 value = 2;
+    for (u32 i = 0; i < 3; i++) {
+        expect_true(job_system_submit(result_job, &value, sizeof(value), result_callback, sizeof(u32)));
+    }
+    job_system_submit_counted(result_job, &value, sizeof(value), &counter);
+    job_system_wait(&counter);
+
+    // Any budget runs at least one callback, one nanosecond runs no more than that.
+    job_system_update(1);
+    expect_equal(callbacks_completed, 1);
+    job_system_update(1);
+    expect_equal(callbacks_completed, 2);
+    job_system_update(0);
+    expect_equal(callbacks_completed, 3);
+
+    job_system_shutdown();
+    return true;
+}
+
+#define PAYLOAD_MAX_SIZE 5000
+#define PAYLOAD_HEADER_SIZE offsetof(Payload, bytes)
+
+LOCAL u32 payload_sizes[] = { 24, 48, 64, 200, 4096, PAYLOAD_MAX_SIZE };
+LOCAL u32 payload_results_checked;
+LOCAL u32 payload_results_bad;
+
+typedef struct {
+    u32 *failures;
+    u32 size;
+    u8 seed;
+    u8 bytes[PAYLOAD_MAX_SIZE - 13];
+} Payload;
+
+LOCAL bool payload_job(void *param_data, void *result_data)
+{
+    Payload *params = (Payload *) param_data;
+    u64 bytes_size = params->size - PAYLOAD_HEADER_SIZE;
+
+    bool valid = ((u64) param_data % JOB_DATA_ALIGNMENT) == 0 && ((u64) result_data % JOB_DATA_ALIGNMENT) == 0;
+    u8 *result = (u8 *) result_data;
+    for (u32 i = 0; i < bytes_size; i++) {
+        valid = valid && params->bytes[i] == (u8) (params->seed + i) && result[i] == 0;
+        result[i] = (u8) (params->seed + i + 1);
+    }
+    return valid;
+}
+
+LOCAL void payload_callback(Job_Status status, void *result_data)
+{
+    // Every byte follows the seed the job saw, so a mixed up result shows.
+    u8 *result = (u8 *) result_data;
+    if (status != JOB_STATUS_COMPLETED || result[1] != (u8) (result[0] + 1) || result[9] != (u8) (result[0] + 9)) {
+        payload_results_bad++;
+    }
+    payload_results_checked++;
+}
+
+LOCAL void fill_payload(Payload *payload, u32 size, u8 seed, u32 *failures)
+{
+    payload->failures = failures;
+    payload->size = size;
+    payload->seed = seed;
+    for (u32 i = 0; i < size - PAYLOAD_HEADER_SIZE; i++) {
+        payload->bytes[i] = (u8) (seed + i);
+    }
+}
+
+LOCAL bool payload_counted_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    Payload *payload = (Payload *) param_data;
+    for (u32 i = 0; i < payload->size - PAYLOAD_HEADER_SIZE; i++) {
+        if (payload->bytes[i] != (u8) (payload->seed + i)) {
+            __atomic_add_fetch(payload->failures, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    return true;
+}
+
+LOCAL bool payload_fan_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    u32 *failures = *(u32 **) param_data;
+
+    // Submitted from a worker, so the pooled ones come from its own pool and go back to it.
+    Payload payload;
+    for (u32 round = 0; round < 20; round++) {
+        for (u32 i = 0; i < ARRAY_LEN(payload_sizes); i++) {
+            fill_payload(&payload, payload_sizes[i], (u8) (round + i), failures);
+            job_system_submit_child(payload_counted_job, &payload, payload_sizes[i]);
+        }
+    }
+    return true;
+}
+
+u8 job_system_carries_inline_pooled_and_large_data(void)
+{
+    Job_System job_system = {};
+    expect_true(job_system_init(&job_system, 3));
+
+    payload_results_checked = 0;
+    payload_results_bad = 0;
+
+    // From the main thread, params and result of the same size, through the shared pool.
+    Payload payload;
+    u32 submitted = 0;
+    for (u32 round = 0; round < 10; round++) {
+        for (u32 i = 0; i < ARRAY_LEN(payload_sizes); i++) {
+            u32 size = payload_sizes[i];
+            fill_payload(&payload, size, (u8) (round * 7 + i), NULL);
+            expect_true(job_system_submit(payload_job, &payload, size, payload_callback, size - PAYLOAD_HEADER_SIZE));
+            submitted++;
+        }
+        // Keeps the slots and the pool cycling.
+        struct timespec pause = { .tv_sec = 0, .tv_nsec = 1000000 };
+        nanosleep(&pause, NULL);
+        job_system_update(0);
+    }
+
+    struct timespec pause = { .tv_sec = 0, .tv_nsec = 100000 };
+    for (u32 waited = 0; waited < JOB_TEST_TIMEOUT_MS * 10 && payload_results_checked < submitted; waited++) {
+        job_system_update(0);
+        nanosleep(&pause, NULL);
+    }
+    expect_equal(payload_results_checked, submitted);
+    expect_equal(payload_results_bad, 0);
+
+    u32 failures = 0;
+    u32 *failures_pointer = &failures;
+    Job_Counter counter = {};
+    for (u32 i = 0; i < 4; i++) {
+        job_system_submit_counted(payload_fan_job, &failures_pointer, sizeof(failures_pointer), &counter);
+    }
+    job_system_wait(&counter);
+    expect_equal(failures, 0);
+
+    job_system_shutdown();
+    return true;
+}
+
+#define PARALLEL_MAX_COUNT 10000
+
+LOCAL void mark_indices(u64 begin, u64 end, void *context)
+{
+    u8 *visits = (u8 *) context;
+    for (u64 i = begin; i < end; i++) {
+        __atomic_add_fetch(&visits[i], 1, __ATOMIC_RELAXED);
+    }
+}
+
+u8 job_parallel_for_visits_every_index_once(void)
+{
+    Job_System job_system = {};
+    expect_true(job_system_init(&job_system, 3));
+
+    u8 *visits = (u8 *) mem_alloc(PARALLEL_MAX_COUNT, MEMORY_TAG_JOB);
+
+    // begin, end, grain, including empty ranges, grains larger than the range and automatic chunking.
+    u64 ranges[][3] = {
+        { 0, 0, 0 }, { 5, 5, 1 }, { 7, 3, 0 }, { 0, 1, 0 }, { 0, 10, 100 },
+        { 0, 10000, 0 }, { 13, 9999, 1 }, { 100, 5000, 64 }, { 0, 10000, 9999 },
+    };
+
+    for (u32 r = 0; r < ARRAY_LEN(ranges); r++) {
+        mem_zero(visits, PARALLEL_MAX_COUNT);
+        job_parallel_for(ranges[r][0], ranges[r][1], ranges[r][2], mark_indices, visits);
+
+        u64 wrong = 0;
+        for (u64 i = 0; i < PARALLEL_MAX_COUNT; i++) {
+            bool inside = i >= ranges[r][0] && i < ranges[r][1];
+            if (visits[i] != (inside ? 1 : 0)) {
+                wrong++;
+            }
+        }
+        expect_equal(wrong, 0);
+    }
+
+    mem_free(visits, PARALLEL_MAX_COUNT, MEMORY_TAG_JOB);
+    job_system_shutdown();
+    return true;
+}
+
+typedef struct {
+    u64 sum;
+    u64 min;
+    u64 max;
+} Range_Stats;
+
+LOCAL void reduce_range(u64 begin, u64 end, void *context, void *accumulator)
+{
+    UNUSED(context);
+    Range_Stats *stats = (Range_Stats *) accumulator;
+    for (u64 i = begin; i < end; i++) {
+        stats->sum += i;
+        stats->min = i < stats->min ? i : stats->min;
+        stats->max = i > stats->max ? i : stats->max;
+    }
+}
+
+LOCAL void combine_range(void *accumulator, const void *other, void *context)
+{
+    UNUSED(context);
+    Range_Stats *stats = (Range_Stats *) accumulator;
+    const Range_Stats *partial = (const Range_Stats *) other;
+    stats->sum += partial->sum;
+    stats->min = partial->min < stats->min ? partial->min : stats->min;
+    stats->max = partial->max > stats->max ? partial->max : stats->max;
+}
+
+LOCAL void reduce_float_range(u64 begin, u64 end, void *context, void *accumulator)
+{
+    UNUSED(context);
+    for (u64 i = begin; i < end; i++) {
+        *(f32 *) accumulator += 1.0f / (f32) (i + 1);
+    }
+}
+
+LOCAL void combine_float(void *accumulator, const void *other, void *context)
+{
+    UNUSED(context);
+    *(f32 *) accumulator += *(const f32 *) other;
+}
+
+LOCAL bool nested_reduce_job(void *param_data, void *result_data)
+{
+    UNUSED(result_data);
+    u64 *sum = *(u64 **) param_data;
+    Range_Stats stats = { .sum = 0, .min = ~0ULL, .max = 0 };
+    job_parallel_reduce(0, 1000, 10, reduce_range, combine_range, NULL, &stats, sizeof(stats));
+    *sum = stats.sum;
+    return true;
+}
+
+u8 job_parallel_reduce_combines_every_chunk(void)
+{
+    Job_System job_system = {};
+    expect_true(job_system_init(&job_system, 3));
+
+    Range_Stats stats = { .sum = 0, .min = ~0ULL, .max = 0 };
+    job_parallel_reduce(10, 10000, 0, reduce_range, combine_range, NULL, &stats, sizeof(stats));
+    expect_equal(stats.sum, 10000ULL * 9999 / 2 - 45);
+    expect_equal(stats.min, 10);
+    expect_equal(stats.max, 9999);
+
+    // A range that fits one chunk is reduced on the calling thread straight into the result.
+    stats = { .sum = 0, .min = ~0ULL, .max = 0 };
+    job_parallel_reduce(0, 4, 16, reduce_range, combine_range, NULL, &stats, sizeof(stats));
+    expect_equal(stats.sum, 6);
+
+    // The chunks are combined in order, so every run adds the floats up the same way.
+    f32 first = 0.0f;
+    job_parallel_reduce(0, 10000, 0, reduce_float_range, combine_float, NULL, &first, sizeof(first));
+    for (u32 i = 0; i < 20; i++) {
+        f32 again = 0.0f;
+        job_parallel_reduce(0, 10000, 0, reduce_float_range, combine_float, NULL, &again, sizeof(again));
+        expect_true(again == first);
+    }
+
+    // From inside jobs, the waiting jobs help out.
+    u64 sums[8] = {};
+    Job_Counter counter = {};
+    for (u32 i = 0; i < ARRAY_LEN(sums); i++) {
+        u64 *sum = &sums[i];
+        job_system_submit_counted(nested_reduce_job, &sum, sizeof(sum), &counter);
+    }
+    job_system_wait(&counter);
+    for (u32 i = 0; i < ARRAY_LEN(sums); i++) {
+        expect_equal(sums[i], 1000ULL * 999 / 2);
+    }
+
+    job_system_shutdown();
+    return true;
+}
+
+void job_register_tests(void)
+{
+    test_manager_register_test(job_deque_pop_lifo_steal_fifo, "job: deque pops newest and steals oldest");
+    test_manager_register_test(job_deque_rejects_push_when_full, "job: deque rejects push when full");
+    test_manager_register_test(job_deque_concurrent_steals_take_every_job_once, "job: concurrent steals take every job once");
+    test_manager_register_test(job_system_runs_every_job, "job: system runs every job");
+    test_manager_register_test(job_system_runs_jobs_after_their_dependencies, "job: system runs jobs after their dependencies");
+    test_manager_register_test(job_system_waits_for_children, "job: system waits for children");
+    test_manager_register_test(job_system_wait_runs_jobs, "job: wait runs jobs");
+    test_manager_register_test(job_system_update_runs_every_callback, "job: update runs every callback");
+    test_manager_register_test(job_system_update_keeps_to_budget, "job: update keeps to budget");
+    test_manager_register_test(job_system_carries_inline_pooled_and_large_data, "job: carries inline, pooled and large data");
+    test_manager_register_test(job_parallel_for_visits_every_index_once, "job: parallel for visits every index once");
+    test_manager_register_test(job_parallel_reduce_combines_every_chunk, "job: parallel reduce combines every chunk");
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void job_register_tests(void);
@@ -0,0 +1,135 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "common/net.h"
+#include "common/datagram.h"
+
+LOCAL Net_Stat net_stat;
+
+LOCAL u64 build_datagram(u8 *buffer, u64 token, u32 sequence, u32 type, const void *payload, u32 payload_size)
+{
+    Datagram_Header header = { .token = token, .sequence = sequence };
+    Packet_Header packet_header = { .type = type, .payload_size = payload_size };
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), &packet_header, sizeof(packet_header));
+    memcpy(buffer + sizeof(header) + sizeof(packet_header), payload, payload_size);
+    return sizeof(header) + sizeof(packet_header) + payload_size;
+}
+
+u8 datagram_sequence_wraps_around(void)
+{
+    expect_true(datagram_sequence_is_newer(2, 1));
+    expect_false(datagram_sequence_is_newer(1, 2));
+    expect_false(datagram_sequence_is_newer(7, 7));
+
+    // Right after the wraparound small values are newer than values close to the maximum.
+    expect_true(datagram_sequence_is_newer(3, 0xFFFFFFF0));
+    expect_false(datagram_sequence_is_newer(0xFFFFFFF0, 3));
+
+    return true;
+}
+
+u8 datagram_window_drops_stale(void)
+{
+    Datagram_Window window = {};
+
+    // Whatever arrives first is accepted, however far from zero it is.
+    expect_true(datagram_window_accept(&window, 0x90000000));
+    expect_true(datagram_window_accept(&window, 0x90000002));
+    expect_false(datagram_window_accept(&window, 0x90000001));
+    expect_equal(window.stale_drops, 1);
+    expect_equal(window.latest, 0x90000002);
+
+    // The same sequence may be split across datagrams.
+    expect_true(datagram_window_accept(&window, 0x90000002));
+    expect_true(datagram_window_accept(&window, 0x90000005));
+    expect_equal(window.stale_drops, 1);
+
+    return true;
+}
+
+u8 datagram_parse_validates_sizes(void)
+{
+    u8 buffer[256];
+    u8 *payload;
+    Datagram_Header header;
+    Packet_Header packet_header;
+
+    Packet_Player_Move move = { .id = 42, .position = { 1.0f, 2.0f, 3.0f } };
+    u64 size = build_datagram(buffer, 0xABCDEF, 9, PACKET_TYPE_PLAYER_MOVE, &move, sizeof(move));
+
+    expect_true(datagram_parse(buffer, size, &header, &packet_header, &payload));
+    expect_equal(header.token, 0xABCDEF);
+    expect_equal(header.sequence, 9);
+    expect_equal(packet_header.type, PACKET_TYPE_PLAYER_MOVE);
+    expect_equal(((Packet_Player_Move *) payload)->id, 42);
+
+    // Truncated, padded and lying about the payload size.
+    expect_false(datagram_parse(buffer, size - 1, &header, &packet_header, &payload));
+    expect_false(datagram_parse(buffer, size + 1, &header, &packet_header, &payload));
+    expect_false(datagram_parse(buffer, sizeof(Datagram_Header) + 3, &header, &packet_header, &payload));
+    size = build_datagram(buffer, 0xABCDEF, 9, PACKET_TYPE_PLAYER_MOVE, &move, sizeof(move) - 4);
+    expect_false(datagram_parse(buffer, size, &header, &packet_header, &payload));
+
+    // Types that need the reliable channel are rejected.
+    Packet_Player_Remove remove = { .id = 42 };
+    size = build_datagram(buffer, 0xABCDEF, 9, PACKET_TYPE_PLAYER_REMOVE, &remove, sizeof(remove));
+    expect_false(datagram_parse(buffer, size, &header, &packet_header, &payload));
+
+    // A batch must hold exactly 'count' moves.
+    u8 batch[4 + 2 * 16] = {};
+    u32 count = 2;
+    memcpy(batch, &count, sizeof(count));
+    size = build_datagram(buffer, 1, 1, PACKET_TYPE_PLAYER_BATCH_MOVE, batch, sizeof(batch));
+    expect_true(datagram_parse(buffer, size, &header, &packet_header, &payload));
+    count = 3;
+    memcpy(batch, &count, sizeof(count));
+    size = build_datagram(buffer, 1, 1, PACKET_TYPE_PLAYER_BATCH_MOVE, batch, sizeof(batch));
+    expect_false(datagram_parse(buffer, size, &header, &packet_header, &payload));
+
+    return true;
+}
+
+u8 datagram_send_and_parse(void)
+{
+    net_init(&net_stat);
+
+    i32 sockets[2];
+    expect_true(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, sockets) == 0);
+
+    Packet_Player_Move first = { .id = 1, .position = { 1.0f, 0.0f, 0.0f } };
+    Packet_Player_Move second = { .id = 2, .position = { 2.0f, 0.0f, 0.0f } };
+    expect_true(datagram_send(sockets[0], 77, 1, PACKET_TYPE_PLAYER_MOVE, &first));
+    expect_true(datagram_send(sockets[0], 77, 2, PACKET_TYPE_PLAYER_MOVE, &second));
+
+    // Datagram boundaries are kept, each read returns exactly one packet.
+    u8 buffer[DATAGRAM_MAX_SIZE];
+    u8 *payload;
+    Datagram_Header header;
+    Packet_Header packet_header;
+    for (u32 sequence = 1; sequence <= 2; sequence++) {
+        i64 bytes_read = read(sockets[1], buffer, sizeof(buffer));
+        expect_equal(bytes_read, (i64) (sizeof(Datagram_Header) + sizeof(Packet_Header) + sizeof(Packet_Player_Move)));
+        expect_true(datagram_parse(buffer, (u64) bytes_read, &header, &packet_header, &payload));
+        expect_equal(header.token, 77);
+        expect_equal(header.sequence, sequence);
+        expect_equal(((Packet_Player_Move *) payload)->id, sequence);
+    }
+
+    close(sockets[0]);
+    close(sockets[1]);
+
+    return true;
+}
+
+void datagram_register_tests(void)
+{
+    test_manager_register_test(datagram_sequence_wraps_around, "datagram: sequence wraps around");
+    test_manager_register_test(datagram_window_drops_stale, "datagram: window drops stale");
+    test_manager_register_test(datagram_parse_validates_sizes, "datagram: parse validates sizes");
+    test_manager_register_test(datagram_send_and_parse, "datagram: send and parse");
+}
@@ -0,0 +1,285 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <string.h>
+
+#include "common/packet_framer.h"
+
+LOCAL void framer_write(Packet_Framer *framer, const void *data, u64 size)
+{
+    u64 available;
+    u8 *buffer = packet_framer_reserve(framer, size, &available);
+    memcpy(buffer, data, size);
+    packet_framer_commit(framer, size);
+}
+
+LOCAL u64 build_packet(u8 *buffer, u32 type, const void *payload, u32 payload_size)
+{
+    Packet_Header header = { .type = type, .payload_size = payload_size };
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), payload, payload_size);
+    return sizeof(header) + payload_size;
+}
+
+u8 packet_framer_create_and_destroy(void)
+{
+    Packet_Framer framer;
+    packet_framer_create(&framer, 64, 128);
+
+    expect_true(framer.data != 0);
+    expect_equal(framer.capacity, 64);
+    expect_equal(framer.max_payload_size, 128);
+    expect_equal(packet_framer_unparsed_length(&framer), 0);
+
+    Packet_Header header;
+    u8 *payload;
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_INCOMPLETE);
+
+    packet_framer_destroy(&framer);
+    expect_true(framer.data == 0);
+    expect_equal(framer.capacity, 0);
+
+    return true;
+}
+
+u8 packet_framer_partial_header_and_payload(void)
+{
+    Packet_Framer framer;
+    packet_framer_create(&framer, 64, 128);
+
+    Packet_Player_Move move = { .id = 1234, .position = { 1.0f, 2.0f, 3.0f } };
+    u8 packet[64];
+    u64 packet_size = build_packet(packet, PACKET_TYPE_PLAYER_MOVE, &move, sizeof(move));
+
+    Packet_Header header;
+    u8 *payload;
+
+    // Split the stream in the middle of the header and again in the middle of the payload.
+    framer_write(&framer, packet, 3);
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_INCOMPLETE);
+
+    framer_write(&framer, packet + 3, 10);
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_INCOMPLETE);
+
+    framer_write(&framer, packet + 13, packet_size - 13);
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_READY);
+    expect_equal(header.type, PACKET_TYPE_PLAYER_MOVE);
+    expect_equal(header.payload_size, sizeof(move));
+    expect_true(memcmp(payload, &move, sizeof(move)) == 0);
+
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_INCOMPLETE);
+    expect_equal(packet_framer_unparsed_length(&framer), 0);
+
+    packet_framer_destroy(&framer);
+
+    return true;
+}
+
+u8 packet_framer_coalesced_packets(void)
+{
+    Packet_Framer framer;
+    packet_framer_create(&framer, 256, 128);
+
+    Packet_Ping ping = { .time = 42 };
+    Packet_Player_Remove remove = { .id = 7 };
+
+    u8 stream[128];
+    u64 offset = build_packet(stream, PACKET_TYPE_PING, &ping, sizeof(ping));
+    offset += build_packet(stream + offset, PACKET_TYPE_PLAYER_REMOVE, &remove, sizeof(remove));
+    u64 third_packet_start = offset;
+    offset += build_packet(stream + offset, PACKET_TYPE_PING, &ping, sizeof(ping));
+
+    // Two complete packets and the first 4 bytes of the third one arrive in a single read.
+    framer_write(&framer, stream, third_packet_start + 4);
+
+    Packet_Header header;
+    u8 *payload;
+
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_READY);
+    expect_equal(header.type, PACKET_TYPE_PING);
+    expect_equal(((Packet_Ping *) payload)->time, 42);
+
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_READY);
+    expect_equal(header.type, PACKET_TYPE_PLAYER_REMOVE);
+    expect_equal(((Packet_Player_Remove *) payload)->id, 7);
+
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_INCOMPLETE);
+    expect_equal(packet_framer_unparsed_length(&framer), 4);
+
+    framer_write(&framer, stream + third_packet_start + 4, offset - third_packet_start - 4);
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_READY);
+    expect_equal(header.type, PACKET_TYPE_PING);
+
+    packet_framer_destroy(&framer);
+
+    return true;
+}
+
+u8 packet_framer_grows_for_large_payload(void)
+{
+    Packet_Framer framer;
+    packet_framer_create(&framer, 32, 4096);
+
+    const u32 payload_size = 3000;
+    u8 payload_data[payload_size];
+    for (u32 i = 0; i < payload_size; i++) {
+        payload_data[i] = (u8) i;
+    }
+    u32 length = payload_size - sizeof(length);
+    memcpy(payload_data, &length, sizeof(length));
+
+    u8 packet[sizeof(Packet_Header) + payload_size];
+    u64 packet_size = build_packet(packet, PACKET_TYPE_TXT_MSG, payload_data, payload_size);
+
+    Packet_Header header;
+    u8 *payload;
+
+    // Feed the stream in small chunks like a slow connection would.
+    u64 written = 0;
+    while (written < packet_size) {
+        u64 chunk = packet_size - written < 100 ? packet_size - written : 100;
+        expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_INCOMPLETE);
+        framer_write(&framer, packet + written, chunk);
+        written += chunk;
+    }
+
+    expect_true(framer.capacity >= packet_size);
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_READY);
+    expect_equal(header.payload_size, payload_size);
+    expect_true(payload >= framer.data && payload < framer.data + framer.capacity);
+    expect_true(memcmp(payload, payload_data, payload_size) == 0);
+
+    packet_framer_destroy(&framer);
+
+    return true;
+}
+
+u8 packet_framer_rejects_invalid_packets(void)
+{
+    Packet_Framer framer;
+    Packet_Header header;
+    u8 *payload;
+
+    packet_framer_create(&framer, 64, 16);
+    Packet_Header too_large = { .type = PACKET_TYPE_TXT_MSG, .payload_size = 17 };
+    framer_write(&framer, &too_large, sizeof(too_large));
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_ERROR);
+    packet_framer_destroy(&framer);
+
+    packet_framer_create(&framer, 64, 16);
+    Packet_Header unknown_type = { .type = NUM_OF_PACKET_TYPES, .payload_size = 0 };
+    framer_write(&framer, &unknown_type, sizeof(unknown_type));
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_ERROR);
+    packet_framer_destroy(&framer);
+
+    return true;
+}
+
+u8 packet_framer_rejects_payloads_of_the_wrong_size(void)
+{
+    Packet_Framer framer;
+    Packet_Header header;
+    u8 *payload;
+    u8 packet[256];
+
+    // A fixed size packet cut short, whose handler would read past the frame.
+    packet_framer_create(&framer, 64, 128);
+    u8 truncated[1] = { 7 };
+    framer_write(&framer, packet, build_packet(packet, PACKET_TYPE_PLAYER_MOVE, truncated, sizeof(truncated)));
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_ERROR);
+    packet_framer_destroy(&framer);
+
+    // Or padded.
+    packet_framer_create(&framer, 64, 128);
+    u8 padded[sizeof(Packet_Player_Move) + 1] = {};
+    framer_write(&framer, packet, build_packet(packet, PACKET_TYPE_PLAYER_MOVE, padded, sizeof(padded)));
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_ERROR);
+    packet_framer_destroy(&framer);
+
+    // A text message claiming to be longer than its payload.
+    packet_framer_create(&framer, 64, 128);
+    u8 message[8] = { 200, 0, 0, 0, 'a', 'b', 'c', 'd' };
+    framer_write(&framer, packet, build_packet(packet, PACKET_TYPE_TXT_MSG, message, sizeof(message)));
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_ERROR);
+    packet_framer_destroy(&framer);
+
+    // A batch whose count would wrap around a 32 bit size.
+    packet_framer_create(&framer, 64, 128);
+    u32 count = 0x10000000;
+    framer_write(&framer, packet, build_packet(packet, PACKET_TYPE_PLAYER_BATCH_MOVE, &count, sizeof(count)));
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_ERROR);
+    packet_framer_destroy(&framer);
+
+    // A join request with a username longer than its array.
+    packet_framer_create(&framer, 256, 128);
+    Packet_Player_Join_Req join = {};
+    join.username_length = PLAYER_USERNAME_MAX_LEN + 1;
+    framer_write(&framer, packet, build_packet(packet, PACKET_TYPE_PLAYER_JOIN_REQ, &join, sizeof(join)));
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_ERROR);
+    packet_framer_destroy(&framer);
+
+    // A snapshot whose username lengths run past the payload.
+    packet_framer_create(&framer, 256, 128);
+    u8 snapshot[4 + 29 + 4] = { 1 };
+    snapshot[4 + 28] = 20; // username length of the only player, none of the bytes follow
+    framer_write(&framer, packet, build_packet(packet, PACKET_TYPE_WORLD_SNAPSHOT, snapshot, sizeof(snapshot)));
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_ERROR);
+    packet_framer_destroy(&framer);
+
+    // The same snapshot with its username is fine.
+    packet_framer_create(&framer, 256, 128);
+    u8 complete[4 + 29 + 20 + 4] = { 1 };
+    complete[4 + 28] = 20;
+    framer_write(&framer, packet, build_packet(packet, PACKET_TYPE_WORLD_SNAPSHOT, complete, sizeof(complete)));
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_READY);
+    packet_framer_destroy(&framer);
+
+    return true;
+}
+
+u8 packet_framer_takes_raw_bytes_before_packets(void)
+{
+    Packet_Framer framer;
+    packet_framer_create(&framer, 64, 64);
+
+    u64 answer = 0xDEADBEEFCAFEBABE;
+    u8 payload_data[6] = { 2, 0, 0, 0, 'h', 'i' };
+    u8 packet[sizeof(Packet_Header) + sizeof(payload_data)];
+    u64 packet_size = build_packet(packet, PACKET_TYPE_TXT_MSG, payload_data, sizeof(payload_data));
+
+    u64 taken = 0;
+    framer_write(&framer, &answer, 5);
+    expect_false(packet_framer_take(&framer, &taken, sizeof(taken)));
+    expect_equal(packet_framer_unparsed_length(&framer), 5);
+
+    // The rest of the raw bytes arrive together with the first packet.
+    u8 stream[3 + sizeof(packet)];
+    memcpy(stream, (u8 *) &answer + 5, 3);
+    memcpy(stream + 3, packet, packet_size);
+    framer_write(&framer, stream, sizeof(stream));
+
+    expect_true(packet_framer_take(&framer, &taken, sizeof(taken)));
+    expect_true(taken == answer);
+
+    Packet_Header header;
+    u8 *payload;
+    expect_true(packet_framer_next(&framer, &header, &payload) == PACKET_FRAMER_STATUS_READY);
+    expect_equal(header.payload_size, sizeof(payload_data));
+    expect_true(memcmp(payload, payload_data, sizeof(payload_data)) == 0);
+    expect_equal(packet_framer_unparsed_length(&framer), 0);
+
+    packet_framer_destroy(&framer);
+
+    return true;
+}
+
+void packet_framer_register_tests(void)
+{
+    test_manager_register_test(packet_framer_create_and_destroy, "packet framer: create and destroy");
+    test_manager_register_test(packet_framer_partial_header_and_payload, "packet framer: partial header and payload");
+    test_manager_register_test(packet_framer_coalesced_packets, "packet framer: coalesced packets");
+    test_manager_register_test(packet_framer_grows_for_large_payload, "packet framer: grows for large payload");
+    test_manager_register_test(packet_framer_rejects_invalid_packets, "packet framer: rejects invalid packets");
+    test_manager_register_test(packet_framer_rejects_payloads_of_the_wrong_size, "packet framer: rejects payloads of the wrong size");
+    test_manager_register_test(packet_framer_takes_raw_bytes_before_packets, "packet framer: takes raw bytes before packets");
+}
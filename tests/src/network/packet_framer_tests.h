@@ -0,0 +1,3 @@
+#pragma once
+
+void packet_framer_register_tests(void);
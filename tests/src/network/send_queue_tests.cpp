@@ -0,0 +1,228 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "common/net.h"
+#include "common/send_queue.h"
+
+LOCAL Net_Stat net_stat;
+
+LOCAL Packet_Buffer *make_move_packet(player_id id)
+{
+    Packet_Player_Move move = { .id = id, .position = { 1.0f, 2.0f, 3.0f } };
+    return packet_buffer_create(PACKET_TYPE_PLAYER_MOVE, &move);
+}
+
+LOCAL bool make_socket_pair(i32 sockets[2])
+{
+    net_init(&net_stat);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets) == -1) {
+        return false;
+    }
+
+    // Keep the socket buffer small so that the tests can fill it quickly.
+    i32 size = 4096;
+    setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    return true;
+}
+
+// Reads everything available and checks that it is a sequence of move packets with consecutive ids.
+LOCAL u64 read_move_packets(i32 socket, player_id *next_id, u8 *pending, u64 *pending_size)
+{
+    u64 packets_read = 0;
+    u64 frame_size = sizeof(Packet_Header) + sizeof(Packet_Player_Move);
+
+    for (;;) {
+        i64 bytes_read = read(socket, pending + *pending_size, frame_size - *pending_size);
+        if (bytes_read <= 0) {
+            return packets_read;
+        }
+
+        *pending_size += (u64) bytes_read;
+        if (*pending_size < frame_size) {
+            continue;
+        }
+
+        Packet_Player_Move move;
+        memcpy(&move, pending + sizeof(Packet_Header), sizeof(move));
+        if (move.id != *next_id) {
+            return 0;
+        }
+
+        *next_id += 1;
+        *pending_size = 0;
+        packets_read++;
+    }
+}
+
+u8 send_queue_flush_drains_in_order(void)
+{
+    i32 sockets[2];
+    expect_true(make_socket_pair(sockets));
+
+    Send_Queue queue;
+    send_queue_create(&queue, 16, KiB(4));
+    expect_true(send_queue_is_empty(&queue));
+
+    for (player_id id = 1; id <= 5; id++) {
+        expect_true(send_queue_push(&queue, make_move_packet(id)));
+    }
+    expect_equal(send_queue_depth(&queue), 5);
+    expect_equal(queue.peak_depth, 5);
+
+    expect_true(send_queue_flush(&queue, sockets[0]) == SEND_QUEUE_FLUSH_DRAINED);
+    expect_true(send_queue_is_empty(&queue));
+    expect_equal(queue.bytes_queued, 0);
+    expect_equal(queue.write_calls, 1); // all five packets gathered into one call
+
+    player_id next_id = 1;
+    u8 pending[64];
+    u64 pending_size = 0;
+    expect_equal(read_move_packets(sockets[1], &next_id, pending, &pending_size), 5);
+
+    send_queue_destroy(&queue);
+    close(sockets[0]);
+    close(sockets[1]);
+
+    return true;
+}
+
+u8 send_queue_enforces_caps(void)
+{
+    u64 packet_size = sizeof(Packet_Header) + sizeof(Packet_Player_Move);
+
+    Send_Queue queue;
+    send_queue_create(&queue, 4, KiB(4));
+
+    for (player_id id = 1; id <= 4; id++) {
+        expect_true(send_queue_push(&queue, make_move_packet(id)));
+    }
+
+    Packet_Buffer *rejected = make_move_packet(5);
+    expect_false(send_queue_push(&queue, rejected));
+    expect_equal(send_queue_depth(&queue), 4);
+    packet_buffer_release(rejected);
+    send_queue_destroy(&queue);
+
+    send_queue_create(&queue, 16, packet_size * 2);
+    expect_true(send_queue_push(&queue, make_move_packet(1)));
+    expect_true(send_queue_push(&queue, make_move_packet(2)));
+
+    rejected = make_move_packet(3);
+    expect_false(send_queue_push(&queue, rejected));
+    expect_equal(queue.bytes_queued, packet_size * 2);
+    packet_buffer_release(rejected);
+    send_queue_destroy(&queue);
+
+    return true;
+}
+
+u8 send_queue_resumes_after_partial_write(void)
+{
+    i32 sockets[2];
+    expect_true(make_socket_pair(sockets));
+
+    Send_Queue queue;
+    send_queue_create(&queue, 4096, MiB(1));
+
+    player_id pushed = 0;
+    while (pushed < 4000) {
+        expect_true(send_queue_push(&queue, make_move_packet(++pushed)));
+    }
+
+    // The peer does not read, so the socket buffer fills up and part of the queue stays behind.
+    expect_true(send_queue_flush(&queue, sockets[0]) == SEND_QUEUE_FLUSH_PENDING);
+    expect_false(send_queue_is_empty(&queue));
+
+    player_id next_id = 1;
+    u8 pending[64];
+    u64 pending_size = 0;
+    u64 received = 0;
+
+    Send_Queue_Flush_Result result = SEND_QUEUE_FLUSH_PENDING;
+    for (u32 round = 0; round < 10000 && result == SEND_QUEUE_FLUSH_PENDING; round++) {
+        received += read_move_packets(sockets[1], &next_id, pending, &pending_size);
+        result = send_queue_flush(&queue, sockets[0]);
+    }
+    received += read_move_packets(sockets[1], &next_id, pending, &pending_size);
+
+    expect_true(result == SEND_QUEUE_FLUSH_DRAINED);
+    expect_equal(received, pushed);
+    expect_equal(pending_size, 0);
+
+    send_queue_destroy(&queue);
+    close(sockets[0]);
+    close(sockets[1]);
+
+    return true;
+}
+
+u8 send_queue_shares_buffer_between_queues(void)
+{
+    i32 first[2], second[2];
+    expect_true(make_socket_pair(first));
+    expect_true(make_socket_pair(second));
+
+    Send_Queue first_queue, second_queue;
+    send_queue_create(&first_queue, 4, KiB(4));
+    send_queue_create(&second_queue, 4, KiB(4));
+
+    // Serialize once, queue the same bytes twice.
+    Packet_Buffer *buffer = make_move_packet(1);
+    expect_true(send_queue_push(&first_queue, packet_buffer_retain(buffer)));
+    expect_true(send_queue_push(&second_queue, packet_buffer_retain(buffer)));
+    expect_equal(buffer->ref_count, 3);
+
+    expect_true(send_queue_flush(&first_queue, first[0]) == SEND_QUEUE_FLUSH_DRAINED);
+    expect_equal(buffer->ref_count, 2);
+    expect_true(send_queue_flush(&second_queue, second[0]) == SEND_QUEUE_FLUSH_DRAINED);
+    expect_equal(buffer->ref_count, 1);
+
+    player_id next_id = 1;
+    u8 pending[64];
+    u64 pending_size = 0;
+    expect_equal(read_move_packets(first[1], &next_id, pending, &pending_size), 1);
+    next_id = 1;
+    expect_equal(read_move_packets(second[1], &next_id, pending, &pending_size), 1);
+
+    packet_buffer_release(buffer);
+
+    send_queue_destroy(&first_queue);
+    send_queue_destroy(&second_queue);
+    close(first[0]); close(first[1]);
+    close(second[0]); close(second[1]);
+
+    return true;
+}
+
+u8 send_queue_reports_broken_connection(void)
+{
+    i32 sockets[2];
+    expect_true(make_socket_pair(sockets));
+    close(sockets[1]);
+
+    Send_Queue queue;
+    send_queue_create(&queue, 4, KiB(4));
+    expect_true(send_queue_push(&queue, make_move_packet(1)));
+
+    // Must not raise SIGPIPE.
+    expect_true(send_queue_flush(&queue, sockets[0]) == SEND_QUEUE_FLUSH_ERROR);
+
+    send_queue_destroy(&queue);
+    close(sockets[0]);
+
+    return true;
+}
+
+void send_queue_register_tests(void)
+{
+    test_manager_register_test(send_queue_flush_drains_in_order, "send queue: flush drains in order");
+    test_manager_register_test(send_queue_enforces_caps, "send queue: enforces caps");
+    test_manager_register_test(send_queue_resumes_after_partial_write, "send queue: resumes after partial write");
+    test_manager_register_test(send_queue_shares_buffer_between_queues, "send queue: shares buffer between queues");
+    test_manager_register_test(send_queue_reports_broken_connection, "send queue: reports broken connection");
+}
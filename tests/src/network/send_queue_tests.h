@@ -0,0 +1,3 @@
+#pragma once
+
+void send_queue_register_tests(void);
@@ -0,0 +1,138 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "server/credentials.h"
+
+// Kept low, the cost itself is covered by the pbkdf2 tests.
+#define TEST_ITERATIONS 2
+
+// Splits a created credential into its salt and key hex, so malformed variants can be assembled from them.
+LOCAL bool split_credential(const char *credential, char *out_salt_hex, char *out_key_hex)
+{
+    const char *salt_hex = strchr(credential + strlen(CREDENTIAL_SCHEME "$"), '$');
+    if (salt_hex == NULL) {
+        return false;
+    }
+    salt_hex++;
+
+    const char *key_hex = strchr(salt_hex, '$');
+    if (key_hex == NULL || key_hex - salt_hex != CREDENTIAL_SALT_SIZE * 2 || strlen(key_hex + 1) != CREDENTIAL_KEY_SIZE * 2) {
+        return false;
+    }
+
+    memcpy(out_salt_hex, salt_hex, CREDENTIAL_SALT_SIZE * 2);
+    out_salt_hex[CREDENTIAL_SALT_SIZE * 2] = '\0';
+    strcpy(out_key_hex, key_hex + 1);
+    return true;
+}
+
+u8 credential_create_then_verify_matches(void)
+{
+    char credential[CREDENTIAL_MAX_LEN];
+    expect_true(credential_create("hunter2", TEST_ITERATIONS, credential));
+    expect_true(strncmp(credential, CREDENTIAL_SCHEME "$2$", strlen(CREDENTIAL_SCHEME "$2$")) == 0);
+
+    expect_true(credential_verify("hunter2", credential, TEST_ITERATIONS) == CREDENTIAL_MATCH);
+    expect_true(credential_verify("hunter3", credential, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+    expect_true(credential_verify("", credential, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+
+    // Salted, so the same password never gives the same credential twice.
+    char other[CREDENTIAL_MAX_LEN];
+    expect_true(credential_create("hunter2", TEST_ITERATIONS, other));
+    expect_true(strcmp(credential, other) != 0);
+    expect_true(credential_verify("hunter2", other, TEST_ITERATIONS) == CREDENTIAL_MATCH);
+
+    return true;
+}
+
+u8 credential_verify_upgrades_plaintext(void)
+{
+    expect_true(credential_verify("hunter2", "hunter2", TEST_ITERATIONS) == CREDENTIAL_MATCH_NEEDS_UPGRADE);
+    expect_true(credential_verify("hunter3", "hunter2", TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+    expect_true(credential_verify("hunter", "hunter2", TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+    expect_true(credential_verify("hunter22", "hunter2", TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+
+    return true;
+}
+
+u8 credential_verify_upgrades_other_iterations(void)
+{
+    char credential[CREDENTIAL_MAX_LEN];
+    expect_true(credential_create("hunter2", TEST_ITERATIONS, credential));
+
+    expect_true(credential_verify("hunter2", credential, TEST_ITERATIONS + 1) == CREDENTIAL_MATCH_NEEDS_UPGRADE);
+    expect_true(credential_verify("hunter2", credential, TEST_ITERATIONS - 1) == CREDENTIAL_MATCH_NEEDS_UPGRADE);
+    // A wrong password is never upgraded.
+    expect_true(credential_verify("hunter3", credential, TEST_ITERATIONS + 1) == CREDENTIAL_MISMATCH);
+
+    return true;
+}
+
+u8 credential_verify_rejects_malformed(void)
+{
+    char credential[CREDENTIAL_MAX_LEN];
+    expect_true(credential_create("hunter2", TEST_ITERATIONS, credential));
+
+    char salt_hex[CREDENTIAL_SALT_SIZE * 2 + 1];
+    char key_hex[CREDENTIAL_KEY_SIZE * 2 + 1];
+    expect_true(split_credential(credential, salt_hex, key_hex));
+
+    // Every variant is checked with the right password, so only the parsing can refuse it.
+    char malformed[CREDENTIAL_MAX_LEN * 2];
+    const char *scheme = CREDENTIAL_SCHEME;
+
+    // Sanity check that reassembling the parts gives a credential that still matches.
+    snprintf(malformed, sizeof(malformed), "%s$%u$%s$%s", scheme, TEST_ITERATIONS, salt_hex, key_hex);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MATCH);
+
+    // Missing separators.
+    snprintf(malformed, sizeof(malformed), "%s$%u$%s%s", scheme, TEST_ITERATIONS, salt_hex, key_hex);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+    snprintf(malformed, sizeof(malformed), "%s$%u%s$%s", scheme, TEST_ITERATIONS, salt_hex, key_hex);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+    snprintf(malformed, sizeof(malformed), "%s$%u$%s$", scheme, TEST_ITERATIONS, salt_hex);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+
+    // Bad hex digits.
+    char bad_salt[sizeof(salt_hex)];
+    strcpy(bad_salt, salt_hex);
+    bad_salt[5] = 'g';
+    snprintf(malformed, sizeof(malformed), "%s$%u$%s$%s", scheme, TEST_ITERATIONS, bad_salt, key_hex);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+
+    char bad_key[sizeof(key_hex)];
+    strcpy(bad_key, key_hex);
+    bad_key[CREDENTIAL_KEY_SIZE * 2 - 1] = 'z';
+    snprintf(malformed, sizeof(malformed), "%s$%u$%s$%s", scheme, TEST_ITERATIONS, salt_hex, bad_key);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+
+    // Wrong hex lengths, one digit short or one too many.
+    snprintf(malformed, sizeof(malformed), "%s$%u$%.*s$%s", scheme, TEST_ITERATIONS, CREDENTIAL_SALT_SIZE * 2 - 1, salt_hex, key_hex);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+    snprintf(malformed, sizeof(malformed), "%s$%u$%s0$%s", scheme, TEST_ITERATIONS, salt_hex, key_hex);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+    snprintf(malformed, sizeof(malformed), "%s$%u$%s$%.*s", scheme, TEST_ITERATIONS, salt_hex, CREDENTIAL_KEY_SIZE * 2 - 1, key_hex);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+    snprintf(malformed, sizeof(malformed), "%s$%u$%s$%s0", scheme, TEST_ITERATIONS, salt_hex, key_hex);
+    expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+
+    // Iterations missing, zero, above u32 or followed by garbage.
+    const char *bad_iterations[] = {"", "0", "4294967296", "99999999999999999999", "2x", "-1"};
+    for (u32 i = 0; i < sizeof(bad_iterations) / sizeof(bad_iterations[0]); i++) {
+        snprintf(malformed, sizeof(malformed), "%s$%s$%s$%s", scheme, bad_iterations[i], salt_hex, key_hex);
+        expect_true(credential_verify("hunter2", malformed, TEST_ITERATIONS) == CREDENTIAL_MISMATCH);
+    }
+
+    return true;
+}
+
+void credentials_register_tests(void)
+{
+    test_manager_register_test(credential_create_then_verify_matches, "credentials: create then verify matches");
+    test_manager_register_test(credential_verify_upgrades_plaintext, "credentials: verify upgrades plaintext");
+    test_manager_register_test(credential_verify_upgrades_other_iterations, "credentials: verify upgrades other iterations");
+    test_manager_register_test(credential_verify_rejects_malformed, "credentials: verify rejects malformed");
+}
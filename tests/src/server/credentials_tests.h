@@ -0,0 +1,3 @@
+#pragma once
+
+void credentials_register_tests(void);
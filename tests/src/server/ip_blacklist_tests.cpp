@@ -0,0 +1,177 @@
+#include "../../expect.h"
+#include "../../test_manager.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "server/ip_blacklist.h"
+
+LOCAL bool contains_ipv4(const Ip_Blacklist *blacklist, const char *text)
+{
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    if (inet_pton(AF_INET, text, &address.sin_addr) != 1) {
+        return false;
+    }
+    return ip_blacklist_contains(blacklist, (const struct sockaddr *) &address);
+}
+
+// Also used for IPv4 clients accepted on a dual stack socket, which show up as ::ffff:a.b.c.d.
+LOCAL bool contains_ipv6(const Ip_Blacklist *blacklist, const char *text)
+{
+    struct sockaddr_in6 address = {};
+    address.sin6_family = AF_INET6;
+    if (inet_pton(AF_INET6, text, &address.sin6_addr) != 1) {
+        return false;
+    }
+    return ip_blacklist_contains(blacklist, (const struct sockaddr *) &address);
+}
+
+u8 ip_blacklist_matches_exact_addresses(void)
+{
+    Ip_Blacklist *blacklist = ip_blacklist_create();
+    expect_true(ip_blacklist_add(blacklist, "192.168.1.10"));
+    expect_true(ip_blacklist_add(blacklist, "2001:db8::1"));
+    expect_true(ip_blacklist_add(blacklist, "192.168.1.10")); // duplicates are counted once
+    expect_equal(blacklist->address_count, 2);
+    expect_equal(blacklist->range_count, 0);
+
+    expect_true(contains_ipv4(blacklist, "192.168.1.10"));
+    expect_false(contains_ipv4(blacklist, "192.168.1.11"));
+    expect_true(contains_ipv6(blacklist, "2001:db8::1"));
+    expect_true(contains_ipv6(blacklist, "2001:0db8:0000::0001"));
+    expect_false(contains_ipv6(blacklist, "2001:db8::2"));
+
+    ip_blacklist_destroy(blacklist);
+    return true;
+}
+
+u8 ip_blacklist_matches_full_length_prefixes(void)
+{
+    Ip_Blacklist *blacklist = ip_blacklist_create();
+    expect_true(ip_blacklist_add(blacklist, "10.0.0.1/32"));
+    expect_true(ip_blacklist_add(blacklist, "2001:db8::1/128"));
+    // A full length prefix is a single address, not a range.
+    expect_equal(blacklist->address_count, 2);
+    expect_equal(blacklist->range_count, 0);
+
+    expect_true(contains_ipv4(blacklist, "10.0.0.1"));
+    expect_false(contains_ipv4(blacklist, "10.0.0.0"));
+    expect_false(contains_ipv4(blacklist, "10.0.0.2"));
+    expect_true(contains_ipv6(blacklist, "2001:db8::1"));
+    expect_false(contains_ipv6(blacklist, "2001:db8::"));
+
+    ip_blacklist_destroy(blacklist);
+    return true;
+}
+
+u8 ip_blacklist_matches_zero_length_prefixes(void)
+{
+    // An IPv4 /0 covers all of IPv4 and nothing of IPv6.
+    Ip_Blacklist *blacklist = ip_blacklist_create();
+    expect_true(ip_blacklist_add(blacklist, "0.0.0.0/0"));
+    expect_equal(blacklist->range_count, 1);
+    expect_true(contains_ipv4(blacklist, "0.0.0.0"));
+    expect_true(contains_ipv4(blacklist, "8.8.8.8"));
+    expect_true(contains_ipv4(blacklist, "255.255.255.255"));
+    expect_false(contains_ipv6(blacklist, "2001:db8::1"));
+    expect_false(contains_ipv6(blacklist, "::1"));
+    ip_blacklist_destroy(blacklist);
+
+    // An IPv6 /0 covers everything.
+    blacklist = ip_blacklist_create();
+    expect_true(ip_blacklist_add(blacklist, "::/0"));
+    expect_true(contains_ipv4(blacklist, "8.8.8.8"));
+    expect_true(contains_ipv6(blacklist, "2001:db8::1"));
+    expect_true(contains_ipv6(blacklist, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"));
+    ip_blacklist_destroy(blacklist);
+
+    return true;
+}
+
+u8 ip_blacklist_matches_ranges(void)
+{
+    Ip_Blacklist *blacklist = ip_blacklist_create();
+    expect_true(ip_blacklist_add(blacklist, "172.16.0.0/12"));
+    expect_true(ip_blacklist_add(blacklist, "2001:db8:abcd::/48"));
+
+    expect_true(contains_ipv4(blacklist, "172.16.0.0"));
+    expect_true(contains_ipv4(blacklist, "172.31.255.255"));
+    expect_false(contains_ipv4(blacklist, "172.32.0.0"));
+    expect_false(contains_ipv4(blacklist, "172.15.255.255"));
+    expect_true(contains_ipv6(blacklist, "2001:db8:abcd:ffff::1"));
+    expect_false(contains_ipv6(blacklist, "2001:db8:abce::1"));
+
+    ip_blacklist_destroy(blacklist);
+    return true;
+}
+
+u8 ip_blacklist_rejects_malformed_entries(void)
+{
+    Ip_Blacklist *blacklist = ip_blacklist_create();
+
+    const char *malformed[] = {
+        "", "garbage", "256.0.0.1", "10.0.0", "2001:db8:::1",
+        "10.0.0.0/33", "10.0.0.0/-1", "10.0.0.0/", "10.0.0.0/8x", "10.0.0.0/x", "10.0.0.0/8/8",
+        "2001:db8::/129", "2001:db8::/", "2001:db8::/abc", "2001:db8::/99999999999999999999",
+    };
+    for (u32 i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        expect_false(ip_blacklist_add(blacklist, malformed[i]));
+    }
+
+    // None of them were added.
+    expect_equal(blacklist->address_count, 0);
+    expect_equal(blacklist->range_count, 0);
+    expect_false(contains_ipv4(blacklist, "10.0.0.0"));
+
+    ip_blacklist_destroy(blacklist);
+    return true;
+}
+
+u8 ip_blacklist_wider_range_covers_narrower_one(void)
+{
+    Ip_Blacklist *blacklist = ip_blacklist_create();
+    expect_true(ip_blacklist_add(blacklist, "10.1.2.0/24"));
+    expect_true(ip_blacklist_add(blacklist, "10.0.0.0/8"));
+
+    expect_true(contains_ipv4(blacklist, "10.1.2.3"));
+    expect_true(contains_ipv4(blacklist, "10.200.0.1"));
+    expect_false(contains_ipv4(blacklist, "11.0.0.1"));
+
+    // Added after the wider one, the narrower range is already covered and ignored.
+    expect_true(ip_blacklist_add(blacklist, "10.3.0.0/16"));
+    expect_equal(blacklist->range_count, 2);
+    expect_true(contains_ipv4(blacklist, "10.3.4.5"));
+
+    ip_blacklist_destroy(blacklist);
+    return true;
+}
+
+u8 ip_blacklist_matches_ipv4_mapped_clients(void)
+{
+    Ip_Blacklist *blacklist = ip_blacklist_create();
+    expect_true(ip_blacklist_add(blacklist, "203.0.113.7"));
+    expect_true(ip_blacklist_add(blacklist, "198.51.100.0/24"));
+
+    expect_true(contains_ipv6(blacklist, "::ffff:203.0.113.7"));
+    expect_false(contains_ipv6(blacklist, "::ffff:203.0.113.8"));
+    expect_true(contains_ipv6(blacklist, "::ffff:198.51.100.200"));
+    expect_false(contains_ipv6(blacklist, "::ffff:198.51.101.1"));
+    // Only the mapped form, not the deprecated IPv4-compatible one.
+    expect_false(contains_ipv6(blacklist, "::203.0.113.7"));
+
+    ip_blacklist_destroy(blacklist);
+    return true;
+}
+
+void ip_blacklist_register_tests(void)
+{
+    test_manager_register_test(ip_blacklist_matches_exact_addresses, "ip blacklist: matches exact addresses");
+    test_manager_register_test(ip_blacklist_matches_full_length_prefixes, "ip blacklist: matches full length prefixes");
+    test_manager_register_test(ip_blacklist_matches_zero_length_prefixes, "ip blacklist: matches zero length prefixes");
+    test_manager_register_test(ip_blacklist_matches_ranges, "ip blacklist: matches ranges");
+    test_manager_register_test(ip_blacklist_rejects_malformed_entries, "ip blacklist: rejects malformed entries");
+    test_manager_register_test(ip_blacklist_wider_range_covers_narrower_one, "ip blacklist: wider range covers narrower one");
+    test_manager_register_test(ip_blacklist_matches_ipv4_mapped_clients, "ip blacklist: matches ipv4 mapped clients");
+}
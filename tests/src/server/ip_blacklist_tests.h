@@ -0,0 +1,3 @@
+#pragma once
+
+void ip_blacklist_register_tests(void);